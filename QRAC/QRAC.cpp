@@ -24,76 +24,48 @@
 #include <limits>
 #include <filesystem>
 #include <unordered_map>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cstring>
+#include <latch>
+#include <thread>
 
 // 使用C++17文件系统库
 namespace fs = std::filesystem;
 
-// 包含stb图像库
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
+// 包含stb图像库（实现位于qrac.cpp）
 #include "stb_image.h"
 #include "stb_image_write.h"
-#include "stb_image_resize.h"
 
-// Windows特定头文件
-#ifdef _WIN32
-#include <windows.h>
-#endif
+// 编解码库
+#include "qrac.h"
 
-// 配置结构体
-struct QRACConfig {
-    int L = 5; // Quantization interval length
-    uint8_t FILLER_MAX_VALUE = 10; // 最大填充值（深灰色）
-    float FEC_REDUNDANCY_RATIO = 0.25f; // FEC冗余比例
-    int MIN_IMAGE_DIMENSION = 16; // 最小图像尺寸
-    int DEFAULT_SMALL_SIZE = 128; // 默认小尺寸
-    int DEFAULT_MEDIUM_SIZE = 512; // 默认中尺寸
-    int DEFAULT_LARGE_SIZE = 1024; // 默认大尺寸
-    size_t SMALL_FILE_THRESHOLD = 96 * 1024; // 小文件阈值 (96KB)
-    size_t MEDIUM_FILE_THRESHOLD = 1024 * 1024; // 中文件阈值 (1MB)
-    int SYMBOLS_PER_PIXEL = 3; // 每像素符号数 (RGB)
-    int FEC_BLOCK_SIZE = 10; // FEC块大小
-    int MAX_FEC_WARNINGS = 15; // 最大FEC警告数
-    float TEXT_DETECTION_THRESHOLD = 0.85f; // 文本检测阈值
-    float CONTROL_CHAR_THRESHOLD = 0.05f; // 控制字符阈值
-    bool USE_ADVANCED_FEC = false; // 使用简单FEC而不是Reed-Solomon
-};
+// 工作窃取线程池（批处理模式）
+#include "qrac_pool.h"
 
-// 全局配置实例
-QRACConfig g_config;
-
-// 计算间隔数量
-int calculateIntervals() {
-    int availableRange = 256 - (g_config.FILLER_MAX_VALUE + 1); // 跳过0-10的范围
-    return availableRange / g_config.L + (availableRange % g_config.L != 0 ? 1 : 0);
-}
-
-// 错误类型枚举
-enum class ErrorType {
-    FileNotFound,
-    FileReadError,
-    FileWriteError,
-    ImageLoadError,
-    ImageSaveError,
-    ImageSizeError,
-    DataSizeError,
-    FECError,
-    UserAbort,
-    InvalidInput
-};
+// 常驻服务模式
+#include "qrac_serve.h"
 
-// 自定义异常类
-class QRACException : public std::runtime_error {
-public:
-    QRACException(ErrorType type, const std::string& message)
-        : std::runtime_error(message), m_type(type) {}
+// 流式编解码（标准输入/输出）
+#include "qrac_stream.h"
+#include "qrac_io.h"
+#include "qrac_task.h"
+#include "qrac_memory.h"
+#include "qrac_perf.h"
+#include "qrac_stats.h"
+#include "qrac_trace.h"
+#include "qrac_cache.h"
+#include "qrac_append.h"
+#include "qrac_archive.h"
 
-    ErrorType getType() const { return m_type; }
+// Windows特定头文件
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
-private:
-    ErrorType m_type;
-};
+using namespace qrac;
 
 // 信任声明和程序信息
 const char* TRUST_STATEMENT =
@@ -104,330 +76,10 @@ const char* TRUST_STATEMENT =
 "请放心使用，如有疑问可查看源代码或联系开发者。\n"
 "================\n";
 
-// Calculate anchor point value
-int calculateAnchor(int intervalIndex) {
-    int intervals = calculateIntervals();
-    int start = g_config.FILLER_MAX_VALUE + 1 + intervalIndex * g_config.L; // 从11开始
-    int end = std::min(start + g_config.L - 1, 255);
-    return start + (end - start) / 2; // Midpoint of interval
-}
-
-// 检查是否为填充值（包括接近黑色的像素）
-bool isFillerValue(uint8_t pixelValue) {
-    return pixelValue <= g_config.FILLER_MAX_VALUE;
-}
-
-// 检查整个像素是否为填充颜色
-bool isFillerPixel(const uint8_t* pixel, int channels) {
-    return isFillerValue(pixel[0]) && isFillerValue(pixel[1]) && isFillerValue(pixel[2]);
-}
-
-// Decode pixel value to interval index
-int decodeToSymbol(uint8_t pixelValue) {
-    // 如果是填充值，返回特殊标记
-    if (isFillerValue(pixelValue)) {
-        return -1; // 特殊值，表示填充区域
-    }
-
-    // 跳过0-10的范围，从11开始计算
-    int adjustedValue = pixelValue - (g_config.FILLER_MAX_VALUE + 1);
-    int intervals = calculateIntervals();
-    int intervalIndex = adjustedValue / g_config.L;
-
-    // 确保在有效范围内
-    if (intervalIndex >= intervals) {
-        intervalIndex = intervals - 1;
-    }
-
-    return intervalIndex;
-}
-
-// 简单的FEC编码
-void addFEC(std::vector<uint8_t>& data) {
-    size_t originalSize = data.size();
-    if (originalSize == 0) return;
-
-    // 根据配置添加FEC冗余
-    size_t fecSize = static_cast<size_t>(originalSize * g_config.FEC_REDUNDANCY_RATIO);
-    data.resize(originalSize + fecSize);
-
-    // 使用简单的线性编码进行FEC
-    for (size_t i = 0; i < fecSize; i++) {
-        uint8_t fecByte = 0;
-        for (size_t j = 0; j < 8; j++) {
-            size_t index = (j * fecSize + i) % originalSize;
-            fecByte ^= data[index]; // XOR操作
-        }
-        data[originalSize + i] = fecByte;
-    }
-}
-
-// 简单的FEC解码
-bool verifyAndCorrectFEC(std::vector<uint8_t>& data) {
-    if (data.size() < 5) {
-        return true; // 数据太小，无法进行FEC校正
-    }
-
-    size_t originalSize = static_cast<size_t>(data.size() / (1.0f + g_config.FEC_REDUNDANCY_RATIO));
-    size_t fecSize = data.size() - originalSize;
-
-    if (fecSize == 0) {
-        return true; // No FEC data
-    }
-
-    bool hasError = false;
-    std::vector<uint8_t> correctedData(data.begin(), data.begin() + originalSize);
-
-    // 检查错误
-    for (size_t i = 0; i < fecSize; i++) {
-        uint8_t calculatedFEC = 0;
-        for (size_t j = 0; j < 8; j++) {
-            size_t index = (j * fecSize + i) % originalSize;
-            calculatedFEC ^= correctedData[index];
-        }
-
-        if (data[originalSize + i] != calculatedFEC) {
-            hasError = true;
-            break;
-        }
-    }
-
-    if (!hasError) {
-        data = std::move(correctedData);
-        return true;
-    }
-
-    // 尝试纠正错误
-    for (size_t i = 0; i < fecSize; i++) {
-        uint8_t calculatedFEC = 0;
-        for (size_t j = 0; j < 8; j++) {
-            size_t index = (j * fecSize + i) % originalSize;
-            calculatedFEC ^= correctedData[index];
-        }
-
-        if (data[originalSize + i] != calculatedFEC) {
-            // 尝试找到并纠正错误
-            for (size_t j = 0; j < 8; j++) {
-                size_t index = (j * fecSize + i) % originalSize;
-                uint8_t originalByte = correctedData[index];
-
-                // 尝试翻转每个位
-                for (int bit = 0; bit < 8; bit++) {
-                    uint8_t testByte = originalByte ^ (1 << bit);
-                    uint8_t testFEC = calculatedFEC ^ originalByte ^ testByte;
-
-                    if (testFEC == data[originalSize + i]) {
-                        correctedData[index] = testByte;
-                        std::cout << "Corrected byte error at position " << index << "\n";
-                        break;
-                    }
-                }
-            }
-        }
-    }
-
-    // 最终验证
-    bool allErrorsCorrected = true;
-    for (size_t i = 0; i < fecSize; i++) {
-        uint8_t calculatedFEC = 0;
-        for (size_t j = 0; j < 8; j++) {
-            size_t index = (j * fecSize + i) % originalSize;
-            calculatedFEC ^= correctedData[index];
-        }
-
-        if (data[originalSize + i] != calculatedFEC) {
-            allErrorsCorrected = false;
-            if (i < g_config.MAX_FEC_WARNINGS) {
-                std::cout << "Warning: Unable to correct error in FEC block " << i << "\n";
-            }
-            else if (i == g_config.MAX_FEC_WARNINGS) {
-                std::cout << "Additional FEC errors omitted for brevity...\n";
-            }
-            break;
-        }
-    }
-
-    // 更新数据
-    data = std::move(correctedData);
-    return allErrorsCorrected;
-}
-
-// Convert data to binary stream
-std::vector<bool> dataToBinary(const std::vector<uint8_t>& data) {
-    std::vector<bool> binaryStream;
-    binaryStream.reserve(data.size() * 8);
-
-    for (uint8_t byte : data) {
-        for (int i = 7; i >= 0; i--) {
-            binaryStream.push_back((byte >> i) & 1);
-        }
-    }
-
-    return binaryStream;
-}
-
-// Convert binary stream to symbol sequence
-std::vector<int> binaryToSymbols(const std::vector<bool>& binaryStream, int bitsPerSymbol) {
-    int intervals = calculateIntervals();
-    int symbolCount = static_cast<int>((binaryStream.size() + bitsPerSymbol - 1) / bitsPerSymbol);
-    std::vector<int> symbols;
-    symbols.reserve(symbolCount);
-
-    for (int i = 0; i < symbolCount; i++) {
-        int symbol = 0;
-        for (int j = 0; j < bitsPerSymbol; j++) {
-            int bitIndex = i * bitsPerSymbol + j;
-            if (bitIndex < static_cast<int>(binaryStream.size())) {
-                symbol = (symbol << 1) | (binaryStream[bitIndex] ? 1 : 0);
-            }
-            else {
-                symbol = symbol << 1; // Pad with 0
-            }
-        }
-        symbols.push_back(symbol % intervals);
-    }
-
-    return symbols;
-}
-
-// Improved QRAC image creation function with filler value for unused areas
-std::vector<uint8_t> createQRACImage(const std::vector<int>& symbols, int width, int height, bool useFEC) {
-    int totalPixels = width * height;
-    int symbolsPerPixel = g_config.SYMBOLS_PER_PIXEL;
-
-    int requiredPixels = (static_cast<int>(symbols.size()) + symbolsPerPixel - 1) / symbolsPerPixel;
-
-    if (requiredPixels > totalPixels) {
-        throw QRACException(ErrorType::ImageSizeError, "Image dimensions too small to contain all data");
-    }
-
-    // Create image data (初始化为纯黑色填充)
-    int channels = 3; // 使用RGB
-    std::vector<uint8_t> imageData(width * height * channels, 0); // 初始化为纯黑色
-
-    // Map symbols to image pixels
-    for (int i = 0; i < static_cast<int>(symbols.size()); i += symbolsPerPixel) {
-        int pixelIndex = i / symbolsPerPixel;
-        int row = pixelIndex / width;
-        int col = pixelIndex % width;
-
-        // 只处理实际需要的像素
-        if (row >= height) {
-            break; // 防止越界
-        }
-
-        int dataIndex = (row * width + col) * channels;
-
-        // Assign symbols to each channel
-        for (int ch = 0; ch < symbolsPerPixel && (i + ch) < static_cast<int>(symbols.size()); ch++) {
-            int symbol = symbols[i + ch];
-            imageData[dataIndex + ch] = calculateAnchor(symbol);
-        }
-    }
-
-    return imageData;
-}
-
-// Extract binary stream from symbol sequence, skipping filler values
-std::vector<bool> symbolsToBinary(const std::vector<int>& symbols, int bitsPerSymbol, size_t expectedBits) {
-    std::vector<bool> binaryStream;
-    binaryStream.reserve(expectedBits);
-
-    for (int symbol : symbols) {
-        // 跳过填充符号
-        if (symbol == -1) {
-            continue;
-        }
-
-        for (int i = bitsPerSymbol - 1; i >= 0; i--) {
-            bool bit = (symbol >> i) & 1;
-            binaryStream.push_back(bit);
-
-            // 如果已经达到预期的位数，停止处理
-            if (binaryStream.size() >= expectedBits) {
-                break;
-            }
-        }
-
-        // 如果已经达到预期的位数，停止处理
-        if (binaryStream.size() >= expectedBits) {
-            break;
-        }
-    }
-
-    if (binaryStream.size() > expectedBits) {
-        binaryStream.resize(expectedBits);
-    }
-
-    return binaryStream;
-}
-
-// Convert binary stream to byte data
-std::vector<uint8_t> binaryToData(const std::vector<bool>& binaryStream) {
-    std::vector<uint8_t> data;
-    size_t byteCount = (binaryStream.size() + 7) / 8;
-    data.reserve(byteCount);
-
-    for (size_t i = 0; i < binaryStream.size(); i += 8) {
-        uint8_t byte = 0;
-        for (int j = 0; j < 8; j++) {
-            if (i + j < binaryStream.size()) {
-                byte = (byte << 1) | (binaryStream[i + j] ? 1 : 0);
-            }
-            else {
-                byte = byte << 1; // Pad with 0
-            }
-        }
-        data.push_back(byte);
-    }
-
-    return data;
-}
-
-// Determine if data is text
-bool isTextData(const std::vector<uint8_t>& data) {
-    if (data.empty()) return false;
-
-    size_t checkSize = std::min(data.size(), size_t(1000));
-    int printableCount = 0;
-    int controlCount = 0;
-    int nullCount = 0;
-
-    for (size_t i = 0; i < checkSize; i++) {
-        uint8_t c = data[i];
-        if (c >= 32 && c <= 126) { // 可打印ASCII字符
-            printableCount++;
-        }
-        else if (c == 9 || c == 10 || c == 13) { // 制表符、换行符、回车符
-            printableCount++;
-        }
-        else if (c == 0) { // 空字符
-            nullCount++;
-            // 文本文件中不应该有太多空字符
-            if (nullCount > checkSize / 20) { // 如果超过5%是空字符，可能是二进制文件
-                return false;
-            }
-        }
-        else if (c < 32) { // 其他控制字符
-            controlCount++;
-            // 文本文件中不应该有太多控制字符
-            if (controlCount > checkSize / 50) { // 如果超过2%是控制字符，可能是二进制文件
-                return false;
-            }
-        }
-        else {
-            // 可能是UTF-8多字节字符的一部分
-            printableCount++;
-        }
-    }
-
-    // 计算可打印字符的比例
-    float printableRatio = static_cast<float>(printableCount) / checkSize;
-    float controlRatio = static_cast<float>(controlCount) / checkSize;
-
-    // 可打印字符比例高且控制字符比例低的很可能是文本
-    return (printableRatio > g_config.TEXT_DETECTION_THRESHOLD) &&
-        (controlRatio < g_config.CONTROL_CHAR_THRESHOLD);
+// 默认配置的编解码上下文（交互菜单使用）
+const CodecContext& defaultCodecContext() {
+    static const CodecContext context{ QRACConfig{} };
+    return context;
 }
 
 // Get file extension
@@ -478,55 +130,6 @@ std::string generateOutputFilename(const std::string& inputPath, const std::stri
     return directory + filename + suffix + "." + extension;
 }
 
-// Calculate optimal image dimensions for adaptive mode
-void calculateAdaptiveDimensions(size_t dataSize, int* width, int* height) {
-    // 计算每个符号的位数
-    int intervals = calculateIntervals();
-    int bitsPerSymbol = static_cast<int>(std::log2(intervals));
-
-    // 计算所需的总符号数（包括FEC）
-    size_t totalSymbols = (dataSize * 8 + bitsPerSymbol - 1) / bitsPerSymbol;
-
-    // 计算所需像素数（每个像素存储3个符号）
-    int symbolsPerPixel = g_config.SYMBOLS_PER_PIXEL;
-    int pixelsNeeded = static_cast<int>((totalSymbols + symbolsPerPixel - 1) / symbolsPerPixel); // 向上取整
-
-    // 找到能容纳像素的最小正方形
-    int side = static_cast<int>(std::ceil(std::sqrt(pixelsNeeded)));
-
-    // 确保最小尺寸
-    side = std::max(side, g_config.MIN_IMAGE_DIMENSION);
-
-    // 计算实际需要的行数和列数
-    int actualWidth = static_cast<int>(std::ceil(std::sqrt(pixelsNeeded)));
-    int actualHeight = (pixelsNeeded + actualWidth - 1) / actualWidth;
-
-    *width = std::max(actualWidth, g_config.MIN_IMAGE_DIMENSION);
-    *height = std::max(actualHeight, g_config.MIN_IMAGE_DIMENSION);
-
-    std::cout << "Precise dimensions: " << *width << "x" << *height
-        << " (pixels needed: " << pixelsNeeded << ")\n";
-
-    // 计算预计文件大小
-    int channels = 3;
-    int rowSize = *width * channels;
-    size_t estimatedSize = rowSize * *height;
-
-    std::cout << "Estimated image size: " << (estimatedSize / 1024) << "KB\n";
-}
-
-// 使用stb_image_write保存图像
-bool saveImage(const std::string& filename, const uint8_t* data, int width, int height, int channels, const std::string& format) {
-    if (format == "bmp") {
-        return stbi_write_bmp(filename.c_str(), width, height, channels, data) != 0;
-    }
-    else if (format == "png") {
-        // PNG压缩级别 6 (中等压缩级别，平衡速度和质量)
-        return stbi_write_png(filename.c_str(), width, height, channels, data, width * channels) != 0;
-    }
-    return false;
-}
-
 // 使用智能指针包装STB图像加载
 struct STBImageDeleter {
     void operator()(unsigned char* data) const {
@@ -569,6 +172,12 @@ STBImagePtr loadImageSTB(const std::string& filename, int* width, int* height, i
     return STBImagePtr(data);
 }
 
+// 从内存中的图像文件加载（数据由I/O后端读取）
+STBImagePtr loadImageSTB(std::span<const uint8_t> encoded, int* width, int* height, int* channels, int desired_channels = 0) {
+    unsigned char* data = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), width, height, channels, desired_channels);
+    return STBImagePtr(data);
+}
+
 // 简单的JPG文件检测函数（仅检测文件头）
 bool isJPGFile(const std::string& filename) {
 #ifdef _WIN32
@@ -666,7 +275,7 @@ void showTrustStatement() {
 }
 
 // 改进的文件保存逻辑
-void saveExtractedData(const std::vector<uint8_t>& data, const std::string& filename, bool isText) {
+void saveExtractedData(std::span<const uint8_t> data, const std::string& filename, bool isText) {
 #ifdef _WIN32
     std::wstring wideStr = utf8ToWstring(filename);
     std::ofstream outFile(wideStr, isText ? std::ios::out : std::ios::binary);
@@ -681,582 +290,2344 @@ void saveExtractedData(const std::vector<uint8_t>& data, const std::string& file
     outFile.close();
 }
 
-// PNG压缩函数，自动调整尺寸直到满足目标大小
-std::vector<uint8_t> compressImageAuto(const std::vector<uint8_t>& imageData, int width, int height, int channels, size_t maxSizeKB) {
-    int tryWidth = width, tryHeight = height;
-    std::vector<uint8_t> resized = imageData;
-    std::vector<uint8_t> result;
-    int compressedSize = 0;
-    unsigned char* compressedData = nullptr;
+// 将UTF-8字符串转换为filesystem路径
+fs::path utf8ToPath(const std::string& utf8Str) {
+#ifdef _WIN32
+    return fs::path(utf8ToWstring(utf8Str));
+#else
+    return fs::path(utf8Str);
+#endif
+}
 
-    while (true) {
-        compressedData = stbi_write_png_to_mem(
-            resized.data(), tryWidth * channels, tryWidth, tryHeight, channels, &compressedSize
-        );
-        if (compressedData && compressedSize <= static_cast<int>(maxSizeKB * 1024)) {
-            result.assign(compressedData, compressedData + compressedSize);
-            STBIW_FREE(compressedData);
-            break;
-        }
-        STBIW_FREE(compressedData);
-        if (tryWidth <= 64 || tryHeight <= 64) {
-            compressedData = stbi_write_png_to_mem(
-                resized.data(), tryWidth * channels, tryWidth, tryHeight, channels, &compressedSize
-            );
-            if (compressedData) {
-                result.assign(compressedData, compressedData + compressedSize);
-                STBIW_FREE(compressedData);
-            }
-            break;
-        }
-        int newWidth = static_cast<int>(tryWidth * 0.9);
-        int newHeight = static_cast<int>(tryHeight * 0.9);
-        std::vector<uint8_t> nextResized(newWidth * newHeight * channels);
-        stbir_resize_uint8(resized.data(), tryWidth, tryHeight, 0,
-            nextResized.data(), newWidth, newHeight, 0, channels);
-        resized = std::move(nextResized);
-        tryWidth = newWidth;
-        tryHeight = newHeight;
+// 以UTF-8路径打开文件，"-"表示标准输入/输出
+std::FILE* openStreamUtf8(const std::string& path, bool write) {
+    if (path == "-") {
+        std::FILE* stream = write ? stdout : stdin;
+        setBinaryMode(stream);
+        return stream;
     }
-    return result;
+#ifdef _WIN32
+    std::FILE* file = _wfopen(utf8ToWstring(path).c_str(), write ? L"wb" : L"rb");
+#else
+    std::FILE* file = std::fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+    if (!file) {
+        throw QRACException(write ? ErrorType::FileWriteError : ErrorType::FileNotFound,
+            std::string(write ? "Cannot create output file: " : "Cannot open input file: ") + path);
+    }
+    return file;
 }
 
-// PNG压缩函数（用于校正后的图像，保持接口一致）
-std::vector<uint8_t> compressImage(const std::vector<uint8_t>& imageData, int width, int height, int channels) {
-    // 使用PNG格式进行无损压缩
-    int compressedSize;
-    unsigned char* compressedData = stbi_write_png_to_mem(
-        imageData.data(), width * channels, width, height, channels, &compressedSize);
-    if (!compressedData) {
-        throw QRACException(ErrorType::ImageSaveError, "Failed to compress image");
+// 输出流水线各阶段的忙碌时间（总耗时接近最慢阶段，而不是各阶段之和）
+void logStageTimes(const StreamReport& report, std::ostream& log) {
+    log << "Pipeline stage busy time:";
+    for (const StageTime& stage : report.stages) {
+        log << " " << stage.name << " " << std::fixed << std::setprecision(2) << stage.busySeconds << "s";
     }
-
-    // 将压缩后的数据复制到vector中
-    std::vector<uint8_t> result(compressedData, compressedData + compressedSize);
-    STBIW_FREE(compressedData);
-
-    return result;
+    log << "\n";
 }
 
-// 文件类型检测
-std::string detectFileType(const std::vector<uint8_t>& data) {
-    if (data.size() < 4) return "bin";
-
-    // 常见文件类型签名
-    static const std::unordered_map<std::string, std::vector<uint8_t>> signatures = {
-        {"zip", {0x50, 0x4B, 0x03, 0x04}},
-        {"doc", {0xD0, 0xCF, 0x11, 0xE0}},
-        {"pdf", {0x25, 0x50, 0x44, 0x46}},
-        {"png", {0x89, 0x50, 0x4E, 0x47}},
-        {"jpg", {0xFF, 0xD8, 0xFF, 0xE0}},
-        {"jpg2", {0xFF, 0xD8, 0xFF, 0xE1}},
-        {"bmp", {0x42, 0x4D}},
-        {"gif", {0x47, 0x49, 0x46, 0x38}}
-    };
+// 输出分块校验发现的损坏位置：FEC之前CRC32C不符的块及其字节范围（最多MAX_FEC_WARNINGS个）
+void logDamagedBlocks(const CodecContext& ctx, const FECReport& fec, size_t payloadBytes, std::ostream& log) {
+    if (fec.checksDamaged) {
+        log << "Block checksum table damaged, whole payload passed to FEC\n";
+    }
+    if (fec.damagedBlocks.empty()) {
+        return;
+    }
+    size_t blockSize = ctx.profile().CHECK_BLOCK_SIZE;
+    size_t shown = std::min(fec.damagedBlocks.size(), static_cast<size_t>(std::max(ctx.profile().MAX_FEC_WARNINGS, 1)));
+    log << "CRC32C mismatch in " << fec.damagedBlocks.size() << " of " << fec.checkedBlocks
+        << " data blocks, only these passed to FEC:";
+    for (size_t k = 0; k < shown; k++) {
+        size_t first = fec.damagedBlocks[k] * blockSize;
+        size_t last = std::min(first + blockSize, std::max(payloadBytes, first + 1)) - 1;
+        log << " #" << fec.damagedBlocks[k] << " (bytes " << first << "-" << last << ")";
+    }
+    if (shown < fec.damagedBlocks.size()) {
+        log << " ...";
+    }
+    log << "\n";
+}
 
-    for (const auto& pair : signatures) {
-        const std::vector<uint8_t>& sig = pair.second;
-        if (data.size() >= sig.size() &&
-            std::equal(sig.begin(), sig.end(), data.begin())) {
-            return pair.first;
+// 输出各阶段的硬件计数器（--perf）：IPC和每个输出字节的未命中次数
+void logStageCounters(const JobStats& stats, std::ostream& log) {
+    log << "Stage counters:\n";
+    for (const StageStats& stage : stats.stages) {
+        if (stage.perf.valid()) {
+            log << "  " << stage.name << ": " << formatPerfCounters(stage.perf, stage.bytes) << "\n";
         }
     }
-
-    // 如果不是已知的二进制格式，检查是否为文本
-    return isTextData(data) ? "txt" : "bin";
 }
 
-// Encoder function
-void encodeFile() {
-    std::string inputFile, mode, formatChoice;
-
-    std::cout << "[Encode] Convert file to QRAC image\n";
-    std::cout << "Enter input file path: ";
-    std::getline(std::cin, inputFile);
-
-    if (!fileExists(inputFile)) {
-        throw QRACException(ErrorType::FileNotFound, "File does not exist: " + inputFile);
+// --perf：在调用线程上打开计数器，不可用时说明原因并继续运行（不统计计数器）
+bool startPerfCounters() {
+    std::string reason;
+    if (!enablePerfCounters(&reason)) {
+        std::cerr << "Performance counters unavailable: " << reason << "\n";
+        return false;
     }
+    return true;
+}
 
-    // 改进的菜单选项
-    std::cout << "\n=== Encoding Mode Selection ===\n";
-    std::cout << "1. Auto Mode (Recommended for files 36KB-1MB)\n";
-    std::cout << "   - System automatically selects optimal size\n";
-    std::cout << "   - Small (" << g_config.DEFAULT_SMALL_SIZE << "x" << g_config.DEFAULT_SMALL_SIZE
-        << "): Best for files up to " << (g_config.SMALL_FILE_THRESHOLD / 1024) << "KB\n";
-    std::cout << "   - Medium (" << g_config.DEFAULT_MEDIUM_SIZE << "x" << g_config.DEFAULT_MEDIUM_SIZE
-        << "): Best for files " << (g_config.SMALL_FILE_THRESHOLD / 1024)
-        << "KB-" << (g_config.MEDIUM_FILE_THRESHOLD / 1024 / 1024) << "MB\n";
-    std::cout << "   - Large (" << g_config.DEFAULT_LARGE_SIZE << "x" << g_config.DEFAULT_LARGE_SIZE
-        << "): Best for files over " << (g_config.MEDIUM_FILE_THRESHOLD / 1024 / 1024) << "MB\n";
-    std::cout << "2. Adaptive Mode (Optimal for any file size)\n";
-    std::cout << "   - Generates minimal image size needed\n";
-    std::cout << "   - Example: 5 bytes = small image, 4MB = large image\n";
-    std::cout << "   - Most efficient use of space\n";
-    std::cout << "Select mode (1 or 2, default 1): ";
+// 检查PNG文件在第一个IEND之后是否还有数据（流式/大文件编码生成的多帧PNG）
+bool isMultiFramePng(const std::string& filename) {
+    std::FILE* file = openStreamUtf8(filename, false);
+    uint8_t header[8];
+    bool multiFrame = false;
+    if (std::fread(header, 1, 8, file) == 8 && header[0] == 0x89 && header[1] == 'P' && header[2] == 'N' && header[3] == 'G') {
+        while (std::fread(header, 1, 8, file) == 8) {
+            uint32_t length = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) | (uint32_t(header[2]) << 8) | header[3];
+            if (std::memcmp(header + 4, "IEND", 4) == 0) {
+                uint8_t next;
+                multiFrame = std::fseek(file, length + 4, SEEK_CUR) == 0 && std::fread(&next, 1, 1, file) == 1;
+                break;
+            }
+            if (std::fseek(file, static_cast<long>(length) + 4, SEEK_CUR) != 0) {
+                break;
+            }
+        }
+    }
+    std::fclose(file);
+    return multiFrame;
+}
 
-    std::getline(std::cin, mode);
+// 格式化字节数
+std::string formatBytes(double bytes) {
+    static const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+    int unit = 0;
+    while (bytes >= 1024.0 && unit < 4) {
+        bytes /= 1024.0;
+        unit++;
+    }
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << bytes << " " << units[unit];
+    return oss.str();
+}
 
-    if (mode.empty()) mode = "1";
+// 编码选项（交互模式与批处理模式共用）
+struct EncodeOptions {
+    bool adaptive = false;      // true: 自适应模式, false: 自动档位模式
+    std::string format = "png"; // 输出格式: png 或 bmp
+    size_t streamChunkBytes = kStreamChunkBytes; // PNG输出时超过此大小的文件按块流式编码
+    EncodeCache* cache = nullptr; // --cache：内容和配置未变的文件直接使用缓存的图像
+    bool delta = false;         // --delta：流式编码的大文件以已有的输出为旧版本，只重新编码变化的帧
+    bool append = false;        // --append：只增长的文件（日志）只编码上次编码之后新增的数据（多帧PNG）
+};
 
-    // 输出格式选择
-    std::cout << "\n=== Output Format Selection ===\n";
-    std::cout << "1. PNG format (Recommended, smaller file size, lossless)\n";
-    std::cout << "2. BMP format (24-bit, better compatibility)\n";
-    std::cout << "Select format (1 or 2, default 1): ";
-    std::getline(std::cin, formatChoice);
+// 单个文件作业的结果（批处理模式据此逐文件报告）
+struct JobResult {
+    std::string input;
+    std::string output;
+    size_t bytesIn = 0;
+    size_t bytesOut = 0;
+    bool success = false;
+    bool dataValid = true; // 解码时FEC是否完全校正
+    std::string message;
+    double seconds = 0.0;
+    JobStats stats; // 启用--stats时的阶段耗时和计数
+    std::string cacheKey; // 未命中编码缓存时的键：输出写完（异步写已flush）后由调用者加入缓存
+};
 
-    std::string outputFormat = "png";
-    if (formatChoice == "2") {
-        outputFormat = "bmp";
-        std::cout << "Using 24-bit BMP format\n";
-    }
-    else {
-        std::cout << "Using PNG format (lossless compression)\n";
+// --trace：构造时开始记录，析构时（命令结束，线程池和流水线线程都已结束）写出跟踪文件
+class TraceSession {
+public:
+    explicit TraceSession(std::string path) : m_path(std::move(path)) {
+        if (!m_path.empty()) {
+            enableTracing();
+        }
     }
-
-    // Read input file
-#ifdef _WIN32
-    std::wstring wideStr = utf8ToWstring(inputFile);
-    std::ifstream file(wideStr, std::ios::binary);
-#else
-    std::ifstream file(inputFile, std::ios::binary);
-#endif
-    if (!file.is_open()) {
-        throw QRACException(ErrorType::FileReadError, "Cannot open input file: " + inputFile);
+    ~TraceSession() {
+        if (m_path.empty()) {
+            return;
+        }
+        std::ofstream file(utf8ToPath(m_path), std::ios::binary);
+        writeTrace(file);
+        file.close();
+        if (!file) {
+            std::cerr << "Failed to write trace file: " << m_path << "\n";
+        }
     }
 
-    size_t fileSize = getFileSize(inputFile);
-    std::vector<uint8_t> fileData(fileSize);
-    file.read(reinterpret_cast<char*>(fileData.data()), fileSize);
-    file.close();
+private:
+    std::string m_path;
+};
 
-    std::cout << "Read input file: " << fileSize << " bytes\n";
+// 输出一个作业的统计记录（一行JSON）。记录写到标准错误，标准输出留给进度信息或流式数据
+void writeJobStatsRecord(const char* operation, const JobResult& result) {
+    std::ostringstream line;
+    line << "{\"type\":\"job\",\"operation\":\"" << operation << "\""
+        << ",\"input\":" << jsonString(result.input)
+        << ",\"output\":" << jsonString(result.output)
+        << ",\"success\":" << (result.success ? "true" : "false")
+        << ",\"data_valid\":" << (result.dataValid ? "true" : "false")
+        << ",\"bytes_in\":" << result.bytesIn
+        << ",\"bytes_out\":" << result.bytesOut
+        << ",\"seconds\":" << std::fixed << std::setprecision(6) << result.seconds << ",";
+    writeStatsJson(line, result.stats);
+    if (!result.message.empty()) {
+        line << ",\"message\":" << jsonString(result.message.substr(0, result.message.find('\n')));
+    }
+    line << "}\n";
+    std::cerr << line.str() << std::flush;
+}
 
-    // Add forward error correction
-    addFEC(fileData);
-    std::cout << "Data with FEC: " << fileData.size() << " bytes\n";
+// 写出前删除已有的输出文件：它可能是编码缓存中文件的硬链接（--cache），原地覆盖会改写缓存的内容
+void removeExistingOutput(const std::string& path) {
+    std::error_code error;
+    fs::remove(utf8ToPath(path), error);
+}
 
-    // Determine image dimensions
-    int width, height;
-    bool useFEC = true;
+// 逐段读取文件计算内容哈希（流式编码的大文件不整体读入内存）
+PayloadHash hashFileStreaming(const std::string& path) {
+    std::FILE* file = openStreamUtf8(path, false);
+    PayloadHasher hasher;
+    std::vector<uint8_t> buffer(kHashPartBytes);
+    size_t got;
+    while ((got = std::fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+        hasher.update(buffer.data(), got);
+    }
+    bool failed = std::ferror(file) != 0;
+    std::fclose(file);
+    if (failed) {
+        throw QRACException(ErrorType::FileReadError, "Failed to read input file: " + path);
+    }
+    return hasher.finish();
+}
 
-    if (mode == "2") {
-        calculateAdaptiveDimensions(fileData.size(), &width, &height);
-        std::cout << "Using adaptive mode: " << width << "x" << height << " pixels\n";
-        std::cout << "This will create the minimal image needed for your data\n";
+// 流式编码到文件。delta（--delta）时以已有的输出为旧版本做增量编码：内容未变的帧从中复制，
+// 新图像先写到临时文件，完成后替换输出（输出可能是缓存文件的硬链接，不原地改写）
+StreamReport encodeStreamToFile(const CodecContext& ctx, std::FILE* in, const std::string& output, size_t chunkBytes, bool delta) {
+    std::FILE* previous = delta && fileExists(output) ? openStreamUtf8(output, false) : nullptr;
+    std::string target = previous ? output + ".partial" : output;
+    std::FILE* out = nullptr;
+    StreamReport report;
+    try {
+        removeExistingOutput(target);
+        out = openStreamUtf8(target, true);
+        encodeStream(ctx, in, out, &report, chunkBytes, previous);
     }
-    else { // auto mode (default)
-        if (fileSize <= g_config.SMALL_FILE_THRESHOLD) {
-            width = g_config.DEFAULT_SMALL_SIZE;
-            height = g_config.DEFAULT_SMALL_SIZE;
-            std::cout << "Auto-selected small mode: " << width << "x" << height
-                << " pixels (best for files up to " << (g_config.SMALL_FILE_THRESHOLD / 1024) << "KB)\n";
-        }
-        else if (fileSize <= g_config.MEDIUM_FILE_THRESHOLD) {
-            width = g_config.DEFAULT_MEDIUM_SIZE;
-            height = g_config.DEFAULT_MEDIUM_SIZE;
-            std::cout << "Auto-selected medium mode: " << width << "x" << height
-                << " pixels (best for files " << (g_config.SMALL_FILE_THRESHOLD / 1024)
-                << "KB-" << (g_config.MEDIUM_FILE_THRESHOLD / 1024 / 1024) << "MB)\n";
+    catch (...) {
+        if (out) std::fclose(out);
+        if (previous) {
+            std::fclose(previous);
+            removeExistingOutput(target);
         }
-        else {
-            width = g_config.DEFAULT_LARGE_SIZE;
-            height = g_config.DEFAULT_LARGE_SIZE;
-            std::cout << "Auto-selected large mode: " << width << "x" << height
-                << " pixels (best for files over " << (g_config.MEDIUM_FILE_THRESHOLD / 1024 / 1024) << "MB)\n";
+        throw;
+    }
+    if (previous) {
+        std::fclose(previous);
+    }
+    if (std::fclose(out) != 0) {
+        if (previous) removeExistingOutput(target);
+        throw QRACException(ErrorType::FileWriteError, "Failed to write output file: " + output);
+    }
+    if (previous) {
+        std::error_code error;
+        fs::rename(utf8ToPath(target), utf8ToPath(output), error);
+        if (error) {
+            removeExistingOutput(target);
+            throw QRACException(ErrorType::FileWriteError, "Cannot replace output file: " + output + " (" + error.message() + ")");
         }
-        std::cout << "Note: For optimal space efficiency, consider adaptive mode next time\n";
     }
+    return report;
+}
 
-    // Convert data to binary stream
-    std::vector<bool> binaryStream = dataToBinary(fileData);
-    std::cout << "Generated binary stream: " << binaryStream.size() << " bits\n";
+// 增量编码复制和重新编码的帧数
+void logDeltaFrames(const StreamReport& report, std::ostream& log) {
+    log << "Delta: " << report.reusedFrames << " of " << report.frames << " frames unchanged (copied), "
+        << (report.frames - report.reusedFrames) << " re-encoded\n";
+}
 
-    // Calculate bits per symbol
-    int intervals = calculateIntervals();
-    int bitsPerSymbol = static_cast<int>(std::log2(intervals));
-    std::cout << "Number of intervals: " << intervals << " (L=" << g_config.L << ")\n";
-    std::cout << "Bits per symbol: " << bitsPerSymbol << "\n";
+// 输入文件中[offset, offset + size)的BLAKE3哈希，文件比记录的短时返回false
+bool hashFileRange(const std::string& path, uint64_t offset, uint64_t size, PayloadHash& hash) {
+    std::FILE* file = openStreamUtf8(path, false);
+    std::vector<uint8_t> data(static_cast<size_t>(size));
+    bool complete = seekFile(file, offset) && std::fread(data.data(), 1, data.size(), file) == data.size();
+    std::fclose(file);
+    if (complete) {
+        hash = blake3(data.data(), data.size());
+    }
+    return complete;
+}
 
-    // Convert binary stream to symbol sequence
-    std::vector<int> symbols = binaryToSymbols(binaryStream, bitsPerSymbol);
-    std::cout << "Generated symbol sequence: " << symbols.size() << " symbols\n";
+// 追加编码（--append）：按状态记录保留已完成的帧，只编码新增的数据（和未满的最后一帧），见qrac_append.h
+JobResult appendFileJob(const CodecContext& ctx, const std::string& inputFile, const EncodeOptions& options, std::ostream& log,
+    JobStats* stats) {
+    JobResult result;
+    result.input = inputFile;
+    if (!fileExists(inputFile)) {
+        throw QRACException(ErrorType::FileNotFound, "File does not exist: " + inputFile);
+    }
+    size_t chunkBytes = options.streamChunkBytes;
+    std::string outputImage = generateOutputFilename(inputFile, "_encoded", "png");
+    std::string statePath = appendStatePath(outputImage);
+    std::string settingsKey = encodeSettingsKey(ctx.profile(), "png", true, chunkBytes);
+    std::string settings = hashToHex(blake3(reinterpret_cast<const uint8_t*>(settingsKey.data()), settingsKey.size()));
+    uint64_t inputSize = getFileSize(inputFile);
+
+    // 从哪里继续：最后一帧已满时接在图像结尾，未满时重新编码最后一帧
+    AppendState state;
+    std::string restart; // 不能继续时的原因
+    bool stateLoaded = loadAppendState(statePath, state);
+    bool keepLastFrame = state.lastFrameBytes == chunkBytes;
+    uint64_t imageStart = keepLastFrame ? state.imageBytes : state.lastFrameOffset;
+    if (!stateLoaded) {
+        restart = "no append state";
+    }
+    else if (state.settings != settings) {
+        restart = "settings changed";
+    }
+    else if (!fileExists(outputImage) || getFileSize(outputImage) < imageStart) {
+        restart = "encoded image is missing or truncated";
+    }
+    else if (fs::hard_link_count(utf8ToPath(outputImage)) > 1) {
+        restart = "encoded image is shared by a hard link";
+    }
+    else {
+        PayloadHash lastFrame;
+        if (inputSize < state.inputBytes ||
+            !hashFileRange(inputFile, state.inputBytes - state.lastFrameBytes, state.lastFrameBytes, lastFrame) ||
+            lastFrame != state.lastFrameHash) {
+            restart = "input no longer extends the encoded data";
+        }
+    }
+
+    uint64_t inputStart = keepLastFrame ? state.inputBytes : state.inputBytes - state.lastFrameBytes;
+    if (!restart.empty()) {
+        inputStart = 0;
+        imageStart = 0;
+    }
+    else if (inputSize == state.inputBytes && getFileSize(outputImage) >= state.imageBytes) {
+        if (getFileSize(outputImage) > state.imageBytes) {
+            fs::resize_file(utf8ToPath(outputImage), state.imageBytes); // 上次中断时未提交的帧
+        }
+        log << "Append: no new data since the last encode (" << inputSize << " bytes)\n";
+        result.output = outputImage;
+        result.success = true;
+        return result;
+    }
+    if (restart.empty()) {
+        log << "Append: resuming at input byte " << inputStart << " (" << formatBytes(static_cast<double>(inputSize - inputStart))
+            << " to encode, " << (keepLastFrame ? "all frames kept" : "last partial frame re-encoded") << ")\n";
+    }
+    else {
+        log << "Append: full encode (" << restart << ")\n";
+    }
+
+    // 截断到续写的位置（去掉未提交或要重新编码的帧），从同一输入位置起编码
+    std::FILE* in = openStreamUtf8(inputFile, false);
+    std::FILE* out = nullptr;
+    StreamReport report;
+    try {
+        if (!seekFile(in, inputStart)) {
+            throw QRACException(ErrorType::FileReadError, "Cannot seek input file: " + inputFile);
+        }
+        if (imageStart == 0) {
+            removeExistingOutput(outputImage);
+            out = openStreamUtf8(outputImage, true);
+        }
+        else {
+            fs::resize_file(utf8ToPath(outputImage), imageStart);
+#ifdef _WIN32
+            out = _wfopen(utf8ToWstring(outputImage).c_str(), L"ab");
+#else
+            out = std::fopen(outputImage.c_str(), "ab");
+#endif
+            if (!out) {
+                throw QRACException(ErrorType::FileWriteError, "Cannot open output file: " + outputImage);
+            }
+        }
+        encodeStream(ctx, in, out, &report, chunkBytes);
+        if (!syncFile(out)) {
+            throw QRACException(ErrorType::FileWriteError, "Failed to write output file: " + outputImage);
+        }
+    }
+    catch (...) {
+        std::fclose(in);
+        if (out) std::fclose(out);
+        throw;
+    }
+    std::fclose(in);
+    if (std::fclose(out) != 0) {
+        throw QRACException(ErrorType::FileWriteError, "Failed to write output file: " + outputImage);
+    }
+
+    // 图像写到磁盘后提交新的状态
+    AppendState next;
+    next.settings = settings;
+    next.inputBytes = inputStart + report.bytesIn;
+    next.imageBytes = imageStart + report.bytesOut;
+    next.lastFrameOffset = imageStart + report.lastFrameOffset;
+    next.lastFrameBytes = report.lastFrameInputBytes;
+    next.lastFrameHash = report.lastFrameHash;
+    saveAppendState(statePath, next);
+
+    logStageTimes(report, log);
+    if (stats) {
+        stats->addStream(report);
+    }
+    log << "QRAC image saved: " << outputImage << " (" << report.frames << " new frames, "
+        << formatBytes(static_cast<double>(next.imageBytes)) << " total for " << next.inputBytes << " input bytes)\n";
+    result.bytesIn = report.bytesIn;
+    result.bytesOut = report.bytesOut;
+    result.output = outputImage;
+    result.success = true;
+    return result;
+}
+
+// 在编码缓存中查找（options.cache非空时），命中时输出已经就位并填好result
+bool fetchCachedImage(const EncodeOptions& options, const std::string& cacheKey, const std::string& outputImage,
+    std::ostream& log, JobResult& result) {
+    bool linked = false;
+    if (!options.cache->fetch(cacheKey, options.format, outputImage, &linked)) {
+        return false;
+    }
+    result.bytesOut = getFileSize(outputImage);
+    result.output = outputImage;
+    result.success = true;
+    log << "Cache hit: " << (linked ? "linked" : "copied") << " cached image (key " << cacheKey.substr(0, 16) << ")\n";
+    log << "QRAC image saved: " << outputImage << " (" << result.bytesOut << " bytes)\n";
+    return true;
+}
+
+// 编码单个文件（非交互），过程信息写入log
+// stats非空时记录各阶段的耗时和字节数
+JobResult encodeFileJob(const CodecContext& ctx, const std::string& inputFile, const EncodeOptions& options, std::ostream& log, IoBackend& io,
+    JobStats* stats = nullptr) {
+    if (options.append) {
+        return appendFileJob(ctx, inputFile, options, log, stats);
+    }
+    const QRACConfig& profile = ctx.profile();
+    JobResult result;
+    result.input = inputFile;
+
+    if (!fileExists(inputFile)) {
+        throw QRACException(ErrorType::FileNotFound, "File does not exist: " + inputFile);
+    }
+
+    size_t fileSize = getFileSize(inputFile);
+
+    // 大文件：按块流水线编码为多帧PNG，读取、FEC、打包、压缩、写出同时进行，内存占用有上限
+    size_t chunkBytes = options.streamChunkBytes;
+    if (options.format == "png" && fileSize > chunkBytes) {
+        std::string outputImage = generateOutputFilename(inputFile, "_encoded", "png");
+        log << "Read input file: " << fileSize << " bytes\n";
+        log << "Large file: encoding " << ((fileSize + chunkBytes - 1) / chunkBytes)
+            << " frames of up to " << formatBytes(static_cast<double>(chunkBytes)) << " (adaptive size per frame)\n";
+
+        result.bytesIn = fileSize;
+        std::string cacheKey;
+        if (options.cache) {
+            StageTimer timer(stats, "encode");
+            PayloadHash content = hashFileStreaming(inputFile);
+            timer.lap("hash", fileSize);
+            cacheKey = EncodeCache::key(content, encodeSettingsKey(profile, options.format, options.adaptive, chunkBytes));
+            if (fetchCachedImage(options, cacheKey, outputImage, log, result)) {
+                return result;
+            }
+        }
+
+        std::FILE* in = openStreamUtf8(inputFile, false);
+        StreamReport report;
+        try {
+            report = encodeStreamToFile(ctx, in, outputImage, chunkBytes, options.delta);
+        }
+        catch (...) {
+            std::fclose(in);
+            throw;
+        }
+        std::fclose(in);
+
+        if (options.delta) {
+            logDeltaFrames(report, log);
+        }
+        logStageTimes(report, log);
+        if (stats) {
+            stats->addStream(report);
+        }
+        log << "QRAC image saved: " << outputImage << " (" << report.frames << " frames, " << report.bytesOut << " bytes)\n";
+        result.cacheKey = cacheKey;
+        result.bytesOut = report.bytesOut;
+        result.output = outputImage;
+        result.success = true;
+        return result;
+    }
+
+    // Read input file（预读的输入只计取走数据的时间）
+    StageTimer timer(stats, "encode");
+    ByteBuffer fileData = io.readFile(inputFile);
+    fileSize = fileData.size();
+    timer.lap("read", fileSize);
+
+    log << "Read input file: " << fileSize << " bytes\n";
+    result.bytesIn = fileSize;
+
+    // Generate output filename
+    const std::string& outputFormat = options.format;
+    std::string outputImage = generateOutputFilename(inputFile, "_encoded", outputFormat);
+
+    // 编码缓存：内容哈希加上配置相同时直接使用缓存的图像
+    std::string cacheKey;
+    if (options.cache) {
+        PayloadHash content = blake3(fileData.data(), fileData.size());
+        timer.lap("hash", fileSize);
+        cacheKey = EncodeCache::key(content, encodeSettingsKey(profile, outputFormat, options.adaptive, 0));
+        if (fetchCachedImage(options, cacheKey, outputImage, log, result)) {
+            return result;
+        }
+        timer.restart();
+    }
+
+    // Encode with libqrac
+    SizeMode sizeMode = options.adaptive ? SizeMode::Adaptive : SizeMode::Auto;
+    EncodeReport report;
+    Image image = encode(fileData, ctx, sizeMode, &report);
+    timer.split("fec", report.fecSeconds, report.encodedBytes);
+    timer.split("pack", report.packSeconds, image.pixels.size());
+    timer.restart();
+    if (stats) {
+        stats->frames = 1;
+    }
+    int width = image.width;
+    int height = image.height;
+    log << "Data with FEC: " << report.encodedBytes << " bytes\n";
+
+    if (options.adaptive) {
+        log << "Precise dimensions: " << width << "x" << height
+            << " (pixels needed: " << report.requiredPixels << ")\n";
+        log << "Using adaptive mode: " << width << "x" << height << " pixels\n";
+        log << "This will create the minimal image needed for your data\n";
+    }
+    else { // auto mode (default)
+        if (fileSize <= profile.SMALL_FILE_THRESHOLD) {
+            log << "Auto-selected small mode: " << width << "x" << height
+                << " pixels (best for files up to " << (profile.SMALL_FILE_THRESHOLD / 1024) << "KB)\n";
+        }
+        else if (fileSize <= profile.MEDIUM_FILE_THRESHOLD) {
+            log << "Auto-selected medium mode: " << width << "x" << height
+                << " pixels (best for files " << (profile.SMALL_FILE_THRESHOLD / 1024)
+                << "KB-" << (profile.MEDIUM_FILE_THRESHOLD / 1024 / 1024) << "MB)\n";
+        }
+        else {
+            log << "Auto-selected large mode: " << width << "x" << height
+                << " pixels (best for files over " << (profile.MEDIUM_FILE_THRESHOLD / 1024 / 1024) << "MB)\n";
+        }
+        log << "Note: For optimal space efficiency, consider adaptive mode next time\n";
+    }
+
+    log << "Generated binary stream: " << report.bits << " bits\n";
+    log << "Number of intervals: " << ctx.intervals() << " (L=" << profile.L << ")\n";
+    log << "Bits per symbol: " << ctx.bitsPerSymbol() << "\n";
+    log << "Generated symbol sequence: " << report.symbols << " symbols\n";
+
+    const ByteBuffer& imageData = image.pixels;
+    log << "Generated image data: " << imageData.size() << " bytes\n";
+
+    // 对图像进行无损压缩（如果是PNG格式）
+    if (outputFormat == "png") {
+        size_t maxSizeKB = static_cast<size_t>(fileSize * 1.5 / 1024); // 原始文件1.5倍
+        log << "Applying auto lossless compression to image (max " << maxSizeKB << "KB)...\n";
+        ByteBuffer compressedData = compressImageAuto(imageData, width, height, 3, maxSizeKB);
+        timer.lap("deflate", compressedData.size());
+        log << "Compressed image data: " << compressedData.size() << " bytes\n";
+        if (compressedData.size() > maxSizeKB * 1024) {
+            log << "Warning: PNG file still exceeds " << maxSizeKB << "KB after compression. Data may be hard to compress.\n";
+        }
+        removeExistingOutput(outputImage);
+        io.writeFile(outputImage, compressedData.data(), compressedData.size());
+        timer.lap("write", compressedData.size());
+        result.bytesOut = compressedData.size();
+    }
+    else {
+        // BMP保存逻辑
+        ByteBuffer bmpData = encodeBmp(image.view());
+        timer.lap("bmp", bmpData.size());
+        removeExistingOutput(outputImage);
+        io.writeFile(outputImage, bmpData.data(), bmpData.size());
+        timer.lap("write", bmpData.size());
+        result.bytesOut = bmpData.size();
+    }
+
+    log << "QRAC image saved: " << outputImage << "\n";
+
+    result.output = outputImage;
+    result.cacheKey = cacheKey;
+    result.success = true;
+    return result;
+}
+
+// Encoder function
+void encodeFile() {
+    const CodecContext& ctx = defaultCodecContext();
+    const QRACConfig& profile = ctx.profile();
+    std::string inputFile, mode, formatChoice;
+
+    std::cout << "[Encode] Convert file to QRAC image\n";
+    std::cout << "Enter input file path: ";
+    std::getline(std::cin, inputFile);
+
+    if (!fileExists(inputFile)) {
+        throw QRACException(ErrorType::FileNotFound, "File does not exist: " + inputFile);
+    }
+
+    // 改进的菜单选项
+    std::cout << "\n=== Encoding Mode Selection ===\n";
+    std::cout << "1. Auto Mode (Recommended for files 36KB-1MB)\n";
+    std::cout << "   - System automatically selects optimal size\n";
+    std::cout << "   - Small (" << profile.DEFAULT_SMALL_SIZE << "x" << profile.DEFAULT_SMALL_SIZE
+        << "): Best for files up to " << (profile.SMALL_FILE_THRESHOLD / 1024) << "KB\n";
+    std::cout << "   - Medium (" << profile.DEFAULT_MEDIUM_SIZE << "x" << profile.DEFAULT_MEDIUM_SIZE
+        << "): Best for files " << (profile.SMALL_FILE_THRESHOLD / 1024)
+        << "KB-" << (profile.MEDIUM_FILE_THRESHOLD / 1024 / 1024) << "MB\n";
+    std::cout << "   - Large (" << profile.DEFAULT_LARGE_SIZE << "x" << profile.DEFAULT_LARGE_SIZE
+        << "): Best for files over " << (profile.MEDIUM_FILE_THRESHOLD / 1024 / 1024) << "MB\n";
+    std::cout << "2. Adaptive Mode (Optimal for any file size)\n";
+    std::cout << "   - Generates minimal image size needed\n";
+    std::cout << "   - Example: 5 bytes = small image, 4MB = large image\n";
+    std::cout << "   - Most efficient use of space\n";
+    std::cout << "Select mode (1 or 2, default 1): ";
+
+    std::getline(std::cin, mode);
+
+    if (mode.empty()) mode = "1";
+
+    // 输出格式选择
+    std::cout << "\n=== Output Format Selection ===\n";
+    std::cout << "1. PNG format (Recommended, smaller file size, lossless)\n";
+    std::cout << "2. BMP format (24-bit, better compatibility)\n";
+    std::cout << "Select format (1 or 2, default 1): ";
+    std::getline(std::cin, formatChoice);
+
+    EncodeOptions options;
+    options.adaptive = (mode == "2");
+    if (formatChoice == "2") {
+        options.format = "bmp";
+        std::cout << "Using 24-bit BMP format\n";
+    }
+    else {
+        std::cout << "Using PNG format (lossless compression)\n";
+    }
+
+    encodeFileJob(ctx, inputFile, options, std::cout, blockingIoBackend());
+
+    std::cout << "Encoding complete! Output file is in the same directory as input.\n";
+    std::cout << options.format << " format ensures lossless storage of your data.\n";
+}
+
+// 是否为PNG文件（按文件头判断）
+bool hasPngSignature(std::span<const uint8_t> encoded) {
+    static const uint8_t kPngSignature[] = { 0x89, 'P', 'N', 'G' };
+    return encoded.size() >= 4 && std::memcmp(encoded.data(), kPngSignature, 4) == 0;
+}
+
+// 写出校正后的图像，保持输入格式：PNG输入写PNG（pngCompression），其他格式写BMP，返回文件大小
+size_t writeCorrectedImage(const ImageView& image, const std::string& outputImage, bool png, PngCompression pngCompression,
+    IoBackend& io, StageTimer& timer) {
+    ByteBuffer outputFile;
+    if (png) {
+        outputFile = encodePng(image, pngCompression);
+        timer.lap("deflate", outputFile.size());
+    }
+    else {
+        outputFile = encodeBmp(image);
+        timer.lap("bmp", outputFile.size());
+    }
+    io.writeFile(outputImage, outputFile.data(), outputFile.size());
+    timer.lap("write", outputFile.size());
+    return outputFile.size();
+}
+
+// 解码单个图像（非交互时JPG只给出警告而不询问用户）
+// 损坏的图像直接解码：提取符号时按间隔吸附到锚点，不需要先校正并写出中间图像
+// dumpCorrected：调试用，解码后另外写出校正后的图像（_corrected，保持输入格式）
+JobResult decodeFileJob(const CodecContext& ctx, const std::string& inputImage, bool interactive, std::ostream& log, IoBackend& io,
+    JobStats* stats = nullptr, bool dumpCorrected = false) {
+    JobResult result;
+    result.input = inputImage;
+
+    if (!fileExists(inputImage)) {
+        throw QRACException(ErrorType::FileNotFound, "File does not exist: " + inputImage);
+    }
+
+    // 检查是否是JPG文件
+    std::string ext = toLower(getFileExtension(inputImage));
+    if (ext == "jpg" || ext == "jpeg") {
+        if (isJPGFile(inputImage)) {
+            if (interactive) {
+                showJPGWarning();
+            }
+            else {
+                log << "Warning: JPG is a lossy format, decoded data may be corrupted\n";
+            }
+        }
+        log << "JPG decoding is experimental and may not work correctly.\n";
+    }
+
+    // 多帧PNG：流水线逐帧解码，先写入临时文件，识别类型后改名
+    if (ext == "png" && isMultiFramePng(inputImage)) {
+        std::string partFile = generateOutputFilename(inputImage, "_decoded", "part");
+        std::FILE* in = openStreamUtf8(inputImage, false);
+        std::FILE* out = nullptr;
+        StreamReport report;
+        try {
+            out = openStreamUtf8(partFile, true);
+            decodeStream(ctx, in, out, &report);
+        }
+        catch (...) {
+            std::fclose(in);
+            if (out) std::fclose(out);
+            std::error_code ignored;
+            fs::remove(utf8ToPath(partFile), ignored);
+            throw;
+        }
+        std::fclose(in);
+        if (std::fclose(out) != 0) {
+            throw QRACException(ErrorType::FileWriteError, "Failed to write output file: " + partFile);
+        }
+
+        log << "Decoded " << report.frames << " frames: " << report.bytesIn << " bytes -> " << report.bytesOut << " bytes\n";
+        if (report.calibratedFrames > 0) {
+            log << "Calibrated shifted pixel levels in " << report.calibratedFrames << " frame(s) before extracting\n";
+        }
+        if (report.deviatingValues > 0) {
+            log << "Snapped " << report.deviatingValues << " pixel values deviating from anchors while extracting\n";
+        }
+        if (report.erasures > 0) {
+            log << "Low-confidence bytes passed to Reed-Solomon as erasures: " << report.erasures << "\n";
+        }
+        if (report.damagedBlocks > 0) {
+            log << "CRC32C mismatch in " << report.damagedBlocks << " data block(s), only these passed to FEC\n";
+        }
+        if (dumpCorrected) {
+            log << "Corrected image dump is not available for multi-frame PNG streams\n";
+        }
+        logStageTimes(report, log);
+        if (stats) {
+            stats->addStream(report);
+        }
+        if (report.invalidFrames > 0) {
+            log << "Warning: " << report.invalidFrames << " frame(s) may contain uncorrectable errors\n";
+        }
+
+        std::string fileType = detectFileType(ctx.profile(), report.head);
+        log << "Detected file type: " << fileType << "\n";
+        std::string outputFile = generateOutputFilename(inputImage, "_decoded", fileType);
+        std::error_code renameError;
+        fs::rename(utf8ToPath(partFile), utf8ToPath(outputFile), renameError);
+        if (renameError) {
+            throw QRACException(ErrorType::FileWriteError, "Cannot create output file: " + outputFile);
+        }
+        log << "Data extracted to: " << outputFile << "\n";
+
+        result.bytesIn = getFileSize(inputImage);
+        result.output = outputFile;
+        result.bytesOut = report.bytesOut;
+        result.dataValid = report.invalidFrames == 0;
+        result.success = true;
+        return result;
+    }
+
+    // Load image using stb_image
+    StageTimer timer(stats, "decode");
+    ByteBuffer encoded = io.readFile(inputImage);
+    timer.lap("read", encoded.size());
+    int width, height, channels;
+    STBImagePtr imageDataPtr = loadImageSTB(encoded, &width, &height, &channels, 0);
+
+    if (!imageDataPtr) {
+        throw QRACException(ErrorType::ImageLoadError, "Failed to load image: " + inputImage);
+    }
+    timer.lap("inflate", static_cast<size_t>(width) * height * channels);
+
+    log << "Loaded image: " << width << "x" << height << " pixels, " << channels << " channels\n";
+    result.bytesIn = encoded.size();
+    bool inputIsPng = hasPngSignature(encoded);
+    encoded = ByteBuffer();
+
+    // 直接在stb_image的缓冲区上解码（少于3个通道时按灰度处理）
+    ImageView view{ imageDataPtr.get(), width, height, channels, 0 };
+    DecodeReport report;
+    ByteBuffer extractedData = decode(view, ctx, &report);
+    timer.split("unpack", report.unpackSeconds, report.extractedBytes);
+    timer.split("fec", report.fecSeconds, extractedData.size());
+    if (stats) {
+        stats->frames = 1;
+        stats->fecCorrectedBytes = report.fec.correctedBytes;
+        stats->fecFailedBlocks = report.fec.failedBlocks;
+        stats->fecErasures = report.fec.erasures;
+        stats->damagedBlocks = report.fec.damagedBlocks.size();
+        stats->fillerPixels = report.fillerPixels;
+        stats->deviatingValues = report.deviatingValues;
+        stats->calibratedFrames = report.levelsCalibrated ? 1 : 0;
+    }
+
+    log << "Storable symbols: " << report.storableSymbols << "\n";
+    log << "Number of intervals: " << ctx.intervals() << " (L=" << ctx.profile().L << ")\n";
+    log << "Bits per symbol: " << ctx.bitsPerSymbol() << "\n";
+    log << "Extracted symbols: " << report.extractedSymbols << " symbols\n";
+    log << "Extracted binary stream: " << report.extractedBits << " bits\n";
+    log << "Extracted data: " << report.extractedBytes << " bytes\n";
+    if (report.levelsCalibrated) {
+        log << "Calibrated shifted pixel levels before extracting (anchor peaks moved by up to "
+            << std::lround(report.levelShift) << ")\n";
+    }
+    if (report.deviatingValues > 0) {
+        log << "Snapped " << report.deviatingValues << " pixel values deviating from anchors while extracting\n";
+    }
+    if (report.fec.erasures > 0) {
+        log << "Low-confidence bytes passed to Reed-Solomon as erasures: " << report.fec.erasures << "\n";
+    }
+    logDamagedBlocks(ctx, report.fec, report.payloadBytes, log);
+    if (report.fec.correctedBytes > 0) {
+        log << "Corrected " << report.fec.correctedBytes << " byte errors\n";
+    }
+    if (report.fec.firstFailedBlock >= 0) {
+        log << "Warning: Unable to correct error in " << (report.fec.checkedBlocks > 0 ? "data block " : "FEC block ")
+            << report.fec.firstFailedBlock << "\n";
+    }
+    log << "Data after FEC correction: " << extractedData.size() << " bytes\n";
+
+    bool dataValid = report.dataValid;
+    if (!dataValid) {
+        log << "Warning: Data may contain uncorrectable errors\n";
+    }
+
+    // Determine output file type
+    std::string fileType = detectFileType(ctx.profile(), extractedData);
+    log << "Detected file type: " << fileType << "\n";
+
+    // Generate output filename
+    std::string outputFile = generateOutputFilename(inputImage, "_decoded", fileType);
+    timer.restart();
+
+    // Save extracted data（文本文件保持原来的文本模式写出）
+    if (fileType == "txt") {
+        saveExtractedData(extractedData, outputFile, true);
+    }
+    else {
+        io.writeFile(outputFile, extractedData.data(), extractedData.size());
+    }
+    timer.lap("write", extractedData.size());
+
+    log << "Data extracted to: " << outputFile << "\n";
+
+    // 调试：写出校正后的图像（解码已完成，可以直接在缓冲区上校正）
+    if (dumpCorrected) {
+        correctInPlace({ imageDataPtr.get(), width, height, channels, 0 }, ctx);
+        timer.lap("correct", static_cast<size_t>(width) * height * channels);
+        std::string correctedImage = generateOutputFilename(inputImage, "_corrected", inputIsPng ? "png" : "bmp");
+        writeCorrectedImage(view, correctedImage, inputIsPng, PngCompression::Default, io, timer);
+        log << "Corrected image saved: " << correctedImage << "\n";
+    }
+
+    result.output = outputFile;
+    result.bytesOut = extractedData.size();
+    result.dataValid = dataValid;
+    result.success = true;
+    return result;
+}
+
+// Decoder function
+void decodeFile() {
+    std::string inputImage;
+
+    std::cout << "[Decode] Extract file from QRAC image\n";
+    std::cout << "Enter input image path (PNG, BMP or PPM format): ";
+    std::getline(std::cin, inputImage);
+
+    JobResult result = decodeFileJob(defaultCodecContext(), inputImage, true, std::cout, blockingIoBackend());
+
+    std::cout << "Decoding complete! Output file is in the same directory as input.\n";
+    std::cout << "Extraction " << (result.dataValid ? "successful" : "partially successful, may contain errors") << "\n";
+}
+
+// 改进的图像加载函数，支持更多格式
+STBImagePtr loadImageWithFallback(std::span<const uint8_t> encoded, int* width, int* height, int* channels) {
+    // 首先尝试正常加载
+    STBImagePtr imageData = loadImageSTB(encoded, width, height, channels, 0);
+
+    if (!imageData) {
+        // 如果正常加载失败，尝试强制转换为3通道（返回的是文件中的通道数，缓冲区实际为3通道）
+        imageData = loadImageSTB(encoded, width, height, channels, 3);
+
+        if (!imageData) {
+            throw QRACException(ErrorType::ImageLoadError,
+                "无法加载图像文件。请确保文件是有效的PNG、BMP或PPM格式，并且没有被压缩。");
+        }
+        *channels = 3;
+    }
+
+    return imageData;
+}
+
+// 原地校正，大图像按行分段在多个线程上同时校正（threads为0时使用全部硬件线程）
+// 每段至少kCorrectBandBytes字节，小图像在调用线程上完成
+CorrectionReport correctImageParallel(const MutableImageView& image, const CodecContext& ctx, unsigned threads) {
+    constexpr size_t kCorrectBandBytes = 4 * 1024 * 1024;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t bytes = image.rowStride() * image.height;
+    unsigned bands = static_cast<unsigned>(std::min<size_t>({ threads, bytes / kCorrectBandBytes, static_cast<size_t>(image.height) }));
+
+    CorrectionReport total;
+    if (bands <= 1) {
+        correctInPlace(image, ctx, &total);
+        return total;
+    }
+
+    std::vector<CorrectionReport> reports(bands);
+    std::vector<std::thread> workers;
+    workers.reserve(bands - 1);
+    auto band = [&](unsigned index) {
+        int first = static_cast<int>(static_cast<long long>(image.height) * index / bands);
+        int last = static_cast<int>(static_cast<long long>(image.height) * (index + 1) / bands);
+        MutableImageView rows{ image.row(first), image.width, last - first, image.channels, image.rowStride() };
+        correctInPlace(rows, ctx, &reports[index]);
+    };
+    for (unsigned index = 1; index < bands; index++) {
+        workers.emplace_back(band, index);
+    }
+    band(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (const auto& report : reports) {
+        total.totalPixels += report.totalPixels;
+        total.fillerPixels += report.fillerPixels;
+        total.deviatingValues += report.deviatingValues;
+    }
+    return total;
+}
+
+// 校正单个图像（非交互），过程信息写入log
+// 在加载的像素缓冲区上原地校正，输出保持输入格式：PNG输入写PNG（pngCompression），其他格式写BMP
+// threads：单个大图像校正时使用的线程数（批处理模式中每个作业已经占用一个工作线程，传1）
+JobResult correctImageFileJob(const CodecContext& ctx, const std::string& inputImage, std::ostream& log, IoBackend& io,
+    JobStats* stats = nullptr, PngCompression pngCompression = PngCompression::Default, unsigned threads = 1) {
+    JobResult result;
+    result.input = inputImage;
+
+    if (!fileExists(inputImage)) {
+        throw QRACException(ErrorType::FileNotFound, "File does not exist: " + inputImage);
+    }
+
+    // 检查是否是JPG文件
+    std::string ext = toLower(getFileExtension(inputImage));
+    if (ext == "jpg" || ext == "jpeg") {
+        throw QRACException(ErrorType::InvalidInput, "JPG format is not supported for correction. Please use PNG or BMP format.");
+    }
+
+    // Load image using improved loader
+    StageTimer timer(stats, "correct");
+    ByteBuffer encoded = io.readFile(inputImage);
+    timer.lap("read", encoded.size());
+    bool inputIsPng = hasPngSignature(encoded);
+    int width, height, channels;
+    STBImagePtr imageDataPtr = loadImageWithFallback(encoded, &width, &height, &channels);
+
+    if (!imageDataPtr) {
+        throw QRACException(ErrorType::ImageLoadError, "Failed to load image: " + inputImage);
+    }
+    timer.lap("inflate", static_cast<size_t>(width) * height * channels);
+
+    log << "Loaded image: " << width << "x" << height << " pixels, " << channels << " channels\n";
+    result.bytesIn = encoded.size();
+    encoded = ByteBuffer();
+
+    // 校正（直接在stb_image的缓冲区上进行，保持通道数）
+    MutableImageView view{ imageDataPtr.get(), width, height, channels, 0 };
+    CorrectionReport report = correctImageParallel(view, ctx, threads);
+    timer.lap("correct", static_cast<size_t>(width) * height * channels);
+    if (stats) {
+        stats->frames = 1;
+        stats->fillerPixels = report.fillerPixels;
+        stats->deviatingValues = report.deviatingValues;
+    }
+
+    size_t colorChannels = channels >= 3 ? 3 : 1;
+    size_t dataValues = (report.totalPixels - report.fillerPixels) * colorChannels;
+    float incorrectRatio = dataValues > 0 ? static_cast<float>(report.deviatingValues) / dataValues : 0.0f;
+    log << "Detected " << report.deviatingValues << " pixel values deviating from anchors ("
+        << std::fixed << std::setprecision(2) << incorrectRatio * 100 << "%)\n";
+    log << "Found " << report.fillerPixels << " filler pixels (will be set to pure black)\n";
+
+    bool alreadyPure = report.deviatingValues == 0 && report.fillerPixels == 0;
+    if (alreadyPure) {
+        log << "Image is already in anchor-pure state, no correction needed\n";
+    }
+    else {
+        log << "Performing correction...\n";
+    }
+
+    // 保持输入格式（PNG/BMP都是无损的）
+    std::string outputImage = generateOutputFilename(inputImage, "_corrected", inputIsPng ? "png" : "bmp");
+    size_t outputBytes = writeCorrectedImage(view, outputImage, inputIsPng, pngCompression, io, timer);
+
+    if (alreadyPure) {
+        log << "Image saved: " << outputImage << "\n";
+        log << "Image was already pure, no changes made.\n";
+    }
+    else {
+        log << "Corrected image saved: " << outputImage << "\n";
+    }
+
+    result.output = outputImage;
+    result.bytesOut = outputBytes;
+
+    result.success = true;
+    return result;
+}
+
+// Corrector function - 改进版本，正确处理填充值
+void correctImageFile() {
+    std::string inputImage;
+
+    std::cout << "[Correct] Repair damaged QRAC image\n";
+    std::cout << "Enter input image path (PNG, BMP or PPM format): ";
+    std::getline(std::cin, inputImage);
+
+    correctImageFileJob(defaultCodecContext(), inputImage, std::cout, blockingIoBackend(), nullptr, PngCompression::Default, 0);
+
+    std::cout << "Correction complete! Output file is in the same directory as input.\n";
+    std::cout << "The corrected image keeps the input format (PNG or BMP), both are lossless.\n";
+}
+
+// ===================== 校验模式 =====================
+
+// 数据的BLAKE3哈希：按kHashPartBytes分段，多个线程同时计算各段后按哈希树合并（threads为0时使用全部硬件线程）
+PayloadHash hashPayloadParallel(std::span<const uint8_t> data, unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<HashNode> parts(hashPartCount(data.size()));
+    std::atomic<size_t> next{ 0 };
+    auto work = [&] {
+        for (size_t part; (part = next.fetch_add(1, std::memory_order_relaxed)) < parts.size();) {
+            parts[part] = hashPart(data.data(), data.size(), part);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    unsigned count = static_cast<unsigned>(std::min<size_t>(threads, parts.size()));
+    for (unsigned i = 1; i < count; i++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return combineHashParts(parts);
+}
+
+constexpr const char* kNoPayloadHash = "no payload hash recorded (encoded with --check-block off or by an earlier version)";
+constexpr const char* kPayloadHashDamaged = "block checks damaged beyond FEC repair, payload hash unreadable";
+
+// 逐帧校验（多帧PNG、标准输入）的失败原因，全部帧的哈希一致时为空
+std::string streamVerifyFailure(const StreamReport& report) {
+    if (report.hashMismatches > 0) {
+        return "payload hash mismatch in " + std::to_string(report.hashMismatches) + " of "
+            + std::to_string(report.frames) + " frames";
+    }
+    if (report.unhashedFrames > 0) {
+        return "no readable payload hash in " + std::to_string(report.unhashedFrames) + " of "
+            + std::to_string(report.frames) + " frames (damaged, or encoded with --check-block off or by an earlier version)";
+    }
+    return "";
+}
+
+// 校验单个图像（非交互）：在内存中解码，重新计算数据的BLAKE3哈希并与编码时记录的比较，不写出任何文件
+// 哈希一致时result.success为true，output为"blake3:<哈希>"
+// threads：计算哈希的线程数（批处理模式中每个作业已经占用一个工作线程，传1）
+JobResult verifyFileJob(const CodecContext& ctx, const std::string& inputImage, std::ostream& log, IoBackend& io,
+    JobStats* stats = nullptr, unsigned threads = 1) {
+    JobResult result;
+    result.input = inputImage;
+
+    if (!fileExists(inputImage)) {
+        throw QRACException(ErrorType::FileNotFound, "File does not exist: " + inputImage);
+    }
+
+    // 多帧PNG：流水线逐帧解码，每帧按各自记录的哈希校验
+    std::string ext = toLower(getFileExtension(inputImage));
+    if (ext == "png" && isMultiFramePng(inputImage)) {
+        std::FILE* in = openStreamUtf8(inputImage, false);
+        StreamReport report;
+        try {
+            decodeStream(ctx, in, nullptr, &report);
+        }
+        catch (...) {
+            std::fclose(in);
+            throw;
+        }
+        std::fclose(in);
+
+        log << "Verified " << report.frames << " frames: " << report.bytesIn << " bytes -> " << report.bytesOut << " bytes\n";
+        if (report.damagedBlocks > 0) {
+            log << "CRC32C mismatch in " << report.damagedBlocks << " data block(s), only these passed to FEC\n";
+        }
+        logStageTimes(report, log);
+        if (stats) {
+            stats->addStream(report);
+        }
+
+        result.bytesIn = getFileSize(inputImage);
+        result.bytesOut = report.bytesOut;
+        result.dataValid = report.invalidFrames == 0;
+        result.message = streamVerifyFailure(report);
+        result.output = "blake3 per frame";
+        result.success = result.message.empty();
+        return result;
+    }
+
+    StageTimer timer(stats, "verify");
+    ByteBuffer encoded = io.readFile(inputImage);
+    timer.lap("read", encoded.size());
+    int width, height, channels;
+    STBImagePtr imageDataPtr = loadImageSTB(encoded, &width, &height, &channels, 0);
+    if (!imageDataPtr) {
+        throw QRACException(ErrorType::ImageLoadError, "Failed to load image: " + inputImage);
+    }
+    timer.lap("inflate", static_cast<size_t>(width) * height * channels);
+    result.bytesIn = encoded.size();
+    encoded = ByteBuffer();
+
+    DecodeReport report;
+    ByteBuffer data = decode({ imageDataPtr.get(), width, height, channels, 0 }, ctx, &report);
+    timer.split("unpack", report.unpackSeconds, report.extractedBytes);
+    timer.split("fec", report.fecSeconds, data.size());
+    imageDataPtr.reset();
+    timer.restart();
+    PayloadHash hash = hashPayloadParallel(data, threads);
+    timer.lap("hash", data.size());
+    if (stats) {
+        stats->frames = 1;
+        stats->fecCorrectedBytes = report.fec.correctedBytes;
+        stats->fecFailedBlocks = report.fec.failedBlocks;
+        stats->fecErasures = report.fec.erasures;
+        stats->damagedBlocks = report.fec.damagedBlocks.size();
+        stats->fillerPixels = report.fillerPixels;
+        stats->deviatingValues = report.deviatingValues;
+        stats->calibratedFrames = report.levelsCalibrated ? 1 : 0;
+    }
+
+    log << "Loaded image: " << width << "x" << height << " pixels, " << channels << " channels\n";
+    if (report.levelsCalibrated) {
+        log << "Calibrated shifted pixel levels before extracting\n";
+    }
+    logDamagedBlocks(ctx, report.fec, report.payloadBytes, log);
+    if (report.fec.correctedBytes > 0) {
+        log << "Corrected " << report.fec.correctedBytes << " byte errors\n";
+    }
+    log << "Payload: " << data.size() << " bytes, BLAKE3 " << hashToHex(hash) << "\n";
+
+    result.output = "blake3:" + hashToHex(hash);
+    result.bytesOut = data.size();
+    result.dataValid = report.dataValid;
+    if (!report.fec.hasPayloadHash) {
+        result.message = report.fec.checksDamaged ? kPayloadHashDamaged : kNoPayloadHash;
+    }
+    else if (hash != report.fec.payloadHash) {
+        log << "Recorded BLAKE3 " << hashToHex(report.fec.payloadHash) << "\n";
+        result.message = "payload hash mismatch";
+    }
+    result.success = result.message.empty();
+    return result;
+}
+
+// ===================== 批处理模式 =====================
+
+// 批处理操作类型
+enum class BatchOperation {
+    Encode,
+    Decode,
+    Correct,
+    Verify
+};
+
+// 批处理操作的名称（统计记录中使用）
+const char* batchOperationName(BatchOperation operation) {
+    switch (operation) {
+    case BatchOperation::Encode: return "encode";
+    case BatchOperation::Decode: return "decode";
+    case BatchOperation::Correct: return "correct";
+    case BatchOperation::Verify: return "verify";
+    }
+    return "";
+}
+
+// 批处理选项
+struct BatchOptions {
+    BatchOperation operation = BatchOperation::Encode;
+    std::string source;      // 目录路径，或 @列表文件（每行一个文件路径）
+    unsigned threads = 0;    // 0 = 使用全部硬件线程
+    bool recursive = false;  // 目录模式下是否递归子目录
+    bool verbose = false;    // 是否输出每个作业的详细过程
+    EncodeOptions encode;
+    QRACConfig profile;      // 编解码配置，整个批次共享一个CodecContext
+    IoBackendKind io = IoBackendKind::Auto; // 文件读写后端
+    size_t memoryBudget = 0; // 同时进行的作业的估算峰值内存之和上限，0 = 不限制
+    ArenaOptions arena{ true }; // 工作线程的缓冲区arena（跨作业复用大块内存）
+    bool statsJson = false;  // --stats=json：每个作业输出一行JSON统计（标准错误）
+    bool perf = false;       // --perf：各阶段的硬件计数器（已成功启用）
+    PngCompression correctPng = PngCompression::Default; // 校正PNG输入时输出PNG的压缩方式
+    bool dumpCorrected = false; // 解码时另外写出校正后的图像（调试）
+    std::string cacheDir;    // --cache：编码缓存目录，空 = 不使用
+    uint64_t cacheBytes = kDefaultCacheBytes; // --cache-size：缓存大小上限
+};
+
+// 批处理输入项
+struct BatchInput {
+    std::string path;
+    size_t size = 0;
+    std::string conflict; // 输出与另一个输入的输出同名时的说明：不运行，报告为失败
+};
+
+// 将filesystem路径转换为UTF-8字符串（与其他路径函数保持一致）
+std::string pathToUtf8(const fs::path& path) {
+    auto u8 = path.u8string();
+    return std::string(u8.begin(), u8.end());
+}
+
+// 判断文件名是否带有本工具生成的后缀（避免重复处理输出文件）
+bool hasGeneratedSuffix(const std::string& filePath, const std::string& suffix) {
+    std::string filename = getFilenameWithoutPath(filePath);
+    size_t dotPos = filename.find_last_of(".");
+    std::string stem = (dotPos != std::string::npos) ? filename.substr(0, dotPos) : filename;
+    return stem.size() >= suffix.size() &&
+        stem.compare(stem.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// 判断文件是否适合当前批处理操作
+bool isBatchCandidate(const std::string& filePath, BatchOperation operation) {
+    std::string ext = toLower(getFileExtension(filePath));
+    if (operation == BatchOperation::Encode) {
+        // 追加编码的状态记录和增量编码的临时文件也是生成的文件
+        return !hasGeneratedSuffix(filePath, "_encoded") && ext != "qrstate" && ext != "partial";
+    }
+
+    if (ext != "png" && ext != "bmp" && ext != "ppm" && ext != "pgm") {
+        return false;
+    }
+    if (operation == BatchOperation::Correct) {
+        return !hasGeneratedSuffix(filePath, "_corrected");
+    }
+    return true;
+}
+
+// 批处理作业的输出文件名；解码和校正的扩展名取决于数据，只到"."为止；校验没有输出
+std::string batchOutputName(const std::string& path, const BatchOptions& options) {
+    switch (options.operation) {
+    case BatchOperation::Encode: return generateOutputFilename(path, "_encoded", options.encode.format);
+    case BatchOperation::Decode: return generateOutputFilename(path, "_decoded", "");
+    case BatchOperation::Correct: return generateOutputFilename(path, "_corrected", "");
+    case BatchOperation::Verify: return "";
+    }
+    return "";
+}
+
+// 比较输出文件名时用的键（Windows的文件名不区分大小写）
+std::string outputNameKey(const std::string& name) {
+#ifdef _WIN32
+    std::string key = name;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return key;
+#else
+    return name;
+#endif
+}
+
+// 收集批处理输入文件
+std::vector<BatchInput> collectBatchInputs(const BatchOptions& options) {
+    std::vector<std::string> paths;
+
+    if (!options.source.empty() && options.source[0] == '@') {
+        // 列表文件：每行一个路径，忽略空行和#注释
+        std::string listFile = options.source.substr(1);
+        std::ifstream list(utf8ToPath(listFile));
+        if (!list.is_open()) {
+            throw QRACException(ErrorType::FileNotFound, "Cannot open file list: " + listFile);
+        }
+        std::string line;
+        while (std::getline(list, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            paths.push_back(line);
+        }
+    }
+    else {
+        fs::path dir = utf8ToPath(options.source);
+        std::error_code ec;
+        if (!fs::is_directory(dir, ec)) {
+            throw QRACException(ErrorType::FileNotFound, "Directory does not exist: " + options.source);
+        }
+
+        auto addEntry = [&](const fs::directory_entry& entry) {
+            if (entry.is_regular_file(ec)) {
+                std::string path = pathToUtf8(entry.path());
+                if (isBatchCandidate(path, options.operation)) {
+                    paths.push_back(path);
+                }
+            }
+        };
+
+        if (options.recursive) {
+            // 缓存目录位于输入目录之下时跳过，不把缓存的图像当作输入
+            fs::path cacheDir = options.cacheDir.empty() ? fs::path() : utf8ToPath(options.cacheDir);
+            for (fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), end; it != end; it.increment(ec)) {
+                std::error_code cacheError;
+                if (!cacheDir.empty() && it->is_directory(cacheError) && fs::equivalent(it->path(), cacheDir, cacheError)) {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                addEntry(*it);
+            }
+        }
+        else {
+            for (const auto& entry : fs::directory_iterator(dir, fs::directory_options::skip_permission_denied, ec)) {
+                addEntry(entry);
+            }
+        }
+    }
+
+    // 输出文件名去掉了输入的扩展名（a.txt和a.bin都编码为a_encoded.png）：按路径顺序，同名输出只保留第一个输入，
+    // 其余的不运行（否则同时写同一个文件，先完成的结果被覆盖）
+    std::sort(paths.begin(), paths.end());
+    std::unordered_map<std::string, std::string> outputOwners;
+    std::vector<BatchInput> inputs;
+    inputs.reserve(paths.size());
+    for (const std::string& path : paths) {
+        std::error_code ec;
+        uintmax_t size = fs::file_size(utf8ToPath(path), ec);
+        BatchInput input{ path, ec ? 0 : static_cast<size_t>(size), {} };
+        std::string output = batchOutputName(path, options);
+        if (!output.empty()) {
+            auto [owner, added] = outputOwners.emplace(outputNameKey(output), path);
+            if (!added) {
+                input.conflict = "Output " + output + (output.back() == '.' ? "*" : "") + " is also the output of " +
+                    owner->second + "; skipped, rename one of the inputs";
+            }
+        }
+        inputs.push_back(std::move(input));
+    }
+
+    // 大文件优先提交，配合工作窃取避免长尾
+    std::stable_sort(inputs.begin(), inputs.end(),
+        [](const BatchInput& a, const BatchInput& b) { return a.size > b.size; });
+
+    return inputs;
+}
+
+// 作业的内存计划（设置了内存预算时据此准入）
+struct JobPlan {
+    size_t memory = 0;      // 估算的峰值内存
+    size_t streamChunk = 0; // 编码：PNG输出时超过此大小按块流式编码
+    std::string note;       // 为满足预算所做的调整（写入作业日志）
+};
+
+// 读取图像文件头中的尺寸和通道数（不解码像素，多帧PNG为第一帧）
+bool readImageInfo(const std::string& path, int* width, int* height, int* channels) {
+    std::FILE* file = openStreamUtf8(path, false);
+    int ok = stbi_info_from_file(file, width, height, channels);
+    std::fclose(file);
+    return ok != 0;
+}
+
+// 估算作业的峰值内存；超出预算的PNG编码改为按更小的块流式编码，其他作业单独运行
+JobPlan planBatchJob(const CodecContext& ctx, const BatchInput& input, const BatchOptions& options) {
+    JobPlan plan;
+    plan.streamChunk = options.encode.streamChunkBytes;
+    size_t budget = options.memoryBudget;
+    if (budget == 0) {
+        return plan;
+    }
+
+    if (options.operation == BatchOperation::Encode) {
+        bool png = options.encode.format == "png";
+        SizeMode mode = options.encode.adaptive ? SizeMode::Adaptive : SizeMode::Auto;
+        plan.memory = png && input.size > plan.streamChunk
+            ? estimateStreamEncodeMemory(ctx, input.size, plan.streamChunk)
+            : estimateEncodeMemory(ctx, input.size, mode);
+        if (png && plan.memory > budget) {
+            size_t chunk = std::min(plan.streamChunk, streamChunkForBudget(ctx, budget));
+            if (input.size > chunk) {
+                plan.streamChunk = chunk;
+                plan.memory = estimateStreamEncodeMemory(ctx, input.size, chunk);
+                plan.note = "streaming in " + formatBytes(static_cast<double>(chunk)) + " chunks to fit the memory budget";
+            }
+        }
+    }
+    else {
+        int width = 0, height = 0, channels = 0;
+        try {
+            if (readImageInfo(input.path, &width, &height, &channels)) {
+                if (options.operation == BatchOperation::Correct) {
+                    plan.memory = estimateCorrectMemory(input.size, width, height, channels);
+                }
+                else if (toLower(getFileExtension(input.path)) == "png" && isMultiFramePng(input.path)) {
+                    plan.memory = estimateStreamDecodeMemory(input.size, width, height);
+                }
+                else {
+                    plan.memory = estimateDecodeMemory(ctx, input.size, width, height, channels);
+                }
+            }
+        }
+        catch (const QRACException&) {
+            // 无法读取的文件由作业本身报告错误
+        }
+    }
+
+    if (plan.memory > budget && plan.note.empty()) {
+        plan.note = "estimated peak exceeds the memory budget, running alone";
+    }
+    return plan;
+}
+
+// 执行单个批处理作业，异常转换为失败结果
+JobResult runBatchJob(const CodecContext& ctx, const BatchInput& input, const BatchOptions& options, const JobPlan& plan, IoBackend& io) {
+    std::ostringstream jobLog;
+    JobResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    if (options.memoryBudget != 0) {
+        jobLog << "Estimated peak memory: " << formatBytes(static_cast<double>(plan.memory));
+        jobLog << (plan.note.empty() ? "" : " (" + plan.note + ")") << "\n";
+    }
+    ArenaStats arenaBefore = threadArenaStats();
+    TraceSpan span("job", batchOperationName(options.operation), -1, input.path);
+    JobStats jobStats;
+    JobStats* stats = options.statsJson || options.perf ? &jobStats : nullptr;
+
+    try {
+        switch (options.operation) {
+        case BatchOperation::Encode: {
+            EncodeOptions encode = options.encode;
+            encode.streamChunkBytes = plan.streamChunk;
+            result = encodeFileJob(ctx, input.path, encode, jobLog, io, stats);
+            break;
+        }
+        case BatchOperation::Decode:
+            result = decodeFileJob(ctx, input.path, false, jobLog, io, stats, options.dumpCorrected);
+            break;
+        case BatchOperation::Correct:
+            result = correctImageFileJob(ctx, input.path, jobLog, io, stats, options.correctPng);
+            break;
+        case BatchOperation::Verify:
+            result = verifyFileJob(ctx, input.path, jobLog, io, stats);
+            break;
+        }
+        if (!result.dataValid && result.message.empty()) {
+            result.message = "uncorrectable FEC errors";
+        }
+    }
+    catch (const std::exception& e) {
+        result.input = input.path;
+        result.bytesIn = input.size;
+        result.success = false;
+        result.message = e.what();
+    }
+    io.discard(input.path); // 作业提前失败时释放未使用的预读数据
+
+    // 作业本身同步运行在一个线程上，线程arena计数的差值就是本作业的分配
+    if (options.arena.enabled) {
+        ArenaStats arenaAfter = threadArenaStats();
+        jobLog << "Buffers: " << (arenaAfter.allocations - arenaBefore.allocations) << " allocations, "
+            << (arenaAfter.reused - arenaBefore.reused) << " reused, "
+            << (arenaAfter.systemAllocations - arenaBefore.systemAllocations) << " new\n";
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.stats = std::move(jobStats);
+    if (options.verbose) {
+        result.message += (result.message.empty() ? "" : "\n") + jobLog.str();
+    }
+    return result;
+}
+
+// 批处理作业协程：等待内存预算、并发名额和输入数据时挂起（不占用线程），就绪后在线程池上编解码
+Task<> batchJob(const CodecContext& ctx, const BatchInput& input, const BatchOptions& options, IoBackend& io,
+    WorkStealingPool& pool, MemoryGovernor<WorkStealingPool>& memory, AsyncSemaphore<WorkStealingPool>& slots, JobResult& result) {
+    if (!input.conflict.empty()) {
+        result.input = input.path;
+        result.message = input.conflict;
+        co_return;
+    }
+
+    // 先占用并发名额再按估算内存准入，预算只计入即将读入数据的作业
+    co_await slots.acquire();
+    JobPlan plan = planBatchJob(ctx, input, options);
+    size_t admitted = co_await memory.admit(plan.memory);
+    // 超过一帧的大文件走流式路径，不整体读入
+    if (input.size <= plan.streamChunk) {
+        co_await awaitCallback(pool, [&](std::function<void()> ready) { io.prefetch(input.path, std::move(ready)); });
+    }
+    result = runBatchJob(ctx, input, options, plan, io);
+    slots.release();
+    memory.release(admitted);
+}
+
+// 运行批处理，返回失败的文件数
+int runBatch(const BatchOptions& options) {
+    const CodecContext ctx(options.profile);
+    std::vector<BatchInput> inputs = collectBatchInputs(options);
+    if (inputs.empty()) {
+        std::cout << "No input files found in " << options.source << "\n";
+        return 0;
+    }
+
+    size_t totalBytes = 0;
+    for (const BatchInput& input : inputs) {
+        totalBytes += input.size;
+    }
+
+    // 设置了内存预算时，arena保留的空闲缓冲区也受限（不超过预算的1/4）
+    ArenaOptions arena = options.arena;
+    if (options.memoryBudget != 0) {
+        arena.retainBytes = std::min(arena.retainBytes, options.memoryBudget / 4);
+    }
+    configureArenas(arena);
+
+    // 编码缓存（--cache）：作业通过EncodeOptions取得，写出完成后统一加入缓存
+    std::unique_ptr<EncodeCache> cache;
+    BatchOptions jobOptions = options;
+    if (options.operation == BatchOperation::Encode && !options.cacheDir.empty()) {
+        cache = std::make_unique<EncodeCache>(options.cacheDir, options.cacheBytes);
+        jobOptions.encode.cache = cache.get();
+    }
+
+    std::unique_ptr<IoBackend> io = createIoBackend(options.io);
+    WorkStealingPool pool(options.threads);
+    std::cout << "Batch: " << inputs.size() << " files, " << formatBytes(static_cast<double>(totalBytes))
+        << ", " << pool.size() << " worker threads, " << io->name() << " I/O";
+    if (options.memoryBudget != 0) {
+        std::cout << ", memory budget " << formatBytes(static_cast<double>(options.memoryBudget));
+    }
+    std::cout << "\n";
+
+
+    std::vector<JobResult> results(inputs.size());
+    std::mutex reportMutex;
+    size_t completed = 0;
+    auto batchStart = std::chrono::steady_clock::now();
+
+    // 所有文件同时作为协程提交，同时进行的作业数（即同时读入内存的输入）由信号量限制为线程数的2倍：
+    // 等待输入的作业挂起，线程继续处理已就绪的作业，读盘与编解码重叠
+    // 设置了--mem-budget时，同时进行的作业的估算峰值内存之和不超过预算
+    AsyncSemaphore<WorkStealingPool> slots(pool, pool.size() * 2);
+    MemoryGovernor<WorkStealingPool> memory(pool, options.memoryBudget != 0 ? options.memoryBudget : SIZE_MAX);
+    std::latch finished(static_cast<std::ptrdiff_t>(inputs.size()));
+
+    for (size_t i = 0; i < inputs.size(); i++) {
+        DetachedTask job = detach(batchJob(ctx, inputs[i], jobOptions, *io, pool, memory, slots, results[i]), [&, i] {
+            const JobResult& result = results[i];
+
+            // 逐文件报告（完成顺序）
+            std::lock_guard<std::mutex> lock(reportMutex);
+            completed++;
+            std::cout << "[" << completed << "/" << inputs.size() << "] "
+                << (result.success ? (result.dataValid ? "OK    " : "WARN  ") : "FAILED") << " "
+                << result.input;
+            if (result.success) {
+                std::cout << " -> " << result.output << " ("
+                    << formatBytes(static_cast<double>(result.bytesIn)) << " -> "
+                    << formatBytes(static_cast<double>(result.bytesOut)) << ", "
+                    << std::fixed << std::setprecision(1) << result.seconds * 1000.0 << " ms)";
+            }
+            std::cout << "\n";
+            if (!result.message.empty()) {
+                std::cout << "    " << result.message << "\n";
+            }
+            if (options.statsJson) {
+                writeJobStatsRecord(batchOperationName(options.operation), result);
+            }
+            finished.count_down();
+        });
+        post(pool, job.handle);
+    }
+    finished.wait();
+    pool.wait();
+
+    // 等待异步写完成，写入失败的文件计为失败
+    for (const IoError& error : io->flush()) {
+        std::cout << "FAILED " << error.path << "\n    " << error.message << "\n";
+        for (JobResult& result : results) {
+            if (result.success && result.output == error.path) {
+                result.success = false;
+                result.message = error.message;
+            }
+        }
+    }
+    if (cache) {
+        for (const JobResult& result : results) {
+            if (result.success && !result.cacheKey.empty()) {
+                cache->store(result.cacheKey, options.encode.format, result.output);
+            }
+        }
+        cache->trim();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+
+    // 汇总吞吐量
+    size_t succeeded = 0, warnings = 0, failed = 0;
+    size_t bytesIn = 0, bytesOut = 0;
+    double cpuSeconds = 0.0;
+    for (const JobResult& result : results) {
+        if (!result.success) {
+            failed++;
+            continue;
+        }
+        succeeded++;
+        if (!result.dataValid) warnings++;
+        bytesIn += result.bytesIn;
+        bytesOut += result.bytesOut;
+        cpuSeconds += result.seconds;
+    }
 
-    // Check if image is large enough
-    int symbolsPerPixel = g_config.SYMBOLS_PER_PIXEL;
-    int totalPixels = width * height;
-    int requiredPixels = (static_cast<int>(symbols.size()) + symbolsPerPixel - 1) / symbolsPerPixel;
+    double mbPerSecond = elapsed > 0.0 ? bytesIn / (1024.0 * 1024.0) / elapsed : 0.0;
+    std::cout << "\n=== Batch Summary ===\n";
+    std::cout << "Files: " << succeeded << " succeeded (" << warnings << " with FEC warnings), "
+        << failed << " failed\n";
+    std::cout << "Input: " << formatBytes(static_cast<double>(bytesIn))
+        << ", Output: " << formatBytes(static_cast<double>(bytesOut)) << "\n";
+    std::cout << std::fixed << std::setprecision(3)
+        << "Wall time: " << elapsed << " s, job time: " << cpuSeconds << " s"
+        << " (parallel speedup " << std::setprecision(2) << (elapsed > 0.0 ? cpuSeconds / elapsed : 0.0) << "x)\n";
+    std::cout << "Throughput: " << std::setprecision(2) << mbPerSecond << " MB/s, "
+        << (elapsed > 0.0 ? succeeded / elapsed : 0.0) << " files/s, "
+        << pool.stealCount() << " steals\n";
+    if (cache) {
+        EncodeCacheStats stats = cache->stats();
+        std::cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.stored << " stored, "
+            << stats.evicted << " evicted (" << formatBytes(static_cast<double>(stats.evictedBytes)) << "), "
+            << formatBytes(static_cast<double>(stats.sizeBytes)) << " of "
+            << formatBytes(static_cast<double>(options.cacheBytes)) << " used\n";
+    }
+    if (options.memoryBudget != 0) {
+        std::cout << "Memory: peak estimated " << formatBytes(static_cast<double>(memory.peak()))
+            << " of " << formatBytes(static_cast<double>(options.memoryBudget)) << " budget\n";
+    }
+    if (arena.enabled) {
+        ArenaStats stats = arenaStats();
+        std::cout << "Buffers: " << stats.allocations << " allocations, " << stats.reused << " reused, "
+            << stats.systemAllocations << " new, " << formatBytes(static_cast<double>(stats.retainedBytes)) << " retained";
+        if (arena.hugePages) {
+            std::cout << ", " << formatBytes(static_cast<double>(stats.hugePageBytes)) << " in huge pages";
+        }
+        std::cout << "\n";
+    }
 
-    if (requiredPixels > totalPixels) {
-        std::cout << "Warning: Image dimensions (" << width << "x" << height << ") may be too small for "
-            << symbols.size() << " symbols\n";
-        std::cout << "Required pixels: " << requiredPixels << ", Available pixels: " << totalPixels << "\n";
-        std::cout << "Consider using a larger mode or adaptive mode\n";
+    // 统计汇总记录：所有作业各阶段耗时和计数的合计
+    JobStats total;
+    if (options.statsJson || options.perf) {
+        for (const JobResult& result : results) {
+            total.merge(result.stats);
+        }
+    }
+    if (options.perf) {
+        logStageCounters(total, std::cout);
+    }
+    if (options.statsJson) {
+        std::ostringstream line;
+        line << "{\"type\":\"batch\",\"operation\":\"" << batchOperationName(options.operation) << "\""
+            << ",\"files\":" << results.size() << ",\"succeeded\":" << succeeded << ",\"failed\":" << failed
+            << ",\"bytes_in\":" << bytesIn << ",\"bytes_out\":" << bytesOut
+            << ",\"wall_seconds\":" << std::fixed << std::setprecision(6) << elapsed
+            << ",\"job_seconds\":" << cpuSeconds << ",";
+        if (cache) {
+            EncodeCacheStats stats = cache->stats();
+            line << "\"cache_hits\":" << stats.hits << ",\"cache_misses\":" << stats.misses
+                << ",\"cache_evicted\":" << stats.evicted << ",";
+        }
+        writeStatsJson(line, total);
+        line << "}\n";
+        std::cerr << line.str() << std::flush;
     }
 
-    // Create QRAC image
-    std::vector<uint8_t> imageData = createQRACImage(symbols, width, height, useFEC);
-    std::cout << "Generated image data: " << imageData.size() << " bytes\n";
+    return static_cast<int>(failed);
+}
 
-    // Generate output filename
-    std::string outputImage = generateOutputFilename(inputFile, "_encoded", outputFormat);
+// ===================== 命令行模式 =====================
 
-    // 对图像进行无损压缩（如果是PNG格式）
-    if (outputFormat == "png") {
-        size_t maxSizeKB = static_cast<size_t>(fileSize * 1.5 / 1024); // 原始文件1.5倍
-        std::cout << "Applying auto lossless compression to image (max " << maxSizeKB << "KB)...\n";
-        std::vector<uint8_t> compressedData = compressImageAuto(imageData, width, height, 3, maxSizeKB);
-        std::cout << "Compressed image data: " << compressedData.size() << " bytes\n";
-        if (compressedData.size() > maxSizeKB * 1024) {
-            std::cout << "Warning: PNG file still exceeds " << maxSizeKB << "KB after compression. Data may be hard to compress.\n";
-        }
-#ifdef _WIN32
-        std::wstring wideOutput = utf8ToWstring(outputImage);
-        std::ofstream outFile(wideOutput, std::ios::binary);
-#else
-        std::ofstream outFile(outputImage, std::ios::binary);
-#endif
-        outFile.write(reinterpret_cast<const char*>(compressedData.data()), compressedData.size());
-        outFile.close();
-    }
-    else {
-        // BMP保存逻辑
+// 获取UTF-8编码的命令行参数（Windows下argv为ANSI代码页）
+std::vector<std::string> getUtf8Arguments(int argc, char* argv[]) {
+    std::vector<std::string> args;
 #ifdef _WIN32
-        std::wstring wideOutput = utf8ToWstring(outputImage);
-        // 使用宽字符版本的文件保存
-        if (!saveImage(outputImage, imageData.data(), width, height, 3, outputFormat)) {
-            throw QRACException(ErrorType::ImageSaveError, "Failed to save output image");
-        }
-#else
-        if (!saveImage(outputImage, imageData.data(), width, height, 3, outputFormat)) {
-            throw QRACException(ErrorType::ImageSaveError, "Failed to save output image");
+    int wideArgc = 0;
+    LPWSTR* wideArgv = CommandLineToArgvW(GetCommandLineW(), &wideArgc);
+    if (wideArgv) {
+        for (int i = 0; i < wideArgc; i++) {
+            int len = WideCharToMultiByte(CP_UTF8, 0, wideArgv[i], -1, nullptr, 0, nullptr, nullptr);
+            std::string arg(len > 0 ? len - 1 : 0, '\0');
+            if (len > 1) {
+                WideCharToMultiByte(CP_UTF8, 0, wideArgv[i], -1, &arg[0], len, nullptr, nullptr);
+            }
+            args.push_back(arg);
         }
+        LocalFree(wideArgv);
+        return args;
+    }
 #endif
+    for (int i = 0; i < argc; i++) {
+        args.push_back(argv[i]);
     }
-
-    std::cout << "QRAC image saved: " << outputImage << "\n";
-    std::cout << "Encoding complete! Output file is in the same directory as input.\n";
-    std::cout << outputFormat << " format ensures lossless storage of your data.\n";
+    return args;
 }
 
-// Decoder function
-void decodeFile() {
-    std::string inputImage;
-
-    std::cout << "[Decode] Extract file from QRAC image\n";
-    std::cout << "Enter input image path (PNG, BMP or PPM format): ";
-    std::getline(std::cin, inputImage);
+// 显示命令行用法
+void showUsage() {
+    std::cout << "Usage:\n";
+    std::cout << "  QRAC                                   Interactive menu\n";
+    std::cout << "  QRAC batch <encode|decode|correct|verify> <directory|@filelist> [options]\n";
+    std::cout << "  QRAC encode <file|-> [-o <file|->] [--adaptive] [--bmp] [--delta|--append] [--cache DIR [--cache-size N]] [--stats=json] [--trace FILE] [--perf] [--L N] [--fec-ratio R] [--fec xor|rs] [--check-block N]\n";
+    std::cout << "  QRAC decode <file|-> [-o <file|->] [--dump-corrected] [--stats=json] [--trace FILE] [--perf] [--L N] [--fec-ratio R] [--fec xor|rs] [--check-block N] [--calibrate on|off]\n";
+    std::cout << "  QRAC verify <file|-> [--threads N] [--stats=json] [--trace FILE] [--perf] [--L N] [--fec-ratio R] [--fec xor|rs] [--check-block N] [--calibrate on|off]\n";
+    std::cout << "  QRAC archive create <directory> [-o FILE] [--L N] [--fec-ratio R] [--fec xor|rs] [--check-block N]\n";
+    std::cout << "  QRAC archive list <archive> [profile options]\n";
+    std::cout << "  QRAC archive extract <archive> [member...] [-C DIR] [profile options]\n";
+    std::cout << "  QRAC serve <socket-path> [--threads N] [--verbose] [--L N] [--fec-ratio R] [--fec xor|rs] [--check-block N]\n";
+    std::cout << "\n";
+    std::cout << "Batch options:\n";
+    std::cout << "  --threads N     Worker threads (default: all hardware threads)\n";
+    std::cout << "  --recursive     Include subdirectories\n";
+    std::cout << "  --adaptive      Encode with adaptive image size (default: auto mode)\n";
+    std::cout << "  --bmp           Encode to 24-bit BMP instead of PNG\n";
+    std::cout << "  --delta         Encode: update the existing output of a multi-frame (large) file, re-encoding only\n";
+    std::cout << "                  the frames whose content changed and copying the others from the old image\n";
+    std::cout << "  --append        Encode files that only grow (logs): keep the frames of the last run and encode\n";
+    std::cout << "                  only the new data, tracked in <image>.qrstate next to the output\n";
+    std::cout << "  --cache DIR     Encode: reuse the image cached for the same content and settings (hard link,\n";
+    std::cout << "                  copy across file systems); new images are added to the cache\n";
+    std::cout << "  --cache-size N  Encode cache limit, least recently used images are evicted (default: 4G)\n";
+    std::cout << "  --verbose       Print the full log of every job\n";
+    std::cout << "  --png-store     Correct: write PNG output uncompressed (much faster, larger files)\n";
+    std::cout << "  --dump-corrected\n";
+    std::cout << "                  Decode: also write the anchor-snapped image (debugging; damaged images decode directly)\n";
+    std::cout << "  --io BACKEND    File I/O: auto (default, io_uring on Linux when available), uring, blocking\n";
+    std::cout << "  --arena MODE    Reuse large buffers across jobs: on (default), off, huge (transparent huge pages)\n";
+    std::cout << "  --mem-budget N  Limit the estimated peak memory of concurrent jobs, e.g. 512M or 2G\n";
+    std::cout << "                  (oversized PNG encodes stream in smaller chunks, others run alone)\n";
+    std::cout << "  --stats=json    Write per-stage timings and counters of every job to stderr as JSON lines\n";
+    std::cout << "  --trace FILE    Record stage spans on every thread, written as Chrome/Perfetto trace JSON\n";
+    std::cout << "  --perf          Count cycles, instructions, LLC and branch misses per stage (Linux perf events)\n";
+    std::cout << "  --L N           Quantization interval length (default: 5, must match for decode)\n";
+    std::cout << "  --fec-ratio R   FEC redundancy ratio (default: 0.25, must match for decode)\n";
+    std::cout << "  --fec SCHEME    xor (default) or rs: interleaved Reed-Solomon that treats low-confidence\n";
+    std::cout << "                  bytes as erasures, so a lower --fec-ratio recovers as much (must match for decode)\n";
+    std::cout << "  --calibrate on|off  Decode: fit the pixel level peaks first so brightness, contrast or gamma\n";
+    std::cout << "                  shifted images still decode (default: on)\n";
+    std::cout << "  --check-block N CRC32C block size, e.g. 4K (default); blocks that pass skip FEC decoding.\n";
+    std::cout << "                  'off' writes the format without block checks; images without the check trailer\n";
+    std::cout << "                  (earlier versions) are detected and decoded without them\n";
+    std::cout << "\n";
+    std::cout << "A file list contains one path per line; empty lines and lines starting with # are ignored.\n";
+    std::cout << "\n";
+    std::cout << "'-' reads stdin / writes stdout. Streams are encoded as a sequence of PNG frames\n";
+    std::cout << "(one per 4 MB of input, adaptive size) and decoded frame by frame with bounded memory.\n";
+    std::cout << "Without -o, a file input is encoded/decoded to a generated file name next to it.\n";
+    std::cout << "Verify decodes in memory and compares the BLAKE3 hash recorded at encode time, writing nothing;\n";
+    std::cout << "it exits with 0 when every payload matches (batch verify checks whole directories).\n";
+    std::cout << "Archive mode packs the files of a directory (recursively) into one image with an index of\n";
+    std::cout << "path, offset, length and BLAKE3 hash; list and extract decode only the frames they need.\n";
+    std::cout << "Serve mode listens on a Unix domain socket; the frame format is described in qrac_serve.h.\n";
+}
 
-    if (!fileExists(inputImage)) {
-        throw QRACException(ErrorType::FileNotFound, "File does not exist: " + inputImage);
+// 解析编解码配置选项（--L、--fec-ratio、--fec、--calibrate、--check-block），已处理时返回true
+bool parseProfileOption(const std::vector<std::string>& args, size_t& i, QRACConfig& profile) {
+    const std::string& arg = args[i];
+    if (arg == "--L" && i + 1 < args.size()) {
+        profile.L = std::atoi(args[++i].c_str());
+        return true;
     }
-
-    // 检查是否是JPG文件
-    std::string ext = toLower(getFileExtension(inputImage));
-    if (ext == "jpg" || ext == "jpeg") {
-        if (isJPGFile(inputImage)) {
-            showJPGWarning();
+    if (arg == "--fec-ratio" && i + 1 < args.size()) {
+        profile.FEC_REDUNDANCY_RATIO = static_cast<float>(std::atof(args[++i].c_str()));
+        return true;
+    }
+    if (arg == "--fec" && i + 1 < args.size() && (args[i + 1] == "xor" || args[i + 1] == "rs")) {
+        profile.USE_ADVANCED_FEC = args[++i] == "rs";
+        return true;
+    }
+    if (arg == "--calibrate" && i + 1 < args.size() && (args[i + 1] == "on" || args[i + 1] == "off")) {
+        profile.CALIBRATE_LEVELS = args[++i] == "on";
+        return true;
+    }
+    if (arg == "--check-block" && i + 1 < args.size()) {
+        size_t blockSize = 0;
+        if (args[i + 1] == "off" || parseByteSize(args[i + 1], blockSize)) {
+            profile.CHECK_BLOCK_SIZE = blockSize;
+            i++;
+            return true;
         }
-        std::cout << "JPG decoding is experimental and may not work correctly.\n";
     }
+    return false;
+}
 
-    // Load image using stb_image
-    int width, height, channels;
-    STBImagePtr imageDataPtr = loadImageSTB(inputImage, &width, &height, &channels, 0);
+// 是否为--stats选项（--stats=json 或 --stats json）
+bool isStatsOption(const std::vector<std::string>& args, size_t i) {
+    return args[i].rfind("--stats=", 0) == 0 || (args[i] == "--stats" && i + 1 < args.size());
+}
 
-    if (!imageDataPtr) {
-        throw QRACException(ErrorType::ImageLoadError, "Failed to load image: " + inputImage);
+// 解析--stats选项，目前只支持json格式
+bool parseStatsOption(const std::vector<std::string>& args, size_t& i, bool& statsJson) {
+    std::string format = args[i] == "--stats" ? args[++i] : args[i].substr(8);
+    if (format != "json") {
+        std::cerr << "Unknown stats format: " << format << " (expected json)\n";
+        return false;
     }
+    statsJson = true;
+    return true;
+}
 
-    unsigned char* imageData = imageDataPtr.get();
+// 解析并执行encode/decode命令：涉及"-"或指定-o时走流式路径，否则与交互模式相同
+int runCodecCommand(const std::vector<std::string>& args) {
+    bool encoding = args[1] == "encode";
+    if (args.size() < 3) {
+        showUsage();
+        return 1;
+    }
 
-    // 确保至少有3个通道
-    if (channels < 3) {
-        // 如果图像通道少于3个，转换为3通道
-        std::unique_ptr<unsigned char[]> newData(new unsigned char[width * height * 3]);
-        for (int i = 0; i < width * height; i++) {
-            unsigned char pixelValue = (channels == 1) ? imageData[i] : imageData[i * channels];
-            newData[i * 3] = pixelValue;
-            newData[i * 3 + 1] = pixelValue;
-            newData[i * 3 + 2] = pixelValue;
+    std::string input = args[2];
+    std::string output;
+    EncodeOptions encodeOptions;
+    QRACConfig profile;
+    bool statsJson = false;
+    bool perf = false;
+    bool dumpCorrected = false;
+    std::string tracePath;
+    std::string cacheDir;
+    uint64_t cacheBytes = kDefaultCacheBytes;
+    for (size_t i = 3; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        if ((arg == "-o" || arg == "--output") && i + 1 < args.size()) {
+            output = args[++i];
+        }
+        else if (encoding && arg == "--adaptive") {
+            encodeOptions.adaptive = true;
+        }
+        else if (encoding && arg == "--bmp") {
+            encodeOptions.format = "bmp";
+        }
+        else if (encoding && arg == "--delta") {
+            encodeOptions.delta = true;
+        }
+        else if (encoding && arg == "--append") {
+            encodeOptions.append = true;
+        }
+        else if (encoding && arg == "--cache" && i + 1 < args.size()) {
+            cacheDir = args[++i];
+        }
+        else if (encoding && arg == "--cache-size" && i + 1 < args.size()) {
+            size_t bytes = 0;
+            if (!parseByteSize(args[++i], bytes) || bytes == 0) {
+                std::cerr << "Invalid cache size: " << args[i] << " (e.g. 512M, 4G)\n";
+                return 1;
+            }
+            cacheBytes = bytes;
+        }
+        else if (!encoding && arg == "--dump-corrected") {
+            dumpCorrected = true;
+        }
+        else if (isStatsOption(args, i)) {
+            if (!parseStatsOption(args, i, statsJson)) {
+                return 1;
+            }
+        }
+        else if (arg == "--trace" && i + 1 < args.size()) {
+            tracePath = args[++i];
+        }
+        else if (arg == "--perf") {
+            perf = true;
+        }
+        else if (!parseProfileOption(args, i, profile)) {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
         }
-        imageDataPtr.reset(newData.release());
-        imageData = imageDataPtr.get();
-        channels = 3;
     }
 
-    std::cout << "Loaded image: " << width << "x" << height << " pixels, " << channels << " channels\n";
-
-    // Calculate total symbols
-    int totalPixels = width * height;
-    int symbolsPerPixel = g_config.SYMBOLS_PER_PIXEL;
-    int totalSymbols = totalPixels * symbolsPerPixel;
-
-    std::cout << "Storable symbols: " << totalSymbols << "\n";
+    TraceSession trace(tracePath);
+    if (perf) {
+        perf = startPerfCounters();
+    }
+    try {
+        CodecContext ctx(profile);
 
-    // Calculate bits per symbol
-    int intervals = calculateIntervals();
-    int bitsPerSymbol = static_cast<int>(std::log2(intervals));
-    std::cout << "Number of intervals: " << intervals << " (L=" << g_config.L << ")\n";
-    std::cout << "Bits per symbol: " << bitsPerSymbol << "\n";
+        const char* operation = encoding ? "encode" : "decode";
+        if (encodeOptions.append && (input == "-" || !output.empty() || encodeOptions.format != "png" ||
+            encodeOptions.delta || !cacheDir.empty())) {
+            std::cerr << "--append needs a file input without -o, and cannot be combined with --bmp, --delta or --cache\n";
+            return 1;
+        }
+        if (input != "-" && output.empty()) {
+            std::unique_ptr<EncodeCache> cache;
+            if (!cacheDir.empty()) {
+                cache = std::make_unique<EncodeCache>(cacheDir, cacheBytes);
+                encodeOptions.cache = cache.get();
+            }
+            JobStats stats;
+            auto start = std::chrono::steady_clock::now();
+            JobStats* statsOut = statsJson || perf ? &stats : nullptr;
+            JobResult result = encoding
+                ? encodeFileJob(ctx, input, encodeOptions, std::cout, blockingIoBackend(), statsOut)
+                : decodeFileJob(ctx, input, false, std::cout, blockingIoBackend(), statsOut, dumpCorrected);
+            if (cache) {
+                // 同步后端：输出已经写完
+                if (!result.cacheKey.empty()) {
+                    cache->store(result.cacheKey, encodeOptions.format, result.output);
+                }
+                cache->trim();
+            }
+            if (perf && result.success) {
+                logStageCounters(stats, std::cout);
+            }
+            if (statsJson) {
+                result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                result.stats = std::move(stats);
+                writeJobStatsRecord(operation, result);
+            }
+            if (!result.success) {
+                std::cerr << "Error: " << result.message << "\n";
+                return 1;
+            }
+            return result.dataValid ? 0 : 2;
+        }
 
-    // Extract symbols from image
-    std::vector<int> symbols;
-    symbols.reserve(totalSymbols);
+        if (encoding && encodeOptions.format != "png") {
+            std::cerr << "Streaming output is always PNG; --bmp needs a file input without -o\n";
+            return 1;
+        }
+        if (dumpCorrected) {
+            std::cerr << "--dump-corrected needs a file input without -o\n";
+            return 1;
+        }
+        if (!cacheDir.empty()) {
+            std::cerr << "--cache needs a file input without -o\n";
+            return 1;
+        }
+        if (encodeOptions.delta && (output.empty() || output == "-")) {
+            std::cerr << "--delta needs an output file to update (a file input, or -o FILE)\n";
+            return 1;
+        }
 
-    for (int i = 0; i < totalPixels * channels; i += channels) {
-        // 检查整个像素是否在填充颜色范围内（接近黑色）
-        if (isFillerPixel(&imageData[i], channels)) {
-            // 如果是填充颜色，则添加填充符号
-            for (int ch = 0; ch < symbolsPerPixel; ch++) {
-                symbols.push_back(-1);
+        // 流式输出时日志写到标准错误
+        std::FILE* in = openStreamUtf8(input, false);
+        StreamReport report;
+        auto start = std::chrono::steady_clock::now();
+        if (encodeOptions.delta) {
+            try {
+                report = encodeStreamToFile(ctx, in, output, kStreamChunkBytes, true);
+            }
+            catch (...) {
+                if (in != stdin) std::fclose(in);
+                throw;
+            }
+            if (in != stdin) std::fclose(in);
+        }
+        else {
+            std::FILE* out = openStreamUtf8(output.empty() ? "-" : output, true);
+            try {
+                if (encoding) {
+                    encodeStream(ctx, in, out, &report);
+                }
+                else {
+                    decodeStream(ctx, in, out, &report);
+                }
+            }
+            catch (...) {
+                if (in != stdin) std::fclose(in);
+                if (out != stdout) std::fclose(out);
+                throw;
             }
+            if (in != stdin) std::fclose(in);
+            if (out != stdout && std::fclose(out) != 0) {
+                throw QRACException(ErrorType::FileWriteError, "Failed to write output file: " + output);
+            }
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (statsJson) {
+            // 统计记录代替文字日志（数据是否有效见data_valid）
+            JobResult result;
+            result.input = input;
+            result.output = output.empty() ? "-" : output;
+            result.bytesIn = report.bytesIn;
+            result.bytesOut = report.bytesOut;
+            result.success = true;
+            result.dataValid = report.invalidFrames == 0;
+            result.seconds = seconds;
+            result.stats.addStream(report);
+            writeJobStatsRecord(operation, result);
         }
         else {
-            for (int ch = 0; ch < symbolsPerPixel; ch++) {
-                uint8_t pixelValue = imageData[i + ch];
-                int symbol = decodeToSymbol(pixelValue);
-                symbols.push_back(symbol);
+            std::cerr << (encoding ? "Encoded " : "Decoded ") << formatBytes(report.bytesIn) << " -> "
+                << formatBytes(report.bytesOut) << " in " << report.frames << " frame(s), "
+                << std::fixed << std::setprecision(3) << seconds << " s\n";
+            if (encodeOptions.delta) {
+                logDeltaFrames(report, std::cerr);
+            }
+            logStageTimes(report, std::cerr);
+            if (perf) {
+                JobStats stats;
+                stats.addStream(report);
+                logStageCounters(stats, std::cerr);
+            }
+            if (report.invalidFrames > 0) {
+                std::cerr << "Warning: " << report.invalidFrames << " frame(s) failed FEC verification\n";
             }
         }
+        return report.invalidFrames > 0 ? 2 : 0;
     }
-
-    std::cout << "Extracted symbols: " << symbols.size() << " symbols\n";
-
-    // Calculate expected data bits
-    size_t expectedBits = totalSymbols * bitsPerSymbol;
-
-    // Convert symbols to binary stream
-    std::vector<bool> binaryStream = symbolsToBinary(symbols, bitsPerSymbol, expectedBits);
-    std::cout << "Extracted binary stream: " << binaryStream.size() << " bits\n";
-
-    // Convert binary stream to byte data
-    std::vector<uint8_t> extractedData = binaryToData(binaryStream);
-    std::cout << "Extracted data: " << extractedData.size() << " bytes\n";
-
-    // Apply FEC error correction
-    bool dataValid = verifyAndCorrectFEC(extractedData);
-    std::cout << "Data after FEC correction: " << extractedData.size() << " bytes\n";
-
-    if (!dataValid) {
-        std::cout << "Warning: Data may contain uncorrectable errors\n";
+    catch (const QRACException& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
     }
+}
 
-    // Determine output file type
-    std::string fileType = detectFileType(extractedData);
-    std::cout << "Detected file type: " << fileType << "\n";
+// 解析并执行verify命令：文件在内存中解码，多线程计算哈希；"-"从标准输入逐帧校验
+int runVerifyCommand(const std::vector<std::string>& args) {
+    if (args.size() < 3) {
+        showUsage();
+        return 1;
+    }
 
-    // Generate output filename
-    std::string outputFile = generateOutputFilename(inputImage, "_decoded", fileType);
+    std::string input = args[2];
+    QRACConfig profile;
+    unsigned threads = 0;
+    bool statsJson = false;
+    bool perf = false;
+    std::string tracePath;
+    for (size_t i = 3; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        if (arg == "--threads" && i + 1 < args.size()) {
+            threads = static_cast<unsigned>(std::max(0, std::atoi(args[++i].c_str())));
+        }
+        else if (isStatsOption(args, i)) {
+            if (!parseStatsOption(args, i, statsJson)) {
+                return 1;
+            }
+        }
+        else if (arg == "--trace" && i + 1 < args.size()) {
+            tracePath = args[++i];
+        }
+        else if (arg == "--perf") {
+            perf = true;
+        }
+        else if (!parseProfileOption(args, i, profile)) {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
 
-    // Save extracted data
-    saveExtractedData(extractedData, outputFile, fileType == "txt");
+    TraceSession trace(tracePath);
+    if (perf) {
+        perf = startPerfCounters();
+    }
+    try {
+        CodecContext ctx(profile);
+        JobStats stats;
+        JobStats* statsOut = statsJson || perf ? &stats : nullptr;
+        auto start = std::chrono::steady_clock::now();
+        JobResult result;
+        if (input == "-") {
+            StreamReport report;
+            decodeStream(ctx, openStreamUtf8(input, false), nullptr, &report);
+            result.input = input;
+            result.bytesIn = report.bytesIn;
+            result.bytesOut = report.bytesOut;
+            result.dataValid = report.invalidFrames == 0;
+            result.output = "blake3 per frame";
+            result.message = streamVerifyFailure(report);
+            result.success = result.message.empty();
+            if (statsOut) {
+                stats.addStream(report);
+            }
+            std::cout << "Verified " << report.frames << " frame(s): " << report.bytesIn << " bytes -> " << report.bytesOut << " bytes\n";
+            logStageTimes(report, std::cout);
+        }
+        else {
+            result = verifyFileJob(ctx, input, std::cout, blockingIoBackend(), statsOut, threads);
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    std::cout << "Data extracted to: " << outputFile << "\n";
-    std::cout << "Decoding complete! Output file is in the same directory as input.\n";
-    std::cout << "Extraction " << (dataValid ? "successful" : "partially successful, may contain errors") << "\n";
+        if (perf) {
+            logStageCounters(stats, std::cout);
+        }
+        if (statsJson) {
+            result.stats = std::move(stats);
+            writeJobStatsRecord("verify", result);
+        }
+        if (!result.success) {
+            std::cout << "FAIL: " << result.message << "\n";
+            return 2;
+        }
+        std::cout << "PASS: payload matches the recorded hash (" << formatBytes(static_cast<double>(result.bytesOut)) << ", "
+            << std::fixed << std::setprecision(1) << result.seconds * 1000.0 << " ms)\n";
+        return 0;
+    }
+    catch (const QRACException& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
 }
 
-// 将图像数据转换为32位BMP（添加Alpha通道）
-std::vector<uint8_t> convertTo32BitBMP(const std::vector<uint8_t>& imageData, int width, int height, int channels) {
-    if (channels == 4) {
-        return imageData; // 已经是32位
+// 解析并执行archive命令：create打包目录，list列出索引，extract解出成员（只解码所需的帧）
+int runArchiveCommand(const std::vector<std::string>& args) {
+    if (args.size() < 4 || (args[2] != "create" && args[2] != "list" && args[2] != "extract")) {
+        showUsage();
+        return 1;
     }
 
-    // 从24位转换为32位（添加Alpha通道，值为255）
-    std::vector<uint8_t> result(width * height * 4);
-    for (int i = 0; i < width * height; i++) {
-        result[i * 4] = imageData[i * channels];
-        result[i * 4 + 1] = imageData[i * channels + 1];
-        result[i * 4 + 2] = imageData[i * channels + 2];
-        result[i * 4 + 3] = 255; // Alpha通道
+    const std::string& action = args[2];
+    std::string source = args[3];
+    std::string output;
+    std::string destination = ".";
+    std::vector<std::string> members;
+    QRACConfig profile;
+    for (size_t i = 4; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        if (action == "create" && arg == "-o" && i + 1 < args.size()) {
+            output = args[++i];
+        }
+        else if (action == "extract" && arg == "-C" && i + 1 < args.size()) {
+            destination = args[++i];
+        }
+        else if (parseProfileOption(args, i, profile)) {
+            continue;
+        }
+        else if (action == "extract" && arg.rfind("--", 0) != 0) {
+            members.push_back(arg);
+        }
+        else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
+        }
     }
-    return result;
-}
 
-// 改进的图像加载函数，支持更多格式
-STBImagePtr loadImageWithFallback(const std::string& filename, int* width, int* height, int* channels) {
-    // 首先尝试正常加载
-    STBImagePtr imageData = loadImageSTB(filename, width, height, channels, 0);
+    try {
+        CodecContext ctx(profile);
+        auto start = std::chrono::steady_clock::now();
+        auto elapsedMs = [&]() {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+        std::cout << std::fixed << std::setprecision(1);
+
+        if (action == "create") {
+            if (output.empty()) {
+                std::string base = source;
+                while (base.size() > 1 && (base.back() == '/' || base.back() == '\\')) {
+                    base.pop_back();
+                }
+                output = base + "_archive.png";
+            }
+            ArchiveReport report = createArchive(ctx, source, output);
+            std::cout << "Archived " << report.files << " file(s), " << formatBytes(static_cast<double>(report.bytes))
+                << " + " << formatBytes(static_cast<double>(report.indexBytes)) << " index -> " << output << " ("
+                << report.frames << " frame(s), " << formatBytes(static_cast<double>(report.stream.bytesOut)) << ", "
+                << elapsedMs() << " ms)\n";
+            return 0;
+        }
 
-    if (!imageData) {
-        // 如果正常加载失败，尝试强制转换为3通道
-        imageData = loadImageSTB(filename, width, height, channels, 3);
+        if (action == "list") {
+            ArchiveReport report;
+            std::vector<ArchiveEntry> entries = listArchive(ctx, source, &report);
+            for (const ArchiveEntry& entry : entries) {
+                std::cout << std::setw(12) << entry.size << "  " << hashToHex(entry.hash).substr(0, 16) << "  " << entry.path << "\n";
+            }
+            std::cout << entries.size() << " file(s), decoded " << report.decodedFrames << " of " << report.frames
+                << " frame(s) (" << elapsedMs() << " ms)\n";
+            return report.invalidFrames > 0 ? 2 : 0;
+        }
 
-        if (!imageData) {
-            throw QRACException(ErrorType::ImageLoadError,
-                "无法加载图像文件。请确保文件是有效的PNG、BMP或PPM格式，并且没有被压缩。");
+        ArchiveReport report = extractArchive(ctx, source, members, destination);
+        std::cout << "Extracted " << report.files << " file(s), " << formatBytes(static_cast<double>(report.bytes))
+            << " to " << destination << ", decoded " << report.decodedFrames << " of " << report.frames << " frame(s) ("
+            << elapsedMs() << " ms)\n";
+        if (report.hashMismatches > 0 || report.invalidFrames > 0) {
+            std::cout << "FAIL: " << report.hashMismatches << " file(s) do not match the recorded hash, "
+                << report.invalidFrames << " frame(s) not fully corrected\n";
+            return 2;
         }
+        return 0;
+    }
+    catch (const QRACException& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
     }
-
-    return imageData;
 }
 
-// Corrector function - 改进版本，正确处理填充值
-void correctImageFile() {
-    std::string inputImage;
+// 解析并执行serve命令
+int runServeCommand(const std::vector<std::string>& args) {
+    if (args.size() < 3) {
+        showUsage();
+        return 1;
+    }
 
-    std::cout << "[Correct] Repair damaged QRAC image\n";
-    std::cout << "Enter input image path (PNG, BMP or PPM format): ";
-    std::getline(std::cin, inputImage);
+    ServeOptions options;
+    options.socketPath = args[2];
+    for (size_t i = 3; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        if (arg == "--threads" && i + 1 < args.size()) {
+            options.threads = static_cast<unsigned>(std::max(0, std::atoi(args[++i].c_str())));
+        }
+        else if (arg == "--verbose" || arg == "-v") {
+            options.verbose = true;
+        }
+        else if (!parseProfileOption(args, i, options.profile)) {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+    return runServe(options);
+}
 
-    if (!fileExists(inputImage)) {
-        throw QRACException(ErrorType::FileNotFound, "File does not exist: " + inputImage);
+// 解析并执行命令行，返回进程退出码
+int runCommandLine(const std::vector<std::string>& args) {
+    if (args.size() < 2 || args[1] == "help" || args[1] == "--help" || args[1] == "-h") {
+        showUsage();
+        return args.size() < 2 ? 1 : 0;
     }
 
-    // 检查是否是JPG文件
-    std::string ext = toLower(getFileExtension(inputImage));
-    if (ext == "jpg" || ext == "jpeg") {
-        throw QRACException(ErrorType::InvalidInput, "JPG format is not supported for correction. Please use PNG or BMP format.");
+    if (args[1] == "serve") {
+        return runServeCommand(args);
     }
 
-    // Load image using improved loader
-    int width, height, channels;
-    STBImagePtr imageDataPtr = loadImageWithFallback(inputImage, &width, &height, &channels);
+    if (args[1] == "encode" || args[1] == "decode") {
+        return runCodecCommand(args);
+    }
 
-    if (!imageDataPtr) {
-        throw QRACException(ErrorType::ImageLoadError, "Failed to load image: " + inputImage);
+    if (args[1] == "verify") {
+        return runVerifyCommand(args);
     }
 
-    unsigned char* imageData = imageDataPtr.get();
+    if (args[1] == "archive") {
+        return runArchiveCommand(args);
+    }
 
-    // 确保至少有3个通道
-    if (channels < 3) {
-        // 如果图像通道少于3个，转换为3通道
-        std::unique_ptr<unsigned char[]> newData(new unsigned char[width * height * 3]);
-        for (int i = 0; i < width * height; i++) {
-            unsigned char pixelValue = (channels == 1) ? imageData[i] : imageData[i * channels];
-            newData[i * 3] = pixelValue;
-            newData[i * 3 + 1] = pixelValue;
-            newData[i * 3 + 2] = pixelValue;
-        }
-        imageDataPtr.reset(newData.release());
-        imageData = imageDataPtr.get();
-        channels = 3;
+    if (args[1] != "batch") {
+        std::cerr << "Unknown command: " << args[1] << "\n";
+        showUsage();
+        return 1;
     }
 
-    std::cout << "Loaded image: " << width << "x" << height << " pixels, " << channels << " channels\n";
+    if (args.size() < 4) {
+        showUsage();
+        return 1;
+    }
 
-    // Check if correction is needed
-    int totalPixels = width * height;
-    int incorrectPixels = 0;
-    int fillerPixels = 0;
+    BatchOptions options;
+    if (args[2] == "encode") {
+        options.operation = BatchOperation::Encode;
+    }
+    else if (args[2] == "decode") {
+        options.operation = BatchOperation::Decode;
+    }
+    else if (args[2] == "correct") {
+        options.operation = BatchOperation::Correct;
+    }
+    else if (args[2] == "verify") {
+        options.operation = BatchOperation::Verify;
+    }
+    else {
+        std::cerr << "Unknown batch operation: " << args[2] << "\n";
+        return 1;
+    }
+    options.source = args[3];
+    std::string tracePath;
 
-    for (int i = 0; i < totalPixels * channels; i += channels) {
-        // 检查整个像素是否在填充颜色范围内（接近黑色）
-        if (isFillerPixel(&imageData[i], channels)) {
-            fillerPixels++;
-            continue;
+    for (size_t i = 4; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        if (arg == "--threads" && i + 1 < args.size()) {
+            options.threads = static_cast<unsigned>(std::max(0, std::atoi(args[++i].c_str())));
         }
-
-        // 检查每个通道是否需要校正
-        for (int ch = 0; ch < 3; ch++) {
-            uint8_t pixelValue = imageData[i + ch];
-            int intervalIndex = decodeToSymbol(pixelValue);
-
-            // 跳过填充值
-            if (intervalIndex == -1) continue;
-
-            uint8_t anchorValue = calculateAnchor(intervalIndex);
-
-            if (pixelValue != anchorValue) {
-                incorrectPixels++;
+        else if (arg == "--recursive" || arg == "-r") {
+            options.recursive = true;
+        }
+        else if (arg == "--adaptive") {
+            options.encode.adaptive = true;
+        }
+        else if (arg == "--bmp") {
+            options.encode.format = "bmp";
+        }
+        else if (arg == "--delta") {
+            options.encode.delta = true;
+        }
+        else if (arg == "--append") {
+            options.encode.append = true;
+        }
+        else if (arg == "--cache" && i + 1 < args.size()) {
+            options.cacheDir = args[++i];
+        }
+        else if (arg == "--cache-size" && i + 1 < args.size()) {
+            size_t bytes = 0;
+            if (!parseByteSize(args[++i], bytes) || bytes == 0) {
+                std::cerr << "Invalid cache size: " << args[i] << " (e.g. 512M, 4G)\n";
+                return 1;
             }
+            options.cacheBytes = bytes;
         }
-    }
-
-    float incorrectRatio = static_cast<float>(incorrectPixels) / (totalPixels * 3 - fillerPixels * 3);
-    std::cout << "Detected " << incorrectPixels << " pixel values deviating from anchors ("
-        << std::fixed << std::setprecision(2) << incorrectRatio * 100 << "%)\n";
-    std::cout << "Found " << fillerPixels << " filler pixels (will be set to pure black)\n";
-
-    if (incorrectPixels == 0 && fillerPixels == 0) {
-        std::cout << "Image is already in anchor-pure state, no correction needed\n";
-
-        // Generate output filename
-        std::string outputImage = generateOutputFilename(inputImage, "_corrected", "bmp");
-
-        // 转换为32位BMP
-        std::vector<uint8_t> bmpData = convertTo32BitBMP(
-            std::vector<uint8_t>(imageData, imageData + totalPixels * channels),
-            width, height, channels
-        );
-
-        // 直接保存为BMP
-#ifdef _WIN32
-        std::wstring wideOutput = utf8ToWstring(outputImage);
-        if (!saveImage(outputImage, bmpData.data(), width, height, 4, "bmp")) {
-            throw QRACException(ErrorType::ImageSaveError, "Failed to save output image");
+        else if (arg == "--verbose" || arg == "-v") {
+            options.verbose = true;
         }
-#else
-        if (!saveImage(outputImage, bmpData.data(), width, height, 4, "bmp")) {
-            throw QRACException(ErrorType::ImageSaveError, "Failed to save output image");
+        else if (arg == "--png-store") {
+            options.correctPng = PngCompression::Store;
         }
-#endif
-
-        std::cout << "Image saved: " << outputImage << "\n";
-        std::cout << "Correction complete! Image was already pure, no changes made.\n";
-    }
-    else {
-        // Perform correction
-        std::cout << "Performing correction...\n";
-        std::vector<uint8_t> correctedData(totalPixels * channels);
-
-        for (int i = 0; i < totalPixels * channels; i += channels) {
-            // 检查整个像素是否在填充颜色范围内（接近黑色）
-            if (isFillerPixel(&imageData[i], channels)) {
-                // 如果是填充颜色，设置为纯黑色
-                correctedData[i] = 0;
-                correctedData[i + 1] = 0;
-                correctedData[i + 2] = 0;
-                if (channels > 3) {
-                    correctedData[i + 3] = imageData[i + 3]; // 保留Alpha通道
-                }
-                continue;
+        else if (arg == "--dump-corrected") {
+            options.dumpCorrected = true;
+        }
+        else if (arg == "--io" && i + 1 < args.size()) {
+            if (!parseIoBackendKind(args[++i], options.io)) {
+                std::cerr << "Unknown I/O backend: " << args[i] << " (expected auto, uring or blocking)\n";
+                return 1;
             }
-
-            // 校正每个通道
-            for (int ch = 0; ch < 3; ch++) {
-                uint8_t pixelValue = imageData[i + ch];
-                int intervalIndex = decodeToSymbol(pixelValue);
-
-                if (intervalIndex == -1) {
-                    // 如果是填充值，设置为纯黑色
-                    correctedData[i + ch] = 0;
-                }
-                else {
-                    correctedData[i + ch] = calculateAnchor(intervalIndex);
-                }
+        }
+        else if (arg == "--arena" && i + 1 < args.size()) {
+            const std::string& mode = args[++i];
+            if (mode != "on" && mode != "off" && mode != "huge") {
+                std::cerr << "Unknown arena mode: " << mode << " (expected on, off or huge)\n";
+                return 1;
             }
-
-            // 保留Alpha通道（如果有）
-            if (channels > 3) {
-                correctedData[i + 3] = imageData[i + 3];
+            options.arena.enabled = mode != "off";
+            options.arena.hugePages = mode == "huge";
+        }
+        else if (arg == "--mem-budget" && i + 1 < args.size()) {
+            if (!parseByteSize(args[++i], options.memoryBudget)) {
+                std::cerr << "Invalid memory budget: " << args[i] << " (e.g. 512M, 2G)\n";
+                return 1;
             }
         }
-
-        // Generate output filename
-        std::string outputImage = generateOutputFilename(inputImage, "_corrected", "bmp");
-
-        // 转换为32位BMP
-        std::vector<uint8_t> bmpData = convertTo32BitBMP(correctedData, width, height, channels);
-
-        // 保存为BMP格式
-#ifdef _WIN32
-        std::wstring wideOutput = utf8ToWstring(outputImage);
-        if (!saveImage(outputImage, bmpData.data(), width, height, 4, "bmp")) {
-            throw QRACException(ErrorType::ImageSaveError, "Failed to save output image");
+        else if (isStatsOption(args, i)) {
+            if (!parseStatsOption(args, i, options.statsJson)) {
+                return 1;
+            }
         }
-#else
-        if (!saveImage(outputImage, bmpData.data(), width, height, 4, "bmp")) {
-            throw QRACException(ErrorType::ImageSaveError, "Failed to save output image");
+        else if (arg == "--trace" && i + 1 < args.size()) {
+            tracePath = args[++i];
         }
-#endif
+        else if (arg == "--perf") {
+            options.perf = true;
+        }
+        else if (!parseProfileOption(args, i, options.profile)) {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    if (options.encode.append && (options.encode.format != "png" || options.encode.delta || !options.cacheDir.empty())) {
+        std::cerr << "--append cannot be combined with --bmp, --delta or --cache\n";
+        return 1;
+    }
 
-        std::cout << "Corrected image saved: " << outputImage << "\n";
-        std::cout << "Correction complete! Output file is in the same directory as input.\n";
-        std::cout << "BMP format ensures lossless storage of your data.\n";
+    TraceSession trace(tracePath);
+    if (options.perf) {
+        options.perf = startPerfCounters();
+    }
+    try {
+        return runBatch(options) == 0 ? 0 : 2;
+    }
+    catch (const QRACException& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
     }
 }
 
@@ -1349,7 +2720,12 @@ void showMenu() {
 }
 
 // Main function
-int main() {
+int main(int argc, char* argv[]) {
+    // 带参数运行时进入命令行模式（批处理等），否则显示交互菜单
+    if (argc > 1) {
+        return runCommandLine(getUtf8Arguments(argc, argv));
+    }
+
     std::cout << "QRAC Integrated Tool Suite - Version 4.0\n";
     std::cout << "Now with improved error correction and 0-10 range skipping\n";
     std::cout << "Supports Word documents, text files, and compressed archives\n";
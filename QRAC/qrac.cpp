@@ -0,0 +1,1632 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * libqrac - 可嵌入的内存编解码库实现
+ *
+ * 本软件根据MIT许可证分发 - 详见LICENSE文件
+ ******************************************************************/
+#define NOMINMAX
+#include "qrac.h"
+#include "qrac_check.h"
+#include "qrac_rs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+// 包含stb图像库（实现只在本文件中编译一次），内部缓冲区经过arena分配
+#define STBI_MALLOC(size) qrac::arenaAllocate(size)
+#define STBI_REALLOC(pointer, size) qrac::arenaReallocate(pointer, size)
+#define STBI_FREE(pointer) qrac::arenaFree(pointer)
+#define STBIW_MALLOC(size) qrac::arenaAllocate(size)
+#define STBIW_REALLOC(pointer, size) qrac::arenaReallocate(pointer, size)
+#define STBIW_FREE(pointer) qrac::arenaFree(pointer)
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+namespace qrac {
+
+// 计算间隔数量
+int calculateIntervals(const QRACConfig& profile) {
+    int availableRange = 256 - (profile.FILLER_MAX_VALUE + 1); // 跳过0-10的范围
+    return availableRange / profile.L + (availableRange % profile.L != 0 ? 1 : 0);
+}
+
+// Calculate anchor point value
+int calculateAnchor(const QRACConfig& profile, int intervalIndex) {
+    int start = profile.FILLER_MAX_VALUE + 1 + intervalIndex * profile.L; // 从11开始
+    int end = std::min(start + profile.L - 1, 255);
+    return start + (end - start) / 2; // Midpoint of interval
+}
+
+// 构建编解码上下文并校验配置
+CodecContext::CodecContext(const QRACConfig& profile)
+    : m_profile(profile) {
+    if (profile.L < 1 || profile.FILLER_MAX_VALUE >= 254) {
+        throw QRACException(ErrorType::InvalidInput, "Invalid profile: L must be >= 1 and FILLER_MAX_VALUE < 254");
+    }
+    if (profile.SYMBOLS_PER_PIXEL < 1 || profile.SYMBOLS_PER_PIXEL > 3) {
+        throw QRACException(ErrorType::InvalidInput, "Invalid profile: SYMBOLS_PER_PIXEL must be 1-3");
+    }
+    if (profile.FEC_REDUNDANCY_RATIO < 0.0f) {
+        throw QRACException(ErrorType::InvalidInput, "Invalid profile: FEC_REDUNDANCY_RATIO must be >= 0");
+    }
+    if (!(profile.ERASURE_CONFIDENCE >= 0.0f && profile.ERASURE_CONFIDENCE <= 1.0f)) {
+        throw QRACException(ErrorType::InvalidInput, "Invalid profile: ERASURE_CONFIDENCE must be 0-1");
+    }
+    if (profile.CHECK_BLOCK_SIZE > 0xFFFFFFFFu) {
+        throw QRACException(ErrorType::InvalidInput, "Invalid profile: CHECK_BLOCK_SIZE must fit in 32 bits");
+    }
+
+    m_intervals = calculateIntervals(profile);
+    if (m_intervals < 2) {
+        throw QRACException(ErrorType::InvalidInput, "Invalid profile: L is too large, fewer than 2 intervals");
+    }
+
+    // 每符号位数 = floor(log2(间隔数))
+    m_bitsPerSymbol = 0;
+    while ((2 << m_bitsPerSymbol) <= m_intervals) {
+        m_bitsPerSymbol++;
+    }
+
+    m_anchors.resize(m_intervals);
+    for (int i = 0; i < m_intervals; i++) {
+        m_anchors[i] = static_cast<uint8_t>(calculateAnchor(profile, i));
+    }
+
+    // 解码表：像素值 -> 间隔索引，填充值为-1
+    for (int value = 0; value < 256; value++) {
+        if (value <= profile.FILLER_MAX_VALUE) {
+            m_decision.symbol[value] = -1;
+            continue;
+        }
+        int intervalIndex = (value - (profile.FILLER_MAX_VALUE + 1)) / profile.L;
+        m_decision.symbol[value] = static_cast<int16_t>(std::min(intervalIndex, m_intervals - 1));
+    }
+
+    // 校正表：填充值吸附为0（不计偏离），其他值吸附到所在间隔的锚点
+    for (int value = 0; value < 256; value++) {
+        int symbol = m_decision.symbol[value];
+        m_snapTable[value] = symbol == -1 ? 0 : m_anchors[symbol];
+        m_decision.deviation[value] = symbol != -1 && m_snapTable[value] != value ? 1 : 0;
+    }
+
+    // 置信度表：1 - 到锚点的距离 / 半个间隔，间隔边缘（最容易是相邻间隔的值受损而来）接近0
+    double halfInterval = profile.L / 2.0;
+    for (int value = 0; value < 256; value++) {
+        int symbol = m_decision.symbol[value];
+        if (symbol == -1) {
+            m_decision.confidence[value] = 255;
+            continue;
+        }
+        double confidence = std::max(0.0, 1.0 - std::abs(value - m_anchors[symbol]) / halfInterval);
+        m_decision.confidence[value] = static_cast<uint8_t>(std::lround(confidence * 255));
+    }
+    m_erasureThreshold = static_cast<uint8_t>(std::lround(profile.ERASURE_CONFIDENCE * 255));
+}
+
+// 异或校验的步长：校验字节i覆盖 (j * stride + i) % originalSize（j = 0..7）。
+// 步长通常为fecSize；fecSize的1-7倍是originalSize的倍数时（如比例0.25且长度为4的倍数）覆盖位置两两重合、
+// 互相抵消，校验字节全为0，无法纠正任何错误，这时改用之后第一个不会重合的步长
+static size_t parityStride(size_t originalSize, size_t fecSize) {
+    auto overlaps = [&](size_t stride) {
+        for (size_t d = 1; d < 8; d++) {
+            if ((d * stride) % originalSize == 0) return true;
+        }
+        return false;
+    };
+    if (originalSize < 8 || !overlaps(fecSize)) {
+        return fecSize; // 少于8字节时必然重合，保持原步长
+    }
+    size_t stride = fecSize + 1;
+    while (overlaps(stride)) {
+        stride++;
+    }
+    return stride;
+}
+
+// 计算FEC校验字节：fec[i] = data[(j * stride + i) % originalSize] 对 j = 0..7 的异或
+// 按j分段累加，索引递增后回绕，内层循环不做取模
+static void computeFEC(const uint8_t* data, size_t originalSize, size_t fecSize, size_t stride, uint8_t* fec) {
+    std::fill(fec, fec + fecSize, uint8_t(0));
+    for (size_t j = 0; j < 8; j++) {
+        size_t index = (j * stride) % originalSize;
+        for (size_t i = 0; i < fecSize; i++) {
+            fec[i] ^= data[index]; // XOR操作
+            if (++index == originalSize) index = 0;
+        }
+    }
+}
+
+// 分块校验和简单的FEC编码：FEC同时保护校验表和尾部
+template <typename Buffer>
+static void appendFEC(const CodecContext& ctx, Buffer& data) {
+    size_t blockSize = ctx.profile().CHECK_BLOCK_SIZE;
+    if (blockSize > 0) {
+        size_t dataSize = data.size();
+        data.resize(dataSize + blockCheckSize(dataSize, blockSize));
+        writeBlockChecks(data.data(), dataSize, blockSize, data.data() + dataSize);
+    }
+
+    size_t originalSize = data.size();
+    if (originalSize == 0) return;
+
+    // 根据配置添加FEC冗余
+    size_t fecSize = static_cast<size_t>(originalSize * ctx.profile().FEC_REDUNDANCY_RATIO);
+    data.resize(originalSize + fecSize);
+
+    if (ctx.profile().USE_ADVANCED_FEC) {
+        rsEncode(data.data(), originalSize, data.data() + originalSize, fecSize);
+        return;
+    }
+
+    // 使用简单的线性编码进行FEC
+    computeFEC(data.data(), originalSize, fecSize, parityStride(originalSize, fecSize), data.data() + originalSize);
+}
+
+void addFEC(const CodecContext& ctx, std::vector<uint8_t>& data) {
+    appendFEC(ctx, data);
+}
+
+void addFEC(const CodecContext& ctx, ByteBuffer& data) {
+    appendFEC(ctx, data);
+}
+
+size_t protectedSize(const CodecContext& ctx, size_t dataSize) {
+    size_t blockSize = ctx.profile().CHECK_BLOCK_SIZE;
+    size_t originalSize = dataSize + (blockSize > 0 ? blockCheckSize(dataSize, blockSize) : 0);
+    return originalSize + static_cast<size_t>(originalSize * ctx.profile().FEC_REDUNDANCY_RATIO);
+}
+
+// 由带FEC的长度反推原始数据长度：addFEC的逆运算，使用与编码时相同的浮点计算
+// 直接用 size / (1 + ratio) 截断在很多长度上会差1，导致FEC字节错位
+static size_t originalSizeForFEC(const CodecContext& ctx, size_t encodedSize) {
+    float ratio = ctx.profile().FEC_REDUNDANCY_RATIO;
+    size_t estimate = static_cast<size_t>(encodedSize / (1.0f + ratio));
+    for (size_t n = estimate > 0 ? estimate - 1 : 0; n <= estimate + 2; n++) {
+        if (n + static_cast<size_t>(n * ratio) == encodedSize) {
+            return n;
+        }
+    }
+    return estimate; // 长度与任何原始长度都不对应（数据不完整），沿用估算值
+}
+
+// 简单的FEC解码（配置为Reed-Solomon时交给rsDecode），处理全部数据，结束时data只保留FEC之前的部分
+template <typename Buffer>
+static bool correctParity(const CodecContext& ctx, Buffer& data, FECReport* report, std::span<const size_t> erasures) {
+    if (data.size() < 5) {
+        return true; // 数据太小，无法进行FEC校正
+    }
+
+    size_t originalSize = originalSizeForFEC(ctx, data.size());
+    size_t fecSize = data.size() - originalSize;
+
+    if (fecSize == 0) {
+        return true; // No FEC data
+    }
+
+    if (ctx.profile().USE_ADVANCED_FEC) {
+        bool valid = rsDecode(data.data(), originalSize, fecSize, erasures, report);
+        data.resize(originalSize);
+        return valid;
+    }
+
+    Buffer correctedData(data.begin(), data.begin() + originalSize);
+    ByteBuffer calculated(fecSize);
+    size_t stride = parityStride(originalSize, fecSize);
+
+    // 检查错误
+    computeFEC(correctedData.data(), originalSize, fecSize, stride, calculated.data());
+    bool hasError = !std::equal(calculated.begin(), calculated.end(), data.begin() + originalSize);
+
+    // 之前的版本在重合的长度上也以fecSize为步长：与按旧步长计算的校验一致时数据完好
+    if (hasError && stride != fecSize) {
+        computeFEC(correctedData.data(), originalSize, fecSize, fecSize, calculated.data());
+        hasError = !std::equal(calculated.begin(), calculated.end(), data.begin() + originalSize);
+    }
+
+    if (!hasError) {
+        data = std::move(correctedData);
+        return true;
+    }
+
+    // 尝试纠正错误
+    for (size_t i = 0; i < fecSize; i++) {
+        uint8_t calculatedFEC = 0;
+        for (size_t j = 0; j < 8; j++) {
+            size_t index = (j * stride + i) % originalSize;
+            calculatedFEC ^= correctedData[index];
+        }
+
+        if (data[originalSize + i] != calculatedFEC) {
+            // 尝试找到并纠正错误
+            for (size_t j = 0; j < 8; j++) {
+                size_t index = (j * stride + i) % originalSize;
+                uint8_t originalByte = correctedData[index];
+
+                // 尝试翻转每个位
+                for (int bit = 0; bit < 8; bit++) {
+                    uint8_t testByte = originalByte ^ (1 << bit);
+                    uint8_t testFEC = calculatedFEC ^ originalByte ^ testByte;
+
+                    if (testFEC == data[originalSize + i]) {
+                        correctedData[index] = testByte;
+                        if (report) {
+                            report->correctedBytes++;
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // 最终验证
+    computeFEC(correctedData.data(), originalSize, fecSize, stride, calculated.data());
+    auto mismatch = std::mismatch(calculated.begin(), calculated.end(), data.begin() + originalSize);
+    bool allErrorsCorrected = mismatch.first == calculated.end();
+    if (!allErrorsCorrected && report) {
+        report->firstFailedBlock = static_cast<long long>(mismatch.first - calculated.begin());
+        for (size_t i = static_cast<size_t>(report->firstFailedBlock); i < fecSize; i++) {
+            report->failedBlocks += calculated[i] != data[originalSize + i];
+        }
+    }
+
+    // 更新数据
+    data = std::move(correctedData);
+    return allErrorsCorrected;
+}
+
+// 异或校验字节i覆盖的数据位置 (j * stride + i) % originalSize（j = 0..7），出现偶数次的位置互相抵消，不计入
+static int parityCoverage(size_t i, size_t originalSize, size_t stride, std::array<size_t, 8>& positions) {
+    int count = 0;
+    for (size_t j = 0; j < 8; j++) {
+        size_t p = (j * stride + i) % originalSize;
+        auto found = std::find(positions.begin(), positions.begin() + count, p);
+        if (found != positions.begin() + count) {
+            *found = positions[--count];
+        }
+        else {
+            positions[count++] = p;
+        }
+    }
+    return count;
+}
+
+// 异或校验只纠正损坏的块（擦除纠正）：损坏块中的字节都作为未知，CRC通过的块中的字节已经确认无误。
+// 一个校验字节只覆盖一个未知字节时，该字节就是校验与其余字节的异或；求出后再检查覆盖它的其他校验字节，
+// 依次推进（peeling）。相邻的覆盖位置落在同一块中时，从块边缘的已知字节开始逐个求出
+static void repairDamagedBlocks(uint8_t* data, size_t originalSize, size_t fecSize, BlockCheckResult& check,
+    FECReport* report) {
+    const uint8_t* parity = data + originalSize;
+    std::vector<uint8_t> unknown(check.dataSize, 0);
+    for (size_t block : check.damaged) {
+        size_t begin = block * check.blockSize;
+        std::fill(unknown.begin() + begin, unknown.begin() + std::min(begin + check.blockSize, check.dataSize), uint8_t(1));
+    }
+
+    // 覆盖位置p的校验字节：p = (j * stride + i) % originalSize 且 i < fecSize
+    size_t stride = parityStride(originalSize, fecSize);
+    auto parityOf = [&](size_t p, size_t j) {
+        return (p + originalSize - (j * stride) % originalSize) % originalSize;
+    };
+
+    // 每个相关校验字节覆盖的未知字节数，只剩一个的放入队列
+    std::vector<uint8_t> unknownCount(fecSize, 0);
+    std::vector<size_t> ready;
+    std::array<size_t, 8> positions;
+    for (size_t block : check.damaged) {
+        size_t begin = block * check.blockSize;
+        size_t end = std::min(begin + check.blockSize, check.dataSize);
+        for (size_t p = begin; p < end; p++) {
+            for (size_t j = 0; j < 8; j++) {
+                size_t i = parityOf(p, j);
+                if (i >= fecSize || unknownCount[i] != 0) continue;
+                int covered = parityCoverage(i, originalSize, stride, positions);
+                uint8_t count = 0;
+                for (int k = 0; k < covered; k++) {
+                    count += positions[k] < check.dataSize && unknown[positions[k]];
+                }
+                unknownCount[i] = count == 0 ? 0xFF : count; // 0xFF：已处理，不含未知字节
+                if (count == 1) ready.push_back(i);
+            }
+        }
+    }
+
+    while (!ready.empty()) {
+        size_t i = ready.back();
+        ready.pop_back();
+        if (unknownCount[i] != 1) continue;
+        int covered = parityCoverage(i, originalSize, stride, positions);
+        uint8_t value = parity[i];
+        size_t target = 0;
+        for (int k = 0; k < covered; k++) {
+            size_t p = positions[k];
+            if (p < check.dataSize && unknown[p]) {
+                target = p;
+            }
+            else {
+                value ^= data[p];
+            }
+        }
+        if (data[target] != value) {
+            data[target] = value;
+            if (report) {
+                report->correctedBytes++;
+            }
+        }
+        unknown[target] = 0;
+
+        // 覆盖target的其他校验字节少了一个未知字节
+        for (size_t j = 0; j < 8; j++) {
+            size_t other = parityOf(target, j);
+            if (other >= fecSize || unknownCount[other] == 0xFF || unknownCount[other] == 0) continue;
+            int otherCovered = parityCoverage(other, originalSize, stride, positions);
+            if (std::find(positions.begin(), positions.begin() + otherCovered, target) == positions.begin() + otherCovered) {
+                continue;
+            }
+            if (--unknownCount[other] == 1) {
+                ready.push_back(other);
+            }
+        }
+    }
+    recheckBlocks(data, check);
+}
+
+// 先按分块校验检查，全部通过时直接去掉校验，不做FEC解码；否则只把损坏的块交给FEC，最后用CRC确认
+template <typename Buffer>
+static bool correctFEC(const CodecContext& ctx, Buffer& data, FECReport* report, std::span<const size_t> erasures) {
+    size_t blockSize = ctx.profile().CHECK_BLOCK_SIZE;
+    if (blockSize == 0) {
+        return correctParity(ctx, data, report, erasures);
+    }
+
+    size_t originalSize = std::min(originalSizeForFEC(ctx, data.size()), data.size());
+    size_t fecSize = data.size() - originalSize;
+    BlockCheckResult check = checkBlocks(data.data(), originalSize);
+
+    if (!check.readable) {
+        // 校验表或尾部损坏，不知道哪些块完好：整个数据交给FEC之后再检查
+        // FEC之前和之后都没有尾部标识时是之前版本的格式（不分块校验），按FEC校正的结果输出
+        bool marked = hasBlockCheckTrailer(data.data(), originalSize);
+        bool valid = correctParity(ctx, data, report, erasures);
+        check = checkBlocks(data.data(), data.size());
+        if (!check.readable && !marked && !hasBlockCheckTrailer(data.data(), data.size())) {
+            return valid;
+        }
+        if (report) {
+            report->checksDamaged = true;
+        }
+        if (!check.readable) {
+            size_t dataSize = 0;
+            if (blockCheckDataSize(data.size(), blockSize, &dataSize)) {
+                data.resize(dataSize);
+            }
+            return false;
+        }
+    }
+    else if (!check.damaged.empty()) {
+        if (report) {
+            report->damagedBlocks = check.damaged;
+        }
+        if (fecSize > 0) {
+            if (ctx.profile().USE_ADVANCED_FEC) {
+                std::vector<std::pair<size_t, size_t>> ranges;
+                for (size_t block : check.damaged) {
+                    ranges.emplace_back(block * check.blockSize, std::min((block + 1) * check.blockSize, check.dataSize));
+                }
+                rsDecode(data.data(), originalSize, fecSize, erasures, report, ranges);
+            }
+            else {
+                repairDamagedBlocks(data.data(), originalSize, fecSize, check, report);
+            }
+            recheckBlocks(data.data(), check);
+        }
+    }
+
+    // 结果以CRC为准：仍然不符的块就是无法纠正的块
+    if (report) {
+        report->hasPayloadHash = check.hasHash;
+        report->payloadHash = check.hash;
+        report->checkedBlocks = check.blocks;
+        report->failedBlocks = check.damaged.size();
+        report->firstFailedBlock = check.damaged.empty() ? -1 : static_cast<long long>(check.damaged.front());
+    }
+    data.resize(check.dataSize);
+    return check.damaged.empty();
+}
+
+bool verifyAndCorrectFEC(const CodecContext& ctx, std::vector<uint8_t>& data, FECReport* report, std::span<const size_t> erasures) {
+    return correctFEC(ctx, data, report, erasures);
+}
+
+bool verifyAndCorrectFEC(const CodecContext& ctx, ByteBuffer& data, FECReport* report, std::span<const size_t> erasures) {
+    return correctFEC(ctx, data, report, erasures);
+}
+
+// Convert data to binary stream
+std::vector<bool> dataToBinary(const std::vector<uint8_t>& data) {
+    std::vector<bool> binaryStream;
+    binaryStream.reserve(data.size() * 8);
+
+    for (uint8_t byte : data) {
+        for (int i = 7; i >= 0; i--) {
+            binaryStream.push_back((byte >> i) & 1);
+        }
+    }
+
+    return binaryStream;
+}
+
+// Convert binary stream to symbol sequence
+std::vector<int> binaryToSymbols(const CodecContext& ctx, const std::vector<bool>& binaryStream, int bitsPerSymbol) {
+    int intervals = ctx.intervals();
+    int symbolCount = static_cast<int>((binaryStream.size() + bitsPerSymbol - 1) / bitsPerSymbol);
+    std::vector<int> symbols;
+    symbols.reserve(symbolCount);
+
+    for (int i = 0; i < symbolCount; i++) {
+        int symbol = 0;
+        for (int j = 0; j < bitsPerSymbol; j++) {
+            int bitIndex = i * bitsPerSymbol + j;
+            if (bitIndex < static_cast<int>(binaryStream.size())) {
+                symbol = (symbol << 1) | (binaryStream[bitIndex] ? 1 : 0);
+            }
+            else {
+                symbol = symbol << 1; // Pad with 0
+            }
+        }
+        symbols.push_back(symbol % intervals);
+    }
+
+    return symbols;
+}
+
+// 库内部的符号缓冲区（图像大小的临时数据，经过arena）
+using SymbolBuffer = std::vector<int, ArenaAllocator<int>>;
+
+// 字节直接打包为符号，结果与dataToBinary + binaryToSymbols相同，不经过逐位的比特流
+// bitsPerSymbol = floor(log2(intervals))，符号值总小于间隔数，无需取模
+template <typename Symbols>
+static Symbols packSymbols(const CodecContext& ctx, std::span<const uint8_t> data) {
+    int bitsPerSymbol = ctx.bitsPerSymbol();
+    uint32_t mask = (1u << bitsPerSymbol) - 1;
+
+    Symbols symbols((data.size() * 8 + bitsPerSymbol - 1) / bitsPerSymbol);
+    int* out = symbols.data();
+
+    uint32_t accumulator = 0;
+    int accumulatedBits = 0;
+    for (uint8_t byte : data) {
+        accumulator = (accumulator << 8) | byte;
+        accumulatedBits += 8;
+        while (accumulatedBits >= bitsPerSymbol) {
+            accumulatedBits -= bitsPerSymbol;
+            *out++ = static_cast<int>((accumulator >> accumulatedBits) & mask);
+        }
+        accumulator &= (1u << accumulatedBits) - 1;
+    }
+    if (accumulatedBits > 0) {
+        *out = static_cast<int>((accumulator << (bitsPerSymbol - accumulatedBits)) & mask); // Pad with 0
+    }
+
+    return symbols;
+}
+
+std::vector<int> dataToSymbols(const CodecContext& ctx, std::span<const uint8_t> data) {
+    return packSymbols<std::vector<int>>(ctx, data);
+}
+
+// 符号直接解包为字节（跳过填充符号）
+// 末尾不足一个字节的位是编码时补的0，直接丢弃，得到的长度与编码时的字节数完全一致
+// confidence不为空时，含有置信度低于threshold的符号的位的字节记入erasures
+template <typename Buffer>
+static Buffer unpackSymbols(std::span<const int> symbols, int bitsPerSymbol,
+    const uint8_t* confidence = nullptr, uint8_t threshold = 0, std::vector<size_t>* erasures = nullptr) {
+    Buffer data(symbols.size() * bitsPerSymbol / 8 + 1);
+    uint8_t* out = data.data();
+
+    uint32_t accumulator = 0;
+    uint32_t uncertain = 0; // 与accumulator对齐，低置信度符号的位为1
+    uint32_t symbolMask = (1u << bitsPerSymbol) - 1;
+    int accumulatedBits = 0;
+    for (size_t i = 0; i < symbols.size(); i++) {
+        int symbol = symbols[i];
+        if (symbol == -1) {
+            continue;
+        }
+        accumulator = (accumulator << bitsPerSymbol) | static_cast<uint32_t>(symbol);
+        if (confidence) {
+            uncertain = (uncertain << bitsPerSymbol) | (confidence[i] < threshold ? symbolMask : 0);
+        }
+        accumulatedBits += bitsPerSymbol;
+        if (accumulatedBits >= 8) {
+            accumulatedBits -= 8;
+            if (confidence && (uncertain >> accumulatedBits) != 0) {
+                erasures->push_back(static_cast<size_t>(out - data.data()));
+            }
+            *out++ = static_cast<uint8_t>(accumulator >> accumulatedBits);
+            accumulator &= (1u << accumulatedBits) - 1;
+            uncertain &= (1u << accumulatedBits) - 1;
+        }
+    }
+    data.resize(out - data.data());
+    return data;
+}
+
+std::vector<uint8_t> symbolsToData(const std::vector<int>& symbols, int bitsPerSymbol) {
+    return unpackSymbols<std::vector<uint8_t>>(symbols, bitsPerSymbol);
+}
+
+std::vector<uint8_t> symbolsToData(const std::vector<int>& symbols, int bitsPerSymbol,
+    const std::vector<uint8_t>& confidence, uint8_t threshold, std::vector<size_t>& erasures) {
+    erasures.clear();
+    return unpackSymbols<std::vector<uint8_t>>(symbols, bitsPerSymbol, confidence.data(), threshold, &erasures);
+}
+
+// 将符号写入图像像素（调用方内存，支持stride），未使用区域填充纯黑色
+static void writeQRACImage(const CodecContext& ctx, std::span<const int> symbols, const MutableImageView& output) {
+    int width = output.width;
+    int height = output.height;
+    int channels = output.channels;
+    int totalPixels = width * height;
+    int symbolsPerPixel = ctx.symbolsPerPixel();
+
+    int requiredPixels = (static_cast<int>(symbols.size()) + symbolsPerPixel - 1) / symbolsPerPixel;
+
+    if (requiredPixels > totalPixels) {
+        throw QRACException(ErrorType::ImageSizeError, "Image dimensions too small to contain all data");
+    }
+    if (channels < 3) {
+        throw QRACException(ErrorType::InvalidInput, "Output image needs at least 3 channels");
+    }
+
+    // 初始化为纯黑色填充（Alpha通道设为不透明）
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = output.row(y);
+        std::fill(row, row + static_cast<size_t>(width) * channels, uint8_t(0));
+        if (channels == 4) {
+            for (int x = 0; x < width; x++) {
+                row[x * 4 + 3] = 255;
+            }
+        }
+    }
+
+    // Map symbols to image pixels（逐行推进，避免每个像素做除法）
+    size_t symbolCount = symbols.size();
+    size_t i = 0;
+    for (int row = 0; row < height && i < symbolCount; row++) {
+        uint8_t* pixel = output.row(row);
+        for (int col = 0; col < width && i < symbolCount; col++, pixel += channels) {
+            // Assign symbols to each channel
+            for (int ch = 0; ch < symbolsPerPixel && i < symbolCount; ch++, i++) {
+                pixel[ch] = ctx.anchor(symbols[i]);
+            }
+        }
+    }
+}
+
+// Improved QRAC image creation function with filler value for unused areas
+ByteBuffer createQRACImage(const CodecContext& ctx, const std::vector<int>& symbols, int width, int height) {
+    // Create image data (使用RGB)
+    ByteBuffer imageData(static_cast<size_t>(width) * height * 3);
+    writeQRACImage(ctx, symbols, { imageData.data(), width, height, 3, 0 });
+    return imageData;
+}
+
+// Extract binary stream from symbol sequence, skipping filler values
+std::vector<bool> symbolsToBinary(const std::vector<int>& symbols, int bitsPerSymbol, size_t expectedBits) {
+    std::vector<bool> binaryStream;
+    binaryStream.reserve(expectedBits);
+
+    for (int symbol : symbols) {
+        // 跳过填充符号
+        if (symbol == -1) {
+            continue;
+        }
+
+        for (int i = bitsPerSymbol - 1; i >= 0; i--) {
+            bool bit = (symbol >> i) & 1;
+            binaryStream.push_back(bit);
+
+            // 如果已经达到预期的位数，停止处理
+            if (binaryStream.size() >= expectedBits) {
+                break;
+            }
+        }
+
+        // 如果已经达到预期的位数，停止处理
+        if (binaryStream.size() >= expectedBits) {
+            break;
+        }
+    }
+
+    if (binaryStream.size() > expectedBits) {
+        binaryStream.resize(expectedBits);
+    }
+
+    return binaryStream;
+}
+
+// Convert binary stream to byte data
+std::vector<uint8_t> binaryToData(const std::vector<bool>& binaryStream) {
+    std::vector<uint8_t> data;
+    size_t byteCount = (binaryStream.size() + 7) / 8;
+    data.reserve(byteCount);
+
+    for (size_t i = 0; i < binaryStream.size(); i += 8) {
+        uint8_t byte = 0;
+        for (int j = 0; j < 8; j++) {
+            if (i + j < binaryStream.size()) {
+                byte = (byte << 1) | (binaryStream[i + j] ? 1 : 0);
+            }
+            else {
+                byte = byte << 1; // Pad with 0
+            }
+        }
+        data.push_back(byte);
+    }
+
+    return data;
+}
+
+// Determine if data is text
+bool isTextData(const QRACConfig& profile, std::span<const uint8_t> data) {
+    if (data.empty()) return false;
+
+    size_t checkSize = std::min(data.size(), size_t(1000));
+    int printableCount = 0;
+    int controlCount = 0;
+    int nullCount = 0;
+
+    for (size_t i = 0; i < checkSize; i++) {
+        uint8_t c = data[i];
+        if (c >= 32 && c <= 126) { // 可打印ASCII字符
+            printableCount++;
+        }
+        else if (c == 9 || c == 10 || c == 13) { // 制表符、换行符、回车符
+            printableCount++;
+        }
+        else if (c == 0) { // 空字符
+            nullCount++;
+            // 文本文件中不应该有太多空字符
+            if (nullCount > checkSize / 20) { // 如果超过5%是空字符，可能是二进制文件
+                return false;
+            }
+        }
+        else if (c < 32) { // 其他控制字符
+            controlCount++;
+            // 文本文件中不应该有太多控制字符
+            if (controlCount > checkSize / 50) { // 如果超过2%是控制字符，可能是二进制文件
+                return false;
+            }
+        }
+        else {
+            // 可能是UTF-8多字节字符的一部分
+            printableCount++;
+        }
+    }
+
+    // 计算可打印字符的比例
+    float printableRatio = static_cast<float>(printableCount) / checkSize;
+    float controlRatio = static_cast<float>(controlCount) / checkSize;
+
+    // 可打印字符比例高且控制字符比例低的很可能是文本
+    return (printableRatio > profile.TEXT_DETECTION_THRESHOLD) &&
+        (controlRatio < profile.CONTROL_CHAR_THRESHOLD);
+}
+
+// Calculate optimal image dimensions for adaptive mode
+void calculateAdaptiveDimensions(const CodecContext& ctx, size_t dataSize, int* width, int* height) {
+    const QRACConfig& profile = ctx.profile();
+
+    // 计算每个符号的位数
+    int bitsPerSymbol = ctx.bitsPerSymbol();
+
+    // 计算所需的总符号数（包括FEC）
+    size_t totalSymbols = (dataSize * 8 + bitsPerSymbol - 1) / bitsPerSymbol;
+
+    // 计算所需像素数（每个像素存储3个符号）
+    int symbolsPerPixel = ctx.symbolsPerPixel();
+    int pixelsNeeded = static_cast<int>((totalSymbols + symbolsPerPixel - 1) / symbolsPerPixel); // 向上取整
+
+    // 找到能容纳像素的最小正方形
+    int side = static_cast<int>(std::ceil(std::sqrt(pixelsNeeded)));
+
+    // 确保最小尺寸
+    side = std::max(side, profile.MIN_IMAGE_DIMENSION);
+
+    // 计算实际需要的行数和列数
+    int actualWidth = std::max(1, static_cast<int>(std::ceil(std::sqrt(pixelsNeeded)))); // 空数据时避免除零
+    int actualHeight = (pixelsNeeded + actualWidth - 1) / actualWidth;
+
+    *width = std::max(actualWidth, profile.MIN_IMAGE_DIMENSION);
+    *height = std::max(actualHeight, profile.MIN_IMAGE_DIMENSION);
+}
+
+// 计算编码inputSize字节所用的图像尺寸
+void encodedImageDimensions(const CodecContext& ctx, size_t inputSize, SizeMode mode, int* width, int* height) {
+    const QRACConfig& profile = ctx.profile();
+
+    if (mode == SizeMode::Adaptive) {
+        calculateAdaptiveDimensions(ctx, protectedSize(ctx, inputSize), width, height);
+        return;
+    }
+
+    // auto mode：按原始文件大小选择档位
+    int side = profile.DEFAULT_LARGE_SIZE;
+    if (inputSize <= profile.SMALL_FILE_THRESHOLD) {
+        side = profile.DEFAULT_SMALL_SIZE;
+    }
+    else if (inputSize <= profile.MEDIUM_FILE_THRESHOLD) {
+        side = profile.DEFAULT_MEDIUM_SIZE;
+    }
+    *width = side;
+    *height = side;
+}
+
+// 提取图像中的符号序列（填充像素产生-1），少于3个通道时按灰度处理
+// deviating不为空时同时统计偏离锚点的颜色值（与correctInPlace的计数相同）
+// confidence不为空时写入每个符号的置信度（与符号一一对应）
+// calibration已应用时每个颜色通道使用校准后的判决表，否则都使用上下文的表
+template <typename Symbols>
+static Symbols readSymbols(const CodecContext& ctx, const ImageView& image, size_t* deviating = nullptr,
+    uint8_t* confidence = nullptr, const LevelCalibration* calibration = nullptr) {
+    int symbolsPerPixel = ctx.symbolsPerPixel();
+    Symbols symbols(static_cast<size_t>(image.width) * image.height * symbolsPerPixel);
+    int* out = symbols.data();
+    const DecisionTables* tables[3];
+    for (int ch = 0; ch < 3; ch++) {
+        tables[ch] = calibration && calibration->applied ? &calibration->forChannel(ch) : &ctx.decisionTables();
+    }
+    int colors = image.channels >= 3 ? 3 : 1;
+    size_t deviatingValues = 0;
+
+    for (int y = 0; y < image.height; y++) {
+        const uint8_t* row = image.row(y);
+        for (int x = 0; x < image.width; x++) {
+            const uint8_t* source = row + static_cast<size_t>(x) * image.channels;
+            uint8_t pixel[3];
+            if (image.channels >= 3) {
+                pixel[0] = source[0];
+                pixel[1] = source[1];
+                pixel[2] = source[2];
+            }
+            else {
+                pixel[0] = pixel[1] = pixel[2] = source[0];
+            }
+
+            // 检查整个像素是否在填充颜色范围内（接近黑色）
+            if (tables[0]->symbol[pixel[0]] < 0 && tables[1]->symbol[pixel[1]] < 0 && tables[2]->symbol[pixel[2]] < 0) {
+                for (int ch = 0; ch < symbolsPerPixel; ch++) {
+                    *out++ = -1;
+                }
+                if (confidence) {
+                    for (int ch = 0; ch < symbolsPerPixel; ch++) {
+                        *confidence++ = 255;
+                    }
+                }
+            }
+            else {
+                for (int ch = 0; ch < symbolsPerPixel; ch++) {
+                    *out++ = tables[ch]->symbol[pixel[ch]];
+                }
+                if (confidence) {
+                    for (int ch = 0; ch < symbolsPerPixel; ch++) {
+                        *confidence++ = tables[ch]->confidence[pixel[ch]];
+                    }
+                }
+                if (deviating) {
+                    for (int ch = 0; ch < colors; ch++) {
+                        deviatingValues += tables[ch]->deviation[pixel[ch]];
+                    }
+                }
+            }
+        }
+    }
+
+    if (deviating) {
+        *deviating = deviatingValues;
+    }
+    return symbols;
+}
+
+std::vector<int> extractSymbols(const CodecContext& ctx, const ImageView& image, size_t* deviatingValues,
+    std::vector<uint8_t>* confidence, const LevelCalibration* calibration) {
+    if (confidence) {
+        confidence->resize(static_cast<size_t>(image.width) * image.height * ctx.symbolsPerPixel());
+    }
+    return readSymbols<std::vector<int>>(ctx, image, deviatingValues, confidence ? confidence->data() : nullptr, calibration);
+}
+
+// ---------- 电平校准 ----------
+
+using LevelHistogram = std::array<size_t, 256>;
+
+// 一遍扫描统计前colors个颜色通道的直方图，覆盖每个像素。
+// 直方图累加是分散写入，没有可用的向量化形式（树中也没有SIMD代码）：
+// 每个通道两份直方图按像素交替累加，相邻像素的相同值不必等待上一次累加写回
+static void levelHistograms(const ImageView& image, int colors, LevelHistogram* histograms) {
+    std::array<LevelHistogram, 6> partial{};
+    for (int y = 0; y < image.height; y++) {
+        const uint8_t* row = image.row(y);
+        int x = 0;
+        for (; x + 1 < image.width; x += 2) {
+            const uint8_t* even = row + static_cast<size_t>(x) * image.channels;
+            const uint8_t* odd = even + image.channels;
+            for (int ch = 0; ch < colors; ch++) {
+                partial[ch * 2][even[ch]]++;
+                partial[ch * 2 + 1][odd[ch]]++;
+            }
+        }
+        if (x < image.width) {
+            const uint8_t* last = row + static_cast<size_t>(x) * image.channels;
+            for (int ch = 0; ch < colors; ch++) {
+                partial[ch * 2][last[ch]]++;
+            }
+        }
+    }
+    for (int ch = 0; ch < colors; ch++) {
+        for (int value = 0; value < 256; value++) {
+            histograms[ch][value] = partial[ch * 2][value] + partial[ch * 2 + 1][value];
+        }
+    }
+}
+
+// 仿射变换 观测值 = scale * 标准值 + offset 的对齐得分：每个观测值换算回标准电平，
+// 落在锚点（或填充值0）上计+1，离最近的锚点半个间隔以上（间隔边缘、编码时用不到的间隔）计-1，之间线性变化。
+// 噪声覆盖整个间隔时直方图是平的，得分接近0；偏移整数个间隔的变换会把两端的峰值换算到用不到的电平上而扣分。
+// 0和255可能是截断的结果，不计入；每个值的计数不超过cap，大片填充像素只相当于少数几个锚点
+static double alignmentScore(const CodecContext& ctx, const LevelHistogram& histogram, int used, size_t cap,
+    double scale, double offset) {
+    double halfInterval = ctx.profile().L / 2.0;
+    double first = ctx.anchor(0);
+    double last = ctx.anchor(used - 1);
+    double score = 0.0;
+    for (int value = 1; value < 255; value++) {
+        if (histogram[value] == 0) continue;
+        double level = (value - offset) / scale;
+        double distance;
+        if (level <= ctx.profile().FILLER_MAX_VALUE + 0.5) {
+            distance = std::abs(level);
+        }
+        else if (level <= first) {
+            distance = first - level;
+        }
+        else if (level >= last) {
+            distance = level - last;
+        }
+        else {
+            int k = static_cast<int>((level - first) / ctx.profile().L + 0.5);
+            distance = std::abs(level - ctx.anchor(std::min(k, used - 1)));
+        }
+        score += static_cast<double>(std::min(histogram[value], cap)) * (1.0 - 2.0 * std::min(distance / halfInterval, 1.0));
+    }
+    return score;
+}
+
+// 直接在直方图中找峰值：相邻峰值之间的谷底不到较低峰值的一半时合并，计数太少的峰值忽略。
+// 找到的数据峰值恰好为used个且间距均匀（相邻间距之比在0.6-1.6之间，没有缺失的符号）时，
+// 按顺序对应到各个锚点，任何单调的电平变化（包括伽马）都适用。比数据峰值多一个时最低的是填充像素
+// distinct：合并后的峰值数（噪声大到峰值连成一片时远少于used）
+static bool findPeaks(const LevelHistogram& histogram, int used, size_t minMass, std::vector<double>& peaks,
+    size_t& distinct) {
+    // 局部最大值（相等的平台取中点）
+    std::vector<int> maxima;
+    for (int value = 1; value < 255; value++) {
+        if (histogram[value] == 0 || histogram[value] < histogram[value - 1]) continue;
+        int end = value;
+        while (end + 1 < 255 && histogram[end + 1] == histogram[value]) end++;
+        if (end + 1 > 254 || histogram[end + 1] < histogram[value]) {
+            maxima.push_back((value + end) / 2);
+        }
+        value = end;
+    }
+    // 合并谷底不明显的相邻峰值，保留较高的
+    auto valley = [&](int left, int right) {
+        size_t lowest = histogram[left];
+        for (int value = left; value <= right; value++) lowest = std::min(lowest, histogram[value]);
+        return lowest;
+    };
+    std::vector<int> merged;
+    for (int position : maxima) {
+        while (!merged.empty()) {
+            int previous = merged.back();
+            if (valley(previous, position) * 2 < std::min(histogram[previous], histogram[position])) break;
+            if (histogram[previous] >= histogram[position]) {
+                position = previous;
+            }
+            merged.pop_back();
+        }
+        merged.push_back(position);
+    }
+    distinct = merged.size();
+    if (merged.size() != static_cast<size_t>(used) && merged.size() != static_cast<size_t>(used) + 1) {
+        return false;
+    }
+
+    // 每个峰值取两侧谷底之间的重心（填充像素的峰值不参与）
+    std::vector<double> found;
+    for (size_t i = merged.size() - used; i < merged.size(); i++) {
+        int left = i == 0 ? 1 : (merged[i - 1] + merged[i]) / 2 + 1;
+        int right = i + 1 == merged.size() ? 254 : (merged[i] + merged[i + 1]) / 2;
+        size_t mass = 0;
+        double weighted = 0.0;
+        for (int value = left; value <= right; value++) {
+            mass += histogram[value];
+            weighted += static_cast<double>(histogram[value]) * value;
+        }
+        if (mass < minMass) return false;
+        found.push_back(weighted / mass);
+    }
+    for (size_t i = 2; i < found.size(); i++) {
+        double ratio = (found[i] - found[i - 1]) / (found[i - 1] - found[i - 2]);
+        if (ratio < 0.6 || ratio > 1.6) return false;
+    }
+    peaks = std::move(found);
+    return true;
+}
+
+// 拟合一个通道：先在缩放/偏移网格上找得分最高的仿射变换，直方图有明显的峰值且好于恒等变换时才采用；
+// 再在每个锚点附近取直方图的重心作为观测峰值，从中间的锚点向两端推进并累积残差，
+// 伽马等平滑的非线性变化也能跟上
+// peaks：每个间隔（包括编码时用不到的间隔）的观测峰值，严格递增
+static void fitLevels(const CodecContext& ctx, const LevelHistogram& histogram, float& scale, float& offset,
+    std::vector<double>& peaks, float& maxShift) {
+    int used = 1 << ctx.bitsPerSymbol();
+    double interval = ctx.profile().L;
+    size_t total = 0;
+    for (int value = 1; value < 255; value++) total += histogram[value];
+    size_t cap = total * 2 / used + 1;
+    size_t minMass = std::max<size_t>(16, total / (static_cast<size_t>(used) * 16));
+
+    // 每个符号都有可分辨的峰值时直接按顺序对应，编码时用不到的间隔按最后的间距外推
+    std::vector<double> found;
+    size_t distinct = 0;
+    if (findPeaks(histogram, used, minMass, found, distinct)) {
+        double first = ctx.anchor(0);
+        double last = ctx.anchor(used - 1);
+        scale = static_cast<float>((found[used - 1] - found[0]) / (last - first));
+        offset = static_cast<float>(found[0] - scale * first);
+        peaks.assign(ctx.intervals(), 0.0);
+        maxShift = 0.0f;
+        for (int k = 0; k < ctx.intervals(); k++) {
+            peaks[k] = k < used ? found[k] : peaks[k - 1] + (found[used - 1] - found[used - 2]);
+            if (k < used) {
+                maxShift = std::max(maxShift, static_cast<float>(std::abs(peaks[k] - ctx.anchor(k))));
+            }
+        }
+        return;
+    }
+    // 可分辨的峰值太少（噪声、JPEG等把峰值连成一片）时仿射搜索也找不到明显的对齐，保持标准电平
+    scale = 1.0f;
+    offset = 0.0f;
+    peaks.clear();
+    maxShift = 0.0f;
+    if (distinct * 4 < static_cast<size_t>(used)) {
+        return;
+    }
+
+    double identityScore = alignmentScore(ctx, histogram, used, cap, 1.0, 0.0);
+    double bestScale = 1.0;
+    double bestOffset = 0.0;
+    double bestScore = identityScore;
+    double bestDistance = 0.0;
+    auto consider = [&](double a, double b) {
+        double score = alignmentScore(ctx, histogram, used, cap, a, b);
+        double distance = std::abs(a - 1.0) * 100 + std::abs(b);
+        if (score > bestScore || (score == bestScore && distance < bestDistance)) {
+            bestScore = score;
+            bestScale = a;
+            bestOffset = b;
+            bestDistance = distance;
+        }
+    };
+    // 粗搜索：缩放0.75-1.25（步长0.02），偏移±40（步长2）
+    for (int i = -12; i <= 12; i++) {
+        for (int b = -20; b <= 20; b++) {
+            consider(1.0 + i * 0.02, b * 2.0);
+        }
+    }
+    // 细搜索覆盖粗搜索的一个步长：缩放步长0.00125，偏移步长0.25
+    double coarseScale = bestScale;
+    double coarseOffset = bestOffset;
+    for (int i = -16; i <= 16; i++) {
+        for (int b = -8; b <= 8; b++) {
+            consider(coarseScale + i * 0.00125, coarseOffset + b * 0.25);
+        }
+    }
+    // 最好的变换下直方图仍然没有明显的峰值（平均得分不到1/4）时不校准
+    if (bestScore * 4 < static_cast<double>(total)) {
+        bestScale = 1.0;
+        bestOffset = 0.0;
+    }
+    scale = static_cast<float>(bestScale);
+    offset = static_cast<float>(bestOffset);
+
+    // 逐个锚点取窗口内的重心，窗口宽度为观测到的间隔长度
+    double spacing = bestScale * interval;
+    int halfWindow = std::max(1, static_cast<int>((spacing - 1) / 2 + 0.5));
+    peaks.assign(ctx.intervals(), 0.0);
+    maxShift = 0.0f;
+    auto refine = [&](int k, double& drift) {
+        double predicted = bestScale * ctx.anchor(k) + bestOffset;
+        peaks[k] = predicted + drift;
+        if (k >= used) return;
+        long center = std::lround(peaks[k]);
+        size_t mass = 0;
+        double weighted = 0.0;
+        for (long value = center - halfWindow; value <= center + halfWindow; value++) {
+            if (value < 0 || value > 255) continue;
+            mass += histogram[value];
+            weighted += static_cast<double>(histogram[value]) * value;
+        }
+        if (mass >= minMass) {
+            peaks[k] = weighted / mass;
+            drift = peaks[k] - predicted;
+        }
+    };
+    int middle = used / 2;
+    double drift = 0.0;
+    for (int k = middle; k < ctx.intervals(); k++) {
+        refine(k, drift);
+    }
+    drift = peaks[middle] - (bestScale * ctx.anchor(middle) + bestOffset);
+    for (int k = middle - 1; k >= 0; k--) {
+        refine(k, drift);
+    }
+    for (int k = 0; k < ctx.intervals(); k++) {
+        if (k > 0 && peaks[k] <= peaks[k - 1]) {
+            peaks[k] = peaks[k - 1] + spacing;
+        }
+        if (k < used) {
+            maxShift = std::max(maxShift, static_cast<float>(std::abs(peaks[k] - ctx.anchor(k))));
+        }
+    }
+}
+
+// 由观测峰值生成判决表：观测值按分段线性的逆映射换算回标准电平，再按标准间隔判决
+// 峰值与锚点一致时结果与上下文的判决表相同
+static void buildCalibratedTables(const CodecContext& ctx, const std::vector<double>& peaks, double scale,
+    DecisionTables& tables) {
+    const DecisionTables& standard = ctx.decisionTables();
+    double halfInterval = ctx.profile().L / 2.0;
+    int last = ctx.intervals() - 1;
+    size_t segment = 0;
+    for (int value = 0; value < 256; value++) {
+        // 换算回标准电平：峰值之间线性插值，两端按拟合的缩放外推
+        double level;
+        if (value <= peaks[0]) {
+            level = ctx.anchor(0) - (peaks[0] - value) / scale;
+        }
+        else if (value >= peaks[last]) {
+            level = ctx.anchor(last) + (value - peaks[last]) / scale;
+        }
+        else {
+            while (peaks[segment + 1] <= value) segment++;
+            double t = (value - peaks[segment]) / (peaks[segment + 1] - peaks[segment]);
+            level = ctx.anchor(static_cast<int>(segment)) +
+                t * (ctx.anchor(static_cast<int>(segment) + 1) - ctx.anchor(static_cast<int>(segment)));
+        }
+
+        int standardValue = static_cast<int>(std::clamp(std::floor(level + 0.5), 0.0, 255.0));
+        int symbol = standard.symbol[standardValue];
+        tables.symbol[value] = static_cast<int16_t>(symbol);
+        if (symbol == -1) {
+            tables.confidence[value] = 255;
+            tables.deviation[value] = 0;
+            continue;
+        }
+        double confidence = std::max(0.0, 1.0 - std::abs(level - ctx.anchor(symbol)) / halfInterval);
+        tables.confidence[value] = static_cast<uint8_t>(std::lround(confidence * 255));
+        tables.deviation[value] = std::lround(peaks[symbol]) != value ? 1 : 0;
+    }
+}
+
+// 电平校准：直方图一遍扫描，之后的拟合只处理256项的直方图，与图像大小无关
+LevelCalibration calibrateLevels(const CodecContext& ctx, const ImageView& image) {
+    LevelCalibration calibration;
+    int colors = image.channels >= 3 ? 3 : 1;
+    calibration.channels = colors;
+    for (DecisionTables& tables : calibration.tables) {
+        tables = ctx.decisionTables();
+    }
+    // 间隔太窄时相邻峰值无法分开，只用标准判决表
+    if (ctx.profile().L < 3 || !image.pixels || image.width <= 0 || image.height <= 0) {
+        return calibration;
+    }
+
+    // 编码时每像素只写前symbolsPerPixel个通道，其余通道保持标准判决表
+    int fitted = colors == 3 ? ctx.symbolsPerPixel() : 1;
+    LevelHistogram histograms[3];
+    levelHistograms(image, fitted, histograms);
+
+    std::vector<double> peaks;
+    for (int ch = 0; ch < fitted; ch++) {
+        float shift = 0.0f;
+        fitLevels(ctx, histograms[ch], calibration.scale[ch], calibration.offset[ch], peaks, shift);
+        calibration.maxShift = std::max(calibration.maxShift, shift);
+        // 峰值偏离锚点不到1个像素值时（对称的噪声等）保持标准判决表
+        if (shift >= 1.0f) {
+            buildCalibratedTables(ctx, peaks, calibration.scale[ch], calibration.tables[ch]);
+            calibration.applied |= calibration.tables[ch].symbol != ctx.decisionTables().symbol;
+        }
+    }
+    return calibration;
+}
+
+static thread_local StageHook t_stageHook = nullptr;
+
+void setStageHook(StageHook hook) {
+    t_stageHook = hook;
+}
+
+// 报告中的阶段耗时：不需要报告时不读取时钟；阶段结束时调用本线程的阶段回调
+class StageClock {
+public:
+    explicit StageClock(bool enabled) : m_enabled(enabled) {
+        if (enabled) m_last = std::chrono::steady_clock::now();
+    }
+
+    // 距上次调用（或构造）的秒数
+    double lap(const char* stage) {
+        if (t_stageHook) t_stageHook(stage);
+        if (!m_enabled) return 0.0;
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - m_last).count();
+        m_last = now;
+        return seconds;
+    }
+
+private:
+    bool m_enabled;
+    std::chrono::steady_clock::time_point m_last;
+};
+
+// 编码到调用方提供的像素内存
+void encodeInto(std::span<const uint8_t> data, const CodecContext& ctx, const MutableImageView& output, EncodeReport* report) {
+    StageClock clock(report != nullptr);
+    ByteBuffer payload;
+    payload.reserve(protectedSize(ctx, data.size()));
+    payload.assign(data.begin(), data.end());
+
+    // Add forward error correction
+    addFEC(ctx, payload);
+    double fecSeconds = clock.lap("fec");
+
+    // 数据 -> 符号序列
+    SymbolBuffer symbols = packSymbols<SymbolBuffer>(ctx, payload);
+
+    int symbolsPerPixel = ctx.symbolsPerPixel();
+    size_t requiredPixels = (symbols.size() + symbolsPerPixel - 1) / symbolsPerPixel;
+    if (report) {
+        report->inputBytes = data.size();
+        report->encodedBytes = payload.size();
+        report->bits = payload.size() * 8;
+        report->symbols = symbols.size();
+        report->requiredPixels = requiredPixels;
+        report->width = output.width;
+        report->height = output.height;
+        report->fecSeconds = fecSeconds;
+    }
+
+    if (requiredPixels > static_cast<size_t>(output.width) * output.height) {
+        throw QRACException(ErrorType::ImageSizeError,
+            "Image dimensions (" + std::to_string(output.width) + "x" + std::to_string(output.height) +
+            ") too small for " + std::to_string(symbols.size()) + " symbols (required pixels: " +
+            std::to_string(requiredPixels) + "). Consider using a larger mode or adaptive mode");
+    }
+
+    writeQRACImage(ctx, symbols, output);
+    double packSeconds = clock.lap("pack");
+    if (report) {
+        report->packSeconds = packSeconds;
+    }
+}
+
+// 编码：数据 -> QRAC图像（RGB）
+Image encode(std::span<const uint8_t> data, const CodecContext& ctx, SizeMode mode, EncodeReport* report) {
+    Image image;
+    encodedImageDimensions(ctx, data.size(), mode, &image.width, &image.height);
+    image.channels = 3;
+    image.pixels.resize(static_cast<size_t>(image.width) * image.height * image.channels);
+    encodeInto(data, ctx, image.mutableView(), report);
+    return image;
+}
+
+Image encode(std::span<const uint8_t> data, const Profile& profile, SizeMode mode) {
+    return encode(data, CodecContext(profile), mode);
+}
+
+// 解码：QRAC图像 -> 数据
+ByteBuffer decode(const ImageView& image, const CodecContext& ctx, DecodeReport* report) {
+    if (!image.pixels || image.width <= 0 || image.height <= 0 || image.channels < 1 || image.channels > 4) {
+        throw QRACException(ErrorType::InvalidInput, "Invalid image view");
+    }
+
+    int bitsPerSymbol = ctx.bitsPerSymbol();
+    size_t totalSymbols = static_cast<size_t>(image.width) * image.height * ctx.symbolsPerPixel();
+
+    StageClock clock(report != nullptr);
+
+    // 电平整体偏移或缩放的图像先校准判决表，否则整段数据系统性地判错，只能交给FEC
+    LevelCalibration calibration;
+    if (ctx.profile().CALIBRATE_LEVELS) {
+        calibration = calibrateLevels(ctx, image);
+    }
+
+    // Extract symbols from image（按间隔查表，偏离锚点的值在这里吸附）
+    // Reed-Solomon可以利用擦除：同时记录每个符号的置信度
+    size_t deviatingValues = 0;
+    bool softDecision = ctx.profile().USE_ADVANCED_FEC;
+    ByteBuffer confidence(softDecision ? totalSymbols : 0);
+    SymbolBuffer symbols = readSymbols<SymbolBuffer>(ctx, image, report ? &deviatingValues : nullptr,
+        softDecision ? confidence.data() : nullptr, &calibration);
+
+    // Convert symbols to byte data
+    std::vector<size_t> erasures;
+    ByteBuffer extractedData = unpackSymbols<ByteBuffer>(symbols, bitsPerSymbol,
+        softDecision ? confidence.data() : nullptr, ctx.erasureThreshold(), &erasures);
+    size_t extractedBytes = extractedData.size();
+    double unpackSeconds = clock.lap("unpack");
+
+    // Apply FEC error correction
+    FECReport fecReport;
+    bool dataValid = verifyAndCorrectFEC(ctx, extractedData, &fecReport, erasures);
+    double fecSeconds = clock.lap("fec");
+
+    if (report) {
+        report->fecSeconds = fecSeconds;
+        report->unpackSeconds = unpackSeconds;
+        size_t fillerSymbols = static_cast<size_t>(std::count(symbols.begin(), symbols.end(), -1));
+        report->fillerPixels = fillerSymbols / ctx.symbolsPerPixel();
+        report->deviatingValues = deviatingValues;
+        report->levelsCalibrated = calibration.applied;
+        report->levelShift = calibration.maxShift;
+        report->storableSymbols = totalSymbols;
+        report->extractedSymbols = symbols.size();
+        report->extractedBits = (symbols.size() - fillerSymbols) * bitsPerSymbol;
+        report->extractedBytes = extractedBytes;
+        report->payloadBytes = extractedData.size();
+        report->dataValid = dataValid;
+        report->fec = fecReport;
+    }
+
+    return extractedData;
+}
+
+ByteBuffer decode(const ImageView& image, const Profile& profile) {
+    return decode(image, CodecContext(profile));
+}
+
+bool verify(const ImageView& image, const CodecContext& ctx, DecodeReport* report) {
+    DecodeReport local;
+    DecodeReport& decoded = report ? *report : local;
+    ByteBuffer data = decode(image, ctx, &decoded);
+    return decoded.fec.hasPayloadHash && blake3(data.data(), data.size()) == decoded.fec.payloadHash;
+}
+
+// 校正一行：每个颜色值查表吸附并累计偏离数。填充值吸附为0、锚点都不为0，
+// 所以颜色值全部变为0的像素就是填充像素（全部是填充值），不需要单独判断和第二遍扫描
+static void correctRow(const CodecContext& ctx, uint8_t* row, int width, int channels, CorrectionReport& counts) {
+    const uint8_t* snap = ctx.snapTable();
+    const uint8_t* deviation = ctx.deviationTable();
+    size_t deviating = 0;
+    size_t filler = 0;
+
+    if (channels == 3 || channels == 1) {
+        // 没有Alpha：整行按字节连续处理
+        size_t count = static_cast<size_t>(width) * channels;
+        for (size_t i = 0; i < count; i++) {
+            uint8_t value = row[i];
+            row[i] = snap[value];
+            deviating += deviation[value];
+        }
+        if (channels == 3) {
+            for (size_t i = 0; i < count; i += 3) {
+                filler += (row[i] | row[i + 1] | row[i + 2]) == 0;
+            }
+        }
+        else {
+            for (size_t i = 0; i < count; i++) {
+                filler += row[i] == 0;
+            }
+        }
+    }
+    else {
+        // 2/4通道：最后一个通道为Alpha，保留原值
+        int colors = channels - 1;
+        for (int x = 0; x < width; x++) {
+            uint8_t* pixel = row + static_cast<size_t>(x) * channels;
+            uint8_t any = 0;
+            for (int ch = 0; ch < colors; ch++) {
+                uint8_t value = pixel[ch];
+                pixel[ch] = snap[value];
+                deviating += deviation[value];
+                any |= pixel[ch];
+            }
+            filler += any == 0;
+        }
+    }
+
+    counts.deviatingValues += deviating;
+    counts.fillerPixels += filler;
+}
+
+void correctInPlace(const MutableImageView& image, const CodecContext& ctx, CorrectionReport* report) {
+    if (!image.pixels || image.width <= 0 || image.height <= 0 || image.channels < 1 || image.channels > 4) {
+        throw QRACException(ErrorType::InvalidInput, "Invalid image view");
+    }
+
+    CorrectionReport counts;
+    counts.totalPixels = static_cast<size_t>(image.width) * image.height;
+    for (int y = 0; y < image.height; y++) {
+        correctRow(ctx, image.row(y), image.width, image.channels, counts);
+    }
+
+    if (report) {
+        *report = counts;
+    }
+}
+
+// 校正：复制到新图像（少于3个通道的转换为3通道）后原地校正
+Image correct(const ImageView& image, const CodecContext& ctx, CorrectionReport* report) {
+    if (!image.pixels || image.width <= 0 || image.height <= 0 || image.channels < 1 || image.channels > 4) {
+        throw QRACException(ErrorType::InvalidInput, "Invalid image view");
+    }
+
+    Image corrected;
+    corrected.width = image.width;
+    corrected.height = image.height;
+    corrected.channels = std::max(image.channels, 3);
+    corrected.pixels.resize(static_cast<size_t>(corrected.width) * corrected.height * corrected.channels);
+
+    size_t rowBytes = static_cast<size_t>(image.width) * corrected.channels;
+    for (int y = 0; y < image.height; y++) {
+        const uint8_t* source = image.row(y);
+        uint8_t* target = corrected.pixels.data() + y * rowBytes;
+        if (image.channels >= 3) {
+            std::memcpy(target, source, rowBytes);
+            continue;
+        }
+        for (int x = 0; x < image.width; x++) {
+            target[x * 3] = target[x * 3 + 1] = target[x * 3 + 2] = source[static_cast<size_t>(x) * image.channels];
+        }
+    }
+
+    correctInPlace(corrected.mutableView(), ctx, report);
+    return corrected;
+}
+
+// 从内存中的图像文件加载
+Image loadImage(std::span<const uint8_t> encoded, int desiredChannels) {
+    int width = 0, height = 0, channels = 0;
+    unsigned char* data = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()),
+        &width, &height, &channels, desiredChannels);
+    if (!data) {
+        throw QRACException(ErrorType::ImageLoadError, "Failed to load image from memory");
+    }
+
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.channels = desiredChannels != 0 ? desiredChannels : channels;
+    image.pixels.assign(data, data + static_cast<size_t>(width) * height * image.channels);
+    stbi_image_free(data);
+    return image;
+}
+
+// PNG压缩函数（无损，目标大小仅作参考）
+ByteBuffer compressImageAuto(std::span<const uint8_t> imageData, int width, int height, int channels, size_t maxSizeKB) {
+    // 只做无损压缩：缩放会改变像素值，破坏编码的符号，因此超出目标大小时也不缩小图像，
+    // 由调用方提示即可
+    (void)maxSizeKB;
+    return encodePng({ imageData.data(), width, height, channels, 0 });
+}
+
+// PNG数据块的CRC32（多项式0xEDB88320），按8字节查表（slicing-by-8），存储模式下整个IDAT都要计算
+static uint32_t pngCrc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const auto tables = [] {
+        std::array<std::array<uint32_t, 256>, 8> entries{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[0][n] = c;
+        }
+        for (uint32_t n = 0; n < 256; n++) {
+            for (int t = 1; t < 8; t++) {
+                entries[t][n] = (entries[t - 1][n] >> 8) ^ entries[0][entries[t - 1][n] & 0xFF];
+            }
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low = crc ^ (uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24);
+        crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24]
+            ^ tables[3][data[4]] ^ tables[2][data[5]] ^ tables[1][data[6]] ^ tables[0][data[7]];
+    }
+    for (; size > 0; data++, size--) {
+        crc = tables[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t pngChunkCrc(const char* type, std::span<const uint8_t> data) {
+    uint32_t crc = pngCrc32(reinterpret_cast<const uint8_t*>(type), 4);
+    return pngCrc32(data.data(), data.size(), crc);
+}
+
+static void appendBigEndian32(ByteBuffer& out, uint32_t value) {
+    uint8_t bytes[4] = { uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value) };
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+// 不压缩的PNG：每行滤波类型0，zlib存储块（每块最多65535字节），只做复制和校验和
+static ByteBuffer encodePngStored(const ImageView& image) {
+    static const uint8_t kColorTypes[] = { 0, 4, 2, 6 }; // 灰度、灰度+Alpha、RGB、RGBA
+    const size_t rowBytes = static_cast<size_t>(image.width) * image.channels;
+    const size_t rawBytes = (rowBytes + 1) * image.height;
+    const size_t blocks = std::max<size_t>(1, (rawBytes + 65534) / 65535);
+    const size_t idatBytes = 2 + rawBytes + blocks * 5 + 4;
+    if (idatBytes > 0x7FFFFFFFu) {
+        throw QRACException(ErrorType::ImageSaveError, "Image too large for a single PNG data chunk");
+    }
+
+    ByteBuffer out;
+    out.reserve(8 + 25 + 12 + idatBytes + 12);
+    static const uint8_t kSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.insert(out.end(), kSignature, kSignature + 8);
+
+    auto beginChunk = [&](const char* type, uint32_t length) {
+        appendBigEndian32(out, length);
+        out.insert(out.end(), type, type + 4);
+        return out.size() - 4; // CRC从类型开始计算
+    };
+    auto endChunk = [&](size_t start) {
+        appendBigEndian32(out, pngCrc32(out.data() + start, out.size() - start));
+    };
+
+    size_t chunk = beginChunk("IHDR", 13);
+    appendBigEndian32(out, static_cast<uint32_t>(image.width));
+    appendBigEndian32(out, static_cast<uint32_t>(image.height));
+    const uint8_t header[] = { 8, kColorTypes[image.channels - 1], 0, 0, 0 };
+    out.insert(out.end(), header, header + 5);
+    endChunk(chunk);
+
+    chunk = beginChunk("IDAT", static_cast<uint32_t>(idatBytes));
+    out.push_back(0x78); // zlib头：deflate，32K窗口，无预设字典
+    out.push_back(0x01);
+
+    // 按存储块切分原始扫描行，同时计算Adler-32
+    size_t rawLeft = rawBytes;
+    size_t blockLeft = 0;
+    uint32_t s1 = 1, s2 = 0;
+    auto emit = [&](const uint8_t* data, size_t size) {
+        while (size > 0) {
+            if (blockLeft == 0) {
+                blockLeft = std::min<size_t>(rawLeft, 65535);
+                uint16_t length = static_cast<uint16_t>(blockLeft);
+                const uint8_t blockHeader[] = { uint8_t(rawLeft == blockLeft ? 1 : 0),
+                    uint8_t(length), uint8_t(length >> 8), uint8_t(~length), uint8_t(~length >> 8) };
+                out.insert(out.end(), blockHeader, blockHeader + 5);
+            }
+            size_t count = std::min(size, blockLeft);
+            out.insert(out.end(), data, data + count);
+            // 局部变量累加（通过引用累加时每次写入都要重新读取数据，字节指针可能与其重叠）
+            uint32_t a = s1, b = s2;
+            for (size_t done = 0; done < count;) {
+                size_t step = std::min<size_t>(count - done, 5552); // 5552字节内累加不会溢出
+                for (size_t i = 0; i < step; i++) {
+                    a += data[done + i];
+                    b += a;
+                }
+                a %= 65521;
+                b %= 65521;
+                done += step;
+            }
+            s1 = a;
+            s2 = b;
+            data += count;
+            size -= count;
+            blockLeft -= count;
+            rawLeft -= count;
+        }
+    };
+    const uint8_t filter = 0;
+    for (int y = 0; y < image.height; y++) {
+        emit(&filter, 1);
+        emit(image.row(y), rowBytes);
+    }
+    appendBigEndian32(out, (s2 << 16) | s1);
+    endChunk(chunk);
+
+    endChunk(beginChunk("IEND", 0));
+    return out;
+}
+
+// PNG编码（无损），直接读取视图内存
+ByteBuffer encodePng(const ImageView& image, PngCompression compression) {
+    if (compression == PngCompression::Store) {
+        return encodePngStored(image);
+    }
+    // 使用PNG格式进行无损压缩
+    int compressedSize;
+    unsigned char* compressedData = stbi_write_png_to_mem(
+        image.pixels, static_cast<int>(image.rowStride()), image.width, image.height, image.channels, &compressedSize);
+    if (!compressedData) {
+        throw QRACException(ErrorType::ImageSaveError, "Failed to compress image");
+    }
+
+    // 将压缩后的数据复制到vector中
+    ByteBuffer result(compressedData, compressedData + compressedSize);
+    STBIW_FREE(compressedData);
+
+    return result;
+}
+
+// BMP编码，stb的BMP写入函数不支持行跨距，非紧凑的视图先复制
+ByteBuffer encodeBmp(const ImageView& image) {
+    const size_t rowBytes = static_cast<size_t>(image.width) * image.channels;
+    ByteBuffer packed;
+    const uint8_t* pixels = image.pixels;
+    if (image.rowStride() != rowBytes) {
+        packed.resize(rowBytes * image.height);
+        for (int y = 0; y < image.height; y++) {
+            std::memcpy(packed.data() + y * rowBytes, image.pixels + y * image.rowStride(), rowBytes);
+        }
+        pixels = packed.data();
+    }
+
+    // 预留完整文件大小（24位：54字节文件头，每行补齐到4字节；32位：122字节文件头），写入过程中不再扩容
+    ByteBuffer result;
+    if (image.channels == 4) {
+        result.reserve(122 + rowBytes * image.height);
+    }
+    else {
+        result.reserve(54 + (static_cast<size_t>(image.width) * 3 + 3) / 4 * 4 * image.height);
+    }
+    auto append = [](void* context, void* data, int size) {
+        auto* out = static_cast<ByteBuffer*>(context);
+        out->insert(out->end(), static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
+    };
+    if (!stbi_write_bmp_to_func(append, &result, image.width, image.height, image.channels, pixels)) {
+        throw QRACException(ErrorType::ImageSaveError, "Failed to encode BMP image");
+    }
+    return result;
+}
+
+// 文件类型检测
+std::string detectFileType(const QRACConfig& profile, std::span<const uint8_t> data) {
+    if (data.size() < 4) return "bin";
+
+    // 常见文件类型签名
+    static const std::unordered_map<std::string, std::vector<uint8_t>> signatures = {
+        {"zip", {0x50, 0x4B, 0x03, 0x04}},
+        {"doc", {0xD0, 0xCF, 0x11, 0xE0}},
+        {"pdf", {0x25, 0x50, 0x44, 0x46}},
+        {"png", {0x89, 0x50, 0x4E, 0x47}},
+        {"jpg", {0xFF, 0xD8, 0xFF, 0xE0}},
+        {"jpg2", {0xFF, 0xD8, 0xFF, 0xE1}},
+        {"bmp", {0x42, 0x4D}},
+        {"gif", {0x47, 0x49, 0x46, 0x38}}
+    };
+
+    for (const auto& pair : signatures) {
+        const std::vector<uint8_t>& sig = pair.second;
+        if (data.size() >= sig.size() &&
+            std::equal(sig.begin(), sig.end(), data.begin())) {
+            return pair.first;
+        }
+    }
+
+    // 如果不是已知的二进制格式，检查是否为文本
+    return isTextData(profile, data) ? "txt" : "bin";
+}
+
+} // namespace qrac
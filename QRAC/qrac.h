@@ -0,0 +1,345 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * libqrac - 可嵌入的内存编解码库（C++接口）
+ *
+ * 所有函数只操作内存缓冲区，不访问文件系统，也不输出到控制台。
+ * 图像视图(ImageView)指向调用方持有的像素内存，支持行跨度(stride)，
+ * 解码时直接读取调用方内存，不做复制。
+ * 所有函数可重入：状态全部保存在只读的CodecContext中。
+ *
+ * C语言接口见 qrac_c.h
+ ******************************************************************/
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "qrac_arena.h"
+#include "qrac_hash.h"
+
+namespace qrac {
+
+// 配置结构体
+struct QRACConfig {
+    int L = 5; // Quantization interval length
+    uint8_t FILLER_MAX_VALUE = 10; // 最大填充值（深灰色）
+    float FEC_REDUNDANCY_RATIO = 0.25f; // FEC冗余比例
+    int MIN_IMAGE_DIMENSION = 16; // 最小图像尺寸
+    int DEFAULT_SMALL_SIZE = 128; // 默认小尺寸
+    int DEFAULT_MEDIUM_SIZE = 512; // 默认中尺寸
+    int DEFAULT_LARGE_SIZE = 1024; // 默认大尺寸
+    size_t SMALL_FILE_THRESHOLD = 96 * 1024; // 小文件阈值 (96KB)
+    size_t MEDIUM_FILE_THRESHOLD = 1024 * 1024; // 中文件阈值 (1MB)
+    int SYMBOLS_PER_PIXEL = 3; // 每像素符号数 (RGB)
+    int FEC_BLOCK_SIZE = 10; // FEC块大小
+    int MAX_FEC_WARNINGS = 15; // 最大FEC警告数
+    float TEXT_DETECTION_THRESHOLD = 0.85f; // 文本检测阈值
+    float CONTROL_CHAR_THRESHOLD = 0.05f; // 控制字符阈值
+    bool USE_ADVANCED_FEC = false; // true: 交错的Reed-Solomon（利用擦除，见qrac_rs.h），false: 简单FEC；解码时必须与编码时一致
+    float ERASURE_CONFIDENCE = 0.25f; // Reed-Solomon解码：置信度（0-1）低于此值的符号所在字节作为擦除位置
+    size_t CHECK_BLOCK_SIZE = 4096; // 分块CRC32C校验的块大小（字节，见qrac_check.h），0表示不分块校验（之前版本的格式）；不为0时解码按尾部标识识别两种格式
+    bool CALIBRATE_LEVELS = true; // 解码前按直方图校准像素电平（亮度/对比度/伽马变化后的图像），只影响解码
+};
+
+// 编解码配置（库接口中的名称）
+using Profile = QRACConfig;
+
+// 错误类型枚举
+enum class ErrorType {
+    FileNotFound,
+    FileReadError,
+    FileWriteError,
+    ImageLoadError,
+    ImageSaveError,
+    ImageSizeError,
+    DataSizeError,
+    FECError,
+    UserAbort,
+    InvalidInput
+};
+
+// 自定义异常类
+class QRACException : public std::runtime_error {
+public:
+    QRACException(ErrorType type, const std::string& message)
+        : std::runtime_error(message), m_type(type) {}
+
+    ErrorType getType() const { return m_type; }
+
+private:
+    ErrorType m_type;
+};
+
+// 计算间隔数量
+int calculateIntervals(const QRACConfig& profile);
+
+// Calculate anchor point value
+int calculateAnchor(const QRACConfig& profile, int intervalIndex);
+
+// 判决表：像素值 -> 符号（填充值为-1）、置信度（0-255）、是否偏离锚点（填充值不计）
+struct DecisionTables {
+    std::array<int16_t, 256> symbol{};
+    std::array<uint8_t, 256> confidence{};
+    std::array<uint8_t, 256> deviation{};
+};
+
+// 编解码上下文：每个配置（profile）构建一次，之后只读
+// 预先计算间隔数、每符号位数、锚点表和解码表，编码/解码/校正流程显式传递，
+// 不同配置的作业可以在同一进程中并行运行
+class CodecContext {
+public:
+    explicit CodecContext(const QRACConfig& profile);
+
+    const QRACConfig& profile() const { return m_profile; }
+    int intervals() const { return m_intervals; }
+    int bitsPerSymbol() const { return m_bitsPerSymbol; }
+    int symbolsPerPixel() const { return m_profile.SYMBOLS_PER_PIXEL; }
+
+    uint8_t anchor(int intervalIndex) const { return m_anchors[intervalIndex]; }
+    int symbolFor(uint8_t pixelValue) const { return m_decision.symbol[pixelValue]; }
+    const DecisionTables& decisionTables() const { return m_decision; }
+
+    // 校正表：像素值 -> 吸附后的值（填充值为0），以及该值是否偏离锚点（填充值不计）
+    const uint8_t* snapTable() const { return m_snapTable.data(); }
+    const uint8_t* deviationTable() const { return m_decision.deviation.data(); }
+
+    // 符号置信度（0-255）：像素值离所在间隔锚点越远越低，间隔边缘为0，填充值为255
+    uint8_t confidenceFor(uint8_t pixelValue) const { return m_decision.confidence[pixelValue]; }
+    const uint8_t* confidenceTable() const { return m_decision.confidence.data(); }
+    // 置信度低于此值的符号作为擦除（由ERASURE_CONFIDENCE换算）
+    uint8_t erasureThreshold() const { return m_erasureThreshold; }
+
+private:
+    QRACConfig m_profile;
+    int m_intervals = 0;
+    int m_bitsPerSymbol = 0;
+    std::vector<uint8_t> m_anchors;
+    DecisionTables m_decision;
+    std::array<uint8_t, 256> m_snapTable{};
+    uint8_t m_erasureThreshold = 0;
+};
+
+// 只读图像视图：像素内存由调用方持有
+struct ImageView {
+    const uint8_t* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 3;  // 1-4，少于3个通道时按灰度处理
+    size_t stride = 0; // 每行字节数，0表示紧密排列
+
+    size_t rowStride() const { return stride != 0 ? stride : static_cast<size_t>(width) * channels; }
+    const uint8_t* row(int y) const { return pixels + static_cast<size_t>(y) * rowStride(); }
+};
+
+// 可写图像视图：像素内存由调用方持有
+struct MutableImageView {
+    uint8_t* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 3;
+    size_t stride = 0;
+
+    size_t rowStride() const { return stride != 0 ? stride : static_cast<size_t>(width) * channels; }
+    uint8_t* row(int y) const { return pixels + static_cast<size_t>(y) * rowStride(); }
+    operator ImageView() const { return { pixels, width, height, channels, stride }; }
+};
+
+// 库分配的图像（紧密排列，像素内存经过arena，见qrac_arena.h）
+struct Image {
+    ByteBuffer pixels;
+    int width = 0;
+    int height = 0;
+    int channels = 3;
+
+    ImageView view() const { return { pixels.data(), width, height, channels, 0 }; }
+    MutableImageView mutableView() { return { pixels.data(), width, height, channels, 0 }; }
+};
+
+// 图像尺寸选择方式
+enum class SizeMode {
+    Auto,     // 按文件大小选择小/中/大固定尺寸
+    Adaptive  // 生成所需的最小图像
+};
+
+// 电平校准结果（见calibrateLevels）
+// 每个颜色通道拟合一条 标准锚点 -> 观测峰值 的分段线性映射，按其逆映射把观测值换算回标准电平后查判决表
+struct LevelCalibration {
+    bool applied = false;          // false：观测峰值与标准锚点一致，按CodecContext的判决表解码
+    int channels = 0;              // 校准的通道数（灰度图像为1）
+    float scale[3] = { 1, 1, 1 };  // 每通道拟合的仿射变换：观测值 ≈ scale * 标准值 + offset
+    float offset[3] = { 0, 0, 0 };
+    float maxShift = 0.0f;         // 观测峰值与标准锚点的最大偏差
+    DecisionTables tables[3];
+
+    // 第ch个颜色值使用的判决表
+    const DecisionTables& forChannel(int ch) const { return tables[channels == 3 ? ch : 0]; }
+};
+
+// 编码过程信息
+struct EncodeReport {
+    size_t inputBytes = 0;
+    size_t encodedBytes = 0;    // 含FEC
+    size_t bits = 0;
+    size_t symbols = 0;
+    size_t requiredPixels = 0;
+    int width = 0;
+    int height = 0;
+    double fecSeconds = 0.0;    // 各阶段耗时
+    double packSeconds = 0.0;   // 符号打包并写入像素
+};
+
+// FEC校验结果
+struct FECReport {
+    size_t correctedBytes = 0;
+    size_t failedBlocks = 0;         // 无法纠正的FEC块数
+    long long firstFailedBlock = -1; // 无法纠正的第一个FEC块，-1表示全部通过
+    size_t erasures = 0;             // 标记为擦除的字节数（Reed-Solomon）
+    size_t checkedBlocks = 0;        // 分块CRC32C校验的数据块数（CHECK_BLOCK_SIZE）
+    std::vector<size_t> damagedBlocks; // FEC之前CRC32C不符的数据块（序号），只有这些块交给FEC
+    bool checksDamaged = false;      // 校验表或尾部本身损坏：整个数据交给FEC
+    bool hasPayloadHash = false;     // 编码时记录了数据的BLAKE3哈希（分块校验的一部分，见qrac_check.h）
+    PayloadHash payloadHash{};
+};
+
+// 解码过程信息
+struct DecodeReport {
+    size_t storableSymbols = 0;
+    size_t extractedSymbols = 0;
+    size_t extractedBits = 0;
+    size_t extractedBytes = 0;
+    size_t payloadBytes = 0;
+    size_t fillerPixels = 0;
+    size_t deviatingValues = 0; // 偏离锚点的颜色值数量（提取时按间隔吸附，与先校正再解码的结果相同）
+    bool levelsCalibrated = false; // 按校准后的电平解码（见calibrateLevels）
+    float levelShift = 0.0f;       // 校准时观测峰值与标准锚点的最大偏差
+    bool dataValid = true;
+    FECReport fec;
+    double unpackSeconds = 0.0; // 各阶段耗时：读取像素并解包符号、FEC校验
+    double fecSeconds = 0.0;
+};
+
+// 校正过程信息
+struct CorrectionReport {
+    size_t totalPixels = 0;
+    size_t fillerPixels = 0;
+    size_t deviatingValues = 0; // 偏离锚点的通道值数量
+};
+
+// ---------- 流水线各阶段 ----------
+
+// 检查是否为填充值（包括接近黑色的像素）
+inline bool isFillerValue(const CodecContext& ctx, uint8_t pixelValue) {
+    return pixelValue <= ctx.profile().FILLER_MAX_VALUE;
+}
+
+// 检查整个像素是否为填充颜色
+inline bool isFillerPixel(const CodecContext& ctx, const uint8_t* pixel, int channels) {
+    return isFillerValue(ctx, pixel[0]) && isFillerValue(ctx, pixel[1]) && isFillerValue(ctx, pixel[2]);
+}
+
+// Decode pixel value to interval index（填充值返回-1）
+inline int decodeToSymbol(const CodecContext& ctx, uint8_t pixelValue) {
+    return ctx.symbolFor(pixelValue);
+}
+
+// 在数据之后追加分块校验（CHECK_BLOCK_SIZE不为0时）和FEC校验字节
+void addFEC(const CodecContext& ctx, std::vector<uint8_t>& data);
+void addFEC(const CodecContext& ctx, ByteBuffer& data);
+// 数据加上分块校验和FEC之后的字节数（addFEC之后的长度）
+size_t protectedSize(const CodecContext& ctx, size_t dataSize);
+// 有分块校验时先检查各块的CRC32C，全部通过时不做FEC解码；只有损坏的块交给FEC
+// erasures：可疑字节的位置（升序，见symbolsToData），只有Reed-Solomon使用
+bool verifyAndCorrectFEC(const CodecContext& ctx, std::vector<uint8_t>& data, FECReport* report = nullptr,
+    std::span<const size_t> erasures = {});
+bool verifyAndCorrectFEC(const CodecContext& ctx, ByteBuffer& data, FECReport* report = nullptr,
+    std::span<const size_t> erasures = {});
+std::vector<bool> dataToBinary(const std::vector<uint8_t>& data);
+std::vector<int> binaryToSymbols(const CodecContext& ctx, const std::vector<bool>& binaryStream, int bitsPerSymbol);
+ByteBuffer createQRACImage(const CodecContext& ctx, const std::vector<int>& symbols, int width, int height);
+// confidence不为空时同时输出每个符号的置信度（见CodecContext::confidenceFor）
+// calibration不为空且已应用时按校准后的判决表提取
+std::vector<int> extractSymbols(const CodecContext& ctx, const ImageView& image, size_t* deviatingValues = nullptr,
+    std::vector<uint8_t>* confidence = nullptr, const LevelCalibration* calibration = nullptr);
+// 电平校准：一遍扫描统计每个通道的直方图，拟合锚点峰值的实际位置，生成校准后的判决表
+// 图像电平与标准锚点一致时applied为false（解码结果与不校准相同）
+LevelCalibration calibrateLevels(const CodecContext& ctx, const ImageView& image);
+std::vector<bool> symbolsToBinary(const std::vector<int>& symbols, int bitsPerSymbol, size_t expectedBits);
+std::vector<uint8_t> binaryToData(const std::vector<bool>& binaryStream);
+std::vector<int> dataToSymbols(const CodecContext& ctx, std::span<const uint8_t> data);
+std::vector<uint8_t> symbolsToData(const std::vector<int>& symbols, int bitsPerSymbol);
+// 同时输出擦除位置：包含置信度低于threshold的符号的位的字节
+std::vector<uint8_t> symbolsToData(const std::vector<int>& symbols, int bitsPerSymbol,
+    const std::vector<uint8_t>& confidence, uint8_t threshold, std::vector<size_t>& erasures);
+bool isTextData(const QRACConfig& profile, std::span<const uint8_t> data);
+std::string detectFileType(const QRACConfig& profile, std::span<const uint8_t> data);
+
+// Calculate optimal image dimensions for adaptive mode
+void calculateAdaptiveDimensions(const CodecContext& ctx, size_t dataSize, int* width, int* height);
+
+// 计算编码inputSize字节所用的图像尺寸
+void encodedImageDimensions(const CodecContext& ctx, size_t inputSize, SizeMode mode, int* width, int* height);
+
+// ---------- 高层接口 ----------
+
+// 编码：数据 -> QRAC图像（RGB）
+Image encode(std::span<const uint8_t> data, const CodecContext& ctx, SizeMode mode = SizeMode::Adaptive, EncodeReport* report = nullptr);
+Image encode(std::span<const uint8_t> data, const Profile& profile, SizeMode mode = SizeMode::Adaptive);
+
+// 编码到调用方提供的像素内存（尺寸用encodedImageDimensions计算，至少3个通道）
+void encodeInto(std::span<const uint8_t> data, const CodecContext& ctx, const MutableImageView& output, EncodeReport* report = nullptr);
+
+// 解码：QRAC图像 -> 数据（直接读取视图内存）
+// 提取符号时每个值按所在间隔查表，已经包含校正的吸附：损坏的图像可以直接解码，不需要先写出校正后的图像
+ByteBuffer decode(const ImageView& image, const CodecContext& ctx, DecodeReport* report = nullptr);
+ByteBuffer decode(const ImageView& image, const Profile& profile);
+
+// 校验：解码后重新计算数据的BLAKE3哈希，与编码时记录的哈希比较，不输出数据
+// 一致时返回true；没有记录哈希（CHECK_BLOCK_SIZE为0或之前的版本编码的图像）时返回false
+// 大数据可以用decode()加上分段的hashPart/combineHashParts在多个线程上计算（见qrac_hash.h）
+bool verify(const ImageView& image, const CodecContext& ctx, DecodeReport* report = nullptr);
+
+// 校正：将像素值吸附到最近的锚点，填充像素设为纯黑
+// 输出至少3个通道，保留Alpha通道
+Image correct(const ImageView& image, const CodecContext& ctx, CorrectionReport* report = nullptr);
+
+// 原地校正（查表，一遍完成吸附和计数），保持通道数：1/3通道全部为颜色值，2/4通道的最后一个为Alpha（保留）
+// 灰度图像的deviatingValues按实际存储的值计数（每像素1个）
+// 各行互不依赖，大图像可以按行分段（子视图）在多个线程上同时调用，再合计报告
+void correctInPlace(const MutableImageView& image, const CodecContext& ctx, CorrectionReport* report = nullptr);
+
+// ---------- 图像格式（内存） ----------
+
+// PNG压缩方式
+enum class PngCompression {
+    Default, // stb的deflate压缩
+    Store    // 不压缩（zlib存储块）：速度接近内存复制，文件与原始像素大小相当
+};
+
+// PNG编码（无损）
+ByteBuffer encodePng(const ImageView& image, PngCompression compression = PngCompression::Default);
+
+// PNG数据块的CRC32（覆盖4字符的类型和数据），用于写入或检查辅助数据块
+uint32_t pngChunkCrc(const char* type, std::span<const uint8_t> data);
+
+// BMP编码（与stbi_write_bmp输出相同）
+ByteBuffer encodeBmp(const ImageView& image);
+
+// PNG无损压缩（maxSizeKB仅作为目标参考，超出时不会缩小图像）
+ByteBuffer compressImageAuto(std::span<const uint8_t> imageData, int width, int height, int channels, size_t maxSizeKB);
+
+// 从内存中的PNG/BMP/PPM文件加载图像
+Image loadImage(std::span<const uint8_t> encoded, int desiredChannels = 0);
+
+// ---------- 阶段回调 ----------
+
+// encode()/decode()内部的阶段（"fec"、"pack"、"unpack"）结束时在调用线程上调用，
+// 调用方可以据此按阶段采样（如硬件性能计数器）。只对设置它的线程生效，nullptr取消
+using StageHook = void (*)(const char* stage);
+void setStageHook(StageHook hook);
+
+} // namespace qrac
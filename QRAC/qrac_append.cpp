@@ -0,0 +1,133 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 追加编码的状态记录实现
+ ******************************************************************/
+#include "qrac_append.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace qrac {
+
+namespace {
+
+constexpr const char* kStateHeader = "qrac-append 1";
+
+std::filesystem::path pathFromUtf8(const std::string& path) {
+    return std::filesystem::path(std::u8string(path.begin(), path.end()));
+}
+
+bool parseHash(const std::string& hex, PayloadHash& hash) {
+    if (hex.size() != hash.size() * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < hash.size(); i++) {
+        unsigned value = 0;
+        for (char c : hex.substr(i * 2, 2)) {
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else return false;
+        }
+        hash[i] = static_cast<uint8_t>(value);
+    }
+    return true;
+}
+
+} // namespace
+
+std::string appendStatePath(const std::string& image) {
+    return image + ".qrstate";
+}
+
+bool loadAppendState(const std::string& path, AppendState& state) {
+    std::ifstream file(pathFromUtf8(path));
+    std::string line;
+    if (!file.is_open() || !std::getline(file, line) || line != kStateHeader) {
+        return false;
+    }
+
+    AppendState loaded;
+    unsigned fields = 0;
+    while (std::getline(file, line)) {
+        std::istringstream fieldLine(line);
+        std::string name, value;
+        if (!(fieldLine >> name >> value)) {
+            continue;
+        }
+        try {
+            if (name == "settings") loaded.settings = value;
+            else if (name == "input") loaded.inputBytes = std::stoull(value);
+            else if (name == "image") loaded.imageBytes = std::stoull(value);
+            else if (name == "last-frame-offset") loaded.lastFrameOffset = std::stoull(value);
+            else if (name == "last-frame-bytes") loaded.lastFrameBytes = std::stoull(value);
+            else if (name == "last-frame-hash") {
+                if (!parseHash(value, loaded.lastFrameHash)) return false;
+            }
+            else continue;
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+        fields++;
+    }
+    if (fields != 6 || loaded.lastFrameOffset > loaded.imageBytes || loaded.lastFrameBytes > loaded.inputBytes) {
+        return false;
+    }
+    state = loaded;
+    return true;
+}
+
+void saveAppendState(const std::string& path, const AppendState& state) {
+    std::filesystem::path target = pathFromUtf8(path);
+    std::filesystem::path temporary = pathFromUtf8(path + ".tmp");
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file << kStateHeader << "\n"
+            << "settings " << state.settings << "\n"
+            << "input " << state.inputBytes << "\n"
+            << "image " << state.imageBytes << "\n"
+            << "last-frame-offset " << state.lastFrameOffset << "\n"
+            << "last-frame-bytes " << state.lastFrameBytes << "\n"
+            << "last-frame-hash " << hashToHex(state.lastFrameHash) << "\n";
+        file.close();
+        if (!file) {
+            throw QRACException(ErrorType::FileWriteError, "Cannot write append state: " + path);
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, target, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        throw QRACException(ErrorType::FileWriteError, "Cannot update append state: " + path);
+    }
+}
+
+bool seekFile(std::FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<long long>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+bool syncFile(std::FILE* file) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+} // namespace qrac
@@ -0,0 +1,48 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 追加编码的状态记录（--append）
+ *
+ * 只会增长的文件（日志）编码为多帧PNG，每帧的FEC和压缩互不依赖，追加数据时不需要改动已完成的帧。
+ * 状态记录保存在图像旁边（<图像>.qrstate，文本格式）：已编码的输入字节数、图像的有效长度、
+ * 最后一帧的位置、输入字节数和哈希，以及配置的哈希。下次编码时：
+ *   - 最后一帧已满时保留所有帧，从上次的结尾开始编码新增的数据；
+ *   - 最后一帧未满时把图像截断到该帧之前，从该帧的输入开始重新编码（最多一帧加上新增的数据）；
+ *   - 输入中最后一帧的数据与记录的哈希不同（文件被改写或轮转）、配置不同或没有状态记录时完整编码。
+ * 状态记录先写临时文件再改名，是每次更新的提交点：中途失败时图像可能多出未提交的帧，
+ * 下次编码按旧的状态记录截断后重做，已提交的部分不受影响。
+ ******************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "qrac.h"
+
+namespace qrac {
+
+struct AppendState {
+    std::string settings;          // 影响编码结果的配置的哈希（十六进制），不同时完整编码
+    uint64_t inputBytes = 0;       // 已编码的输入字节数
+    uint64_t imageBytes = 0;       // 图像的有效长度
+    uint64_t lastFrameOffset = 0;  // 最后一帧在图像中的位置
+    uint64_t lastFrameBytes = 0;   // 最后一帧的输入字节数
+    PayloadHash lastFrameHash{};   // 最后一帧输入数据的BLAKE3哈希
+};
+
+// 图像对应的状态记录路径
+std::string appendStatePath(const std::string& image);
+
+// 读取状态记录，不存在或格式不符时返回false
+bool loadAppendState(const std::string& path, AppendState& state);
+
+// 写入状态记录（临时文件 + 改名），失败时抛出QRACException
+void saveAppendState(const std::string& path, const AppendState& state);
+
+// 定位到文件中的绝对位置（64位偏移），失败时返回false
+bool seekFile(std::FILE* file, uint64_t offset);
+
+// 把已写出的图像数据写到磁盘（提交状态记录之前），失败时返回false
+bool syncFile(std::FILE* file);
+
+} // namespace qrac
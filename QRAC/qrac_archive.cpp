@@ -0,0 +1,380 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 归档模式实现
+ ******************************************************************/
+#include "qrac_archive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <system_error>
+
+namespace qrac {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kArchiveMagic[] = "QRACARC1";
+constexpr size_t kArchiveHeaderBytes = 16;      // 标识 + 索引字节数
+constexpr size_t kEntryFixedBytes = 2 + 8 + 8 + 32;
+constexpr uint64_t kMaxIndexBytes = 1ull << 30; // 索引大小上限（防止损坏的头部导致无限制分配）
+constexpr size_t kCopyBytes = 1024 * 1024;
+
+fs::path pathFromUtf8(const std::string& path) {
+    return fs::path(std::u8string(path.begin(), path.end()));
+}
+
+std::string pathToUtf8(const fs::path& path) {
+    std::u8string text = path.generic_u8string();
+    return std::string(text.begin(), text.end());
+}
+
+std::FILE* openFile(const fs::path& path, bool write) {
+#ifdef _WIN32
+    return _wfopen(path.c_str(), write ? L"wb" : L"rb");
+#else
+    return std::fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+}
+
+// 关闭时自动释放的文件
+struct FileCloser {
+    void operator()(std::FILE* file) const { std::fclose(file); }
+};
+using FileHandle = std::unique_ptr<std::FILE, FileCloser>;
+
+FileHandle openOrThrow(const fs::path& path, bool write, const std::string& name) {
+    FileHandle file(openFile(path, write));
+    if (!file) {
+        throw QRACException(write ? ErrorType::FileWriteError : ErrorType::FileReadError,
+            std::string(write ? "Cannot create output file: " : "Cannot open file: ") + name);
+    }
+    return file;
+}
+
+void appendLittleEndian(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+uint64_t readLittleEndian(const uint8_t* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+// 头部和索引
+std::vector<uint8_t> serializeIndex(const std::vector<ArchiveEntry>& entries) {
+    std::vector<uint8_t> index;
+    appendLittleEndian(index, entries.size(), 4);
+    for (const ArchiveEntry& entry : entries) {
+        appendLittleEndian(index, entry.path.size(), 2);
+        index.insert(index.end(), entry.path.begin(), entry.path.end());
+        appendLittleEndian(index, entry.offset, 8);
+        appendLittleEndian(index, entry.size, 8);
+        index.insert(index.end(), entry.hash.begin(), entry.hash.end());
+    }
+    std::vector<uint8_t> header(kArchiveMagic, kArchiveMagic + 8);
+    appendLittleEndian(header, index.size(), 8);
+    header.insert(header.end(), index.begin(), index.end());
+    return header;
+}
+
+std::vector<ArchiveEntry> parseIndex(const std::vector<uint8_t>& index) {
+    if (index.size() < 4) {
+        throw QRACException(ErrorType::InvalidInput, "Archive index is truncated");
+    }
+    size_t count = static_cast<size_t>(readLittleEndian(index.data(), 4));
+    size_t position = 4;
+    std::vector<ArchiveEntry> entries;
+    entries.reserve(std::min(count, index.size() / kEntryFixedBytes));
+    for (size_t i = 0; i < count; i++) {
+        if (index.size() - position < kEntryFixedBytes) {
+            throw QRACException(ErrorType::InvalidInput, "Archive index is truncated");
+        }
+        size_t pathBytes = static_cast<size_t>(readLittleEndian(&index[position], 2));
+        position += 2;
+        if (index.size() - position < pathBytes + kEntryFixedBytes - 2) {
+            throw QRACException(ErrorType::InvalidInput, "Archive index is truncated");
+        }
+        ArchiveEntry entry;
+        entry.path.assign(reinterpret_cast<const char*>(&index[position]), pathBytes);
+        position += pathBytes;
+        entry.offset = readLittleEndian(&index[position], 8);
+        entry.size = readLittleEndian(&index[position + 8], 8);
+        std::copy_n(&index[position + 16], entry.hash.size(), entry.hash.begin());
+        position += 16 + entry.hash.size();
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+// 解出的路径只能是destination之下的相对路径
+bool isSafeMemberPath(const std::string& path) {
+    if (path.empty() || path.front() == '/' || path.find('\\') != std::string::npos || path.find(':') != std::string::npos) {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        std::string part = path.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        if (part.empty() || part == "." || part == "..") {
+            return false;
+        }
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+// 按数据位置随机读取归档：只解码覆盖所读范围的帧，保留最近解码的一帧（相邻的小文件通常在同一帧）
+class ArchiveReader {
+public:
+    ArchiveReader(const CodecContext& ctx, const std::string& path, ArchiveReport& report)
+        : m_ctx(ctx), m_file(openOrThrow(pathFromUtf8(path), false, path)), m_report(report) {
+        m_frames = listStreamFrames(m_file.get());
+        m_report.frames = m_frames.size();
+        const StreamFrame& last = m_frames.back();
+        m_size = last.inputOffset + last.inputBytes;
+    }
+
+    // 读取[offset, offset + size)，按帧分段交给sink
+    void read(uint64_t offset, uint64_t size, const std::function<void(const uint8_t*, size_t)>& sink) {
+        if (offset > m_size || size > m_size - offset) {
+            throw QRACException(ErrorType::DataSizeError, "Archive member lies outside the archive data");
+        }
+        while (size > 0) {
+            auto next = std::upper_bound(m_frames.begin(), m_frames.end(), offset,
+                [](uint64_t value, const StreamFrame& frame) { return value < frame.inputOffset; });
+            size_t index = static_cast<size_t>(next - m_frames.begin()) - 1;
+            const ByteBuffer& data = frameData(index);
+            uint64_t within = offset - m_frames[index].inputOffset;
+            size_t take = static_cast<size_t>(std::min<uint64_t>(size, data.size() - within));
+            sink(data.data() + within, take);
+            offset += take;
+            size -= take;
+        }
+    }
+
+    std::vector<uint8_t> read(uint64_t offset, uint64_t size) {
+        std::vector<uint8_t> bytes;
+        bytes.reserve(static_cast<size_t>(size));
+        read(offset, size, [&](const uint8_t* data, size_t count) { bytes.insert(bytes.end(), data, data + count); });
+        return bytes;
+    }
+
+    // 头部和索引，返回各成员（偏移已换算为整个数据中的位置）
+    std::vector<ArchiveEntry> readIndex() {
+        if (m_size < kArchiveHeaderBytes) {
+            throw QRACException(ErrorType::InvalidInput, "Not a QRAC archive (data too short)");
+        }
+        std::vector<uint8_t> header = read(0, kArchiveHeaderBytes);
+        if (std::memcmp(header.data(), kArchiveMagic, 8) != 0) {
+            throw QRACException(ErrorType::InvalidInput, "Not a QRAC archive (missing archive header)");
+        }
+        uint64_t indexBytes = readLittleEndian(header.data() + 8, 8);
+        if (indexBytes > kMaxIndexBytes || indexBytes > m_size - kArchiveHeaderBytes) {
+            throw QRACException(ErrorType::InvalidInput, "Archive index size is invalid");
+        }
+        std::vector<ArchiveEntry> entries = parseIndex(read(kArchiveHeaderBytes, indexBytes));
+        uint64_t dataStart = kArchiveHeaderBytes + indexBytes;
+        for (ArchiveEntry& entry : entries) {
+            entry.offset += dataStart;
+        }
+        m_report.indexBytes = dataStart;
+        return entries;
+    }
+
+private:
+    const ByteBuffer& frameData(size_t index) {
+        if (index != m_cachedFrame) {
+            DecodeReport decoded;
+            m_cache = decodeStreamFrame(m_ctx, m_file.get(), m_frames[index], &decoded);
+            m_cachedFrame = index;
+            m_report.decodedFrames++;
+            m_report.invalidFrames += decoded.dataValid ? 0 : 1;
+        }
+        return m_cache;
+    }
+
+    const CodecContext& m_ctx;
+    FileHandle m_file;
+    ArchiveReport& m_report;
+    std::vector<StreamFrame> m_frames;
+    uint64_t m_size = 0;
+    size_t m_cachedFrame = SIZE_MAX;
+    ByteBuffer m_cache;
+};
+
+} // namespace
+
+ArchiveReport createArchive(const CodecContext& ctx, const std::string& directory, const std::string& output) {
+    fs::path root = pathFromUtf8(directory);
+    std::error_code error;
+    if (!fs::is_directory(root, error)) {
+        throw QRACException(ErrorType::FileNotFound, "Directory does not exist: " + directory);
+    }
+    fs::path outputPath = fs::weakly_canonical(pathFromUtf8(output), error);
+
+    // 收集文件（按相对路径排序，归档内容与遍历顺序无关）
+    std::vector<std::pair<std::string, fs::path>> files;
+    for (fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, error), end;
+        it != end; it.increment(error)) {
+        std::error_code entryError;
+        if (!it->is_regular_file(entryError) || fs::weakly_canonical(it->path(), entryError) == outputPath) {
+            continue;
+        }
+        std::string relative = pathToUtf8(fs::relative(it->path(), root, entryError));
+        if (entryError || relative.size() > 0xFFFF) {
+            throw QRACException(ErrorType::InvalidInput, "Cannot archive path: " + pathToUtf8(it->path()));
+        }
+        files.emplace_back(std::move(relative), it->path());
+    }
+    std::sort(files.begin(), files.end());
+
+    // 第一遍：大小和哈希（索引在内容之前）
+    std::vector<ArchiveEntry> entries;
+    entries.reserve(files.size());
+    std::vector<uint8_t> buffer(kCopyBytes);
+    uint64_t offset = 0;
+    for (const auto& [relative, path] : files) {
+        FileHandle file = openOrThrow(path, false, relative);
+        PayloadHasher hasher;
+        uint64_t size = 0;
+        size_t got;
+        while ((got = std::fread(buffer.data(), 1, buffer.size(), file.get())) > 0) {
+            hasher.update(buffer.data(), got);
+            size += got;
+        }
+        if (std::ferror(file.get())) {
+            throw QRACException(ErrorType::FileReadError, "Failed to read file: " + relative);
+        }
+        entries.push_back({ relative, offset, size, hasher.finish() });
+        offset += size;
+    }
+
+    // 第二遍：头部和索引，然后依次读出各文件的内容，作为流式编码的输入
+    std::vector<uint8_t> header = serializeIndex(entries);
+    size_t headerSent = 0;
+    size_t current = 0;
+    FileHandle file;
+    uint64_t fileLeft = 0;
+    StreamReader reader = [&](uint8_t* data, size_t size) {
+        size_t filled = 0;
+        while (filled < size) {
+            if (headerSent < header.size()) {
+                size_t take = std::min(size - filled, header.size() - headerSent);
+                std::memcpy(data + filled, header.data() + headerSent, take);
+                headerSent += take;
+                filled += take;
+                continue;
+            }
+            if (!file) {
+                if (current == entries.size()) {
+                    break;
+                }
+                file = openOrThrow(files[current].second, false, entries[current].path);
+                fileLeft = entries[current].size;
+            }
+            size_t take = static_cast<size_t>(std::min<uint64_t>(size - filled, fileLeft));
+            size_t got = take > 0 ? std::fread(data + filled, 1, take, file.get()) : 0;
+            if (got != take) {
+                throw QRACException(ErrorType::FileReadError, "File changed while archiving: " + entries[current].path);
+            }
+            filled += got;
+            fileLeft -= got;
+            if (fileLeft == 0) {
+                file.reset();
+                current++;
+            }
+        }
+        return filled;
+    };
+
+    ArchiveReport report;
+    FileHandle out = openOrThrow(pathFromUtf8(output), true, output);
+    encodeStream(ctx, reader, out.get(), &report.stream);
+    if (std::fclose(out.release()) != 0) {
+        throw QRACException(ErrorType::FileWriteError, "Failed to write output file: " + output);
+    }
+    report.files = entries.size();
+    report.bytes = offset;
+    report.indexBytes = header.size();
+    report.frames = report.stream.frames;
+    return report;
+}
+
+std::vector<ArchiveEntry> listArchive(const CodecContext& ctx, const std::string& archive, ArchiveReport* report) {
+    ArchiveReport local;
+    ArchiveReader reader(ctx, archive, local);
+    std::vector<ArchiveEntry> entries = reader.readIndex();
+    uint64_t dataStart = local.indexBytes;
+    for (ArchiveEntry& entry : entries) {
+        entry.offset -= dataStart;
+    }
+    local.files = entries.size();
+    if (report) {
+        *report = local;
+    }
+    return entries;
+}
+
+ArchiveReport extractArchive(const CodecContext& ctx, const std::string& archive, const std::vector<std::string>& members,
+    const std::string& destination) {
+    ArchiveReport report;
+    ArchiveReader reader(ctx, archive, report);
+    std::vector<ArchiveEntry> entries = reader.readIndex();
+
+    std::vector<const ArchiveEntry*> selected;
+    if (members.empty()) {
+        for (const ArchiveEntry& entry : entries) {
+            selected.push_back(&entry);
+        }
+    }
+    else {
+        for (const std::string& member : members) {
+            auto found = std::find_if(entries.begin(), entries.end(), [&](const ArchiveEntry& entry) { return entry.path == member; });
+            if (found == entries.end()) {
+                throw QRACException(ErrorType::FileNotFound, "No such file in archive: " + member);
+            }
+            selected.push_back(&*found);
+        }
+        // 按位置顺序解出，相邻的成员共用解码的帧
+        std::sort(selected.begin(), selected.end(), [](const ArchiveEntry* a, const ArchiveEntry* b) { return a->offset < b->offset; });
+    }
+
+    fs::path root = pathFromUtf8(destination);
+    for (const ArchiveEntry* entry : selected) {
+        if (!isSafeMemberPath(entry->path)) {
+            throw QRACException(ErrorType::InvalidInput, "Unsafe path in archive: " + entry->path);
+        }
+        fs::path target = root / pathFromUtf8(entry->path);
+        std::error_code error;
+        fs::create_directories(target.parent_path(), error);
+        FileHandle out = openOrThrow(target, true, pathToUtf8(target));
+        PayloadHasher hasher;
+        reader.read(entry->offset, entry->size, [&](const uint8_t* data, size_t size) {
+            hasher.update(data, size);
+            if (size > 0 && std::fwrite(data, 1, size, out.get()) != size) {
+                throw QRACException(ErrorType::FileWriteError, "Failed to write file: " + pathToUtf8(target));
+            }
+        });
+        if (std::fclose(out.release()) != 0) {
+            throw QRACException(ErrorType::FileWriteError, "Failed to write file: " + pathToUtf8(target));
+        }
+        report.hashMismatches += hasher.finish() != entry->hash ? 1 : 0;
+        report.files++;
+        report.bytes += entry->size;
+    }
+    return report;
+}
+
+} // namespace qrac
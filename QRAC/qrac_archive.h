@@ -0,0 +1,54 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 归档模式（QRAC archive）
+ *
+ * 每个小文件单独编码至少要一张MIN_IMAGE_DIMENSION尺寸的图像、PNG头部和一次完整的编码。
+ * 归档把目录下的所有文件（递归，按路径排序）首尾相接成一份数据，前面加上索引，整体按流式编码为一张多帧PNG
+ * （不超过一帧时就是普通的单帧PNG）：
+ *   "QRACARC1"(8) | 索引字节数(8) | 索引 | 各文件内容
+ *   索引：文件数(4)，每个文件：路径字节数(2) 路径(UTF-8，'/'分隔的相对路径) 偏移(8) 长度(8) BLAKE3(32)
+ *   整数为小端，偏移相对于内容区的开头（索引之后）。
+ * 每帧的清单（见qrac_stream.h）给出该帧数据的位置，读取索引或解出单个文件时只解码所需的帧（随机访问），
+ * 解出的文件按索引中的哈希校验。
+ ******************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "qrac.h"
+#include "qrac_stream.h"
+
+namespace qrac {
+
+struct ArchiveEntry {
+    std::string path;     // 相对路径，'/'分隔
+    uint64_t offset = 0;  // 在内容区中的位置
+    uint64_t size = 0;
+    PayloadHash hash{};
+};
+
+struct ArchiveReport {
+    size_t files = 0;           // 打包/解出的文件数
+    uint64_t bytes = 0;         // 打包/解出的文件内容字节数
+    uint64_t indexBytes = 0;    // 头部和索引的字节数
+    size_t frames = 0;          // 归档的帧数
+    size_t decodedFrames = 0;   // 读取：解码的帧数（只解码所需的帧）
+    size_t invalidFrames = 0;   // 读取：FEC未能完全校正的帧数
+    size_t hashMismatches = 0;  // 解出：内容与索引中的哈希不同的文件数
+    StreamReport stream;        // 创建：流式编码的报告
+};
+
+// 把directory下的所有文件打包并编码到output（多帧PNG）；output位于directory之下时跳过它
+ArchiveReport createArchive(const CodecContext& ctx, const std::string& directory, const std::string& output);
+
+// 读取归档的索引（只解码索引所在的帧）
+std::vector<ArchiveEntry> listArchive(const CodecContext& ctx, const std::string& archive, ArchiveReport* report = nullptr);
+
+// 解出members（归档中的路径，空时为全部）到destination目录下，只解码这些文件所在的帧
+// 归档中没有某个成员，或路径不安全（绝对路径、".."）时抛出QRACException
+ArchiveReport extractArchive(const CodecContext& ctx, const std::string& archive, const std::vector<std::string>& members,
+    const std::string& destination);
+
+} // namespace qrac
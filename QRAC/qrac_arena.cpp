@@ -0,0 +1,288 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 缓冲区arena实现
+ *
+ * 每块内存前有16字节的头，记录容量和来源（malloc/分级块/大页），
+ * 释放时不需要知道是哪个线程、是否启用arena时分配的。
+ * 分级：64KB以上按2的幂再分4级（最多浪费25%），自适应尺寸的相近图像可以共用。
+ * Linux上分级块直接用mmap映射（级别大小含头部，正好是整页），不放在malloc的堆里：
+ * 保留的块不会妨碍glibc收缩堆顶，否则堆顶反复收缩/增长会带来大量缺页。
+ * 小块仍由malloc分配（如stb PNG压缩的数万个哈希桶），启用时同时提高glibc的
+ * 堆顶收缩阈值，每个作业结束释放的小块内存留给下一个作业，不再重新缺页。
+ ******************************************************************/
+#include "qrac_arena.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace qrac {
+
+namespace {
+
+enum class BlockKind : uint32_t {
+    Small,  // 小块或未启用arena：malloc，capacity为申请的大小
+    Pooled, // 分级块：mmap（其他平台malloc），capacity为级别大小减去头部
+    Huge    // 分级块：mmap + 透明大页
+};
+
+struct alignas(16) BlockHeader {
+    size_t capacity;
+    BlockKind kind;
+    uint32_t sizeClass;
+};
+static_assert(sizeof(BlockHeader) == 16, "block header must keep 16-byte alignment");
+
+constexpr size_t kHugePageBytes = 2 * 1024 * 1024;
+constexpr int kMinClassShift = 16; // 64KB
+constexpr size_t kClassCount = (sizeof(size_t) * 8 - kMinClassShift) * 4;
+
+std::atomic<bool> g_enabled{ false };
+std::atomic<bool> g_hugePages{ false };
+std::atomic<size_t> g_retainLimit{ kArenaDefaultRetainBytes };
+std::atomic<size_t> g_retained{ 0 };
+std::atomic<size_t> g_allocations{ 0 };
+std::atomic<size_t> g_reused{ 0 };
+std::atomic<size_t> g_systemAllocations{ 0 };
+std::atomic<size_t> g_hugePageBytes{ 0 };
+
+int floorLog2(size_t value) {
+    int shift = 0;
+    while (value >>= 1) shift++;
+    return shift;
+}
+
+// 向上取整到级别大小，返回级别编号
+uint32_t sizeClassFor(size_t bytes, size_t* classBytes) {
+    int shift = floorLog2(bytes);
+    size_t step = size_t(1) << (shift - 2);
+    size_t rounded = (bytes + step - 1) / step * step;
+    shift = floorLog2(rounded);
+    step = size_t(1) << (shift - 2);
+    *classBytes = rounded;
+    return static_cast<uint32_t>((shift - kMinClassShift) * 4 + (rounded / step - 4));
+}
+
+#ifdef __linux__
+// 映射长度：大页块向上取整到2MB
+size_t mappedLength(size_t capacity, BlockKind kind) {
+    size_t length = capacity + sizeof(BlockHeader);
+    return kind == BlockKind::Huge ? (length + kHugePageBytes - 1) / kHugePageBytes * kHugePageBytes : length;
+}
+#endif
+
+BlockHeader* systemAllocate(size_t capacity, BlockKind kind, uint32_t sizeClass) {
+    void* memory = nullptr;
+#ifdef __linux__
+    if (kind != BlockKind::Small) {
+        size_t length = mappedLength(capacity, kind);
+        memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+        if (kind == BlockKind::Huge) {
+            madvise(memory, length, MADV_HUGEPAGE);
+            g_hugePageBytes.fetch_add(length, std::memory_order_relaxed);
+        }
+    }
+    else
+#endif
+    {
+        memory = std::malloc(capacity + sizeof(BlockHeader));
+        if (!memory) {
+            return nullptr;
+        }
+    }
+    BlockHeader* header = static_cast<BlockHeader*>(memory);
+    header->capacity = capacity;
+    header->kind = kind;
+    header->sizeClass = sizeClass;
+    return header;
+}
+
+void systemFree(BlockHeader* header) {
+#ifdef __linux__
+    if (header->kind != BlockKind::Small) {
+        munmap(header, mappedLength(header->capacity, header->kind));
+        return;
+    }
+#endif
+    std::free(header);
+}
+
+// 线程的空闲链表
+struct ThreadArena {
+    std::array<std::vector<BlockHeader*>, kClassCount> freeBlocks;
+    ArenaStats stats;
+
+    void releaseAll() {
+        for (std::vector<BlockHeader*>& blocks : freeBlocks) {
+            for (BlockHeader* header : blocks) {
+                g_retained.fetch_sub(header->capacity, std::memory_order_relaxed);
+                systemFree(header);
+            }
+            blocks.clear();
+        }
+        stats.retainedBytes = 0;
+    }
+};
+
+// t_arena本身是普通指针（线程结束后仍可安全读取），由t_releaser在线程结束时释放，
+// 之后（其他线程局部对象析构时）释放的内存直接归还系统
+thread_local ThreadArena* t_arena = nullptr;
+thread_local bool t_exited = false;
+
+struct ArenaReleaser {
+    ~ArenaReleaser() {
+        t_exited = true;
+        if (t_arena) {
+            t_arena->releaseAll();
+            delete t_arena;
+            t_arena = nullptr;
+        }
+    }
+};
+thread_local ArenaReleaser t_releaser;
+
+ThreadArena* threadArena(bool create) {
+    if (!t_arena && create && !t_exited) {
+        (void)&t_releaser; // 注册线程结束时的释放
+        t_arena = new ThreadArena();
+    }
+    return t_arena;
+}
+
+void* toUser(BlockHeader* header) {
+    return header ? header + 1 : nullptr;
+}
+
+} // namespace
+
+void configureArenas(const ArenaOptions& options) {
+    g_hugePages.store(options.hugePages, std::memory_order_relaxed);
+    g_retainLimit.store(options.retainBytes, std::memory_order_relaxed);
+    g_enabled.store(options.enabled, std::memory_order_release);
+#ifdef __GLIBC__
+    if (options.enabled) {
+        mallopt(M_TRIM_THRESHOLD, static_cast<int>(std::min<size_t>(options.retainBytes, 1u << 30)));
+    }
+#endif
+    if (!options.enabled) {
+        if (ThreadArena* arena = threadArena(false)) {
+            arena->releaseAll();
+        }
+    }
+}
+
+ArenaStats arenaStats() {
+    ArenaStats stats;
+    stats.allocations = g_allocations.load(std::memory_order_relaxed);
+    stats.reused = g_reused.load(std::memory_order_relaxed);
+    stats.systemAllocations = g_systemAllocations.load(std::memory_order_relaxed);
+    stats.retainedBytes = g_retained.load(std::memory_order_relaxed);
+    stats.hugePageBytes = g_hugePageBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+ArenaStats threadArenaStats() {
+    ThreadArena* arena = threadArena(false);
+    return arena ? arena->stats : ArenaStats{};
+}
+
+void* arenaAllocate(size_t bytes) {
+    if (bytes < kArenaMinBlockBytes || !g_enabled.load(std::memory_order_acquire)) {
+        return toUser(systemAllocate(bytes, BlockKind::Small, 0));
+    }
+
+    size_t classBytes = 0;
+    uint32_t sizeClass = sizeClassFor(bytes + sizeof(BlockHeader), &classBytes);
+    size_t capacity = classBytes - sizeof(BlockHeader);
+    ThreadArena* arena = threadArena(true);
+    if (!arena) {
+        return toUser(systemAllocate(bytes, BlockKind::Small, 0));
+    }
+    arena->stats.allocations++;
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<BlockHeader*>& blocks = arena->freeBlocks[sizeClass];
+    if (!blocks.empty()) {
+        BlockHeader* header = blocks.back();
+        blocks.pop_back();
+        arena->stats.reused++;
+        arena->stats.retainedBytes -= header->capacity;
+        g_reused.fetch_add(1, std::memory_order_relaxed);
+        g_retained.fetch_sub(header->capacity, std::memory_order_relaxed);
+        return toUser(header);
+    }
+
+    bool huge = classBytes >= kHugePageBytes && g_hugePages.load(std::memory_order_relaxed);
+#ifndef __linux__
+    huge = false;
+#endif
+    BlockHeader* header = systemAllocate(capacity, huge ? BlockKind::Huge : BlockKind::Pooled, sizeClass);
+    if (!header && huge) {
+        header = systemAllocate(capacity, BlockKind::Pooled, sizeClass);
+    }
+    arena->stats.systemAllocations++;
+    g_systemAllocations.fetch_add(1, std::memory_order_relaxed);
+    return toUser(header);
+}
+
+void arenaFree(void* pointer) {
+    if (!pointer) {
+        return;
+    }
+    BlockHeader* header = static_cast<BlockHeader*>(pointer) - 1;
+    ThreadArena* arena = nullptr;
+    if (header->kind == BlockKind::Small || !g_enabled.load(std::memory_order_acquire) || !(arena = threadArena(true))) {
+        systemFree(header);
+        return;
+    }
+
+    // 超出保留上限时直接归还系统
+    size_t limit = g_retainLimit.load(std::memory_order_relaxed);
+    size_t retained = g_retained.fetch_add(header->capacity, std::memory_order_relaxed);
+    if (retained + header->capacity > limit) {
+        g_retained.fetch_sub(header->capacity, std::memory_order_relaxed);
+        systemFree(header);
+        return;
+    }
+    arena->stats.retainedBytes += header->capacity;
+    arena->freeBlocks[header->sizeClass].push_back(header);
+}
+
+void* arenaReallocate(void* pointer, size_t bytes) {
+    if (!pointer) {
+        return arenaAllocate(bytes);
+    }
+    BlockHeader* header = static_cast<BlockHeader*>(pointer) - 1;
+    if (bytes <= header->capacity) {
+        return pointer;
+    }
+    // 小块（或未启用arena）直接用realloc，系统可以原地扩展而不复制
+    if (header->kind == BlockKind::Small && (bytes < kArenaMinBlockBytes || !g_enabled.load(std::memory_order_acquire))) {
+        BlockHeader* resized = static_cast<BlockHeader*>(std::realloc(header, bytes + sizeof(BlockHeader)));
+        if (!resized) {
+            return nullptr;
+        }
+        resized->capacity = bytes;
+        return resized + 1;
+    }
+    void* resized = arenaAllocate(bytes);
+    if (resized) {
+        std::memcpy(resized, pointer, std::min(header->capacity, bytes));
+        arenaFree(pointer);
+    }
+    return resized;
+}
+
+} // namespace qrac
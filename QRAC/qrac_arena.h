@@ -0,0 +1,85 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 缓冲区arena（大块内存的回收复用）
+ *
+ * 编解码每个作业都要分配数MB的像素、符号、FEC和压缩输出缓冲区。
+ * 启用arena后，不小于kArenaMinBlockBytes的分配按大小分级（每个2的幂分4级），
+ * 释放时放回当前线程的空闲链表，之后相近大小的分配直接复用，
+ * 稳定状态下的作业不再向系统申请内存，也没有新映射页面的缺页开销。
+ * 每个线程（批处理的每个工作线程）一个arena，分配和释放都不加锁；
+ * 在其他线程释放的缓冲区进入释放线程的arena。
+ * 可选用透明大页（Linux，2MB以上的缓冲区用mmap + MADV_HUGEPAGE）。
+ *
+ * stb_image/stb_image_write的内部分配、Image::pixels和ByteBuffer都经过这里；
+ * 未启用时直接使用系统分配器。
+ ******************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace qrac {
+
+// 小于此大小的分配不经过arena
+constexpr size_t kArenaMinBlockBytes = 64 * 1024;
+
+// 默认最多保留的空闲缓冲区总量（所有线程合计）
+constexpr size_t kArenaDefaultRetainBytes = 256ull * 1024 * 1024;
+
+struct ArenaOptions {
+    bool enabled = false;
+    bool hugePages = false; // 2MB以上的缓冲区使用透明大页（仅Linux）
+    size_t retainBytes = kArenaDefaultRetainBytes;
+};
+
+struct ArenaStats {
+    size_t allocations = 0;       // 经过arena的大块分配次数
+    size_t reused = 0;            // 由空闲缓冲区满足的次数
+    size_t systemAllocations = 0; // 向系统申请新内存的次数
+    size_t retainedBytes = 0;     // 当前保留的空闲缓冲区（合计时为所有线程）
+    size_t hugePageBytes = 0;     // 累计以透明大页方式申请的字节数
+};
+
+// 设置arena选项（在工作线程开始分配之前调用）；关闭时释放调用线程保留的缓冲区
+void configureArenas(const ArenaOptions& options);
+
+// 所有线程合计 / 当前线程的计数
+ArenaStats arenaStats();
+ArenaStats threadArenaStats();
+
+// malloc风格的接口（stb使用）：返回16字节对齐的内存，必须用arenaFree释放
+void* arenaAllocate(size_t bytes);
+void* arenaReallocate(void* pointer, size_t bytes);
+void arenaFree(void* pointer);
+
+// 标准库分配器：无状态，任意实例之间可以互相释放
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() noexcept = default;
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) noexcept {}
+
+    T* allocate(size_t count) {
+        if (count > static_cast<size_t>(-1) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void* memory = arenaAllocate(count * sizeof(T));
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(memory);
+    }
+    void deallocate(T* pointer, size_t) noexcept { arenaFree(pointer); }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>&) const noexcept { return true; }
+};
+
+// 大块字节缓冲区（像素、载荷、压缩输出）
+using ByteBuffer = std::vector<uint8_t, ArenaAllocator<uint8_t>>;
+
+} // namespace qrac
@@ -0,0 +1,809 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 基准测试（qrac_bench）
+ *
+ * 对流水线的每个阶段单独计时：FEC编码/校验、分块CRC32C、BLAKE3数据哈希、符号打包、生成图像、提取符号、
+ * 符号解包、PNG/BMP写出和读取、图像校正，以及端到端的流式编码/解码。
+ * 输入为合成数据（随机字节、文本）和可选的真实文件（--corpus），
+ * 大小从1KB到1GB；与程序本身一样，超过kStreamChunkBytes的输入按帧处理，
+ * 每个阶段逐帧运行，单帧的中间数据不会随总大小增长。
+ * 每行报告MB/s、ns/字节（按原始数据字节计）和该阶段的峰值内存增量，
+ * 结果写成JSON，便于不同版本之间比较。
+ *
+ * impair模式模拟信道损伤：编码后加入噪声、成段的行损坏、块丢失、JPEG重新压缩、亮度/对比度/伽马变化，
+ * 再校正和解码，按L和FEC冗余比例报告校正/解码耗时、恢复的字节数和残余错误率，
+ * 用数据而不是猜测来选择配置。
+ *
+ * 用法：qrac_bench [--max-size N] [--sizes 1K,4M,...] [--corpus DIR] [--min-time S]
+ *                  [--out FILE] [--L N] [--fec-ratio R] [--fec xor|rs] [--check-block N|off]
+ *       qrac_bench impair [--L 3,5,8] [--fec-ratio 0,0.25,0.5] [--fec xor,rs] [--size N] [--trials N]
+ *                         [--calibrate on|off] [--check-block N|off] [--out FILE]
+ ******************************************************************/
+#define NOMINMAX
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "qrac.h"
+#include "qrac_check.h"
+#include "qrac_memory.h"
+#include "qrac_stats.h"
+#include "qrac_stream.h"
+#include "stb_image_write.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+namespace fs = std::filesystem;
+using namespace qrac;
+
+// 合成数据的默认大小（每级x16），--max-size 1G时包含1GB
+const size_t kSizeLadder[] = {
+    1024, 16 * 1024, 256 * 1024, 4 * 1024 * 1024, 64 * 1024 * 1024, 1024ull * 1024 * 1024
+};
+
+struct BenchOptions {
+    std::vector<size_t> sizes;          // 合成数据的大小
+    size_t maxSize = 64 * 1024 * 1024;  // 未指定--sizes时的上限
+    std::string corpus;                 // 真实文件目录（不递归）
+    double minSeconds = 0.2;            // 每行的最短计时（重复运行直到达到）
+    std::string output;                 // 空 = 标准输出
+    QRACConfig profile;
+};
+
+// 一行结果
+struct BenchRow {
+    std::string corpus;
+    size_t size = 0;
+    std::string stage;
+    size_t iterations = 0;
+    double seconds = 0.0;      // 处理一遍全部输入的平均耗时
+    size_t peakMemory = 0;     // 阶段运行期间的内存增量峰值
+};
+
+// ---------- 内存 ----------
+
+// 当前常驻内存（字节）
+size_t currentRss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.WorkingSetSize;
+#else
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+    return 0;
+#endif
+}
+
+// 峰值常驻内存；Linux上可以清零（/proc/self/clear_refs），其他平台为整个进程的峰值
+size_t peakRss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#else
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+    return 0;
+#endif
+}
+
+void resetPeakRss() {
+#ifdef __linux__
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+#endif
+}
+
+// ---------- 计时 ----------
+
+// 防止结果被优化掉
+volatile size_t g_sink = 0;
+
+// 运行一个阶段直到累计minSeconds（至少一次），只计body的时间；setup在每次运行前准备输入
+// 返回平均每次的秒数，peak为运行期间常驻内存相对开始时的最大增量
+double timeStage(double minSeconds, const std::function<void()>& setup, const std::function<void()>& body,
+    size_t& iterations, size_t& peak) {
+    double total = 0.0;
+    iterations = 0;
+    do {
+        setup();
+        resetPeakRss();
+        size_t before = currentRss();
+        auto start = std::chrono::steady_clock::now();
+        body();
+        total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        size_t high = peakRss();
+        peak = std::max(peak, high > before ? high - before : 0);
+        iterations++;
+    } while (total < minSeconds);
+    return total / iterations;
+}
+
+// ---------- 输入数据 ----------
+
+std::vector<uint8_t> randomData(size_t size, uint64_t seed) {
+    std::mt19937_64 random(seed);
+    std::vector<uint8_t> data(size);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t value = random();
+        std::memcpy(&data[i], &value, 8);
+    }
+    for (; i < size; i++) {
+        data[i] = static_cast<uint8_t>(random());
+    }
+    return data;
+}
+
+// 类似文本的数据（单词、空格和换行，可压缩）
+std::vector<uint8_t> textData(size_t size, uint64_t seed) {
+    static const char* words[] = {
+        "quantization", "interval", "anchor", "symbol", "pixel", "image", "encode", "decode",
+        "the", "of", "and", "data", "frame", "error", "correction", "block", "stream", "编码", "图像"
+    };
+    std::mt19937_64 random(seed);
+    std::vector<uint8_t> data;
+    data.reserve(size);
+    size_t column = 0;
+    while (data.size() < size) {
+        const char* word = words[random() % std::size(words)];
+        size_t length = std::strlen(word);
+        data.insert(data.end(), word, word + length);
+        column += length + 1;
+        data.push_back(column > 72 ? '\n' : ' ');
+        if (column > 72) column = 0;
+    }
+    data.resize(size);
+    return data;
+}
+
+// ---------- 各阶段 ----------
+
+// 单帧的中间数据（依次由前一阶段生成）
+struct FrameData {
+    ByteBuffer withFec;
+    std::vector<int> symbols;
+    Image image;
+    Image noisy;
+    ByteBuffer png;
+    ByteBuffer bmp;
+};
+
+// 加入少量偏离锚点的噪声（模拟有损传输），校正阶段才有实际工作
+Image addNoise(const Image& image, uint64_t seed) {
+    Image noisy = image;
+    std::mt19937 random(static_cast<uint32_t>(seed));
+    for (uint8_t& value : noisy.pixels) {
+        if (value > 20 && random() % 10 == 0) {
+            value = static_cast<uint8_t>(value + (random() % 2 ? 1 : -1));
+        }
+    }
+    return noisy;
+}
+
+// 流水线阶段的名称（按顺序）
+const char* const kStages[] = {
+    "fec_encode", "crc32c", "blake3", "pack", "create_image", "png_write", "png_write_store", "bmp_write",
+    "png_load", "bmp_load", "calibrate", "extract", "unpack", "fec_verify", "correct", "correct_in_place"
+};
+
+// 逐帧运行各阶段，每个阶段的耗时为各帧之和
+void benchStages(const CodecContext& ctx, const std::string& corpus, const std::vector<uint8_t>& data,
+    const BenchOptions& options, std::vector<BenchRow>& rows) {
+    size_t frameBytes = kStreamChunkBytes;
+    size_t frameCount = data.empty() ? 1 : (data.size() + frameBytes - 1) / frameBytes;
+
+    std::vector<BenchRow> stageRows;
+    for (const char* stage : kStages) {
+        stageRows.push_back({ corpus, data.size(), stage });
+    }
+
+    for (size_t f = 0; f < frameCount; f++) {
+        size_t offset = f * frameBytes;
+        size_t length = std::min(frameBytes, data.size() - offset);
+        std::span<const uint8_t> input(data.data() + offset, length);
+        // 每帧分到的计时份额与其大小成正比
+        double minSeconds = data.empty() ? options.minSeconds : options.minSeconds * length / data.size();
+        FrameData frame;
+        ByteBuffer scratch;
+        size_t row = 0;
+
+        auto run = [&](const std::function<void()>& setup, const std::function<void()>& body) {
+            BenchRow& target = stageRows[row++];
+            size_t iterations = 0;
+            target.seconds += timeStage(minSeconds, setup, body, iterations, target.peakMemory);
+            target.iterations = std::max(target.iterations, iterations);
+        };
+        auto none = [] {};
+
+        // 编码方向：每个阶段最后一次运行的结果作为下一阶段的输入
+        run([&] { scratch.assign(input.begin(), input.end()); },
+            [&] { addFEC(ctx, scratch); });
+        frame.withFec = scratch;
+
+        run(none, [&] { g_sink = crc32c(input.data(), input.size()); });
+
+        run(none, [&] { g_sink = blake3(input.data(), input.size())[0]; });
+
+        run(none, [&] { frame.symbols = dataToSymbols(ctx, frame.withFec); });
+
+        int width = 0, height = 0;
+        calculateAdaptiveDimensions(ctx, frame.withFec.size(), &width, &height);
+        run(none, [&] {
+            frame.image.pixels = createQRACImage(ctx, frame.symbols, width, height);
+            frame.image.width = width;
+            frame.image.height = height;
+            frame.image.channels = 3;
+        });
+
+        run(none, [&] { frame.png = encodePng(frame.image.view()); });
+        run(none, [&] { g_sink = encodePng(frame.image.view(), PngCompression::Store).size(); });
+        run(none, [&] { frame.bmp = encodeBmp(frame.image.view()); });
+
+        // 解码方向
+        Image loaded;
+        run(none, [&] { loaded = loadImage(frame.png, 3); g_sink = loaded.pixels.size(); });
+        run(none, [&] { loaded = loadImage(frame.bmp, 3); g_sink = loaded.pixels.size(); });
+
+        run(none, [&] { g_sink = calibrateLevels(ctx, loaded.view()).applied ? 1 : 0; });
+
+        std::vector<int> extracted;
+        run(none, [&] { extracted = extractSymbols(ctx, loaded.view()); });
+
+        std::vector<uint8_t> unpacked;
+        run(none, [&] { unpacked = symbolsToData(extracted, ctx.bitsPerSymbol()); });
+
+        run([&] { scratch.assign(unpacked.begin(), unpacked.end()); },
+            [&] { g_sink = verifyAndCorrectFEC(ctx, scratch) ? 1 : 0; });
+
+        frame.noisy = addNoise(frame.image, f);
+        run(none, [&] {
+            Image corrected = correct(frame.noisy.view(), ctx);
+            g_sink = corrected.pixels.size();
+        });
+        Image inPlace = frame.noisy;
+        run([&] { inPlace.pixels = frame.noisy.pixels; },
+            [&] { correctInPlace(inPlace.mutableView(), ctx); });
+    }
+
+    rows.insert(rows.end(), stageRows.begin(), stageRows.end());
+}
+
+// 端到端：流式编码到临时文件，再解码（多线程流水线，包括文件读写）
+void benchEndToEnd(const CodecContext& ctx, const std::string& corpus, const std::vector<uint8_t>& data,
+    const BenchOptions& options, std::vector<BenchRow>& rows) {
+    std::FILE* plain = std::tmpfile();
+    std::FILE* encoded = std::tmpfile();
+    std::FILE* decoded = std::tmpfile();
+    if (!plain || !encoded || !decoded) {
+        if (plain) std::fclose(plain);
+        if (encoded) std::fclose(encoded);
+        if (decoded) std::fclose(decoded);
+        throw QRACException(ErrorType::FileWriteError, "Cannot create temporary files");
+    }
+    std::fwrite(data.data(), 1, data.size(), plain);
+    std::fflush(plain);
+
+    BenchRow encodeRow{ corpus, data.size(), "encode" };
+    encodeRow.seconds = timeStage(options.minSeconds,
+        [&] { std::rewind(plain); std::rewind(encoded); },
+        [&] { encodeStream(ctx, plain, encoded); std::fflush(encoded); },
+        encodeRow.iterations, encodeRow.peakMemory);
+
+    BenchRow decodeRow{ corpus, data.size(), "decode" };
+    decodeRow.seconds = timeStage(options.minSeconds,
+        [&] { std::rewind(encoded); std::rewind(decoded); },
+        [&] { decodeStream(ctx, encoded, decoded); std::fflush(decoded); },
+        decodeRow.iterations, decodeRow.peakMemory);
+
+    std::fclose(plain);
+    std::fclose(encoded);
+    std::fclose(decoded);
+    rows.push_back(encodeRow);
+    rows.push_back(decodeRow);
+}
+
+void benchCorpus(const CodecContext& ctx, const std::string& corpus, const std::vector<uint8_t>& data,
+    const BenchOptions& options, std::vector<BenchRow>& rows) {
+    std::cerr << corpus << " " << data.size() << " bytes...\n";
+    benchStages(ctx, corpus, data, options, rows);
+    benchEndToEnd(ctx, corpus, data, options, rows);
+}
+
+// ---------- 输出 ----------
+
+void writeResults(std::ostream& out, const BenchOptions& options, const std::vector<BenchRow>& rows) {
+    out << "{\"benchmark\":\"qrac\",\"profile\":{\"L\":" << options.profile.L
+        << ",\"fec_ratio\":" << options.profile.FEC_REDUNDANCY_RATIO
+        << ",\"fec\":\"" << (options.profile.USE_ADVANCED_FEC ? "rs" : "xor") << "\""
+        << ",\"check_block\":" << options.profile.CHECK_BLOCK_SIZE << "}"
+        << ",\"frame_bytes\":" << kStreamChunkBytes
+#ifdef __linux__
+        << ",\"peak_memory\":\"stage\""
+#else
+        << ",\"peak_memory\":\"process\""
+#endif
+        << ",\"rows\":[\n";
+    for (size_t i = 0; i < rows.size(); i++) {
+        const BenchRow& row = rows[i];
+        double mbPerSecond = row.seconds > 0.0 ? row.size / (1024.0 * 1024.0) / row.seconds : 0.0;
+        double nsPerByte = row.size > 0 ? row.seconds * 1e9 / row.size : 0.0;
+        out << "{\"corpus\":" << jsonString(row.corpus) << ",\"size\":" << row.size
+            << ",\"stage\":\"" << row.stage << "\",\"iterations\":" << row.iterations
+            << std::fixed << std::setprecision(9) << ",\"seconds\":" << row.seconds
+            << std::setprecision(3) << ",\"mb_per_s\":" << mbPerSecond << ",\"ns_per_byte\":" << nsPerByte
+            << ",\"peak_memory_bytes\":" << row.peakMemory << "}" << (i + 1 < rows.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+}
+
+void showUsage() {
+    std::cout << "Usage: qrac_bench [options]\n";
+    std::cout << "  --max-size N    Largest synthetic input, sizes 1K x16 up to N (default: 64M, up to 1G)\n";
+    std::cout << "  --sizes LIST    Explicit synthetic sizes, e.g. 1K,1M,100M\n";
+    std::cout << "  --corpus DIR    Also run every file in DIR (not recursive)\n";
+    std::cout << "  --min-time S    Minimum measured time per row in seconds (default: 0.2)\n";
+    std::cout << "  --out FILE      Write the JSON results to FILE instead of stdout\n";
+    std::cout << "  --L N           Quantization interval length (default: 5)\n";
+    std::cout << "  --fec-ratio R   FEC redundancy ratio (default: 0.25)\n";
+    std::cout << "  --fec SCHEME    xor (default) or rs (Reed-Solomon)\n";
+    std::cout << "  --check-block N CRC32C block size (default: 4K), off to disable block checks\n";
+    std::cout << "\n";
+    std::cout << "Usage: qrac_bench impair [options]\n";
+    std::cout << "  Encode payloads, apply noise, row bursts, lost tiles, JPEG recompression and level shifts,\n";
+    std::cout << "  then correct and decode; reports timings, bytes recovered and residual error rate\n";
+    std::cout << "  --L LIST        Quantization interval lengths (default: 3,5,8)\n";
+    std::cout << "  --fec-ratio LIST FEC redundancy ratios (default: 0,0.25,0.5)\n";
+    std::cout << "  --fec LIST      FEC schemes: xor, rs (default: xor,rs)\n";
+    std::cout << "  --size N        Payload size per trial (default: 64K)\n";
+    std::cout << "  --trials N      Trials per profile and impairment (default: 3)\n";
+    std::cout << "  --calibrate on|off  Calibrate pixel levels before decoding (default: on)\n";
+    std::cout << "  --check-block N|off CRC32C block size (default: 4K); off sends every payload through FEC\n";
+    std::cout << "  --out FILE      Write the JSON results to FILE instead of stdout\n";
+}
+
+bool parseSizes(const std::string& text, std::vector<size_t>& sizes) {
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        size_t size = 0;
+        if (!parseByteSize(item, size)) {
+            return false;
+        }
+        sizes.push_back(size);
+    }
+    return !sizes.empty();
+}
+
+// ---------- 信道损伤（qrac_bench impair） ----------
+
+// 一种损伤及其强度；level的含义见applyImpairment
+struct Impairment {
+    const char* name;
+    double level;
+};
+
+const Impairment kImpairments[] = {
+    { "none", 0 },
+    { "noise", 1 }, { "noise", 2 }, { "noise", 4 }, { "noise", 8 },     // 每个通道值±k以内的随机噪声
+    { "burst_rows", 0.01 }, { "burst_rows", 0.05 },                     // 连续一段行（占总行数的比例）变为随机值
+    { "lost_tiles", 0.01 }, { "lost_tiles", 0.05 },                     // 16x16的块（按比例）内容丢失
+    { "jpeg", 95 }, { "jpeg", 85 }, { "jpeg", 75 },                     // JPEG重新压缩的质量
+    { "brightness", 4 }, { "brightness", -8 }, { "brightness", 16 },    // 整体亮度偏移
+    { "contrast", 0.9 }, { "contrast", 1.08 },                          // 整体缩放
+    { "gamma", 0.9 }, { "gamma", 1.1 }                                  // 伽马变化
+};
+
+uint8_t clampPixel(int value) {
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+// 对编码后的图像施加损伤（原地修改）
+void applyImpairment(Image& image, const Impairment& impairment, std::mt19937& random) {
+    std::string name = impairment.name;
+    if (name == "noise") {
+        int k = static_cast<int>(impairment.level);
+        std::uniform_int_distribution<int> offset(-k, k);
+        for (uint8_t& value : image.pixels) {
+            value = clampPixel(value + offset(random));
+        }
+    }
+    else if (name == "burst_rows") {
+        int rows = std::max(1, static_cast<int>(image.height * impairment.level));
+        int first = static_cast<int>(random() % std::max(1, image.height - rows + 1));
+        size_t rowBytes = static_cast<size_t>(image.width) * image.channels;
+        for (size_t i = first * rowBytes; i < (first + rows) * rowBytes; i++) {
+            image.pixels[i] = static_cast<uint8_t>(random());
+        }
+    }
+    else if (name == "lost_tiles") {
+        // 丢失的块填成中灰色（不是填充色，符号序列不会错位，只有块内的值出错）
+        const int tile = 16;
+        int tilesX = (image.width + tile - 1) / tile;
+        int tilesY = (image.height + tile - 1) / tile;
+        size_t lost = std::max<size_t>(1, static_cast<size_t>(tilesX * tilesY * impairment.level));
+        for (size_t t = 0; t < lost; t++) {
+            int tx = static_cast<int>(random() % tilesX) * tile;
+            int ty = static_cast<int>(random() % tilesY) * tile;
+            for (int y = ty; y < std::min(ty + tile, image.height); y++) {
+                uint8_t* row = image.pixels.data() + static_cast<size_t>(y) * image.width * image.channels;
+                std::fill(row + static_cast<size_t>(tx) * image.channels,
+                    row + static_cast<size_t>(std::min(tx + tile, image.width)) * image.channels, uint8_t(128));
+            }
+        }
+    }
+    else if (name == "jpeg") {
+        ByteBuffer jpeg;
+        auto append = [](void* context, void* data, int size) {
+            auto* out = static_cast<ByteBuffer*>(context);
+            out->insert(out->end(), static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
+        };
+        if (!stbi_write_jpg_to_func(append, &jpeg, image.width, image.height, image.channels, image.pixels.data(),
+            static_cast<int>(impairment.level))) {
+            throw QRACException(ErrorType::ImageSaveError, "Failed to encode JPEG image");
+        }
+        image = loadImage(jpeg, 3);
+    }
+    else if (name == "brightness") {
+        int shift = static_cast<int>(impairment.level);
+        for (uint8_t& value : image.pixels) {
+            value = clampPixel(value + shift);
+        }
+    }
+    else if (name == "contrast") {
+        for (uint8_t& value : image.pixels) {
+            value = clampPixel(static_cast<int>(std::lround(value * impairment.level)));
+        }
+    }
+    else if (name == "gamma") {
+        for (uint8_t& value : image.pixels) {
+            value = clampPixel(static_cast<int>(std::lround(255.0 * std::pow(value / 255.0, impairment.level))));
+        }
+    }
+}
+
+struct ImpairOptions {
+    std::vector<int> levels{ 3, 5, 8 };                 // L
+    std::vector<float> fecRatios{ 0.0f, 0.25f, 0.5f };  // FEC冗余比例
+    std::vector<std::string> fecSchemes{ "xor", "rs" };  // FEC方式
+    bool calibrate = true;                               // 解码前校准电平
+    size_t checkBlockSize = QRACConfig().CHECK_BLOCK_SIZE; // 分块CRC32C校验，0为不校验
+    size_t payloadBytes = 64 * 1024;
+    int trials = 3;
+    std::string output;
+};
+
+// 一种配置在一种损伤下多次试验的合计
+struct ImpairRow {
+    int L = 0;
+    float fecRatio = 0.0f;
+    std::string fecScheme;
+    Impairment impairment{};
+    int trials = 0;
+    int validTrials = 0;          // FEC报告全部校正的次数
+    double encodeSeconds = 0.0;   // 以下均为合计
+    double correctSeconds = 0.0;
+    double decodeSeconds = 0.0;
+    size_t payloadBytes = 0;
+    size_t recoveredBytes = 0;    // 与原始数据逐字节相同的字节数
+    size_t fecCorrectedBytes = 0;
+    size_t fecErasures = 0;
+    int calibratedTrials = 0;     // 解码前校准了电平的次数
+    size_t damagedBlocks = 0;     // FEC之前CRC32C不符的数据块数
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 编码 -> 损伤 -> 解码。损坏的图像直接解码（提取时吸附到锚点，Reed-Solomon还需要原始值的置信度），
+// 校正(correct)只计时，结果与先校正再解码相同
+void runImpairTrial(const CodecContext& ctx, const std::vector<uint8_t>& payload, std::mt19937& random, ImpairRow& row) {
+    auto start = std::chrono::steady_clock::now();
+    Image image = encode(payload, ctx, SizeMode::Adaptive);
+    row.encodeSeconds += secondsSince(start);
+
+    applyImpairment(image, row.impairment, random);
+
+    start = std::chrono::steady_clock::now();
+    Image corrected = correct(image.view(), ctx);
+    row.correctSeconds += secondsSince(start);
+    g_sink = corrected.pixels.size();
+
+    DecodeReport report;
+    ByteBuffer decoded;
+    start = std::chrono::steady_clock::now();
+    try {
+        decoded = decode(image.view(), ctx, &report);
+    }
+    catch (const QRACException&) {
+        report.dataValid = false; // 无法解码：全部计为错误
+    }
+    row.decodeSeconds += secondsSince(start);
+
+    size_t compared = std::min(decoded.size(), payload.size());
+    for (size_t i = 0; i < compared; i++) {
+        row.recoveredBytes += decoded[i] == payload[i];
+    }
+    row.payloadBytes += payload.size();
+    row.fecCorrectedBytes += report.fec.correctedBytes;
+    row.fecErasures += report.fec.erasures;
+    row.calibratedTrials += report.levelsCalibrated ? 1 : 0;
+    row.damagedBlocks += report.fec.damagedBlocks.size();
+    row.validTrials += report.dataValid && decoded.size() == payload.size() ? 1 : 0;
+    row.trials++;
+}
+
+void writeImpairResults(std::ostream& out, const ImpairOptions& options, const std::vector<ImpairRow>& rows) {
+    out << "{\"benchmark\":\"qrac_impair\",\"payload_bytes\":" << options.payloadBytes
+        << ",\"trials\":" << options.trials << ",\"rows\":[\n";
+    for (size_t i = 0; i < rows.size(); i++) {
+        const ImpairRow& row = rows[i];
+        double residual = row.payloadBytes > 0 ? 1.0 - static_cast<double>(row.recoveredBytes) / row.payloadBytes : 0.0;
+        out << "{\"L\":" << row.L << ",\"fec\":\"" << row.fecScheme << "\",\"fec_ratio\":"
+            << std::setprecision(3) << std::defaultfloat << row.fecRatio
+            << ",\"impairment\":\"" << row.impairment.name << "\",\"level\":" << row.impairment.level
+            << ",\"trials\":" << row.trials << ",\"valid_trials\":" << row.validTrials
+            << ",\"calibrated_trials\":" << row.calibratedTrials
+            << std::fixed << std::setprecision(6)
+            << ",\"encode_seconds\":" << row.encodeSeconds / row.trials
+            << ",\"correct_seconds\":" << row.correctSeconds / row.trials
+            << ",\"decode_seconds\":" << row.decodeSeconds / row.trials
+            << ",\"bytes_recovered\":" << row.recoveredBytes / row.trials
+            << ",\"fec_corrected_bytes\":" << row.fecCorrectedBytes / row.trials
+            << ",\"fec_erasures\":" << row.fecErasures / row.trials
+            << ",\"damaged_blocks\":" << row.damagedBlocks / row.trials
+            << ",\"residual_error_rate\":" << residual << "}" << (i + 1 < rows.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+}
+
+template <typename T>
+bool parseList(const std::string& text, std::vector<T>& values) {
+    std::stringstream list(text);
+    std::string item;
+    values.clear();
+    while (std::getline(list, item, ',')) {
+        char* end = nullptr;
+        double value = std::strtod(item.c_str(), &end);
+        if (end == item.c_str() || *end != '\0') {
+            return false;
+        }
+        values.push_back(static_cast<T>(value));
+    }
+    return !values.empty();
+}
+
+// FEC方式列表（xor、rs）
+bool parseSchemes(const std::string& text, std::vector<std::string>& schemes) {
+    std::stringstream list(text);
+    std::string item;
+    schemes.clear();
+    while (std::getline(list, item, ',')) {
+        if (item != "xor" && item != "rs") {
+            return false;
+        }
+        schemes.push_back(item);
+    }
+    return !schemes.empty();
+}
+
+// 每个L、FEC方式和冗余比例的组合，对每种损伤做若干次试验（随机载荷和损伤位置固定种子，可重复）
+int runImpairBench(int argc, char* argv[]) {
+    ImpairOptions options;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool ok = true;
+        if (arg == "--L" && hasValue) {
+            ok = parseList(argv[++i], options.levels);
+        }
+        else if (arg == "--fec-ratio" && hasValue) {
+            ok = parseList(argv[++i], options.fecRatios);
+        }
+        else if (arg == "--fec" && hasValue) {
+            ok = parseSchemes(argv[++i], options.fecSchemes);
+        }
+        else if (arg == "--size" && hasValue) {
+            ok = parseByteSize(argv[++i], options.payloadBytes);
+        }
+        else if (arg == "--trials" && hasValue) {
+            options.trials = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--calibrate" && hasValue) {
+            std::string value = argv[++i];
+            ok = value == "on" || value == "off";
+            options.calibrate = value == "on";
+        }
+        else if (arg == "--check-block" && hasValue) {
+            std::string value = argv[++i];
+            options.checkBlockSize = 0;
+            ok = value == "off" || parseByteSize(value, options.checkBlockSize);
+        }
+        else if (arg == "--out" && hasValue) {
+            options.output = argv[++i];
+        }
+        else {
+            showUsage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+        if (!ok) {
+            std::cerr << "Invalid value for " << arg << ": " << argv[i] << "\n";
+            return 1;
+        }
+    }
+
+    try {
+        std::vector<ImpairRow> rows;
+        for (int L : options.levels) {
+            for (const std::string& scheme : options.fecSchemes) {
+                for (float fecRatio : options.fecRatios) {
+                    QRACConfig profile;
+                    profile.L = L;
+                    profile.FEC_REDUNDANCY_RATIO = fecRatio;
+                    profile.USE_ADVANCED_FEC = scheme == "rs";
+                    profile.CALIBRATE_LEVELS = options.calibrate;
+                    profile.CHECK_BLOCK_SIZE = options.checkBlockSize;
+                    CodecContext ctx(profile);
+                    std::cerr << "L " << L << ", FEC " << scheme << " ratio " << fecRatio << "...\n";
+                    for (const Impairment& impairment : kImpairments) {
+                        ImpairRow row;
+                        row.L = L;
+                        row.fecRatio = fecRatio;
+                        row.fecScheme = scheme;
+                        row.impairment = impairment;
+                        std::mt19937 random(12345);
+                        for (int trial = 0; trial < options.trials; trial++) {
+                            runImpairTrial(ctx, randomData(options.payloadBytes, trial + 1), random, row);
+                        }
+                        rows.push_back(row);
+                    }
+                }
+            }
+        }
+
+        if (options.output.empty()) {
+            writeImpairResults(std::cout, options, rows);
+        }
+        else {
+            std::ofstream out(options.output, std::ios::binary);
+            writeImpairResults(out, options, rows);
+            if (!out) {
+                std::cerr << "Failed to write " << options.output << "\n";
+                return 1;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "impair") {
+        return runImpairBench(argc, argv);
+    }
+
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--max-size" && hasValue) {
+            if (!parseByteSize(argv[++i], options.maxSize)) {
+                std::cerr << "Invalid size: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--sizes" && hasValue) {
+            if (!parseSizes(argv[++i], options.sizes)) {
+                std::cerr << "Invalid size list: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--corpus" && hasValue) {
+            options.corpus = argv[++i];
+        }
+        else if (arg == "--min-time" && hasValue) {
+            options.minSeconds = std::max(0.0, std::atof(argv[++i]));
+        }
+        else if (arg == "--out" && hasValue) {
+            options.output = argv[++i];
+        }
+        else if (arg == "--L" && hasValue) {
+            options.profile.L = std::atoi(argv[++i]);
+        }
+        else if (arg == "--fec-ratio" && hasValue) {
+            options.profile.FEC_REDUNDANCY_RATIO = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if (arg == "--fec" && hasValue && (std::string(argv[i + 1]) == "xor" || std::string(argv[i + 1]) == "rs")) {
+            options.profile.USE_ADVANCED_FEC = std::string(argv[++i]) == "rs";
+        }
+        else if (arg == "--check-block" && hasValue) {
+            std::string value = argv[++i];
+            size_t blockSize = 0;
+            if (value != "off" && !parseByteSize(value, blockSize)) {
+                std::cerr << "Invalid block size: " << value << "\n";
+                return 1;
+            }
+            options.profile.CHECK_BLOCK_SIZE = blockSize;
+        }
+        else {
+            showUsage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+    if (options.sizes.empty()) {
+        for (size_t size : kSizeLadder) {
+            if (size <= options.maxSize) options.sizes.push_back(size);
+        }
+    }
+
+    try {
+        CodecContext ctx(options.profile);
+        std::vector<BenchRow> rows;
+        for (size_t size : options.sizes) {
+            benchCorpus(ctx, "random", randomData(size, size), options, rows);
+            benchCorpus(ctx, "text", textData(size, size), options, rows);
+        }
+        if (!options.corpus.empty()) {
+            std::vector<fs::path> files;
+            for (const auto& entry : fs::directory_iterator(options.corpus)) {
+                if (entry.is_regular_file()) files.push_back(entry.path());
+            }
+            std::sort(files.begin(), files.end());
+            for (const fs::path& path : files) {
+                std::ifstream file(path, std::ios::binary);
+                std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                auto name = path.filename().u8string();
+                benchCorpus(ctx, std::string(name.begin(), name.end()), data, options, rows);
+            }
+        }
+
+        if (options.output.empty()) {
+            writeResults(std::cout, options, rows);
+        }
+        else {
+            std::ofstream out(options.output, std::ios::binary);
+            writeResults(out, options, rows);
+            if (!out) {
+                std::cerr << "Failed to write " << options.output << "\n";
+                return 1;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,302 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * libqrac - C语言接口实现
+ *
+ * 异常不会跨越C边界：全部转换为qrac_status，详细信息通过qrac_last_error获取
+ ******************************************************************/
+#include "qrac_c.h"
+#include "qrac.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+using namespace qrac;
+
+// 不透明上下文
+struct qrac_context {
+    CodecContext codec;
+};
+
+namespace {
+
+thread_local std::string t_lastError;
+
+qrac_status statusFromError(ErrorType type) {
+    switch (type) {
+    case ErrorType::ImageSizeError:
+        return QRAC_ERROR_IMAGE_SIZE;
+    case ErrorType::DataSizeError:
+        return QRAC_ERROR_DATA_SIZE;
+    case ErrorType::FECError:
+        return QRAC_ERROR_FEC;
+    case ErrorType::ImageLoadError:
+        return QRAC_ERROR_IMAGE_LOAD;
+    case ErrorType::ImageSaveError:
+        return QRAC_ERROR_IMAGE_SAVE;
+    case ErrorType::InvalidInput:
+        return QRAC_ERROR_INVALID_ARGUMENT;
+    default:
+        return QRAC_ERROR_INTERNAL;
+    }
+}
+
+// 执行函数体并把异常转换为状态码
+template <typename Body>
+qrac_status guarded(Body&& body) {
+    try {
+        body();
+        t_lastError.clear();
+        return QRAC_OK;
+    }
+    catch (const QRACException& e) {
+        t_lastError = e.what();
+        return statusFromError(e.getType());
+    }
+    catch (const std::bad_alloc&) {
+        t_lastError = "out of memory";
+        return QRAC_ERROR_OUT_OF_MEMORY;
+    }
+    catch (const std::exception& e) {
+        t_lastError = e.what();
+        return QRAC_ERROR_INTERNAL;
+    }
+    catch (...) {
+        t_lastError = "unknown error";
+        return QRAC_ERROR_INTERNAL;
+    }
+}
+
+qrac_status invalidArgument(const char* message) {
+    t_lastError = message;
+    return QRAC_ERROR_INVALID_ARGUMENT;
+}
+
+// 复制到malloc分配的内存，调用方用qrac_*_free释放
+uint8_t* copyToMalloc(std::span<const uint8_t> bytes) {
+    uint8_t* memory = static_cast<uint8_t*>(std::malloc(bytes.empty() ? 1 : bytes.size()));
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    if (!bytes.empty()) {
+        std::memcpy(memory, bytes.data(), bytes.size());
+    }
+    return memory;
+}
+
+void exportImage(const Image& source, qrac_image* image) {
+    image->pixels = copyToMalloc(source.pixels);
+    image->width = source.width;
+    image->height = source.height;
+    image->channels = source.channels;
+    image->stride = static_cast<size_t>(source.width) * source.channels;
+}
+
+ImageView toView(const qrac_image_view* image) {
+    return { image->pixels, image->width, image->height, image->channels, image->stride };
+}
+
+SizeMode toSizeMode(qrac_size_mode mode) {
+    return mode == QRAC_SIZE_AUTO ? SizeMode::Auto : SizeMode::Adaptive;
+}
+
+} // namespace
+
+extern "C" {
+
+uint32_t qrac_abi_version(void) {
+    return QRAC_ABI_VERSION;
+}
+
+const char* qrac_status_string(qrac_status status) {
+    switch (status) {
+    case QRAC_OK: return "ok";
+    case QRAC_ERROR_INVALID_ARGUMENT: return "invalid argument";
+    case QRAC_ERROR_IMAGE_SIZE: return "image too small for data";
+    case QRAC_ERROR_DATA_SIZE: return "invalid data size";
+    case QRAC_ERROR_FEC: return "FEC error";
+    case QRAC_ERROR_IMAGE_LOAD: return "image load error";
+    case QRAC_ERROR_IMAGE_SAVE: return "image save error";
+    case QRAC_ERROR_OUT_OF_MEMORY: return "out of memory";
+    default: return "internal error";
+    }
+}
+
+const char* qrac_last_error(void) {
+    return t_lastError.c_str();
+}
+
+void qrac_profile_default(qrac_profile* profile) {
+    if (!profile) return;
+    QRACConfig defaults;
+    std::memset(profile, 0, sizeof(*profile));
+    profile->struct_size = sizeof(qrac_profile);
+    profile->L = defaults.L;
+    profile->filler_max_value = defaults.FILLER_MAX_VALUE;
+    profile->fec_redundancy_ratio = defaults.FEC_REDUNDANCY_RATIO;
+    profile->min_image_dimension = defaults.MIN_IMAGE_DIMENSION;
+    profile->symbols_per_pixel = defaults.SYMBOLS_PER_PIXEL;
+    profile->default_small_size = defaults.DEFAULT_SMALL_SIZE;
+    profile->default_medium_size = defaults.DEFAULT_MEDIUM_SIZE;
+    profile->default_large_size = defaults.DEFAULT_LARGE_SIZE;
+    profile->small_file_threshold = defaults.SMALL_FILE_THRESHOLD;
+    profile->medium_file_threshold = defaults.MEDIUM_FILE_THRESHOLD;
+    profile->fec_scheme = defaults.USE_ADVANCED_FEC ? QRAC_FEC_REED_SOLOMON : QRAC_FEC_XOR;
+    profile->erasure_confidence = defaults.ERASURE_CONFIDENCE;
+    profile->calibrate_levels = defaults.CALIBRATE_LEVELS ? 1 : 0;
+    profile->check_block_size = static_cast<uint32_t>(defaults.CHECK_BLOCK_SIZE);
+}
+
+qrac_status qrac_context_create(const qrac_profile* profile, qrac_context** context) {
+    if (!context) return invalidArgument("context is NULL");
+    *context = nullptr;
+
+    // 只读取调用方结构体中实际存在的字段（兼容旧版本的较小结构体）
+    qrac_profile effective;
+    qrac_profile_default(&effective);
+    if (profile) {
+        if (profile->struct_size < offsetof(qrac_profile, min_image_dimension)) {
+            return invalidArgument("qrac_profile.struct_size is too small");
+        }
+        size_t size = profile->struct_size < sizeof(qrac_profile) ? profile->struct_size : sizeof(qrac_profile);
+        std::memcpy(&effective, profile, size);
+        if (size < offsetof(qrac_profile, check_block_size) + sizeof(effective.check_block_size)) {
+            effective.check_block_size = 0; // 旧调用方编码为之前的格式（不分块校验）
+        }
+    }
+
+    return guarded([&] {
+        if (effective.filler_max_value < 0 || effective.filler_max_value > 255) {
+            throw QRACException(ErrorType::InvalidInput, "filler_max_value must be 0-255");
+        }
+
+        QRACConfig config;
+        config.L = effective.L;
+        config.FILLER_MAX_VALUE = static_cast<uint8_t>(effective.filler_max_value);
+        config.FEC_REDUNDANCY_RATIO = effective.fec_redundancy_ratio;
+        config.MIN_IMAGE_DIMENSION = effective.min_image_dimension;
+        config.SYMBOLS_PER_PIXEL = effective.symbols_per_pixel;
+        config.DEFAULT_SMALL_SIZE = effective.default_small_size;
+        config.DEFAULT_MEDIUM_SIZE = effective.default_medium_size;
+        config.DEFAULT_LARGE_SIZE = effective.default_large_size;
+        config.SMALL_FILE_THRESHOLD = static_cast<size_t>(effective.small_file_threshold);
+        config.MEDIUM_FILE_THRESHOLD = static_cast<size_t>(effective.medium_file_threshold);
+        if (effective.fec_scheme != QRAC_FEC_XOR && effective.fec_scheme != QRAC_FEC_REED_SOLOMON) {
+            throw QRACException(ErrorType::InvalidInput, "fec_scheme must be QRAC_FEC_XOR or QRAC_FEC_REED_SOLOMON");
+        }
+        config.USE_ADVANCED_FEC = effective.fec_scheme == QRAC_FEC_REED_SOLOMON;
+        config.ERASURE_CONFIDENCE = effective.erasure_confidence;
+        config.CALIBRATE_LEVELS = effective.calibrate_levels != 0;
+        config.CHECK_BLOCK_SIZE = effective.check_block_size;
+
+        *context = new qrac_context{ CodecContext(config) };
+    });
+}
+
+void qrac_context_destroy(qrac_context* context) {
+    delete context;
+}
+
+qrac_status qrac_encoded_dimensions(const qrac_context* context, size_t size,
+    qrac_size_mode mode, int32_t* width, int32_t* height) {
+    if (!context || !width || !height) return invalidArgument("NULL argument");
+
+    return guarded([&] {
+        int w = 0, h = 0;
+        encodedImageDimensions(context->codec, size, toSizeMode(mode), &w, &h);
+        *width = w;
+        *height = h;
+    });
+}
+
+qrac_status qrac_encode(const qrac_context* context, const uint8_t* data, size_t size,
+    qrac_size_mode mode, qrac_image* image) {
+    if (!context || !image || (!data && size > 0)) return invalidArgument("NULL argument");
+    std::memset(image, 0, sizeof(*image));
+
+    return guarded([&] {
+        Image encoded = encode(std::span<const uint8_t>(data, size), context->codec, toSizeMode(mode));
+        exportImage(encoded, image);
+    });
+}
+
+qrac_status qrac_encode_into(const qrac_context* context, const uint8_t* data, size_t size,
+    uint8_t* pixels, int32_t width, int32_t height, int32_t channels, size_t stride) {
+    if (!context || !pixels || (!data && size > 0)) return invalidArgument("NULL argument");
+
+    return guarded([&] {
+        encodeInto(std::span<const uint8_t>(data, size), context->codec,
+            MutableImageView{ pixels, width, height, channels, stride });
+    });
+}
+
+qrac_status qrac_decode(const qrac_context* context, const qrac_image_view* image,
+    qrac_buffer* data, int* data_valid) {
+    if (!context || !image || !data) return invalidArgument("NULL argument");
+    std::memset(data, 0, sizeof(*data));
+
+    return guarded([&] {
+        DecodeReport report;
+        ByteBuffer decoded = decode(toView(image), context->codec, &report);
+        data->data = copyToMalloc(decoded);
+        data->size = decoded.size();
+        if (data_valid) {
+            *data_valid = report.dataValid ? 1 : 0;
+        }
+    });
+}
+
+qrac_status qrac_verify(const qrac_context* context, const qrac_image_view* image, int* verified) {
+    if (!context || !image || !verified) return invalidArgument("NULL argument");
+    *verified = 0;
+
+    return guarded([&] {
+        *verified = verify(toView(image), context->codec) ? 1 : 0;
+    });
+}
+
+qrac_status qrac_correct(const qrac_context* context, const qrac_image_view* image,
+    qrac_image* corrected) {
+    if (!context || !image || !corrected) return invalidArgument("NULL argument");
+    std::memset(corrected, 0, sizeof(*corrected));
+
+    return guarded([&] {
+        exportImage(correct(toView(image), context->codec), corrected);
+    });
+}
+
+qrac_status qrac_encode_png(const qrac_image_view* image, qrac_buffer* png) {
+    if (!image || !png) return invalidArgument("NULL argument");
+    std::memset(png, 0, sizeof(*png));
+
+    return guarded([&] {
+        ByteBuffer bytes = encodePng(toView(image));
+        png->data = copyToMalloc(bytes);
+        png->size = bytes.size();
+    });
+}
+
+qrac_status qrac_load_image(const uint8_t* encoded, size_t size, qrac_image* image) {
+    if (!encoded || !image) return invalidArgument("NULL argument");
+    std::memset(image, 0, sizeof(*image));
+
+    return guarded([&] {
+        exportImage(loadImage(std::span<const uint8_t>(encoded, size)), image);
+    });
+}
+
+void qrac_image_free(qrac_image* image) {
+    if (!image) return;
+    std::free(image->pixels);
+    image->pixels = nullptr;
+}
+
+void qrac_buffer_free(qrac_buffer* buffer) {
+    if (!buffer) return;
+    std::free(buffer->data);
+    buffer->data = nullptr;
+    buffer->size = 0;
+}
+
+} // extern "C"
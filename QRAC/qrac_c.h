@@ -0,0 +1,155 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * libqrac - 稳定的C语言接口（ABI）
+ *
+ * - 只使用C类型，结构体按值布局固定，新增字段只追加在末尾
+ * - qrac_profile 以 struct_size 标识版本，旧调用方的较小结构体仍可使用
+ * - 库分配的内存必须用对应的 qrac_*_free 释放
+ * - 所有函数可在多个线程中同时调用（同一上下文可共享）
+ *
+ * 构建为DLL时定义 QRAC_SHARED 和 QRAC_BUILD_DLL，使用方只定义 QRAC_SHARED
+ ******************************************************************/
+#ifndef QRAC_C_H
+#define QRAC_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(QRAC_SHARED)
+#ifdef QRAC_BUILD_DLL
+#define QRAC_API __declspec(dllexport)
+#else
+#define QRAC_API __declspec(dllimport)
+#endif
+#elif defined(QRAC_SHARED) && defined(__GNUC__)
+#define QRAC_API __attribute__((visibility("default")))
+#else
+#define QRAC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ABI版本，不兼容的修改才会增加 */
+#define QRAC_ABI_VERSION 1
+
+/* 状态码（与C++的ErrorType对应） */
+typedef enum qrac_status {
+    QRAC_OK = 0,
+    QRAC_ERROR_INVALID_ARGUMENT = 1,
+    QRAC_ERROR_IMAGE_SIZE = 2,
+    QRAC_ERROR_DATA_SIZE = 3,
+    QRAC_ERROR_FEC = 4,
+    QRAC_ERROR_IMAGE_LOAD = 5,
+    QRAC_ERROR_IMAGE_SAVE = 6,
+    QRAC_ERROR_OUT_OF_MEMORY = 7,
+    QRAC_ERROR_INTERNAL = 8
+} qrac_status;
+
+/* 编解码配置 */
+typedef struct qrac_profile {
+    uint32_t struct_size;          /* = sizeof(qrac_profile)，由qrac_profile_default填写 */
+    int32_t L;                     /* 量化间隔长度 */
+    int32_t filler_max_value;      /* 最大填充值 */
+    float fec_redundancy_ratio;    /* FEC冗余比例 */
+    int32_t min_image_dimension;   /* 最小图像尺寸 */
+    int32_t symbols_per_pixel;     /* 每像素符号数 (1-3) */
+    int32_t default_small_size;    /* 自动模式小尺寸 */
+    int32_t default_medium_size;   /* 自动模式中尺寸 */
+    int32_t default_large_size;    /* 自动模式大尺寸 */
+    uint64_t small_file_threshold; /* 小文件阈值（字节） */
+    uint64_t medium_file_threshold;/* 中文件阈值（字节） */
+    int32_t fec_scheme;            /* FEC方式（qrac_fec_scheme），解码时必须与编码时一致 */
+    float erasure_confidence;      /* Reed-Solomon：置信度低于此值(0-1)的字节作为擦除 */
+    int32_t calibrate_levels;      /* 非0：解码前按直方图校准像素电平（亮度/对比度/伽马变化） */
+    uint32_t check_block_size;     /* 分块CRC32C校验的块大小（字节），0为不分块校验；
+                                      不为0时解码按尾部标识识别两种格式，struct_size不含此字段时为0 */
+} qrac_profile;
+
+/* FEC方式 */
+typedef enum qrac_fec_scheme {
+    QRAC_FEC_XOR = 0,         /* 简单FEC */
+    QRAC_FEC_REED_SOLOMON = 1 /* 交错的Reed-Solomon，利用低置信度符号作为擦除 */
+} qrac_fec_scheme;
+
+/* 图像尺寸选择方式 */
+typedef enum qrac_size_mode {
+    QRAC_SIZE_AUTO = 0,
+    QRAC_SIZE_ADAPTIVE = 1
+} qrac_size_mode;
+
+/* 只读图像视图：像素内存由调用方持有，stride为每行字节数（0表示紧密排列） */
+typedef struct qrac_image_view {
+    const uint8_t* pixels;
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    size_t stride;
+} qrac_image_view;
+
+/* 库分配的图像，用qrac_image_free释放 */
+typedef struct qrac_image {
+    uint8_t* pixels;
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    size_t stride;
+} qrac_image;
+
+/* 库分配的字节缓冲区，用qrac_buffer_free释放 */
+typedef struct qrac_buffer {
+    uint8_t* data;
+    size_t size;
+} qrac_buffer;
+
+/* 不透明的编解码上下文（只读，可在线程间共享） */
+typedef struct qrac_context qrac_context;
+
+QRAC_API uint32_t qrac_abi_version(void);
+QRAC_API const char* qrac_status_string(qrac_status status);
+
+/* 当前线程最近一次失败的详细错误信息 */
+QRAC_API const char* qrac_last_error(void);
+
+QRAC_API void qrac_profile_default(qrac_profile* profile);
+
+QRAC_API qrac_status qrac_context_create(const qrac_profile* profile, qrac_context** context);
+QRAC_API void qrac_context_destroy(qrac_context* context);
+
+/* 计算编码size字节所需的图像尺寸（用于qrac_encode_into预先分配内存） */
+QRAC_API qrac_status qrac_encoded_dimensions(const qrac_context* context, size_t size,
+    qrac_size_mode mode, int32_t* width, int32_t* height);
+
+/* 编码：数据 -> RGB图像（库分配） */
+QRAC_API qrac_status qrac_encode(const qrac_context* context, const uint8_t* data, size_t size,
+    qrac_size_mode mode, qrac_image* image);
+
+/* 编码到调用方内存（pixels可写，channels为3或4） */
+QRAC_API qrac_status qrac_encode_into(const qrac_context* context, const uint8_t* data, size_t size,
+    uint8_t* pixels, int32_t width, int32_t height, int32_t channels, size_t stride);
+
+/* 解码：直接读取调用方图像内存；data_valid可为NULL，输出FEC是否完全校正 */
+QRAC_API qrac_status qrac_decode(const qrac_context* context, const qrac_image_view* image,
+    qrac_buffer* data, int* data_valid);
+
+/* 校验：解码后重新计算数据的BLAKE3哈希并与编码时记录的比较，不输出数据；
+   一致时verified为1，不一致或没有记录哈希（check_block_size为0编码）时为0 */
+QRAC_API qrac_status qrac_verify(const qrac_context* context, const qrac_image_view* image, int* verified);
+
+/* 校正：像素值吸附到锚点（库分配输出图像） */
+QRAC_API qrac_status qrac_correct(const qrac_context* context, const qrac_image_view* image,
+    qrac_image* corrected);
+
+/* PNG编码 / 从内存加载PNG、BMP、PPM */
+QRAC_API qrac_status qrac_encode_png(const qrac_image_view* image, qrac_buffer* png);
+QRAC_API qrac_status qrac_load_image(const uint8_t* encoded, size_t size, qrac_image* image);
+
+QRAC_API void qrac_image_free(qrac_image* image);
+QRAC_API void qrac_buffer_free(qrac_buffer* buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QRAC_C_H */
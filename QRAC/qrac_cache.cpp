@@ -0,0 +1,182 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 编码缓存实现
+ ******************************************************************/
+#include "qrac_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <sstream>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace qrac {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// 键的格式版本：编码输出的格式改变时修改，旧的缓存文件不再命中，由trim()逐渐淘汰
+const char* const kCacheKeyVersion = "qrac-encode-cache-1";
+
+fs::path pathFromUtf8(const std::string& path) {
+    return fs::path(std::u8string(path.begin(), path.end()));
+}
+
+// 同一目录下的临时文件名（进程内唯一）
+fs::path temporaryPath(const fs::path& target) {
+    static std::atomic<uint64_t> counter{ 0 };
+    std::ostringstream name;
+    name << target.filename().string() << ".tmp" << std::hash<std::thread::id>{}(std::this_thread::get_id())
+        << "." << counter.fetch_add(1);
+    return target.parent_path() / name.str();
+}
+
+// 链接到target，不支持硬链接（跨文件系统等）时复制；成功返回true
+bool linkOrCopy(const fs::path& source, const fs::path& target, bool* linked) {
+    std::error_code error;
+    fs::create_hard_link(source, target, error);
+    if (!error) {
+        if (linked) *linked = true;
+        return true;
+    }
+    error.clear();
+    fs::copy_file(source, target, fs::copy_options::overwrite_existing, error);
+    if (linked) *linked = false;
+    return !error;
+}
+
+} // namespace
+
+EncodeCache::EncodeCache(const std::string& directory, uint64_t maxBytes)
+    : m_directory(pathFromUtf8(directory)), m_maxBytes(maxBytes) {
+    std::error_code error;
+    fs::create_directories(m_directory, error);
+    if (error || !fs::is_directory(m_directory)) {
+        throw QRACException(ErrorType::FileWriteError, "Cannot create cache directory: " + directory);
+    }
+}
+
+std::string EncodeCache::key(const PayloadHash& content, const std::string& settings) {
+    std::vector<uint8_t> material(content.begin(), content.end());
+    material.insert(material.end(), settings.begin(), settings.end());
+    return hashToHex(blake3(material.data(), material.size()));
+}
+
+fs::path EncodeCache::entryPath(const std::string& key, const std::string& extension) const {
+    return m_directory / key.substr(0, 2) / (key + "." + extension);
+}
+
+bool EncodeCache::fetch(const std::string& key, const std::string& extension, const std::string& output, bool* linked) {
+    fs::path entry = entryPath(key, extension);
+    std::error_code error;
+    if (!fs::is_regular_file(entry, error)) {
+        m_misses++;
+        return false;
+    }
+
+    // 先删除已有的输出：它可能是另一个缓存文件的硬链接
+    fs::path target = pathFromUtf8(output);
+    fs::remove(target, error);
+    if (!linkOrCopy(entry, target, linked)) {
+        m_misses++; // 可能刚被其他进程淘汰，按未命中重新编码
+        return false;
+    }
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), error); // LRU：命中时更新
+    m_hits++;
+    return true;
+}
+
+void EncodeCache::store(const std::string& key, const std::string& extension, const std::string& output) {
+    fs::path entry = entryPath(key, extension);
+    std::error_code error;
+    fs::create_directories(entry.parent_path(), error);
+    if (error) {
+        return;
+    }
+    fs::path temporary = temporaryPath(entry);
+    if (!linkOrCopy(pathFromUtf8(output), temporary, nullptr)) {
+        fs::remove(temporary, error);
+        return;
+    }
+    fs::last_write_time(temporary, fs::file_time_type::clock::now(), error);
+    fs::rename(temporary, entry, error); // 相同的键内容相同，其他作业同时写入时后者覆盖即可
+    if (error) {
+        fs::remove(temporary, error);
+        return;
+    }
+    m_stored++;
+}
+
+void EncodeCache::trim() {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type time;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code error;
+    for (fs::recursive_directory_iterator it(m_directory, error), end; !error && it != end; it.increment(error)) {
+        if (!it->is_regular_file(error)) {
+            continue;
+        }
+        Entry entry{ it->path(), it->last_write_time(error), it->file_size(error) };
+        if (!error) {
+            total += entry.size;
+            entries.push_back(std::move(entry));
+        }
+        error.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(m_trimMutex);
+    if (total > m_maxBytes) {
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+        for (const Entry& entry : entries) {
+            if (total <= m_maxBytes) {
+                break;
+            }
+            if (fs::remove(entry.path, error)) {
+                total -= entry.size;
+                m_evicted++;
+                m_evictedBytes += entry.size;
+            }
+        }
+    }
+    m_sizeBytes = total;
+}
+
+EncodeCacheStats EncodeCache::stats() const {
+    EncodeCacheStats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.stored = m_stored;
+    std::lock_guard<std::mutex> lock(m_trimMutex);
+    stats.evicted = m_evicted;
+    stats.evictedBytes = m_evictedBytes;
+    stats.sizeBytes = m_sizeBytes;
+    return stats;
+}
+
+std::string encodeSettingsKey(const QRACConfig& profile, const std::string& format, bool adaptive, size_t streamChunkBytes) {
+    std::ostringstream text;
+    text << kCacheKeyVersion
+        << ";L=" << profile.L
+        << ";filler=" << static_cast<int>(profile.FILLER_MAX_VALUE)
+        << ";fec=" << profile.FEC_REDUNDANCY_RATIO
+        << ";min=" << profile.MIN_IMAGE_DIMENSION
+        << ";sizes=" << profile.DEFAULT_SMALL_SIZE << "," << profile.DEFAULT_MEDIUM_SIZE << "," << profile.DEFAULT_LARGE_SIZE
+        << ";thresholds=" << profile.SMALL_FILE_THRESHOLD << "," << profile.MEDIUM_FILE_THRESHOLD
+        << ";symbols=" << profile.SYMBOLS_PER_PIXEL
+        << ";fecblock=" << profile.FEC_BLOCK_SIZE
+        << ";rs=" << profile.USE_ADVANCED_FEC
+        << ";check=" << profile.CHECK_BLOCK_SIZE
+        << ";format=" << format
+        << ";adaptive=" << adaptive
+        << ";chunk=" << streamChunkBytes;
+    return text.str();
+}
+
+} // namespace qrac
@@ -0,0 +1,74 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 编码缓存（--cache）
+ *
+ * 以输入内容的BLAKE3哈希加上影响输出的配置（编解码配置、输出格式、尺寸模式、分帧大小）为键，
+ * 保存编码生成的图像。内容未变的文件再次编码时直接把缓存的图像硬链接到输出位置
+ * （不支持硬链接时复制），省去FEC、打包和PNG压缩，只需读取并计算哈希。
+ * 缓存文件为 <目录>/<键的前2个字符>/<键>.png|bmp，先写临时文件再改名，多个作业可以同时使用。
+ * 命中时更新文件的修改时间，trim()按修改时间从旧到新删除，使总大小不超过上限（LRU）。
+ * 输出与缓存共享硬链接，因此编码写出前总是先删除已有的输出文件，不会改写缓存中的内容。
+ ******************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+
+#include "qrac.h"
+
+namespace qrac {
+
+// 默认的缓存大小上限
+constexpr uint64_t kDefaultCacheBytes = 4ull * 1024 * 1024 * 1024;
+
+// 缓存的使用情况（本进程内的计数，sizeBytes为最近一次trim后的总大小）
+struct EncodeCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t stored = 0;
+    size_t evicted = 0;
+    uint64_t evictedBytes = 0;
+    uint64_t sizeBytes = 0;
+};
+
+class EncodeCache {
+public:
+    // 目录不存在时创建，失败时抛出QRACException
+    EncodeCache(const std::string& directory, uint64_t maxBytes);
+
+    // 缓存键（64个十六进制字符）：内容哈希加上settings（影响输出的配置，见encodeSettingsKey）
+    static std::string key(const PayloadHash& content, const std::string& settings);
+
+    // 命中时把缓存的图像链接（或复制）到output（已有的output先删除），返回true；linked为是否为硬链接
+    bool fetch(const std::string& key, const std::string& extension, const std::string& output, bool* linked = nullptr);
+
+    // 编码完成后把output加入缓存，失败时只放弃缓存（不影响编码结果）
+    void store(const std::string& key, const std::string& extension, const std::string& output);
+
+    // 按修改时间淘汰最旧的文件，直到总大小不超过上限
+    void trim();
+
+    EncodeCacheStats stats() const;
+
+private:
+    std::filesystem::path entryPath(const std::string& key, const std::string& extension) const;
+
+    std::filesystem::path m_directory;
+    uint64_t m_maxBytes;
+    std::atomic<size_t> m_hits{ 0 };
+    std::atomic<size_t> m_misses{ 0 };
+    std::atomic<size_t> m_stored{ 0 };
+    mutable std::mutex m_trimMutex;
+    size_t m_evicted = 0;
+    uint64_t m_evictedBytes = 0;
+    uint64_t m_sizeBytes = 0;
+};
+
+// 影响编码输出的配置（编解码配置的全部字段、输出格式、尺寸模式、分帧大小）的文本形式，作为缓存键的一部分
+std::string encodeSettingsKey(const QRACConfig& profile, const std::string& format, bool adaptive, size_t streamChunkBytes);
+
+} // namespace qrac
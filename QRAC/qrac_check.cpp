@@ -0,0 +1,219 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 分块CRC32C校验实现
+ ******************************************************************/
+#include "qrac_check.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define QRAC_CRC32C_SSE42 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// GCC/Clang需要为使用crc32指令的函数单独开启SSE4.2，其余代码不依赖它
+#if defined(QRAC_CRC32C_SSE42) && !defined(_MSC_VER)
+#define QRAC_TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define QRAC_TARGET_SSE42
+#endif
+
+namespace qrac {
+
+namespace {
+
+constexpr char kTrailerMagic[4] = { 'Q', 'R', 'B', 'C' };
+constexpr uint16_t kTrailerVersion = 1;
+
+// 按8字节查表（slicing-by-8），没有SSE4.2时使用
+uint32_t crc32cTable(const uint8_t* data, size_t size, uint32_t crc) {
+    static const auto tables = [] {
+        std::array<std::array<uint32_t, 256>, 8> entries{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0x82F63B78u ^ (c >> 1) : c >> 1;
+            }
+            entries[0][n] = c;
+        }
+        for (uint32_t n = 0; n < 256; n++) {
+            for (int t = 1; t < 8; t++) {
+                entries[t][n] = (entries[t - 1][n] >> 8) ^ entries[0][entries[t - 1][n] & 0xFF];
+            }
+        }
+        return entries;
+    }();
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low = crc ^ (uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24);
+        crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24]
+            ^ tables[3][data[4]] ^ tables[2][data[5]] ^ tables[1][data[6]] ^ tables[0][data[7]];
+    }
+    for (; size > 0; data++, size--) {
+        crc = tables[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(QRAC_CRC32C_SSE42)
+bool hasSse42() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+// crc32指令每次处理8字节
+QRAC_TARGET_SSE42 uint32_t crc32cSse42(const uint8_t* data, size_t size, uint32_t crc) {
+    uint64_t state = crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        state = _mm_crc32_u64(state, word);
+    }
+    uint32_t low = static_cast<uint32_t>(state);
+    for (; size > 0; data++, size--) {
+        low = _mm_crc32_u8(low, *data);
+    }
+    return low;
+}
+#endif
+
+void storeLittleEndian(uint8_t* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+uint64_t loadLittleEndian(const uint8_t* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+size_t blockCount(size_t dataSize, size_t blockSize) {
+    return (dataSize + blockSize - 1) / blockSize;
+}
+
+bool blockMatches(const uint8_t* checked, const BlockCheckResult& result, size_t block) {
+    size_t offset = block * result.blockSize;
+    size_t size = std::min(result.blockSize, result.dataSize - offset);
+    uint32_t stored = static_cast<uint32_t>(loadLittleEndian(checked + result.dataSize + block * 4, 4));
+    return crc32c(checked + offset, size) == stored;
+}
+
+} // namespace
+
+uint32_t crc32c(const uint8_t* data, size_t size, uint32_t crc) {
+#if defined(QRAC_CRC32C_SSE42)
+    static const bool hardware = hasSse42();
+    if (hardware) {
+        return ~crc32cSse42(data, size, ~crc);
+    }
+#endif
+    return ~crc32cTable(data, size, ~crc);
+}
+
+size_t blockCheckSize(size_t dataSize, size_t blockSize) {
+    return blockCount(dataSize, blockSize) * 4 + sizeof(PayloadHash) + kBlockCheckTrailerSize;
+}
+
+bool blockCheckDataSize(size_t checkedSize, size_t blockSize, size_t* dataSize) {
+    if (blockSize == 0) return false;
+    // 每块多4字节：先按比例估算，再在附近找精确的长度
+    size_t fixed = sizeof(PayloadHash) + kBlockCheckTrailerSize;
+    if (checkedSize < fixed) return false;
+    size_t estimate = static_cast<size_t>(static_cast<double>(checkedSize - fixed) * blockSize / (blockSize + 4));
+    for (size_t n = estimate > 4 ? estimate - 4 : 0; n <= estimate + 4; n++) {
+        if (n + blockCheckSize(n, blockSize) == checkedSize) {
+            *dataSize = n;
+            return true;
+        }
+    }
+    return false;
+}
+
+void writeBlockChecks(const uint8_t* data, size_t dataSize, size_t blockSize, uint8_t* out) {
+    size_t blocks = blockCount(dataSize, blockSize);
+    for (size_t block = 0; block < blocks; block++) {
+        size_t offset = block * blockSize;
+        storeLittleEndian(out + block * 4, crc32c(data + offset, std::min(blockSize, dataSize - offset)), 4);
+    }
+
+    PayloadHash hash = blake3(data, dataSize);
+    std::memcpy(out + blocks * 4, hash.data(), hash.size());
+
+    uint8_t* trailer = out + blocks * 4 + hash.size();
+    std::memcpy(trailer, kTrailerMagic, 4);
+    storeLittleEndian(trailer + 4, kTrailerVersion, 2);
+    storeLittleEndian(trailer + 6, kBlockCheckHasHash, 2);
+    storeLittleEndian(trailer + 8, blockSize, 4);
+    storeLittleEndian(trailer + 12, dataSize, 8);
+    storeLittleEndian(trailer + 20, crc32c(out, blocks * 4 + hash.size()), 4);
+    storeLittleEndian(trailer + 24, crc32c(trailer, 24), 4);
+}
+
+BlockCheckResult checkBlocks(const uint8_t* checked, size_t checkedSize) {
+    BlockCheckResult result;
+    if (checkedSize < kBlockCheckTrailerSize) return result;
+
+    // 尾部：标识、版本、自身的CRC，以及记录的长度与总长度一致
+    const uint8_t* trailer = checked + checkedSize - kBlockCheckTrailerSize;
+    if (std::memcmp(trailer, kTrailerMagic, 4) != 0 ||
+        loadLittleEndian(trailer + 4, 2) != kTrailerVersion ||
+        crc32c(trailer, 24) != static_cast<uint32_t>(loadLittleEndian(trailer + 24, 4))) {
+        return result;
+    }
+    bool hasHash = (loadLittleEndian(trailer + 6, 2) & kBlockCheckHasHash) != 0;
+    size_t hashSize = hasHash ? sizeof(PayloadHash) : 0;
+    size_t blockSize = static_cast<size_t>(loadLittleEndian(trailer + 8, 4));
+    uint64_t dataSize = loadLittleEndian(trailer + 12, 8);
+    if (blockSize == 0 || dataSize > checkedSize ||
+        dataSize + blockCount(dataSize, blockSize) * 4 + hashSize + kBlockCheckTrailerSize != checkedSize) {
+        return result;
+    }
+    size_t blocks = blockCount(dataSize, blockSize);
+    if (crc32c(checked + dataSize, blocks * 4 + hashSize) != static_cast<uint32_t>(loadLittleEndian(trailer + 20, 4))) {
+        return result;
+    }
+    if (hasHash) {
+        result.hasHash = true;
+        std::memcpy(result.hash.data(), checked + dataSize + blocks * 4, hashSize);
+    }
+
+    result.readable = true;
+    result.dataSize = static_cast<size_t>(dataSize);
+    result.blockSize = blockSize;
+    result.blocks = blocks;
+    for (size_t block = 0; block < blocks; block++) {
+        if (!blockMatches(checked, result, block)) {
+            result.damaged.push_back(block);
+        }
+    }
+    return result;
+}
+
+bool hasBlockCheckTrailer(const uint8_t* checked, size_t checkedSize) {
+    return checkedSize >= kBlockCheckTrailerSize &&
+        std::memcmp(checked + checkedSize - kBlockCheckTrailerSize, kTrailerMagic, 4) == 0;
+}
+
+bool recheckBlocks(const uint8_t* checked, BlockCheckResult& result) {
+    size_t before = result.damaged.size();
+    std::erase_if(result.damaged, [&](size_t block) { return blockMatches(checked, result, block); });
+    return result.damaged.size() < before;
+}
+
+} // namespace qrac
@@ -0,0 +1,60 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 分块CRC32C校验
+ *
+ * 数据按固定大小（CHECK_BLOCK_SIZE）分块，每块一个CRC32C，校验表放在数据之后，
+ * 然后是整个数据的BLAKE3哈希（32字节，见qrac_hash.h），最后是28字节的尾部：
+ *   "QRBC" | 版本(u16) | 标志(u16) | 块大小(u32) | 数据长度(u64) | 校验表和哈希的CRC32C(u32) | 尾部前24字节的CRC32C(u32)
+ * 全部为小端序。标志kBlockCheckHasHash表示有哈希（之前的版本没有哈希，标志为0，仍然可以读取）。
+ * FEC校验字节跟在尾部之后，同样保护校验表、哈希和尾部。
+ *
+ * 解码时先检查尾部和各块的CRC：全部通过（绝大多数图像）时直接输出，不做FEC解码；
+ * 只有CRC不符的块交给FEC，同时得到损坏的确切位置。
+ * 有SSE4.2时用crc32指令计算，否则按8字节查表。
+ ******************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "qrac_hash.h"
+
+namespace qrac {
+
+constexpr size_t kBlockCheckTrailerSize = 28;
+constexpr uint16_t kBlockCheckHasHash = 1; // 尾部标志：校验表之后有数据的BLAKE3哈希
+
+// CRC32C（Castagnoli，多项式0x82F63B78），crc为前一段的结果，可以分段计算
+uint32_t crc32c(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+// dataSize字节数据的校验表、哈希和尾部的字节数
+size_t blockCheckSize(size_t dataSize, size_t blockSize);
+
+// 由数据加校验的总长度反推数据长度（blockCheckSize的逆运算），没有对应的长度时返回false
+bool blockCheckDataSize(size_t checkedSize, size_t blockSize, size_t* dataSize);
+
+// 写出data的校验表、哈希和尾部（out为blockCheckSize字节，通常紧跟在数据之后）
+void writeBlockChecks(const uint8_t* data, size_t dataSize, size_t blockSize, uint8_t* out);
+
+// 分块检查的结果
+struct BlockCheckResult {
+    bool readable = false;       // 尾部和校验表完好，且与总长度一致
+    size_t dataSize = 0;
+    size_t blockSize = 0;
+    size_t blocks = 0;
+    std::vector<size_t> damaged; // CRC不符的块（升序）
+    bool hasHash = false;        // 编码时记录了数据的哈希
+    PayloadHash hash{};
+};
+
+// 检查checked（数据 + 校验表 + 哈希 + 尾部，共checkedSize字节）。尾部或校验表损坏时readable为false，不检查数据块
+BlockCheckResult checkBlocks(const uint8_t* checked, size_t checkedSize);
+
+// checked的末尾是否有尾部标识（"QRBC"）：没有时是之前版本的格式（不分块校验），而不是损坏的校验表
+bool hasBlockCheckTrailer(const uint8_t* checked, size_t checkedSize);
+
+// 重新检查result.damaged中的块（FEC纠正之后），移除已经通过的块，有块通过时返回true
+bool recheckBlocks(const uint8_t* checked, BlockCheckResult& result);
+
+} // namespace qrac
@@ -0,0 +1,329 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 数据哈希（BLAKE3）实现
+ ******************************************************************/
+#include "qrac_hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define QRAC_BLAKE3_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace qrac {
+
+namespace {
+
+constexpr size_t kChunkBytes = 1024; // 叶子块
+constexpr size_t kBlockBytes = 64;   // 每次压缩的消息块
+constexpr size_t kBlocksPerChunk = kChunkBytes / kBlockBytes;
+
+constexpr uint32_t kChunkStart = 1;
+constexpr uint32_t kChunkEnd = 2;
+constexpr uint32_t kParent = 4;
+constexpr uint32_t kRoot = 8;
+
+constexpr std::array<uint32_t, 8> kIV = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+// 每轮使用的消息字顺序：上一轮的顺序按固定置换重排
+constexpr std::array<std::array<uint8_t, 16>, 7> kSchedule = [] {
+    constexpr uint8_t permutation[16] = { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 };
+    std::array<std::array<uint8_t, 16>, 7> schedule{};
+    for (uint8_t i = 0; i < 16; i++) schedule[0][i] = i;
+    for (int round = 1; round < 7; round++) {
+        for (int i = 0; i < 16; i++) schedule[round][i] = schedule[round - 1][permutation[i]];
+    }
+    return schedule;
+}();
+
+inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t load32(const uint8_t* p) {
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+inline void g(uint32_t* v, int a, int b, int c, int d, uint32_t x, uint32_t y) {
+    v[a] += v[b] + x;
+    v[d] = rotr(v[d] ^ v[a], 16);
+    v[c] += v[d];
+    v[b] = rotr(v[b] ^ v[c], 12);
+    v[a] += v[b] + y;
+    v[d] = rotr(v[d] ^ v[a], 8);
+    v[c] += v[d];
+    v[b] = rotr(v[b] ^ v[c], 7);
+}
+
+// 压缩函数，state为完整的16字输出（前8字异或后8字为新的链值）
+void compress(const std::array<uint32_t, 8>& cv, const uint32_t* m, uint64_t counter, uint32_t blockLength,
+    uint32_t flags, uint32_t* state) {
+    uint32_t* v = state;
+    std::copy(cv.begin(), cv.end(), v);
+    v[8] = kIV[0]; v[9] = kIV[1]; v[10] = kIV[2]; v[11] = kIV[3];
+    v[12] = static_cast<uint32_t>(counter);
+    v[13] = static_cast<uint32_t>(counter >> 32);
+    v[14] = blockLength;
+    v[15] = flags;
+    for (const auto& s : kSchedule) {
+        g(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+        g(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+        g(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+        g(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+        g(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+        g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        g(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+        g(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+    for (int i = 0; i < 8; i++) v[i] ^= v[i + 8];
+}
+
+std::array<uint32_t, 8> chainingValue(const HashNode& node) {
+    uint32_t state[16];
+    compress(node.chainingValue, node.block.data(), node.counter, node.blockLength, node.flags, state);
+    std::array<uint32_t, 8> cv;
+    std::copy(state, state + 8, cv.begin());
+    return cv;
+}
+
+void loadBlock(const uint8_t* data, size_t size, std::array<uint32_t, 16>& block) {
+    uint8_t bytes[kBlockBytes] = {};
+    std::memcpy(bytes, data, size);
+    for (int i = 0; i < 16; i++) block[i] = load32(bytes + 4 * i);
+}
+
+// 一个叶子块（最多1KB）：压缩前面的消息块，最后一个消息块留在节点中
+HashNode chunkNode(const uint8_t* data, size_t size, uint64_t chunk) {
+    HashNode node;
+    node.chainingValue = kIV;
+    node.counter = chunk;
+    uint32_t start = kChunkStart;
+    for (; size > kBlockBytes; data += kBlockBytes, size -= kBlockBytes) {
+        loadBlock(data, kBlockBytes, node.block);
+        node.chainingValue = chainingValue({ node.chainingValue, node.block, chunk, kBlockBytes, start });
+        start = 0;
+    }
+    loadBlock(data, size, node.block);
+    node.blockLength = static_cast<uint32_t>(size);
+    node.flags = start | kChunkEnd;
+    return node;
+}
+
+HashNode parentNode(const std::array<uint32_t, 8>& left, const std::array<uint32_t, 8>& right) {
+    HashNode node;
+    node.chainingValue = kIV;
+    std::copy(left.begin(), left.end(), node.block.begin());
+    std::copy(right.begin(), right.end(), node.block.begin() + 8);
+    node.blockLength = kBlockBytes;
+    node.flags = kParent;
+    return node;
+}
+
+#if defined(QRAC_BLAKE3_SSE2)
+inline __m128i rotrLanes(__m128i x, int n) {
+    return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n));
+}
+
+// 循环右移16位：交换每个32位通道的两个16位字
+inline __m128i rotr16Lanes(__m128i x) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xB1), 0xB1);
+}
+
+inline void g4(__m128i* v, int a, int b, int c, int d, __m128i x, __m128i y) {
+    v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), x);
+    v[d] = rotr16Lanes(_mm_xor_si128(v[d], v[a]));
+    v[c] = _mm_add_epi32(v[c], v[d]);
+    v[b] = rotrLanes(_mm_xor_si128(v[b], v[c]), 12);
+    v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), y);
+    v[d] = rotrLanes(_mm_xor_si128(v[d], v[a]), 8);
+    v[c] = _mm_add_epi32(v[c], v[d]);
+    v[b] = rotrLanes(_mm_xor_si128(v[b], v[c]), 7);
+}
+
+// 一轮（消息字顺序在编译时确定，寄存器分配不依赖运行时下标）
+template <int R>
+inline void round4(__m128i* v, const __m128i* m) {
+    constexpr const auto& s = kSchedule[R];
+    g4(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+    g4(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+    g4(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+    g4(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+    g4(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+    g4(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+    g4(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+    g4(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+}
+
+// 4个完整的叶子块（连续的4KB）同时压缩，每个32位通道一个叶子块，cvs输出4个链值
+void hashFourChunks(const uint8_t* data, uint64_t chunk, std::array<uint32_t, 8>* cvs) {
+    __m128i h[8];
+    for (int i = 0; i < 8; i++) h[i] = _mm_set1_epi32(static_cast<int>(kIV[i]));
+    __m128i counterLow = _mm_setr_epi32(static_cast<int>(chunk), static_cast<int>(chunk + 1),
+        static_cast<int>(chunk + 2), static_cast<int>(chunk + 3));
+    __m128i counterHigh = _mm_setr_epi32(static_cast<int>(chunk >> 32), static_cast<int>((chunk + 1) >> 32),
+        static_cast<int>((chunk + 2) >> 32), static_cast<int>((chunk + 3) >> 32));
+
+    for (size_t blockIndex = 0; blockIndex < kBlocksPerChunk; blockIndex++) {
+        // 转置：m[i]为4个叶子块各自的第i个消息字（x86为小端序，直接加载）
+        __m128i m[16];
+        for (int group = 0; group < 4; group++) {
+            __m128i rows[4];
+            for (int lane = 0; lane < 4; lane++) {
+                rows[lane] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                    data + lane * kChunkBytes + blockIndex * kBlockBytes + group * 16));
+            }
+            __m128i t0 = _mm_unpacklo_epi32(rows[0], rows[1]);
+            __m128i t1 = _mm_unpacklo_epi32(rows[2], rows[3]);
+            __m128i t2 = _mm_unpackhi_epi32(rows[0], rows[1]);
+            __m128i t3 = _mm_unpackhi_epi32(rows[2], rows[3]);
+            m[group * 4 + 0] = _mm_unpacklo_epi64(t0, t1);
+            m[group * 4 + 1] = _mm_unpackhi_epi64(t0, t1);
+            m[group * 4 + 2] = _mm_unpacklo_epi64(t2, t3);
+            m[group * 4 + 3] = _mm_unpackhi_epi64(t2, t3);
+        }
+
+        uint32_t flags = (blockIndex == 0 ? kChunkStart : 0) | (blockIndex + 1 == kBlocksPerChunk ? kChunkEnd : 0);
+        __m128i v[16];
+        for (int i = 0; i < 8; i++) v[i] = h[i];
+        for (int i = 0; i < 4; i++) v[8 + i] = _mm_set1_epi32(static_cast<int>(kIV[i]));
+        v[12] = counterLow;
+        v[13] = counterHigh;
+        v[14] = _mm_set1_epi32(static_cast<int>(kBlockBytes));
+        v[15] = _mm_set1_epi32(static_cast<int>(flags));
+        round4<0>(v, m);
+        round4<1>(v, m);
+        round4<2>(v, m);
+        round4<3>(v, m);
+        round4<4>(v, m);
+        round4<5>(v, m);
+        round4<6>(v, m);
+        for (int i = 0; i < 8; i++) h[i] = _mm_xor_si128(v[i], v[i + 8]);
+    }
+
+    alignas(16) uint32_t lanes[8][4];
+    for (int i = 0; i < 8; i++) _mm_store_si128(reinterpret_cast<__m128i*>(lanes[i]), h[i]);
+    for (int lane = 0; lane < 4; lane++) {
+        for (int i = 0; i < 8; i++) cvs[lane][i] = lanes[i][lane];
+    }
+}
+#endif
+
+// 不超过n的最大的2的幂（n >= 2时严格小于n）：左子树的大小
+size_t leftSubtreeSize(size_t n) {
+    size_t left = 1;
+    while (left * 2 < n) left *= 2;
+    return left;
+}
+
+// 把count个链值（或节点）按哈希树合并，count >= 2时结果为父节点
+template <typename Leaf>
+HashNode mergeNodes(const Leaf* leaves, size_t count) {
+    auto cv = [](const Leaf* first, size_t n) {
+        if (n == 1) {
+            if constexpr (std::is_same_v<Leaf, HashNode>) return chainingValue(*first);
+            else return *first;
+        }
+        return chainingValue(mergeNodes(first, n));
+    };
+    size_t left = leftSubtreeSize(count);
+    return parentNode(cv(leaves, left), cv(leaves + left, count - left));
+}
+
+// 从第chunk个叶子块开始的一棵子树（size不超过kHashPartBytes）
+HashNode subtreeNode(const uint8_t* data, size_t size, uint64_t chunk) {
+    size_t chunks = std::max<size_t>(1, (size + kChunkBytes - 1) / kChunkBytes);
+    if (chunks == 1) {
+        return chunkNode(data, size, chunk);
+    }
+
+    // 最后一个叶子块可能不完整，单独计算；前面的完整叶子块每4个一起压缩
+    std::array<uint32_t, 8> cvs[kHashPartBytes / kChunkBytes];
+    size_t full = chunks - 1;
+    size_t i = 0;
+#if defined(QRAC_BLAKE3_SSE2)
+    for (; i + 4 <= full; i += 4) {
+        hashFourChunks(data + i * kChunkBytes, chunk + i, cvs + i);
+    }
+#endif
+    for (; i < full; i++) {
+        cvs[i] = chainingValue(chunkNode(data + i * kChunkBytes, kChunkBytes, chunk + i));
+    }
+    cvs[full] = chainingValue(chunkNode(data + full * kChunkBytes, size - full * kChunkBytes, chunk + full));
+    return mergeNodes(cvs, chunks);
+}
+
+PayloadHash rootHash(const HashNode& node) {
+    uint32_t state[16];
+    compress(node.chainingValue, node.block.data(), 0, node.blockLength, node.flags | kRoot, state);
+    PayloadHash hash;
+    for (int i = 0; i < 8; i++) {
+        for (int k = 0; k < 4; k++) hash[4 * i + k] = static_cast<uint8_t>(state[i] >> (8 * k));
+    }
+    return hash;
+}
+
+} // namespace
+
+size_t hashPartCount(size_t size) {
+    return std::max<size_t>(1, (size + kHashPartBytes - 1) / kHashPartBytes);
+}
+
+HashNode hashPart(const uint8_t* data, size_t size, size_t part) {
+    size_t offset = part * kHashPartBytes;
+    return subtreeNode(data + offset, std::min(kHashPartBytes, size - offset), offset / kChunkBytes);
+}
+
+PayloadHash combineHashParts(std::span<const HashNode> parts) {
+    return rootHash(parts.size() == 1 ? parts[0] : mergeNodes(parts.data(), parts.size()));
+}
+
+PayloadHash blake3(const uint8_t* data, size_t size) {
+    std::vector<HashNode> parts(hashPartCount(size));
+    for (size_t part = 0; part < parts.size(); part++) {
+        parts[part] = hashPart(data, size, part);
+    }
+    return combineHashParts(parts);
+}
+
+void PayloadHasher::update(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        size_t take = std::min(size, kHashPartBytes - m_pending.size());
+        m_pending.insert(m_pending.end(), data, data + take);
+        data += take;
+        size -= take;
+        // 满一段就计算：完整段的节点与它是否为最后一段无关
+        if (m_pending.size() == kHashPartBytes) {
+            m_parts.push_back(subtreeNode(m_pending.data(), m_pending.size(), m_parts.size() * (kHashPartBytes / kChunkBytes)));
+            m_pending.clear();
+        }
+    }
+}
+
+PayloadHash PayloadHasher::finish() {
+    if (!m_pending.empty() || m_parts.empty()) {
+        m_parts.push_back(subtreeNode(m_pending.data(), m_pending.size(), m_parts.size() * (kHashPartBytes / kChunkBytes)));
+    }
+    PayloadHash hash = combineHashParts(m_parts);
+    m_pending.clear();
+    m_parts.clear();
+    return hash;
+}
+
+std::string hashToHex(const PayloadHash& hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string text;
+    text.reserve(hash.size() * 2);
+    for (uint8_t byte : hash) {
+        text += digits[byte >> 4];
+        text += digits[byte & 0xF];
+    }
+    return text;
+}
+
+} // namespace qrac
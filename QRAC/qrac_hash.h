@@ -0,0 +1,64 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 数据哈希（BLAKE3，256位）
+ *
+ * 编码时对原始数据计算BLAKE3，写入分块校验的尾部之前（见qrac_check.h），
+ * verify模式解码后重新计算并比较，确认图像可以逐字节还原。
+ * BLAKE3是哈希树：每1KB一个叶子块，相邻子树两两合并，因此数据可以按kHashPartBytes分段，
+ * 各段在不同线程上同时计算（hashPart），再按相同的树形合并（combineHashParts），
+ * 结果与一次计算整个数据相同。x86-64上每次用SSE2同时压缩4个叶子块。
+ ******************************************************************/
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace qrac {
+
+// 256位哈希值
+using PayloadHash = std::array<uint8_t, 32>;
+
+// 并行计算时每段的字节数（1024个BLAKE3叶子块，必须是叶子块大小的2的幂倍）
+constexpr size_t kHashPartBytes = 1024 * 1024;
+
+// 哈希树中一段数据的节点（尚未确定是否为根的压缩输入）
+struct HashNode {
+    std::array<uint32_t, 8> chainingValue{};
+    std::array<uint32_t, 16> block{};
+    uint64_t counter = 0;
+    uint32_t blockLength = 0;
+    uint32_t flags = 0;
+};
+
+// 整个数据的BLAKE3哈希
+PayloadHash blake3(const uint8_t* data, size_t size);
+
+// size字节数据分成的段数（空数据为1段）
+size_t hashPartCount(size_t size);
+
+// 第part段（data为整个数据）的节点，各段互不依赖
+HashNode hashPart(const uint8_t* data, size_t size, size_t part);
+
+// 按哈希树合并各段的节点，得到整个数据的哈希
+PayloadHash combineHashParts(std::span<const HashNode> parts);
+
+// 分段输入的哈希（流式读取、不整体读入内存时使用），结果与blake3()相同
+// 每满kHashPartBytes计算一段，只保留不足一段的数据和各段的节点
+class PayloadHasher {
+public:
+    void update(const uint8_t* data, size_t size);
+    PayloadHash finish();
+
+private:
+    std::vector<uint8_t> m_pending;
+    std::vector<HashNode> m_parts;
+};
+
+// 十六进制文本（小写）
+std::string hashToHex(const PayloadHash& hash);
+
+} // namespace qrac
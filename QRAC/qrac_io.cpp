@@ -0,0 +1,626 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 文件I/O后端实现
+ *
+ * io_uring后端直接使用系统调用（不依赖liburing）：
+ *   - 一个提交/完成队列由互斥锁保护，专门的完成线程收割CQE；
+ *   - 预读把整个文件读入作业稍后取走的缓冲区，短读自动续读；
+ *   - 写出按固定槽（已注册缓冲区）分块提交，槽用完时写入方等待，
+ *     因此未落盘的输出数据总量有上限。
+ ******************************************************************/
+#include "qrac_io.h"
+
+#include <filesystem>
+#include <fstream>
+
+#include "qrac.h"
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#endif
+
+namespace qrac {
+
+namespace {
+
+std::filesystem::path pathFromUtf8(const std::string& path) {
+    return std::filesystem::path(std::u8string(path.begin(), path.end()));
+}
+
+ByteBuffer readFileBlocking(const std::string& path) {
+    std::ifstream file(pathFromUtf8(path), std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        throw QRACException(ErrorType::FileReadError, "Cannot open input file: " + path);
+    }
+    std::streamoff size = file.tellg();
+    ByteBuffer data(size > 0 ? static_cast<size_t>(size) : 0);
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()))) {
+        throw QRACException(ErrorType::FileReadError, "Failed to read input file: " + path);
+    }
+    return data;
+}
+
+// 可移植的同步实现
+class BlockingIoBackend : public IoBackend {
+public:
+    const char* name() const override { return "blocking"; }
+
+    ByteBuffer readFile(const std::string& path) override {
+        return readFileBlocking(path);
+    }
+
+    void writeFile(const std::string& path, const uint8_t* data, size_t size) override {
+        std::ofstream file(pathFromUtf8(path), std::ios::binary);
+        if (!file.is_open()) {
+            throw QRACException(ErrorType::FileWriteError, "Cannot create output file: " + path);
+        }
+        file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+        file.close();
+        if (!file) {
+            throw QRACException(ErrorType::FileWriteError, "Failed to write output file: " + path);
+        }
+    }
+};
+
+#ifdef __linux__
+
+constexpr unsigned kUringEntries = 64;
+constexpr unsigned kWriteSlots = 8;                  // 已注册的写缓冲区个数
+constexpr size_t kWriteSlotBytes = 512 * 1024;       // 每个写缓冲区的大小
+constexpr unsigned kMaxPrefetchReads = kUringEntries - kWriteSlots - 1; // 留一个位置给退出通知
+constexpr size_t kMaxReadPerOp = 1u << 30;
+
+int uringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int uringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+std::string errnoText(int error) {
+    return std::strerror(error);
+}
+
+enum class UringOpKind { Read, Write, Wake };
+
+struct UringOp {
+    UringOpKind kind;
+};
+
+// 预读的文件
+struct UringRead : UringOp {
+    int fd = -1;
+    ByteBuffer data;
+    std::vector<std::function<void()>> waiters; // 读取完成后调用
+    size_t budget = 0; // 占用的预读预算
+    size_t done = 0;
+    int error = 0;
+    bool finished = false;
+};
+
+// 正在写出的文件（所有分块完成后关闭）
+struct UringWrite {
+    std::string path;
+    int fd = -1;
+    size_t pendingChunks = 0;
+    int error = 0;
+};
+
+// 一个写分块，占用一个固定缓冲区
+struct UringChunk : UringOp {
+    UringWrite* file = nullptr;
+    unsigned slot = 0;
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    uint32_t done = 0;
+};
+
+class UringIoBackend : public IoBackend {
+public:
+    UringIoBackend() {
+        io_uring_params params{};
+        m_ringFd = uringSetup(kUringEntries, &params);
+        if (m_ringFd < 0) {
+            throw QRACException(ErrorType::InvalidInput, "io_uring is not available: " + errnoText(errno));
+        }
+
+        try {
+            checkOpcodes();
+            mapRings(params);
+            registerSlots();
+        }
+        catch (...) {
+            unmap();
+            close(m_ringFd);
+            throw;
+        }
+
+        m_reaper = std::thread([this] { reap(); });
+    }
+
+    ~UringIoBackend() override {
+        flush();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for (auto& entry : m_prefetched) {
+                m_cv.wait(lock, [&] { return entry.second->finished; });
+                delete entry.second;
+            }
+            m_prefetched.clear();
+            submit(&m_wake, [](io_uring_sqe& sqe) { sqe.opcode = IORING_OP_NOP; });
+        }
+        m_reaper.join();
+        unmap();
+        close(m_ringFd);
+    }
+
+    const char* name() const override { return "io_uring"; }
+
+    void prefetch(const std::string& path, std::function<void()> ready) override {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            ready(); // 由readFile报告错误
+            return;
+        }
+        struct stat st {};
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            close(fd);
+            ready();
+            return;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto existing = m_prefetched.find(path);
+        if (existing != m_prefetched.end() && !existing->second->finished) {
+            close(fd);
+            existing->second->waiters.push_back(std::move(ready));
+            return;
+        }
+        if (existing != m_prefetched.end() || m_prefetchBytes + size > kIoPrefetchBudget || m_inflightReads >= kMaxPrefetchReads) {
+            lock.unlock();
+            close(fd);
+            ready();
+            return;
+        }
+
+        UringRead* read = new UringRead();
+        read->kind = UringOpKind::Read;
+        read->fd = fd;
+        read->data.resize(size);
+        read->budget = size;
+        m_prefetched.emplace(path, read);
+        m_prefetchBytes += size;
+        if (size == 0) {
+            read->finished = true;
+            lock.unlock();
+            close(fd);
+            ready();
+            return;
+        }
+        read->waiters.push_back(std::move(ready));
+        m_inflightReads++;
+        submitRead(read);
+    }
+
+    void discard(const std::string& path) override {
+        UringRead* read = take(path);
+        delete read;
+    }
+
+    ByteBuffer readFile(const std::string& path) override {
+        UringRead* read = take(path);
+        if (!read) {
+            // 没有预读：立即需要的数据，同步读取即可
+            return readFileBlocking(path);
+        }
+        int error = read->error;
+        ByteBuffer data = std::move(read->data);
+        delete read;
+        if (error != 0) {
+            throw QRACException(ErrorType::FileReadError, "Failed to read input file: " + path + " (" + errnoText(error) + ")");
+        }
+        return data;
+    }
+
+    void writeFile(const std::string& path, const uint8_t* data, size_t size) override {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw QRACException(ErrorType::FileWriteError, "Cannot create output file: " + path + " (" + errnoText(errno) + ")");
+        }
+        // 预先分配空间：减少分块写入时的扩展和碎片，空间不足时立即失败
+        // （文件系统或设备不支持fallocate时忽略）
+        if (size > 0 && fallocate(fd, 0, 0, static_cast<off_t>(size)) != 0 && (errno == ENOSPC || errno == EDQUOT || errno == EFBIG)) {
+            int error = errno;
+            close(fd);
+            throw QRACException(ErrorType::FileWriteError, "Cannot allocate output file: " + path + " (" + errnoText(error) + ")");
+        }
+        if (size == 0) {
+            close(fd);
+            return;
+        }
+
+        UringWrite* file = new UringWrite();
+        file->path = path;
+        file->fd = fd;
+        file->pendingChunks = (size + kWriteSlotBytes - 1) / kWriteSlotBytes;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_pendingWrites++;
+        for (size_t offset = 0; offset < size; offset += kWriteSlotBytes) {
+            m_cv.wait(lock, [&] { return !m_freeSlots.empty(); });
+            unsigned slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+
+            uint32_t length = static_cast<uint32_t>(std::min(kWriteSlotBytes, size - offset));
+            lock.unlock();
+            std::memcpy(slotData(slot), data + offset, length);
+            lock.lock();
+
+            UringChunk* chunk = new UringChunk();
+            chunk->kind = UringOpKind::Write;
+            chunk->file = file;
+            chunk->slot = slot;
+            chunk->offset = offset;
+            chunk->length = length;
+            submitWrite(chunk);
+        }
+    }
+
+    std::vector<IoError> flush() override {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_pendingWrites == 0; });
+        std::vector<IoError> errors;
+        errors.swap(m_errors);
+        return errors;
+    }
+
+private:
+    void checkOpcodes() {
+        std::vector<uint8_t> buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (uringRegister(m_ringFd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+            throw QRACException(ErrorType::InvalidInput, "io_uring probe failed: " + errnoText(errno));
+        }
+        for (unsigned op : { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_WRITE_FIXED, IORING_OP_NOP }) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                throw QRACException(ErrorType::InvalidInput, "io_uring kernel support is too old");
+            }
+        }
+    }
+
+    void mapRings(const io_uring_params& params) {
+        m_sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            m_sqRingBytes = m_cqRingBytes = std::max(m_sqRingBytes, m_cqRingBytes);
+        }
+
+        m_sqRing = mmap(nullptr, m_sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED) {
+            m_sqRing = nullptr;
+            throw QRACException(ErrorType::InvalidInput, "io_uring mmap failed: " + errnoText(errno));
+        }
+        if (singleMap) {
+            m_cqRing = m_sqRing;
+        }
+        else {
+            m_cqRing = mmap(nullptr, m_cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+            if (m_cqRing == MAP_FAILED) {
+                m_cqRing = nullptr;
+                throw QRACException(ErrorType::InvalidInput, "io_uring mmap failed: " + errnoText(errno));
+            }
+        }
+        m_sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            throw QRACException(ErrorType::InvalidInput, "io_uring mmap failed: " + errnoText(errno));
+        }
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+        uint8_t* sq = static_cast<uint8_t*>(m_sqRing);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        uint8_t* cq = static_cast<uint8_t*>(m_cqRing);
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    // 分配并注册写缓冲区；注册失败（如RLIMIT_MEMLOCK过小）时使用普通写请求
+    void registerSlots() {
+        void* memory = mmap(nullptr, kWriteSlots * kWriteSlotBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw QRACException(ErrorType::InvalidInput, "Cannot allocate I/O buffers: " + errnoText(errno));
+        }
+        m_slotMemory = static_cast<uint8_t*>(memory);
+
+        iovec vectors[kWriteSlots];
+        for (unsigned i = 0; i < kWriteSlots; i++) {
+            vectors[i].iov_base = slotData(i);
+            vectors[i].iov_len = kWriteSlotBytes;
+            m_freeSlots.push_back(i);
+        }
+        m_fixedBuffers = uringRegister(m_ringFd, IORING_REGISTER_BUFFERS, vectors, kWriteSlots) == 0;
+    }
+
+    void unmap() {
+        if (m_slotMemory) munmap(m_slotMemory, kWriteSlots * kWriteSlotBytes);
+        if (m_sqes) munmap(m_sqes, m_sqeBytes);
+        if (m_cqRing && m_cqRing != m_sqRing) munmap(m_cqRing, m_cqRingBytes);
+        if (m_sqRing) munmap(m_sqRing, m_sqRingBytes);
+        m_slotMemory = nullptr;
+        m_sqes = nullptr;
+        m_sqRing = m_cqRing = nullptr;
+    }
+
+    uint8_t* slotData(unsigned slot) {
+        return m_slotMemory + static_cast<size_t>(slot) * kWriteSlotBytes;
+    }
+
+    // 取出预读项（等待读取完成），没有预读时返回nullptr
+    UringRead* take(const std::string& path) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_prefetched.find(path);
+        if (it == m_prefetched.end()) {
+            return nullptr;
+        }
+        UringRead* read = it->second;
+        m_cv.wait(lock, [&] { return read->finished; });
+        m_prefetched.erase(path);
+        m_prefetchBytes -= read->budget;
+        return read;
+    }
+
+    // 以下函数必须持有m_mutex
+    template <typename Fill>
+    void submit(UringOp* op, Fill fill) {
+        unsigned tail = std::atomic_ref<unsigned>(*m_sqTail).load(std::memory_order_relaxed);
+        unsigned index = tail & m_sqMask;
+        io_uring_sqe& sqe = m_sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        fill(sqe);
+        sqe.user_data = reinterpret_cast<uint64_t>(op);
+        m_sqArray[index] = index;
+        std::atomic_ref<unsigned>(*m_sqTail).store(tail + 1, std::memory_order_release);
+        m_unsubmitted++;
+
+        int submitted;
+        while ((submitted = uringEnter(m_ringFd, m_unsubmitted, 0, 0)) < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+            std::this_thread::yield();
+        }
+        if (submitted > 0) {
+            m_unsubmitted -= std::min<unsigned>(m_unsubmitted, static_cast<unsigned>(submitted));
+        }
+    }
+
+    void submitRead(UringRead* read) {
+        size_t length = std::min(read->data.size() - read->done, kMaxReadPerOp);
+        submit(read, [&](io_uring_sqe& sqe) {
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = read->fd;
+            sqe.addr = reinterpret_cast<uint64_t>(read->data.data() + read->done);
+            sqe.len = static_cast<uint32_t>(length);
+            sqe.off = read->done;
+        });
+    }
+
+    void submitWrite(UringChunk* chunk) {
+        submit(chunk, [&](io_uring_sqe& sqe) {
+            sqe.opcode = m_fixedBuffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            sqe.fd = chunk->file->fd;
+            sqe.addr = reinterpret_cast<uint64_t>(slotData(chunk->slot) + chunk->done);
+            sqe.len = chunk->length - chunk->done;
+            sqe.off = chunk->offset + chunk->done;
+            if (m_fixedBuffers) {
+                sqe.buf_index = static_cast<uint16_t>(chunk->slot);
+            }
+        });
+    }
+
+    void completeRead(UringRead* read, int result) {
+        if (result == -EINTR || result == -EAGAIN) {
+            submitRead(read);
+            return;
+        }
+        if (result < 0) {
+            read->error = -result;
+        }
+        else if (result == 0) {
+            read->data.resize(read->done); // 文件在预读期间变短
+        }
+        else {
+            read->done += static_cast<size_t>(result);
+            if (read->done < read->data.size()) {
+                submitRead(read); // 短读
+                return;
+            }
+        }
+        close(read->fd);
+        read->finished = true;
+        m_inflightReads--;
+        for (auto& waiter : read->waiters) {
+            m_readyCallbacks.push_back(std::move(waiter));
+        }
+        read->waiters.clear();
+        m_cv.notify_all();
+    }
+
+    void completeWrite(UringChunk* chunk, int result) {
+        UringWrite* file = chunk->file;
+        if (result == -EINTR || result == -EAGAIN) {
+            submitWrite(chunk);
+            return;
+        }
+        if (result <= 0) {
+            if (file->error == 0) file->error = result < 0 ? -result : EIO;
+        }
+        else {
+            chunk->done += static_cast<uint32_t>(result);
+            if (chunk->done < chunk->length) {
+                submitWrite(chunk); // 短写
+                return;
+            }
+        }
+
+        m_freeSlots.push_back(chunk->slot);
+        delete chunk;
+        if (--file->pendingChunks == 0) {
+            if (close(file->fd) != 0 && file->error == 0) {
+                file->error = errno;
+            }
+            if (file->error != 0) {
+                m_errors.push_back({ file->path, "Failed to write output file: " + file->path + " (" + errnoText(file->error) + ")" });
+            }
+            delete file;
+            m_pendingWrites--;
+        }
+        m_cv.notify_all();
+    }
+
+    // 完成线程：等待并处理CQE，收到退出通知后结束
+    void reap() {
+        bool running = true;
+        std::vector<std::function<void()>> ready;
+        while (running) {
+            if (uringEnter(m_ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                std::this_thread::yield();
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            unsigned head = *m_cqHead;
+            unsigned tail = std::atomic_ref<unsigned>(*m_cqTail).load(std::memory_order_acquire);
+            for (; head != tail; head++) {
+                const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+                UringOp* op = reinterpret_cast<UringOp*>(cqe.user_data);
+                int result = cqe.res;
+                switch (op->kind) {
+                case UringOpKind::Read:
+                    completeRead(static_cast<UringRead*>(op), result);
+                    break;
+                case UringOpKind::Write:
+                    completeWrite(static_cast<UringChunk*>(op), result);
+                    break;
+                case UringOpKind::Wake:
+                    running = false;
+                    break;
+                }
+            }
+            std::atomic_ref<unsigned>(*m_cqHead).store(head, std::memory_order_release);
+
+            // 完成回调在锁外调用（通常是把等待的协程提交到线程池）
+            ready.swap(m_readyCallbacks);
+            lock.unlock();
+            for (auto& callback : ready) {
+                callback();
+            }
+            ready.clear();
+        }
+    }
+
+    int m_ringFd = -1;
+    void* m_sqRing = nullptr;
+    void* m_cqRing = nullptr;
+    size_t m_sqRingBytes = 0;
+    size_t m_cqRingBytes = 0;
+    size_t m_sqeBytes = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned* m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+    unsigned m_cqMask = 0;
+    unsigned m_unsubmitted = 0;
+
+    uint8_t* m_slotMemory = nullptr;
+    bool m_fixedBuffers = false;
+    std::vector<unsigned> m_freeSlots;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::unordered_map<std::string, UringRead*> m_prefetched;
+    size_t m_prefetchBytes = 0;
+    unsigned m_inflightReads = 0;
+    size_t m_pendingWrites = 0;
+    std::vector<IoError> m_errors;
+    std::vector<std::function<void()>> m_readyCallbacks;
+    UringOp m_wake{ UringOpKind::Wake };
+    std::thread m_reaper;
+};
+
+#endif
+
+} // namespace
+
+std::unique_ptr<IoBackend> createIoBackend(IoBackendKind kind) {
+#ifdef __linux__
+    if (kind == IoBackendKind::Uring) {
+        return std::make_unique<UringIoBackend>();
+    }
+    if (kind == IoBackendKind::Auto) {
+        try {
+            return std::make_unique<UringIoBackend>();
+        }
+        catch (const QRACException&) {
+            // 内核不支持或被安全策略禁止，使用同步实现
+        }
+    }
+#else
+    if (kind == IoBackendKind::Uring) {
+        throw QRACException(ErrorType::InvalidInput, "io_uring is only available on Linux");
+    }
+#endif
+    return std::make_unique<BlockingIoBackend>();
+}
+
+IoBackend& blockingIoBackend() {
+    static BlockingIoBackend backend;
+    return backend;
+}
+
+bool parseIoBackendKind(const std::string& name, IoBackendKind& kind) {
+    if (name == "auto") {
+        kind = IoBackendKind::Auto;
+    }
+    else if (name == "uring" || name == "io_uring") {
+        kind = IoBackendKind::Uring;
+    }
+    else if (name == "blocking") {
+        kind = IoBackendKind::Blocking;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace qrac
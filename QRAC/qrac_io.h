@@ -0,0 +1,75 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 文件I/O后端（批处理模式的读写）
+ *
+ * 批处理作业通过IoBackend读取输入、写出结果，而不是直接使用fstream：
+ *   - Blocking：可移植的同步实现（所有平台，交互模式也使用它）
+ *   - Uring：Linux io_uring实现。预读后续的输入文件；输出先复制到
+ *            已注册的固定缓冲区，再异步提交写请求（WRITE_FIXED），
+ *            作业线程不等待磁盘，可以立即开始下一个文件；
+ *            输出文件用fallocate预先分配空间。
+ * 异步写的错误在flush()时统一返回。
+ * prefetch的完成回调用于协程等待输入就绪（见qrac_task.h的awaitCallback）。
+ ******************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "qrac_arena.h"
+
+namespace qrac {
+
+enum class IoBackendKind {
+    Auto,     // Linux上优先io_uring，不可用时使用同步实现
+    Uring,
+    Blocking
+};
+
+// 每个后端最多预读的字节数
+constexpr size_t kIoPrefetchBudget = 64ull * 1024 * 1024;
+
+// 异步写失败的文件
+struct IoError {
+    std::string path;
+    std::string message;
+};
+
+class IoBackend {
+public:
+    virtual ~IoBackend() = default;
+
+    virtual const char* name() const = 0;
+
+    // 提前提交读请求，数据就绪后调用ready（可能在完成线程中、也可能在本函数内调用）。
+    // 超出预读预算或同步实现时直接调用ready，之后的readFile同步读取
+    virtual void prefetch(const std::string& /*path*/, std::function<void()> ready) { ready(); }
+
+    // 放弃未被读取的预读数据
+    virtual void discard(const std::string& /*path*/) {}
+
+    // 读取整个文件（已预读时等待预读完成），失败时抛出QRACException
+    virtual ByteBuffer readFile(const std::string& path) = 0;
+
+    // 写出整个文件。数据在返回前已被复制或写出，调用者可以立即释放；
+    // 异步实现中写入错误在flush()时返回，打开文件失败仍立即抛出异常
+    virtual void writeFile(const std::string& path, const uint8_t* data, size_t size) = 0;
+
+    // 等待所有写请求完成，返回失败的文件
+    virtual std::vector<IoError> flush() { return {}; }
+};
+
+// 创建I/O后端；Uring在当前系统不可用时抛出QRACException，Auto回退到Blocking
+std::unique_ptr<IoBackend> createIoBackend(IoBackendKind kind);
+
+// 进程共享的同步后端（交互模式、流式命令）
+IoBackend& blockingIoBackend();
+
+// 解析后端名称：auto、uring、blocking
+bool parseIoBackendKind(const std::string& name, IoBackendKind& kind);
+
+} // namespace qrac
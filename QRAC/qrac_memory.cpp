@@ -0,0 +1,102 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 内存预算：峰值内存估算
+ *
+ * 估算按各阶段同时存在的缓冲区相加，偏保守（实测峰值RSS略低于估算）：
+ *   编码：输入 + 含FEC的数据 + 像素 + PNG滤波缓冲/压缩输出/结果副本（各约等于像素大小）
+ *   解码：图像文件 + 解码像素（stb_image解压缓冲+反滤波输出+像素） + 提取数据 + 校验后数据
+ *   流式：同时存在的帧数 x 每帧一份像素大小的数据，加上最忙阶段的工作缓冲区
+ ******************************************************************/
+#include "qrac_memory.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include "qrac_stream.h"
+
+namespace qrac {
+
+namespace {
+
+// 编码chunkBytes字节数据得到的像素字节数（每个通道值存放一个符号）
+size_t pixelBytesFor(const CodecContext& ctx, size_t dataBytes) {
+    return static_cast<size_t>(protectedSize(ctx, dataBytes) * 8.0 / ctx.bitsPerSymbol());
+}
+
+// 流式处理中同时存在的帧：每帧约1.25倍像素大小，最忙的阶段另需4倍像素大小的工作缓冲区
+size_t streamMemory(size_t frames, size_t framePixelBytes) {
+    size_t inFlight = std::min(std::max<size_t>(frames, 1), kStreamFramesInFlight);
+    return inFlight * (framePixelBytes + framePixelBytes / 4) + 4 * framePixelBytes;
+}
+
+} // namespace
+
+size_t estimateEncodeMemory(const CodecContext& ctx, size_t inputBytes, SizeMode mode) {
+    int width = 0, height = 0;
+    encodedImageDimensions(ctx, inputBytes, mode, &width, &height);
+    size_t pixelBytes = static_cast<size_t>(width) * height * 3;
+    return inputBytes + protectedSize(ctx, inputBytes) + 4 * pixelBytes;
+}
+
+size_t estimateStreamEncodeMemory(const CodecContext& ctx, size_t inputBytes, size_t chunkBytes) {
+    size_t frames = (inputBytes + chunkBytes - 1) / chunkBytes;
+    return streamMemory(frames, pixelBytesFor(ctx, chunkBytes));
+}
+
+size_t estimateDecodeMemory(const CodecContext& ctx, size_t fileBytes, int width, int height, int channels) {
+    size_t pixels = static_cast<size_t>(width) * height;
+    size_t dataBytes = pixels * ctx.symbolsPerPixel() * ctx.bitsPerSymbol() / 8;
+    return fileBytes + 3 * pixels * channels + 2 * dataBytes;
+}
+
+size_t estimateStreamDecodeMemory(size_t fileBytes, int frameWidth, int frameHeight) {
+    size_t framePixelBytes = std::max<size_t>(static_cast<size_t>(frameWidth) * frameHeight * 3, 1);
+    // 随机数据的PNG帧约与像素一样大，可压缩的数据帧更多，但同时存在的帧数有上限
+    return streamMemory(fileBytes / framePixelBytes + 1, framePixelBytes);
+}
+
+size_t estimateCorrectMemory(size_t fileBytes, int width, int height, int channels) {
+    size_t pixels = static_cast<size_t>(width) * height;
+    // 加载（原地校正）+ 输出文件（不超过原始像素大小加少量文件头）
+    return fileBytes + 3 * pixels * channels + pixels * std::max(channels, 3) + 1024;
+}
+
+size_t streamChunkForBudget(const CodecContext& ctx, size_t budget) {
+    size_t fullChunk = estimateStreamEncodeMemory(ctx, kStreamFramesInFlight * kStreamChunkBytes, kStreamChunkBytes);
+    size_t chunk = static_cast<size_t>(static_cast<double>(budget) / fullChunk * kStreamChunkBytes);
+    chunk -= chunk % (64 * 1024);
+    return std::clamp(chunk, kStreamMinChunkBytes, kStreamChunkBytes);
+}
+
+bool parseByteSize(const std::string& text, size_t& bytes) {
+    const char* begin = text.c_str();
+    char* end = nullptr;
+    double value = std::strtod(begin, &end);
+    if (end == begin || !(value > 0.0)) {
+        return false;
+    }
+
+    std::string suffix(end);
+    if (!suffix.empty() && std::toupper(static_cast<unsigned char>(suffix.back())) == 'B') {
+        suffix.pop_back();
+    }
+    double scale = 1.0;
+    if (suffix.size() == 1) {
+        switch (std::toupper(static_cast<unsigned char>(suffix[0]))) {
+        case 'K': scale = 1024.0; break;
+        case 'M': scale = 1024.0 * 1024; break;
+        case 'G': scale = 1024.0 * 1024 * 1024; break;
+        case 'T': scale = 1024.0 * 1024 * 1024 * 1024; break;
+        default: return false;
+        }
+    }
+    else if (!suffix.empty()) {
+        return false;
+    }
+
+    bytes = static_cast<size_t>(value * scale);
+    return bytes > 0;
+}
+
+} // namespace qrac
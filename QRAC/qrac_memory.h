@@ -0,0 +1,135 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 内存预算（批处理模式的准入控制）
+ *
+ * 每个作业开始前按输入大小、图像尺寸和配置估算峰值内存，
+ * MemoryGovernor只在已准入作业的估算总和不超过预算时放行新作业，
+ * 否则挂起作业协程（不占用线程）直到有作业结束。
+ * 估算超出预算的编码作业改为按更小的块流式编码；
+ * 无法流式处理的作业（BMP输出、单帧图像的解码/校正）单独运行。
+ ******************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "qrac.h"
+#include "qrac_task.h"
+
+namespace qrac {
+
+// 流式编码的最小块（更小的块只会增加帧数和开销）
+constexpr size_t kStreamMinChunkBytes = 256 * 1024;
+
+// ---------- 峰值内存估算（字节） ----------
+
+// 整体编码inputBytes字节的输入
+size_t estimateEncodeMemory(const CodecContext& ctx, size_t inputBytes, SizeMode mode);
+
+// 按chunkBytes字节的块流式编码
+size_t estimateStreamEncodeMemory(const CodecContext& ctx, size_t inputBytes, size_t chunkBytes);
+
+// 解码单帧图像（fileBytes为图像文件大小，尺寸来自文件头）
+size_t estimateDecodeMemory(const CodecContext& ctx, size_t fileBytes, int width, int height, int channels);
+
+// 流式解码多帧PNG（尺寸为第一帧的尺寸）
+size_t estimateStreamDecodeMemory(size_t fileBytes, int frameWidth, int frameHeight);
+
+// 原地校正图像并按输入格式输出（PNG或BMP）
+size_t estimateCorrectMemory(size_t fileBytes, int width, int height, int channels);
+
+// 流式编码占用不超过budget的最大块大小（在kStreamMinChunkBytes和kStreamChunkBytes之间）
+size_t streamChunkForBudget(const CodecContext& ctx, size_t budget);
+
+// 解析字节数：纯数字或带K/M/G/T后缀（可带B，1024进制），如512M、1.5G
+bool parseByteSize(const std::string& text, size_t& bytes);
+
+// ---------- 准入控制 ----------
+
+// 按字节计数的异步信号量：先到先得，不足时挂起协程，由release()在执行器上恢复。
+// 超过总预算的申请按整个预算计算，即等到所有作业结束后单独运行
+template <typename Executor>
+class MemoryGovernor {
+public:
+    MemoryGovernor(Executor& executor, size_t budget) : m_executor(executor), m_budget(budget) {}
+
+    size_t budget() const { return m_budget; }
+
+    // co_await admit(bytes)返回实际占用的字节数，作业结束后传给release()
+    auto admit(size_t bytes) {
+        struct Awaiter {
+            MemoryGovernor& governor;
+            Waiter waiter;
+            bool await_ready() {
+                std::lock_guard<std::mutex> lock(governor.m_mutex);
+                return governor.tryGrant(waiter.bytes);
+            }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                std::lock_guard<std::mutex> lock(governor.m_mutex);
+                if (governor.tryGrant(waiter.bytes)) {
+                    return false; // 期间有作业结束，不挂起
+                }
+                waiter.handle = handle;
+                governor.m_waiters.push_back(&waiter);
+                return true;
+            }
+            size_t await_resume() const noexcept { return waiter.bytes; }
+        };
+        return Awaiter{ *this, Waiter{ std::min(bytes, m_budget), {} } };
+    }
+
+    void release(size_t bytes) {
+        std::deque<std::coroutine_handle<>> ready;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_used -= bytes;
+            // 按到达顺序放行，队首放不下时后面的也等待（避免大作业饿死）
+            while (!m_waiters.empty() && m_used + m_waiters.front()->bytes <= m_budget) {
+                grant(m_waiters.front()->bytes);
+                ready.push_back(m_waiters.front()->handle);
+                m_waiters.pop_front();
+            }
+        }
+        for (std::coroutine_handle<> handle : ready) {
+            post(m_executor, handle);
+        }
+    }
+
+    // 同时准入的估算内存的最大值
+    size_t peak() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_peak;
+    }
+
+private:
+    struct Waiter {
+        size_t bytes;
+        std::coroutine_handle<> handle;
+    };
+
+    bool tryGrant(size_t bytes) {
+        if (!m_waiters.empty() || m_used + bytes > m_budget) {
+            return false;
+        }
+        grant(bytes);
+        return true;
+    }
+
+    void grant(size_t bytes) {
+        m_used += bytes;
+        m_peak = std::max(m_peak, m_used);
+    }
+
+    Executor& m_executor;
+    const size_t m_budget;
+    mutable std::mutex m_mutex;
+    size_t m_used = 0;
+    size_t m_peak = 0;
+    std::deque<Waiter*> m_waiters;
+};
+
+} // namespace qrac
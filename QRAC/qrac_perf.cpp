@@ -0,0 +1,225 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 硬件性能计数器实现
+ *
+ * 每个线程一个计数器组（第一个打开成功的事件作为组长），PERF_FORMAT_GROUP一次读出全部，
+ * 单个事件不支持时跳过，其余照常计数。
+ ******************************************************************/
+#include "qrac_perf.h"
+
+#include <atomic>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "qrac.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <fstream>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace qrac {
+
+double PerfCounters::ipc() const {
+    return has(kCycles) && has(kInstructions) && cycles > 0 ? static_cast<double>(instructions) / cycles : 0.0;
+}
+
+PerfCounters& PerfCounters::operator+=(const PerfCounters& other) {
+    cycles += other.cycles;
+    instructions += other.instructions;
+    cacheMisses += other.cacheMisses;
+    branchMisses += other.branchMisses;
+    available |= other.available;
+    return *this;
+}
+
+PerfCounters operator-(const PerfCounters& end, const PerfCounters& begin) {
+    PerfCounters delta;
+    delta.available = end.available & begin.available;
+    auto diff = [](uint64_t a, uint64_t b) { return a > b ? a - b : 0; }; // 换算后的读数可能略有回退
+    delta.cycles = diff(end.cycles, begin.cycles);
+    delta.instructions = diff(end.instructions, begin.instructions);
+    delta.cacheMisses = diff(end.cacheMisses, begin.cacheMisses);
+    delta.branchMisses = diff(end.branchMisses, begin.branchMisses);
+    return delta;
+}
+
+namespace {
+
+std::atomic<bool> g_enabled{ false };
+
+// 库阶段回调记录的读数（每个线程）
+thread_local std::vector<std::pair<const char*, PerfCounters>> t_boundaries;
+
+#ifdef __linux__
+
+struct EventSpec {
+    uint64_t config;
+    unsigned counter;
+};
+
+constexpr EventSpec kEvents[] = {
+    { PERF_COUNT_HW_CPU_CYCLES, PerfCounters::kCycles },
+    { PERF_COUNT_HW_INSTRUCTIONS, PerfCounters::kInstructions },
+    { PERF_COUNT_HW_CACHE_MISSES, PerfCounters::kCacheMisses }, // 通常为末级缓存
+    { PERF_COUNT_HW_BRANCH_MISSES, PerfCounters::kBranchMisses },
+};
+
+int openEvent(const EventSpec& spec, int groupFd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = spec.config;
+    attr.disabled = groupFd == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC));
+}
+
+std::string openFailure(int error) {
+    switch (error) {
+    case EACCES:
+    case EPERM: {
+        std::string paranoid;
+        std::ifstream file("/proc/sys/kernel/perf_event_paranoid");
+        std::getline(file, paranoid);
+        return "not permitted (kernel.perf_event_paranoid=" + (paranoid.empty() ? "?" : paranoid) +
+            "; needs CAP_PERFMON or a setting of 2 or lower)";
+    }
+    case ENOENT:
+    case EOPNOTSUPP:
+        return "hardware events are not supported on this CPU or virtual machine";
+    case ENOSYS:
+        return "perf_event_open is not available in this kernel";
+    default:
+        return std::string("perf_event_open failed: ") + std::strerror(error);
+    }
+}
+
+void stageBoundary(const char* stage);
+
+class ThreadCounters {
+public:
+    ~ThreadCounters() {
+        for (int fd : m_fds) {
+            close(fd);
+        }
+    }
+
+    // 打开本线程的计数器组（只尝试一次）
+    bool open(std::string* reason) {
+        if (m_tried) {
+            return !m_fds.empty();
+        }
+        m_tried = true;
+        int firstError = 0;
+        for (const EventSpec& spec : kEvents) {
+            int fd = openEvent(spec, m_fds.empty() ? -1 : m_fds[0]);
+            if (fd < 0) {
+                if (firstError == 0) firstError = errno;
+                continue;
+            }
+            m_fds.push_back(fd);
+            m_counters.push_back(spec.counter);
+        }
+        if (m_fds.empty()) {
+            if (reason) *reason = openFailure(firstError);
+            return false;
+        }
+        ioctl(m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        setStageHook(stageBoundary);
+        return true;
+    }
+
+    PerfCounters read() {
+        PerfCounters counters;
+        if (m_fds.empty()) {
+            return counters;
+        }
+        // nr, time_enabled, time_running, 各事件的值
+        uint64_t values[3 + std::size(kEvents)] = {};
+        ssize_t got = ::read(m_fds[0], values, sizeof(values));
+        if (got < static_cast<ssize_t>(3 * sizeof(uint64_t)) || values[0] != m_fds.size() || values[2] == 0) {
+            return counters;
+        }
+        double scale = static_cast<double>(values[1]) / values[2];
+        for (size_t i = 0; i < m_fds.size(); i++) {
+            uint64_t value = static_cast<uint64_t>(values[3 + i] * scale);
+            switch (m_counters[i]) {
+            case PerfCounters::kCycles: counters.cycles = value; break;
+            case PerfCounters::kInstructions: counters.instructions = value; break;
+            case PerfCounters::kCacheMisses: counters.cacheMisses = value; break;
+            case PerfCounters::kBranchMisses: counters.branchMisses = value; break;
+            }
+            counters.available |= m_counters[i];
+        }
+        return counters;
+    }
+
+private:
+    bool m_tried = false;
+    std::vector<int> m_fds;          // m_fds[0]为组长
+    std::vector<unsigned> m_counters;
+};
+
+thread_local ThreadCounters t_counters;
+
+void stageBoundary(const char* stage) {
+    t_boundaries.emplace_back(stage, t_counters.read());
+}
+
+#endif
+
+} // namespace
+
+bool enablePerfCounters(std::string* reason) {
+#ifdef __linux__
+    if (!t_counters.open(reason)) {
+        return false;
+    }
+    g_enabled.store(true, std::memory_order_release);
+    return true;
+#else
+    if (reason) *reason = "hardware performance counters are only supported on Linux";
+    return false;
+#endif
+}
+
+bool perfCountersEnabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+PerfCounters readPerfCounters() {
+#ifdef __linux__
+    if (perfCountersEnabled() && t_counters.open(nullptr)) {
+        return t_counters.read();
+    }
+#endif
+    return {};
+}
+
+bool takeStageBoundary(const char* stage, PerfCounters& counters) {
+    for (auto it = t_boundaries.begin(); it != t_boundaries.end(); ++it) {
+        if (std::strcmp(it->first, stage) == 0) {
+            counters = it->second;
+            t_boundaries.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void clearStageBoundaries() {
+    t_boundaries.clear();
+}
+
+} // namespace qrac
@@ -0,0 +1,60 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 硬件性能计数器（--perf，Linux perf_event_open）
+ *
+ * 每个线程打开一组计数器（周期、指令、末级缓存未命中、分支预测失败），只统计用户态，
+ * 阶段开始和结束时各读取一次，差值归到该阶段：
+ *   - 流式处理的每个阶段是一个线程，按每帧的处理时间段累计；
+ *   - 整体编解码的作业在StageTimer的阶段边界读取，encode()/decode()内部的
+ *     FEC和符号打包/解包阶段由库的阶段回调（setStageHook）读取。
+ * 报告每个阶段的IPC（指令/周期）和每字节的缓存未命中、分支预测失败次数。
+ * 计数器被复用（multiplexing）时按实际计数时间比例换算。
+ * 不被允许（perf_event_paranoid、虚拟机/容器不提供硬件事件、非Linux）时
+ * enablePerfCounters()返回false并给出原因，其他功能照常运行。
+ ******************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace qrac {
+
+struct PerfCounters {
+    enum : unsigned {
+        kCycles = 1,
+        kInstructions = 2,
+        kCacheMisses = 4,
+        kBranchMisses = 8
+    };
+
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cacheMisses = 0;  // 末级缓存未命中
+    uint64_t branchMisses = 0;
+    unsigned available = 0;    // 有读数的计数器（上面的位）
+
+    bool valid() const { return available != 0; }
+    bool has(unsigned counter) const { return (available & counter) != 0; }
+    double ipc() const;
+
+    PerfCounters& operator+=(const PerfCounters& other);
+};
+
+// 两次读数之差
+PerfCounters operator-(const PerfCounters& end, const PerfCounters& begin);
+
+// 启用计数器：先在调用线程上打开一次，失败时返回false并在reason中说明原因
+bool enablePerfCounters(std::string* reason);
+
+bool perfCountersEnabled();
+
+// 当前线程的计数器读数（第一次调用时打开），未启用或不可用时available为0
+PerfCounters readPerfCounters();
+
+// 取出本线程库阶段回调在stage结束时记录的读数
+bool takeStageBoundary(const char* stage, PerfCounters& counters);
+
+// 丢弃本线程尚未取出的库阶段读数
+void clearStageBoundaries();
+
+} // namespace qrac
@@ -0,0 +1,163 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 工作窃取线程池（批处理模式使用）
+ *
+ * 每个工作线程拥有自己的任务双端队列：
+ * - 所有者从队首取任务（提交顺序，批处理时大文件优先）
+ * - 空闲线程从其他队列的队尾窃取任务
+ * 文件大小从100B到1GB不等，静态划分会留下长尾，窃取可以自动平衡负载。
+ ******************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "qrac_trace.h"
+
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned threadCount = 0) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        m_queues.reserve(threadCount);
+        for (unsigned i = 0; i < threadCount; i++) {
+            m_queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        m_threads.reserve(threadCount);
+        for (unsigned i = 0; i < threadCount; i++) {
+            m_threads.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_stopping = true;
+        }
+        m_sleepCv.notify_all();
+        for (auto& t : m_threads) {
+            t.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(m_threads.size()); }
+
+    // 提交任务：工作线程内提交时放入自己的队列，否则轮询分配
+    void submit(Task task) {
+        size_t target = (t_workerIndex >= 0 && t_owner == this)
+            ? static_cast<size_t>(t_workerIndex)
+            : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        // 先计数再入队：入队后其他线程可能立即取走任务并减少计数
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_queued++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_queues[target]->mutex);
+            m_queues[target]->tasks.push_back(std::move(task));
+        }
+        m_sleepCv.notify_one();
+    }
+
+    // 等待所有已提交任务完成
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_doneMutex);
+        m_doneCv.wait(lock, [this] { return m_pending.load(std::memory_order_acquire) == 0; });
+    }
+
+    // 窃取次数（用于统计负载均衡效果）
+    size_t stealCount() const { return m_steals.load(std::memory_order_relaxed); }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    static inline thread_local int t_workerIndex = -1;
+    static inline thread_local const WorkStealingPool* t_owner = nullptr;
+
+    bool popLocal(size_t index, Task& task) {
+        WorkerQueue& q = *m_queues[index];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) return false;
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(size_t thief, Task& task) {
+        size_t count = m_queues.size();
+        for (size_t offset = 1; offset < count; offset++) {
+            WorkerQueue& q = *m_queues[(thief + offset) % count];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty()) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+                m_steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned index) {
+        t_workerIndex = static_cast<int>(index);
+        t_owner = this;
+        qrac::setTraceThreadName("worker " + std::to_string(index));
+
+        while (true) {
+            Task task;
+            if (popLocal(index, task) || steal(index, task)) {
+                {
+                    std::lock_guard<std::mutex> lock(m_sleepMutex);
+                    m_queued--;
+                }
+                task();
+                if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    std::lock_guard<std::mutex> lock(m_doneMutex);
+                    m_doneCv.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_sleepCv.wait(lock, [this] { return m_stopping || m_queued > 0; });
+            if (m_stopping && m_queued == 0) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_nextQueue{ 0 };
+    std::atomic<size_t> m_pending{ 0 };
+    std::atomic<size_t> m_steals{ 0 };
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCv;
+    size_t m_queued = 0; // 受m_sleepMutex保护：已入队但尚未被取走的任务数
+    bool m_stopping = false;
+
+    std::mutex m_doneMutex;
+    std::condition_variable m_doneCv;
+};
@@ -0,0 +1,430 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * Reed-Solomon纠错实现
+ *
+ * GF(2^8)，本原多项式0x11D，生成多项式的根为 α^0 .. α^(p-1)。
+ * 多项式按高次在前存放，码字为数据字节后接校验字节。
+ * 编码用线性反馈移位寄存器求余式；解码先算伴随式，全部为0（绝大多数码字）时直接通过，
+ * 否则用擦除位置修正伴随式（Forney伴随式），Berlekamp-Massey求错误位置多项式，
+ * Chien搜索找错误位置，最后用Forney算法同时求出错误和擦除的值。
+ ******************************************************************/
+#include "qrac_rs.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace qrac {
+
+namespace {
+
+// GF(2^8)的指数/对数表（指数表加倍，乘法不用取模）和完整乘法表（伴随式计算用）
+struct GaloisField {
+    std::array<uint8_t, 512> exp{};
+    std::array<int, 256> log{};
+    std::array<std::array<uint8_t, 256>, 256> mul{};
+
+    GaloisField() {
+        int x = 1;
+        for (int i = 0; i < 255; i++) {
+            exp[i] = static_cast<uint8_t>(x);
+            log[x] = i;
+            x <<= 1;
+            if (x & 0x100) x ^= 0x11D;
+        }
+        for (int i = 255; i < 512; i++) {
+            exp[i] = exp[i - 255];
+        }
+        for (int a = 1; a < 256; a++) {
+            for (int b = 1; b < 256; b++) {
+                mul[a][b] = exp[log[a] + log[b]];
+            }
+        }
+    }
+};
+
+const GaloisField& field() {
+    static const GaloisField instance;
+    return instance;
+}
+
+uint8_t gfMul(uint8_t a, uint8_t b) {
+    if (a == 0 || b == 0) return 0;
+    const GaloisField& gf = field();
+    return gf.exp[gf.log[a] + gf.log[b]];
+}
+
+uint8_t gfDiv(uint8_t a, uint8_t b) {
+    if (a == 0) return 0;
+    const GaloisField& gf = field();
+    return gf.exp[gf.log[a] + 255 - gf.log[b]];
+}
+
+uint8_t gfInverse(uint8_t a) {
+    const GaloisField& gf = field();
+    return gf.exp[255 - gf.log[a]];
+}
+
+// α^n
+uint8_t gfAlpha(int n) {
+    return field().exp[n % 255];
+}
+
+using Poly = std::vector<uint8_t>;
+
+Poly polyScale(const Poly& p, uint8_t x) {
+    Poly result(p.size());
+    for (size_t i = 0; i < p.size(); i++) {
+        result[i] = gfMul(p[i], x);
+    }
+    return result;
+}
+
+// 低次对齐相加
+Poly polyAdd(const Poly& p, const Poly& q) {
+    Poly result(std::max(p.size(), q.size()));
+    for (size_t i = 0; i < p.size(); i++) {
+        result[i + result.size() - p.size()] = p[i];
+    }
+    for (size_t i = 0; i < q.size(); i++) {
+        result[i + result.size() - q.size()] ^= q[i];
+    }
+    return result;
+}
+
+Poly polyMul(const Poly& p, const Poly& q) {
+    Poly result(p.size() + q.size() - 1);
+    for (size_t j = 0; j < q.size(); j++) {
+        for (size_t i = 0; i < p.size(); i++) {
+            result[i + j] ^= gfMul(p[i], q[j]);
+        }
+    }
+    return result;
+}
+
+uint8_t polyEval(const uint8_t* p, size_t size, uint8_t x) {
+    uint8_t y = p[0];
+    for (size_t i = 1; i < size; i++) {
+        y = gfMul(y, x) ^ p[i];
+    }
+    return y;
+}
+
+uint8_t polyEval(const Poly& p, uint8_t x) {
+    return polyEval(p.data(), p.size(), x);
+}
+
+// 生成多项式 (x - α^0)(x - α^1)...(x - α^(paritySize-1))
+Poly generatorPoly(size_t paritySize) {
+    Poly g{ 1 };
+    for (size_t i = 0; i < paritySize; i++) {
+        g = polyMul(g, Poly{ 1, gfAlpha(static_cast<int>(i)) });
+    }
+    return g;
+}
+
+// 伴随式 S_i = msg(α^i)，全部为0时返回false
+// 按字节外层、伴随式内层计算：各S_i的Horner链互不依赖，每步只查一次乘法表
+bool syndromes(const uint8_t* msg, size_t size, size_t paritySize, Poly& synd) {
+    const GaloisField& gf = field();
+    std::array<const uint8_t*, 255> rows;
+    for (size_t i = 0; i < paritySize; i++) {
+        rows[i] = gf.mul[gf.exp[i]].data();
+    }
+    std::array<uint8_t, 255> s{};
+    for (size_t j = 0; j < size; j++) {
+        uint8_t b = msg[j];
+        for (size_t i = 0; i < paritySize; i++) {
+            s[i] = rows[i][s[i]] ^ b;
+        }
+    }
+    synd.assign(s.begin(), s.begin() + paritySize);
+    return std::any_of(synd.begin(), synd.end(), [](uint8_t v) { return v != 0; });
+}
+
+// 错误/擦除位置多项式：∏(1 + α^pos·x)，pos为系数位置（从低次数起）
+Poly errataLocator(const std::vector<int>& coefPositions) {
+    Poly locator{ 1 };
+    for (int position : coefPositions) {
+        locator = polyMul(locator, Poly{ gfAlpha(position), 1 });
+    }
+    return locator;
+}
+
+// 已知全部错误和擦除的位置（消息下标），用Forney算法求值并纠正
+bool correctErrata(uint8_t* msg, size_t size, const Poly& synd, const std::vector<int>& positions) {
+    std::vector<int> coefPositions;
+    for (int position : positions) {
+        coefPositions.push_back(static_cast<int>(size) - 1 - position);
+    }
+    Poly locator = errataLocator(coefPositions);
+
+    // 错误值多项式 Ω = S(x)·Λ(x) mod x^(deg Λ + 1)，伴随式按高次在前（S_(p-1) ... S_0, 0）
+    Poly reversedSynd(synd.rbegin(), synd.rend());
+    reversedSynd.push_back(0);
+    Poly product = polyMul(reversedSynd, locator);
+    Poly evaluator(product.end() - locator.size(), product.end());
+
+    std::vector<uint8_t> roots;
+    for (int position : coefPositions) {
+        roots.push_back(gfAlpha(position));
+    }
+    for (size_t i = 0; i < roots.size(); i++) {
+        uint8_t inverse = gfInverse(roots[i]);
+        uint8_t derivative = 1;
+        for (size_t j = 0; j < roots.size(); j++) {
+            if (j != i) {
+                derivative = gfMul(derivative, 1 ^ gfMul(inverse, roots[j]));
+            }
+        }
+        if (derivative == 0) {
+            return false;
+        }
+        uint8_t y = gfMul(roots[i], polyEval(evaluator, inverse));
+        msg[positions[i]] ^= gfDiv(y, derivative);
+    }
+    return true;
+}
+
+// 纠正一个码字：erasures为码字内的下标。成功时返回true（msg已纠正）
+bool decodeCodeword(uint8_t* msg, size_t size, size_t paritySize, const std::vector<int>& erasures) {
+    if (erasures.size() > paritySize) {
+        return false;
+    }
+    for (int position : erasures) {
+        msg[position] = 0;
+    }
+
+    Poly synd;
+    if (!syndromes(msg, size, paritySize, synd)) {
+        return true; // 擦除位置上的值恰好都是0
+    }
+
+    // 从伴随式中消去擦除的影响（Forney伴随式）
+    Poly forney = synd;
+    for (int position : erasures) {
+        uint8_t x = gfAlpha(static_cast<int>(size) - 1 - position);
+        for (size_t j = 0; j + 1 < forney.size(); j++) {
+            forney[j] = gfMul(forney[j], x) ^ forney[j + 1];
+        }
+    }
+
+    // Berlekamp-Massey：剩余的伴随式求错误位置多项式
+    Poly locator{ 1 };
+    Poly previous{ 1 };
+    for (size_t i = 0; i < paritySize - erasures.size(); i++) {
+        uint8_t delta = forney[i];
+        for (size_t j = 1; j < locator.size() && j <= i; j++) {
+            delta ^= gfMul(locator[locator.size() - 1 - j], forney[i - j]);
+        }
+        previous.push_back(0);
+        if (delta != 0) {
+            if (previous.size() > locator.size()) {
+                Poly next = polyScale(previous, delta);
+                previous = polyScale(locator, gfInverse(delta));
+                locator = std::move(next);
+            }
+            locator = polyAdd(locator, polyScale(previous, delta));
+        }
+    }
+    auto leading = std::find_if(locator.begin(), locator.end(), [](uint8_t c) { return c != 0; });
+    locator.erase(locator.begin(), leading);
+    size_t errors = locator.size() - 1;
+    if (errors * 2 + erasures.size() > paritySize) {
+        return false;
+    }
+
+    // Chien搜索：逐个位置代入求根
+    std::vector<int> positions = erasures;
+    Poly reversed(locator.rbegin(), locator.rend());
+    for (size_t i = 0; i < size; i++) {
+        if (polyEval(reversed, gfAlpha(static_cast<int>(i))) == 0) {
+            positions.push_back(static_cast<int>(size - 1 - i));
+        }
+    }
+    if (positions.size() != errors + erasures.size()) {
+        return false;
+    }
+
+    if (!correctErrata(msg, size, synd, positions)) {
+        return false;
+    }
+    return !syndromes(msg, size, paritySize, synd);
+}
+
+// 交错布局：blocks个码字，数据和校验尽量平均分配。多出的数据字节给前面的码字，
+// 多出的校验字节给后面的码字，每个码字不超过255字节
+struct Layout {
+    size_t blocks = 0;
+    size_t dataSize = 0;
+    size_t paritySize = 0;
+
+    Layout(size_t data, size_t parity) : blocks((data + parity + 254) / 255), dataSize(data), paritySize(parity) {}
+
+    size_t dataCount(size_t block) const {
+        return dataSize / blocks + (block < dataSize % blocks ? 1 : 0);
+    }
+    size_t parityCount(size_t block) const {
+        return paritySize / blocks + (block >= blocks - paritySize % blocks ? 1 : 0);
+    }
+    // 第t个校验字节在校验区中的位置
+    size_t parityOffset(size_t block, size_t t) const {
+        return (blocks - 1 - block) + t * blocks;
+    }
+};
+
+} // namespace
+
+void rsEncode(const uint8_t* data, size_t dataSize, uint8_t* parity, size_t paritySize) {
+    if (dataSize == 0 || paritySize == 0) return;
+    const GaloisField& gf = field();
+    Layout layout(dataSize, paritySize);
+
+    // 码字的校验字节数只有两种，生成多项式（取对数）各算一次
+    std::array<std::vector<int>, 2> generatorLogs;
+    std::array<size_t, 2> generatorSizes{ 0, 0 };
+    std::array<uint8_t, 256> message{};
+    std::array<uint8_t, 256> remainder{};
+
+    for (size_t block = 0; block < layout.blocks; block++) {
+        size_t count = layout.dataCount(block);
+        size_t parityCount = layout.parityCount(block);
+        if (parityCount == 0) continue;
+
+        size_t slot = parityCount == paritySize / layout.blocks ? 0 : 1;
+        if (generatorSizes[slot] != parityCount) {
+            Poly g = generatorPoly(parityCount);
+            generatorLogs[slot].assign(parityCount, -1);
+            for (size_t j = 0; j < parityCount; j++) {
+                if (g[j + 1] != 0) generatorLogs[slot][j] = gf.log[g[j + 1]];
+            }
+            generatorSizes[slot] = parityCount;
+        }
+        const std::vector<int>& logs = generatorLogs[slot];
+
+        for (size_t t = 0; t < count; t++) {
+            message[t] = data[block + t * layout.blocks];
+        }
+
+        // 线性反馈移位寄存器求 m(x)·x^p mod g(x)
+        std::fill(remainder.begin(), remainder.begin() + parityCount, uint8_t(0));
+        for (size_t t = 0; t < count; t++) {
+            uint8_t feedback = message[t] ^ remainder[0];
+            std::copy(remainder.begin() + 1, remainder.begin() + parityCount, remainder.begin());
+            remainder[parityCount - 1] = 0;
+            if (feedback != 0) {
+                int logFeedback = gf.log[feedback];
+                for (size_t j = 0; j < parityCount; j++) {
+                    if (logs[j] >= 0) remainder[j] ^= gf.exp[logs[j] + logFeedback];
+                }
+            }
+        }
+
+        for (size_t t = 0; t < parityCount; t++) {
+            parity[layout.parityOffset(block, t)] = remainder[t];
+        }
+    }
+}
+
+bool rsDecode(uint8_t* buffer, size_t dataSize, size_t paritySize, std::span<const size_t> erasures, FECReport* report,
+    std::span<const std::pair<size_t, size_t>> damaged) {
+    if (dataSize == 0 || paritySize == 0) return true;
+    Layout layout(dataSize, paritySize);
+    uint8_t* parity = buffer + dataSize;
+
+    // 只解码包含损坏字节的码字：字节j属于码字 j % blocks，一段至少blocks字节的范围覆盖全部码字
+    std::vector<uint8_t> selected;
+    if (!damaged.empty()) {
+        selected.assign(layout.blocks, 0);
+        for (const auto& [first, second] : damaged) {
+            size_t end = std::min(second, dataSize);
+            if (end <= first) continue;
+            if (end - first >= layout.blocks) {
+                std::fill(selected.begin(), selected.end(), uint8_t(1));
+                break;
+            }
+            for (size_t j = first; j < end; j++) {
+                selected[j % layout.blocks] = 1;
+            }
+        }
+    }
+
+    // 擦除位置按码字分组（码字内的下标）
+    std::vector<uint32_t> firstErasure(layout.blocks + 1, 0);
+    std::vector<std::pair<size_t, int>> located;
+    located.reserve(erasures.size());
+    for (size_t position : erasures) {
+        if (position < dataSize) {
+            located.emplace_back(position % layout.blocks, static_cast<int>(position / layout.blocks));
+        }
+        else if (position < dataSize + paritySize) {
+            size_t m = position - dataSize;
+            size_t block = layout.blocks - 1 - m % layout.blocks;
+            located.emplace_back(block, static_cast<int>(layout.dataCount(block) + m / layout.blocks));
+        }
+    }
+    std::sort(located.begin(), located.end());
+
+    std::array<uint8_t, 256> received{};
+    std::array<uint8_t, 256> message{};
+    std::vector<int> blockErasures;
+    Poly synd;
+    bool allValid = true;
+    size_t next = 0;
+
+    for (size_t block = 0; block < layout.blocks; block++) {
+        size_t count = layout.dataCount(block);
+        size_t parityCount = layout.parityCount(block);
+        size_t size = count + parityCount;
+
+        blockErasures.clear();
+        for (; next < located.size() && located[next].first == block; next++) {
+            blockErasures.push_back(located[next].second);
+        }
+        if (!selected.empty() && !selected[block]) continue;
+        if (report) {
+            report->erasures += blockErasures.size();
+        }
+        if (parityCount == 0) continue;
+
+        for (size_t t = 0; t < count; t++) {
+            received[t] = buffer[block + t * layout.blocks];
+        }
+        for (size_t t = 0; t < parityCount; t++) {
+            received[count + t] = parity[layout.parityOffset(block, t)];
+        }
+        if (!syndromes(received.data(), size, parityCount, synd)) {
+            continue;
+        }
+
+        // 先利用擦除标记，失败（标记不准确或过多）时只按错误纠正
+        std::copy(received.begin(), received.begin() + size, message.begin());
+        bool corrected = !blockErasures.empty() && decodeCodeword(message.data(), size, parityCount, blockErasures);
+        if (!corrected) {
+            std::copy(received.begin(), received.begin() + size, message.begin());
+            corrected = decodeCodeword(message.data(), size, parityCount, {});
+        }
+        if (!corrected) {
+            allValid = false;
+            if (report) {
+                if (report->firstFailedBlock < 0) report->firstFailedBlock = static_cast<long long>(block);
+                report->failedBlocks++;
+            }
+            continue;
+        }
+
+        for (size_t t = 0; t < size; t++) {
+            if (message[t] == received[t]) continue;
+            if (report) report->correctedBytes++;
+            if (t < count) {
+                buffer[block + t * layout.blocks] = message[t];
+            }
+            else {
+                parity[layout.parityOffset(block, t - count)] = message[t];
+            }
+        }
+    }
+    return allValid;
+}
+
+} // namespace qrac
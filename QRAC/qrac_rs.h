@@ -0,0 +1,34 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * Reed-Solomon纠错（GF(2^8)，支持擦除）
+ *
+ * FEC数据的布局与简单FEC相同：originalSize字节数据后接paritySize字节校验，
+ * 数据保持原样（系统码），长度只由冗余比例决定，图像尺寸的计算不变。
+ * 数据和校验交错分成若干个码字（每个不超过255字节）：数据字节j属于码字 j % blocks，
+ * 图像中连续的损坏（一段像素）分散到不同码字，每个码字只承担其中一小部分。
+ *
+ * 每个码字有p个校验字节时，可以纠正e个错误和f个擦除（位置已知的可疑字节），
+ * 只要 2e + f <= p。解码时量化距离接近间隔边缘的符号所在字节作为擦除，
+ * 同样的冗余可以纠正更多的损坏；擦除标记过多或不准确时退回只按错误纠正。
+ ******************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+#include "qrac.h"
+
+namespace qrac {
+
+// 计算交错的RS校验字节（parity为paritySize字节）
+void rsEncode(const uint8_t* data, size_t dataSize, uint8_t* parity, size_t paritySize);
+
+// 校验并纠正buffer（dataSize字节数据 + paritySize字节校验），全部码字通过时返回true
+// erasures：可疑字节在buffer中的位置（升序），report中的块为码字
+// damaged不为空时只解码与这些数据范围 [first, second) 相交的码字，其余数据已由分块校验确认无误
+bool rsDecode(uint8_t* buffer, size_t dataSize, size_t paritySize, std::span<const size_t> erasures, FECReport* report,
+    std::span<const std::pair<size_t, size_t>> damaged = {});
+
+} // namespace qrac
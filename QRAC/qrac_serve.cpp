@@ -0,0 +1,712 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 常驻服务模式实现
+ *
+ * 每个连接由一个协程（Task）处理：套接字为非阻塞模式，数据未到达或
+ * 发送缓冲区已满时协程挂起并把连接登记到epoll（EPOLLONESHOT），
+ * 主线程的epoll循环在就绪时把协程重新提交到线程池继续执行。
+ * 慢速客户端或空闲连接不占用线程，少量线程即可服务大量连接。
+ ******************************************************************/
+#include "qrac_serve.h"
+
+#include <iostream>
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstring>
+#include <mutex>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+#include <csignal>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "qrac_pool.h"
+#include "qrac_task.h"
+
+namespace qrac {
+
+namespace {
+
+constexpr int kMaxPassedFds = 2;
+constexpr size_t kLatencyBuckets = 100000; // 微秒，超出的计入最后一个桶
+constexpr size_t kKeepBufferBytes = 4 * 1024 * 1024; // 每个连接在请求之间保留的缓冲区上限
+constexpr size_t kInputChunkBytes = 1024 * 1024;     // 内联数据缓冲区的最小扩容步长
+
+int g_serveWakeFd = -1;
+
+void onServeSignal(int) {
+    uint64_t one = 1;
+    ssize_t ignored = write(g_serveWakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+// 一个客户端连接，由一个协程处理
+struct Connection {
+    int fd = -1;
+    bool registered = false;               // 是否已加入epoll
+    std::coroutine_handle<> root;          // 顶层协程（服务关闭时销毁）
+    std::atomic<void*> waiting{ nullptr }; // 等待就绪事件的协程
+
+    // 连接复用自己的缓冲区：协程可能在不同线程上恢复，不能使用thread_local缓冲区
+    std::vector<uint8_t> input;
+    ByteBuffer result;
+    Image image;
+};
+
+// 非阻塞套接字操作的结果
+enum class SocketStatus { Done, WouldBlock, Closed };
+
+template <typename Buffer>
+void trimBuffer(Buffer& buffer) {
+    if (buffer.capacity() > kKeepBufferBytes) {
+        Buffer().swap(buffer);
+    }
+}
+
+// 自动关闭通过SCM_RIGHTS收到的描述符
+struct PassedFds {
+    std::array<int, kMaxPassedFds> fds{ -1, -1 };
+    std::array<int, kMaxPassedFds> savedFlags{ -1, -1 }; // 改为非阻塞之前的状态标志
+    int count = 0;
+
+    ~PassedFds() {
+        for (int i = 0; i < count; i++) {
+            if (savedFlags[i] >= 0) {
+                fcntl(fds[i], F_SETFL, savedFlags[i]);
+            }
+            close(fds[i]);
+        }
+    }
+    // 管道/套接字读写不能阻塞工作线程：改为非阻塞，未就绪时协程挂起在epoll上
+    // 描述符与客户端共享打开的文件描述，关闭前恢复原来的标志
+    void makeNonBlocking() {
+        for (int i = 0; i < count; i++) {
+            int flags = fcntl(fds[i], F_GETFL);
+            if (flags >= 0 && !(flags & O_NONBLOCK) && fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) == 0) {
+                savedFlags[i] = flags;
+            }
+        }
+    }
+    int first() const { return count > 0 ? fds[0] : -1; }
+    int last() const { return count > 0 ? fds[count - 1] : -1; }
+};
+
+// 接收size字节，done记录已接收的字节数，WouldBlock之后可以继续调用
+SocketStatus receiveSome(int fd, uint8_t* data, size_t size, size_t& done) {
+    while (done < size) {
+        ssize_t n = recv(fd, data + done, size - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return SocketStatus::WouldBlock;
+        if (n <= 0) return SocketStatus::Closed;
+        done += static_cast<size_t>(n);
+    }
+    return SocketStatus::Done;
+}
+
+// 发送size字节，done记录已发送的字节数
+SocketStatus sendSome(int fd, const uint8_t* data, size_t size, size_t& done) {
+    while (done < size) {
+        ssize_t n = send(fd, data + done, size - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return SocketStatus::WouldBlock;
+        if (n <= 0) return SocketStatus::Closed;
+        done += static_cast<size_t>(n);
+    }
+    return SocketStatus::Done;
+}
+
+// 写入通过SCM_RIGHTS收到的描述符（文件、管道或套接字），done记录已写入的字节数
+// 失败返回Closed，errno为失败原因
+SocketStatus writeSome(int fd, const uint8_t* data, size_t size, size_t& done) {
+    while (done < size) {
+        ssize_t n = write(fd, data + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return SocketStatus::WouldBlock;
+        if (n <= 0) return SocketStatus::Closed;
+        done += static_cast<size_t>(n);
+    }
+    return SocketStatus::Done;
+}
+
+// 读取描述符直到EOF（普通文件按大小预分配，管道逐块读取），used记录已读取的字节数
+// 读到EOF返回Done，失败返回Closed，errno为失败原因
+SocketStatus readSome(int fd, std::vector<uint8_t>& out, size_t& used) {
+    if (used == 0) {
+        out.clear();
+        struct stat st {};
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            out.reserve(static_cast<size_t>(st.st_size));
+        }
+    }
+
+    while (true) {
+        if (out.size() - used < 64 * 1024) {
+            out.resize(std::max(used + 64 * 1024, out.capacity()));
+        }
+        ssize_t n = read(fd, out.data() + used, out.size() - used);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return SocketStatus::WouldBlock;
+        if (n < 0) return SocketStatus::Closed;
+        if (n == 0) break;
+        used += static_cast<size_t>(n);
+    }
+    out.resize(used);
+    return SocketStatus::Done;
+}
+
+// 接收帧头及随附的描述符，received记录已接收的字节数
+SocketStatus receiveHeader(int fd, ServeHeader& header, PassedFds& passed, size_t& received) {
+    uint8_t* data = reinterpret_cast<uint8_t*>(&header);
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxPassedFds)];
+    while (received < sizeof(header)) {
+        iovec iov{ data + received, sizeof(header) - received };
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return SocketStatus::WouldBlock;
+        if (n <= 0) return SocketStatus::Closed;
+        received += static_cast<size_t>(n);
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+            size_t fdCount = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* fds = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            for (size_t i = 0; i < fdCount; i++) {
+                if (passed.count < kMaxPassedFds) {
+                    passed.fds[passed.count++] = fds[i];
+                }
+                else {
+                    close(fds[i]);
+                }
+            }
+        }
+    }
+    return SocketStatus::Done;
+}
+
+QRACConfig withoutCalibration(QRACConfig profile) {
+    profile.CALIBRATE_LEVELS = false;
+    return profile;
+}
+
+class Server {
+public:
+    explicit Server(const ServeOptions& options)
+        : m_options(options), m_ctx(options.profile), m_exactCtx(withoutCalibration(options.profile)),
+          m_pool(options.threads) {}
+
+    int run();
+
+private:
+    // co_await waitFor(conn, EPOLLIN/EPOLLOUT)：挂起直到连接可读/可写
+    // passedFd >= 0时等待随请求传入的描述符，只在等待期间登记到epoll
+    auto waitFor(Connection& conn, uint32_t events, int passedFd = -1) {
+        struct Awaiter {
+            Server& server;
+            Connection& conn;
+            uint32_t events;
+            int passedFd;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                int op = (conn.registered && passedFd < 0) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+                if (passedFd < 0) {
+                    conn.registered = true;
+                }
+                conn.waiting.store(handle.address(), std::memory_order_release);
+
+                epoll_event ev{};
+                ev.events = events | EPOLLRDHUP | EPOLLONESHOT;
+                ev.data.ptr = &conn;
+                // epoll_ctl之后协程可能已在其他线程恢复，不能再访问conn
+                Server& target = server;
+                int fd = passedFd >= 0 ? passedFd : conn.fd;
+                if (epoll_ctl(target.m_epoll, op, fd, &ev) != 0) {
+                    conn.waiting.store(nullptr, std::memory_order_relaxed);
+                    post(target.m_pool, handle);
+                }
+            }
+            void await_resume() const noexcept {
+                // 客户端仍持有该描述符，关闭不会自动从epoll中移除
+                if (passedFd >= 0) {
+                    epoll_ctl(server.m_epoll, EPOLL_CTL_DEL, passedFd, nullptr);
+                }
+            }
+        };
+        return Awaiter{ *this, conn, events, passedFd };
+    }
+
+    void acceptConnections(int listenFd);
+    Task<> serveConnection(Connection& conn);
+    Task<bool> handleFrame(Connection& conn);
+    void closeConnection(Connection* conn);
+    void recordLatency(std::chrono::steady_clock::duration elapsed);
+    void printSummary() const;
+
+    ServeOptions m_options;
+    CodecContext m_ctx;
+    CodecContext m_exactCtx; // 跳过电平校准：原始像素和ServeFlagExact请求，省去直方图扫描
+    WorkStealingPool m_pool;
+    int m_epoll = -1;
+
+    char m_listenTag = 0; // epoll事件的data.ptr：监听套接字和退出通知
+    char m_wakeTag = 0;
+
+    std::mutex m_connectionsMutex;
+    std::unordered_set<Connection*> m_connections;
+    std::mutex m_logMutex;
+
+    std::atomic<uint64_t> m_requests{ 0 };
+    std::atomic<uint64_t> m_failures{ 0 };
+    std::atomic<uint64_t> m_bytesIn{ 0 };
+    std::atomic<uint64_t> m_bytesOut{ 0 };
+    std::vector<std::atomic<uint32_t>> m_latency = std::vector<std::atomic<uint32_t>>(kLatencyBuckets);
+};
+
+int Server::run() {
+    if (m_options.socketPath.size() >= sizeof(sockaddr_un::sun_path)) {
+        std::cerr << "Socket path is too long: " << m_options.socketPath << "\n";
+        return 1;
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, m_options.socketPath.c_str(), m_options.socketPath.size() + 1);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        std::cerr << "socket() failed: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    // 已有服务在监听时不抢占；否则删除残留的套接字文件
+    if (connect(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+        std::cerr << "Another server is already listening on " << m_options.socketPath << "\n";
+        close(listenFd);
+        return 1;
+    }
+    close(listenFd);
+    unlink(m_options.socketPath.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listenFd < 0 ||
+        bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(listenFd, SOMAXCONN) != 0) {
+        std::cerr << "Cannot listen on " << m_options.socketPath << ": " << std::strerror(errno) << "\n";
+        if (listenFd >= 0) close(listenFd);
+        return 1;
+    }
+
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    g_serveWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &m_listenTag;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.data.ptr = &m_wakeTag;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, g_serveWakeFd, &ev);
+
+    struct sigaction sa {};
+    sa.sa_handler = onServeSignal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::cout << "QRAC server listening on " << m_options.socketPath
+        << " (" << m_pool.size() << " threads, L=" << m_ctx.profile().L
+        << ", FEC ratio " << m_ctx.profile().FEC_REDUNDANCY_RATIO
+        << (m_ctx.profile().USE_ADVANCED_FEC ? " Reed-Solomon" : "") << ")\n";
+    std::cout.flush();
+
+    bool stopping = false;
+    std::array<epoll_event, 64> events;
+    while (!stopping) {
+        int count = epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait() failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            void* tag = events[i].data.ptr;
+            if (tag == &m_wakeTag) {
+                stopping = true;
+            }
+            else if (tag == &m_listenTag) {
+                acceptConnections(listenFd);
+            }
+            else {
+                // 恢复等待该连接的协程
+                Connection* conn = static_cast<Connection*>(tag);
+                void* waiting = conn->waiting.exchange(nullptr, std::memory_order_acq_rel);
+                if (waiting) {
+                    post(m_pool, std::coroutine_handle<>::from_address(waiting));
+                }
+            }
+        }
+    }
+
+    std::cout << "Shutting down...\n";
+    close(listenFd);
+    unlink(m_options.socketPath.c_str());
+    m_pool.wait();
+
+    // 线程池空闲后所有连接协程都挂起在epoll上，直接销毁
+    {
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        for (Connection* conn : m_connections) {
+            conn->root.destroy();
+            close(conn->fd);
+            delete conn;
+        }
+        m_connections.clear();
+    }
+    close(m_epoll);
+    close(g_serveWakeFd);
+    g_serveWakeFd = -1;
+
+    printSummary();
+    return 0;
+}
+
+void Server::acceptConnections(int listenFd) {
+    while (true) {
+        int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (client < 0) break;
+
+        Connection* conn = new Connection();
+        conn->fd = client;
+        DetachedTask task = detach(serveConnection(*conn), [this, conn] { closeConnection(conn); });
+        conn->root = task.handle;
+        {
+            std::lock_guard<std::mutex> lock(m_connectionsMutex);
+            m_connections.insert(conn);
+        }
+        post(m_pool, task.handle);
+    }
+}
+
+// 连接协程：逐帧处理请求，已到达的后续请求直接处理，没有数据时挂起
+Task<> Server::serveConnection(Connection& conn) {
+    // 不把co_await写在while条件中：GCC 12会错误编译这种写法
+    while (true) {
+        bool keepOpen = co_await handleFrame(conn);
+        if (!keepOpen) {
+            break;
+        }
+    }
+}
+
+void Server::closeConnection(Connection* conn) {
+    if (conn->registered) {
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, conn->fd, nullptr);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        m_connections.erase(conn);
+    }
+    close(conn->fd);
+    delete conn;
+}
+
+// 处理一个请求帧，连接应关闭时返回false
+Task<bool> Server::handleFrame(Connection& conn) {
+    const int fd = conn.fd;
+    ServeHeader request;
+    PassedFds passed;
+    SocketStatus status;
+    size_t received = 0;
+    while ((status = receiveHeader(fd, request, passed, received)) == SocketStatus::WouldBlock) {
+        co_await waitFor(conn, EPOLLIN);
+    }
+    if (status != SocketStatus::Done) {
+        co_return false;
+    }
+    passed.makeNonBlocking();
+    auto start = std::chrono::steady_clock::now();
+
+    ServeHeader response;
+    response.magic = kServeResponseMagic;
+    response.requestId = request.requestId;
+
+    std::string error;
+    std::span<const uint8_t> payload;
+    ByteBuffer& result = conn.result;
+    bool keepConnection = true;
+
+    auto fail = [&](ServeStatus status, const std::string& message) {
+        response.code = status;
+        error = message;
+        payload = std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(error.data()), error.size());
+    };
+
+    std::vector<uint8_t>& input = conn.input;
+
+    if (request.magic != kServeRequestMagic) {
+        fail(ServeStatusBadRequest, "bad frame magic");
+        keepConnection = false;
+    }
+    else if (request.length > kServeMaxInlinePayload) {
+        fail(ServeStatusBadRequest, "inline payload too large");
+        keepConnection = false;
+    }
+    else {
+        // 读取输入：内联数据必须完整读出，否则后续帧无法对齐
+        // 缓冲区随数据到达翻倍扩容，不按帧头声明的长度预先分配：只发帧头的连接不占用内存
+        bool inputOk = true;
+        const size_t inputLength = static_cast<size_t>(request.length);
+        size_t inputReceived = 0;
+        input.clear();
+        while (true) {
+            if (inputReceived == input.size() && inputReceived < inputLength) {
+                input.resize(std::min(inputLength, inputReceived + std::max(inputReceived, kInputChunkBytes)));
+            }
+            status = receiveSome(fd, input.data(), input.size(), inputReceived);
+            if (status == SocketStatus::WouldBlock) {
+                co_await waitFor(conn, EPOLLIN);
+            }
+            else if (status != SocketStatus::Done) {
+                co_return false;
+            }
+            else if (inputReceived == inputLength) {
+                break;
+            }
+        }
+        if (request.flags & ServeFlagInputFd) {
+            if (passed.count == 0) {
+                fail(ServeStatusBadRequest, "input descriptor missing");
+                inputOk = false;
+            }
+            else {
+                size_t fdReceived = 0;
+                while ((status = readSome(passed.first(), input, fdReceived)) == SocketStatus::WouldBlock) {
+                    co_await waitFor(conn, EPOLLIN, passed.first());
+                }
+                if (status != SocketStatus::Done) {
+                    fail(ServeStatusIOError, std::string("cannot read input descriptor: ") + std::strerror(errno));
+                    inputOk = false;
+                }
+            }
+        }
+        if (inputOk && (request.flags & ServeFlagOutputFd) && passed.count == 0) {
+            fail(ServeStatusBadRequest, "output descriptor missing");
+            inputOk = false;
+        }
+
+        if (inputOk) {
+            try {
+                bool raw = (request.flags & ServeFlagRaw) != 0;
+                const CodecContext& decodeCtx = (raw || (request.flags & ServeFlagExact)) ? m_exactCtx : m_ctx;
+                std::span<const uint8_t> data(input.data(), input.size());
+
+                // 原始像素直接作为视图使用，PNG/BMP先解码
+                auto inputImage = [&](Image& decoded) -> ImageView {
+                    if (!raw) {
+                        decoded = loadImage(data);
+                        return decoded.view();
+                    }
+                    size_t expected = static_cast<size_t>(std::max(0, request.width)) *
+                        std::max(0, request.height) * request.channels;
+                    if (request.width <= 0 || request.height <= 0 || request.channels < 1 ||
+                        request.channels > 4 || expected != data.size()) {
+                        throw QRACException(ErrorType::InvalidInput, "raw image size does not match width/height/channels");
+                    }
+                    return { data.data(), request.width, request.height, request.channels, 0 };
+                };
+
+                auto imageOutput = [&](const Image& image) {
+                    if (raw) {
+                        response.flags |= ServeFlagRaw;
+                        response.width = image.width;
+                        response.height = image.height;
+                        response.channels = static_cast<uint16_t>(image.channels);
+                        payload = std::span<const uint8_t>(image.pixels.data(), image.pixels.size());
+                    }
+                    else {
+                        // 默认不压缩：deflate占小图像往返时间的大部分
+                        result = encodePng(image.view(), (request.flags & ServeFlagDeflate) ?
+                            PngCompression::Default : PngCompression::Store);
+                        payload = result;
+                    }
+                };
+
+                switch (request.code) {
+                case ServeOpPing:
+                    break;
+                case ServeOpEncode: {
+                    SizeMode mode = (request.flags & ServeFlagAdaptive) ? SizeMode::Adaptive : SizeMode::Auto;
+                    Image& image = conn.image;
+                    encodedImageDimensions(m_ctx, data.size(), mode, &image.width, &image.height);
+                    image.channels = 3;
+                    image.pixels.resize(static_cast<size_t>(image.width) * image.height * 3);
+                    encodeInto(data, m_ctx, image.mutableView());
+                    imageOutput(image);
+                    break;
+                }
+                case ServeOpDecode: {
+                    Image decoded;
+                    DecodeReport report;
+                    result = decode(inputImage(decoded), decodeCtx, &report);
+                    if (report.dataValid) {
+                        response.flags |= ServeFlagDataValid;
+                    }
+                    payload = result;
+                    break;
+                }
+                case ServeOpVerify: {
+                    // 不返回数据：响应数据为重新计算的哈希，与编码时记录的一致时带DataValid
+                    Image decoded;
+                    DecodeReport report;
+                    result = decode(inputImage(decoded), decodeCtx, &report);
+                    PayloadHash hash = blake3(result.data(), result.size());
+                    if (report.fec.hasPayloadHash && hash == report.fec.payloadHash) {
+                        response.flags |= ServeFlagDataValid;
+                    }
+                    result.assign(hash.begin(), hash.end());
+                    payload = result;
+                    break;
+                }
+                case ServeOpCorrect: {
+                    Image decoded;
+                    conn.image = correct(inputImage(decoded), decodeCtx);
+                    imageOutput(conn.image);
+                    break;
+                }
+                default:
+                    fail(ServeStatusBadRequest, "unknown operation");
+                    break;
+                }
+            }
+            catch (const QRACException& e) {
+                fail(ServeStatusCodecError, e.what());
+            }
+            catch (const std::exception& e) {
+                fail(ServeStatusInternalError, e.what());
+            }
+        }
+    }
+
+    // 输出写入描述符时响应只带字节数
+    bool toFd = response.code == ServeStatusOk && (request.flags & ServeFlagOutputFd);
+    if (toFd) {
+        size_t written = 0;
+        while ((status = writeSome(passed.last(), payload.data(), payload.size(), written)) == SocketStatus::WouldBlock) {
+            co_await waitFor(conn, EPOLLOUT, passed.last());
+        }
+        if (status != SocketStatus::Done) {
+            fail(ServeStatusIOError, std::string("cannot write output descriptor: ") + std::strerror(errno));
+            toFd = false;
+        }
+    }
+    response.length = payload.size();
+
+    // 发送缓冲区满时挂起等待可写
+    size_t headerSent = 0;
+    while ((status = sendSome(fd, reinterpret_cast<const uint8_t*>(&response), sizeof(response), headerSent)) == SocketStatus::WouldBlock) {
+        co_await waitFor(conn, EPOLLOUT);
+    }
+    if (status == SocketStatus::Done && !toFd) {
+        size_t payloadSent = 0;
+        while ((status = sendSome(fd, payload.data(), payload.size(), payloadSent)) == SocketStatus::WouldBlock) {
+            co_await waitFor(conn, EPOLLOUT);
+        }
+    }
+    bool sent = status == SocketStatus::Done;
+
+    m_requests.fetch_add(1, std::memory_order_relaxed);
+    m_bytesIn.fetch_add(input.size(), std::memory_order_relaxed);
+    m_bytesOut.fetch_add(payload.size(), std::memory_order_relaxed);
+    if (response.code != ServeStatusOk) {
+        m_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+    recordLatency(std::chrono::steady_clock::now() - start);
+
+    if (m_options.verbose) {
+        std::lock_guard<std::mutex> lock(m_logMutex);
+        std::cerr << "[fd " << fd << "] request " << request.requestId << " op " << int(request.code)
+            << ": " << input.size() << " B -> " << payload.size() << " B, status " << int(response.code);
+        if (!error.empty()) std::cerr << " (" << error << ")";
+        std::cerr << "\n";
+    }
+
+    // 大请求之后不长期占用内存（空闲连接可能很多）
+    trimBuffer(input);
+    trimBuffer(result);
+    trimBuffer(conn.image.pixels);
+    co_return sent && keepConnection;
+}
+
+void Server::recordLatency(std::chrono::steady_clock::duration elapsed) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    size_t bucket = std::min(static_cast<size_t>(std::max<long long>(0, us)), kLatencyBuckets - 1);
+    m_latency[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Server::printSummary() const {
+    uint64_t total = m_requests.load();
+    std::cout << "Served " << total << " requests (" << m_failures.load() << " failed), "
+        << m_bytesIn.load() << " B in, " << m_bytesOut.load() << " B out\n";
+    if (total == 0) return;
+
+    auto percentile = [&](double p) {
+        uint64_t target = static_cast<uint64_t>(p * (total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kLatencyBuckets; i++) {
+            seen += m_latency[i].load();
+            if (seen >= target) return i;
+        }
+        return kLatencyBuckets - 1;
+    };
+    std::cout << "Service time: p50 " << percentile(0.50) << " us, p99 " << percentile(0.99)
+        << " us, p99.9 " << percentile(0.999) << " us\n";
+}
+
+} // namespace
+
+int runServe(const ServeOptions& options) {
+    try {
+        Server server(options);
+        return server.run();
+    }
+    catch (const QRACException& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
+
+} // namespace qrac
+
+#else
+
+namespace qrac {
+
+int runServe(const ServeOptions&) {
+    std::cerr << "Serve mode requires Linux (Unix domain sockets with SCM_RIGHTS)\n";
+    return 1;
+}
+
+} // namespace qrac
+
+#endif
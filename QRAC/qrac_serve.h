@@ -0,0 +1,85 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 常驻服务模式（qrac serve）
+ *
+ * 通过Unix域套接字提供编码/解码/校正/校验服务，避免每个文件启动一次进程。
+ * 编解码表在启动时构建一次，每个连接由一个协程处理并保留自己的缓冲区，
+ * 协程在工作窃取线程池上执行，等待套接字时挂起。
+ *
+ * 帧格式（小端序，请求和响应使用相同的32字节帧头）：
+ *   ServeHeader + length字节的内联数据
+ * 数据也可以通过SCM_RIGHTS传递文件描述符：
+ *   - ServeFlagInputFd：  输入从随帧头传入的第一个描述符读取（读到EOF）
+ *   - ServeFlagOutputFd： 结果写入随帧头传入的最后一个描述符，响应不带内联数据
+ * 失败时响应的code为非零状态，数据为错误信息文本。
+ *
+ * 仅支持Linux（epoll + SCM_RIGHTS）
+ ******************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "qrac.h"
+
+namespace qrac {
+
+constexpr uint32_t kServeRequestMagic = 0x31515251;  // "QRQ1"
+constexpr uint32_t kServeResponseMagic = 0x31535251; // "QRS1"
+constexpr uint64_t kServeMaxInlinePayload = 1ull << 30;
+
+// 请求操作
+enum ServeOp : uint8_t {
+    ServeOpPing = 0,
+    ServeOpEncode = 1,
+    ServeOpDecode = 2,
+    ServeOpCorrect = 3,
+    ServeOpVerify = 4   // 解码并比较数据哈希，响应数据为32字节的BLAKE3哈希
+};
+
+// 帧标志
+enum ServeFlags : uint8_t {
+    ServeFlagInputFd = 1 << 0,   // 请求：输入通过描述符传递
+    ServeFlagOutputFd = 1 << 1,  // 请求：输出写入描述符
+    ServeFlagAdaptive = 1 << 2,  // 请求：编码使用自适应尺寸（否则为自动模式）
+    ServeFlagRaw = 1 << 3,       // 图像为原始像素（width/height/channels在帧头中）而不是PNG
+    ServeFlagDataValid = 1 << 4, // 响应：解码数据通过FEC校验（校验操作：哈希与编码时记录的一致）
+    ServeFlagExact = 1 << 5,     // 请求：输入图像未经亮度/对比度处理，解码跳过电平校准（原始像素总是跳过）
+    ServeFlagDeflate = 1 << 6    // 请求：PNG输出使用deflate压缩（默认不压缩，以延迟换体积）
+};
+
+// 响应状态
+enum ServeStatus : uint8_t {
+    ServeStatusOk = 0,
+    ServeStatusBadRequest = 1,
+    ServeStatusIOError = 2,
+    ServeStatusCodecError = 3,   // QRACException，错误信息在数据中
+    ServeStatusInternalError = 4
+};
+
+#pragma pack(push, 1)
+struct ServeHeader {
+    uint32_t magic = 0;
+    uint8_t code = 0;       // 请求：ServeOp，响应：ServeStatus
+    uint8_t flags = 0;
+    uint16_t channels = 0;  // 原始像素的通道数
+    uint32_t requestId = 0; // 原样返回
+    int32_t width = 0;      // 原始像素尺寸
+    int32_t height = 0;
+    uint32_t reserved = 0;
+    uint64_t length = 0;    // 内联数据字节数（输出写入描述符时为写入的字节数）
+};
+#pragma pack(pop)
+static_assert(sizeof(ServeHeader) == 32, "ServeHeader must be 32 bytes");
+
+struct ServeOptions {
+    std::string socketPath;
+    unsigned threads = 0;
+    bool verbose = false;
+    QRACConfig profile;
+};
+
+// 运行服务直到收到SIGINT/SIGTERM，返回进程退出码
+int runServe(const ServeOptions& options);
+
+} // namespace qrac
@@ -0,0 +1,81 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 有界单生产者/单消费者无锁队列（流水线各阶段之间使用）
+ *
+ * 环形缓冲区，生产者只写m_tail，消费者只写m_head，不需要互斥锁。
+ * 队列满/空时先自旋再让出CPU，最后短暂休眠：流水线传递的是MB级数据块，
+ * 唤醒延迟可以忽略，空闲阶段也不会占满一个核心。
+ * 共享的取消标志被置位后，阻塞中的push/pop立即返回false。
+ ******************************************************************/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class SpscQueue {
+public:
+    SpscQueue(size_t capacity, const std::atomic<bool>& cancelled)
+        : m_cancelled(cancelled) {
+        size_t size = 2;
+        while (size < capacity + 1) {
+            size <<= 1;
+        }
+        m_slots.resize(size);
+        m_mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // 生产者：队列满时等待，取消时返回false
+    bool push(T item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        for (unsigned spins = 0; ((tail + 1) & m_mask) == m_head.load(std::memory_order_acquire); spins++) {
+            if (!backoff(spins)) return false;
+        }
+        m_slots[tail] = std::move(item);
+        m_tail.store((tail + 1) & m_mask, std::memory_order_release);
+        return true;
+    }
+
+    // 消费者：队列空时等待，取消时返回false
+    bool pop(T& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        for (unsigned spins = 0; head == m_tail.load(std::memory_order_acquire); spins++) {
+            if (!backoff(spins)) return false;
+        }
+        item = std::move(m_slots[head]);
+        m_slots[head] = T();
+        m_head.store((head + 1) & m_mask, std::memory_order_release);
+        return true;
+    }
+
+private:
+    bool backoff(unsigned spins) {
+        if (m_cancelled.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        if (spins < 64) {
+            // 忙等
+        }
+        else if (spins < 128) {
+            std::this_thread::yield();
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return true;
+    }
+
+    std::vector<T> m_slots;
+    size_t m_mask = 0;
+    const std::atomic<bool>& m_cancelled;
+
+    alignas(64) std::atomic<size_t> m_head{ 0 }; // 消费者位置
+    alignas(64) std::atomic<size_t> m_tail{ 0 }; // 生产者位置
+};
@@ -0,0 +1,145 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 作业统计实现
+ ******************************************************************/
+#include "qrac_stats.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+namespace qrac {
+
+void JobStats::addStage(const std::string& name, double seconds, size_t bytes, const PerfCounters& perf) {
+    for (StageStats& stage : stages) {
+        if (stage.name == name) {
+            stage.seconds += seconds;
+            stage.bytes += bytes;
+            stage.perf += perf;
+            return;
+        }
+    }
+    stages.push_back({ name, seconds, bytes, perf });
+}
+
+void JobStats::addStream(const StreamReport& report) {
+    for (const StageTime& stage : report.stages) {
+        addStage(stage.name, stage.busySeconds, stage.bytes, stage.perf);
+    }
+    frames += report.frames;
+    fecCorrectedBytes += report.correctedBytes;
+    fecFailedBlocks += report.failedBlocks;
+    fecErasures += report.erasures;
+    damagedBlocks += report.damagedBlocks;
+    fillerPixels += report.fillerPixels;
+    deviatingValues += report.deviatingValues;
+    calibratedFrames += report.calibratedFrames;
+    reusedFrames += report.reusedFrames;
+}
+
+void JobStats::merge(const JobStats& other) {
+    for (const StageStats& stage : other.stages) {
+        addStage(stage.name, stage.seconds, stage.bytes, stage.perf);
+    }
+    frames += other.frames;
+    fecCorrectedBytes += other.fecCorrectedBytes;
+    fecFailedBlocks += other.fecFailedBlocks;
+    fecErasures += other.fecErasures;
+    damagedBlocks += other.damagedBlocks;
+    fillerPixels += other.fillerPixels;
+    deviatingValues += other.deviatingValues;
+    calibratedFrames += other.calibratedFrames;
+    reusedFrames += other.reusedFrames;
+}
+
+namespace {
+
+double perByte(uint64_t count, size_t bytes) {
+    return bytes > 0 ? static_cast<double>(count) / bytes : 0.0;
+}
+
+// "perf":{...}，只写出有读数的计数器
+void writePerfJson(std::ostream& out, const PerfCounters& perf, size_t bytes) {
+    out << ",\"perf\":{";
+    const char* separator = "";
+    auto field = [&](const char* name, auto value) {
+        out << separator << "\"" << name << "\":" << value;
+        separator = ",";
+    };
+    if (perf.has(PerfCounters::kCycles)) field("cycles", perf.cycles);
+    if (perf.has(PerfCounters::kInstructions)) field("instructions", perf.instructions);
+    if (perf.has(PerfCounters::kCacheMisses)) field("llc_misses", perf.cacheMisses);
+    if (perf.has(PerfCounters::kBranchMisses)) field("branch_misses", perf.branchMisses);
+    out << std::setprecision(4);
+    if (perf.has(PerfCounters::kCycles) && perf.has(PerfCounters::kInstructions)) field("ipc", perf.ipc());
+    if (perf.has(PerfCounters::kCacheMisses)) field("llc_misses_per_byte", perByte(perf.cacheMisses, bytes));
+    if (perf.has(PerfCounters::kBranchMisses)) field("branch_misses_per_byte", perByte(perf.branchMisses, bytes));
+    out << "}";
+}
+
+} // namespace
+
+std::string formatPerfCounters(const PerfCounters& perf, size_t bytes) {
+    std::ostringstream text;
+    text << std::fixed;
+    const char* separator = "";
+    if (perf.has(PerfCounters::kCycles) && perf.has(PerfCounters::kInstructions)) {
+        text << "IPC " << std::setprecision(2) << perf.ipc();
+        separator = ", ";
+    }
+    if (perf.has(PerfCounters::kCacheMisses)) {
+        text << separator << std::setprecision(4) << perByte(perf.cacheMisses, bytes) << " LLC misses/B";
+        separator = ", ";
+    }
+    if (perf.has(PerfCounters::kBranchMisses)) {
+        text << separator << std::setprecision(4) << perByte(perf.branchMisses, bytes) << " branch misses/B";
+    }
+    return text.str();
+}
+
+std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (unsigned char c : text) {
+        switch (c) {
+        case '"': quoted += "\\\""; break;
+        case '\\': quoted += "\\\\"; break;
+        case '\n': quoted += "\\n"; break;
+        case '\r': quoted += "\\r"; break;
+        case '\t': quoted += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                quoted += escaped;
+            }
+            else {
+                quoted += static_cast<char>(c); // UTF-8原样输出
+            }
+        }
+    }
+    return quoted + "\"";
+}
+
+void writeStatsJson(std::ostream& out, const JobStats& stats) {
+    out << "\"frames\":" << stats.frames << ",\"stages\":[";
+    for (size_t i = 0; i < stats.stages.size(); i++) {
+        const StageStats& stage = stats.stages[i];
+        out << (i > 0 ? "," : "") << "{\"name\":" << jsonString(stage.name)
+            << ",\"seconds\":" << std::fixed << std::setprecision(6) << stage.seconds
+            << ",\"bytes\":" << stage.bytes;
+        if (stage.perf.valid()) {
+            writePerfJson(out, stage.perf, stage.bytes);
+        }
+        out << "}";
+    }
+    out << "],\"fec_corrected_bytes\":" << stats.fecCorrectedBytes
+        << ",\"fec_failed_blocks\":" << stats.fecFailedBlocks
+        << ",\"fec_erasures\":" << stats.fecErasures
+        << ",\"damaged_blocks\":" << stats.damagedBlocks
+        << ",\"filler_pixels\":" << stats.fillerPixels
+        << ",\"deviating_values\":" << stats.deviatingValues
+        << ",\"calibrated_frames\":" << stats.calibratedFrames
+        << ",\"reused_frames\":" << stats.reusedFrames;
+}
+
+} // namespace qrac
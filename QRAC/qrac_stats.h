@@ -0,0 +1,126 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 作业统计（--stats=json）
+ *
+ * 编码/解码/校正作业按阶段记录耗时（单调时钟）和输出的字节数，
+ * 以及FEC纠正的字节数、无法纠正的FEC块数和填充像素数，每个作业输出一行JSON。
+ * 库内部的阶段（FEC、符号打包/解包）由EncodeReport/DecodeReport报告耗时，
+ * 流式处理的阶段来自StreamReport（各阶段线程的忙碌时间）。
+ * 未启用统计时作业得到空指针，StageTimer不读取时钟，不产生任何开销。
+ * 启用--trace时StageTimer同时把各阶段记录为跟踪时间段（见qrac_trace.h），
+ * 启用--perf时同时读取硬件计数器，每个阶段附带IPC和每字节的未命中次数（见qrac_perf.h）。
+ ******************************************************************/
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "qrac_perf.h"
+#include "qrac_stream.h"
+#include "qrac_trace.h"
+
+namespace qrac {
+
+// 单个阶段：耗时、输出的字节数和硬件计数（--perf）
+struct StageStats {
+    std::string name;
+    double seconds = 0.0;
+    size_t bytes = 0;
+    PerfCounters perf;
+};
+
+// 单个作业（或合计）的统计
+struct JobStats {
+    std::vector<StageStats> stages; // 按首次出现的顺序
+    size_t frames = 0;              // 处理的帧数（整体编解码为1）
+    size_t fecCorrectedBytes = 0;
+    size_t fecFailedBlocks = 0;
+    size_t fecErasures = 0;         // Reed-Solomon：作为擦除交给解码器的字节数
+    size_t damagedBlocks = 0;       // 分块校验：FEC之前CRC32C不符的数据块数
+    size_t fillerPixels = 0;
+    size_t deviatingValues = 0;     // 校正/解码：偏离锚点的通道值数量
+    size_t calibratedFrames = 0;    // 解码：按校准后的电平解码的帧数
+    size_t reusedFrames = 0;        // 增量编码：从旧图像原样复制的帧数
+
+    // 同名阶段累加
+    void addStage(const std::string& name, double seconds, size_t bytes, const PerfCounters& perf = {});
+
+    // 流式处理的各阶段和计数
+    void addStream(const StreamReport& report);
+
+    // 合计（批处理汇总）
+    void merge(const JobStats& other);
+};
+
+// 顺序执行的阶段计时：lap()记录从上次记录/restart()（或构造）到现在的阶段
+// category为跟踪中的分类（encode/decode/correct）
+class StageTimer {
+public:
+    explicit StageTimer(JobStats* stats, const char* category = "job")
+        : m_stats(stats), m_category(category), m_active(stats || tracingEnabled()),
+          m_perf(stats && perfCountersEnabled()) {
+        restart();
+    }
+
+    void lap(const char* name, size_t bytes) {
+        if (!m_active) return;
+        auto now = TraceClock::now();
+        record(name, now, bytes, m_perf ? readPerfCounters() : PerfCounters{});
+    }
+
+    // 库内部连续执行、只报告了耗时的阶段（如encode()中的FEC和打包）：从上次记录的时刻起依次排列，
+    // 计数器取库阶段回调在该阶段结束时的读数
+    void split(const char* name, double seconds, size_t bytes) {
+        if (!m_active) return;
+        PerfCounters counters;
+        if (m_perf && !takeStageBoundary(name, counters)) {
+            counters = m_counters; // 没有读数：该阶段不计
+        }
+        record(name, m_last + std::chrono::duration_cast<TraceClock::duration>(std::chrono::duration<double>(seconds)),
+            bytes, counters);
+    }
+
+    // 跳过不属于任何阶段的时间
+    void restart() {
+        if (!m_active) return;
+        if (m_perf) {
+            clearStageBoundaries();
+            m_counters = readPerfCounters();
+        }
+        m_last = TraceClock::now();
+    }
+
+private:
+    void record(const char* name, TraceClock::time_point end, size_t bytes, const PerfCounters& counters) {
+        if (m_stats) {
+            m_stats->addStage(name, std::chrono::duration<double>(end - m_last).count(), bytes,
+                m_perf ? counters - m_counters : PerfCounters{});
+        }
+        if (tracingEnabled()) {
+            traceSpan(name, m_category, m_last, end);
+        }
+        m_last = end;
+        if (m_perf) m_counters = counters;
+    }
+
+    JobStats* m_stats;
+    const char* m_category;
+    bool m_active;
+    bool m_perf;
+    PerfCounters m_counters; // 上次记录时的读数
+    TraceClock::time_point m_last;
+};
+
+// 文本格式的阶段计数器说明，如"IPC 1.85, 0.012 LLC misses/B, 0.004 branch misses/B"，没有读数时为空
+std::string formatPerfCounters(const PerfCounters& perf, size_t bytes);
+
+// JSON字符串（含引号，转义控制字符）
+std::string jsonString(const std::string& text);
+
+// 写出统计字段（"frames":...,"stages":[...],...），不含外层花括号
+void writeStatsJson(std::ostream& out, const JobStats& stats);
+
+} // namespace qrac
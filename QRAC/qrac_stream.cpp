@@ -0,0 +1,679 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 流式编解码实现
+ ******************************************************************/
+#include "qrac_stream.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <stdexcept>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "qrac_spsc.h"
+#include "qrac_trace.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace qrac {
+
+namespace {
+
+constexpr std::array<uint8_t, 8> kPngSignature = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+// 读取最多size字节，只有在EOF时才会少于size
+size_t readFully(std::FILE* in, uint8_t* data, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        size_t n = std::fread(data + total, 1, size - total, in);
+        if (n == 0) {
+            if (std::ferror(in)) {
+                throw QRACException(ErrorType::FileReadError, "Failed to read input stream");
+            }
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+void writeFully(std::FILE* out, const uint8_t* data, size_t size) {
+    if (size > 0 && std::fwrite(data, 1, size, out) != size) {
+        throw QRACException(ErrorType::FileWriteError, "Failed to write output stream");
+    }
+}
+
+uint32_t readBigEndian32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+        (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+void writeBigEndian32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+}
+
+// 64位偏移的定位（大于2GB的旧图像）
+bool seekFile(std::FILE* file, int64_t offset, int origin) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, origin) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#endif
+}
+
+// 每帧的清单：辅助、私有的PNG数据块（解码器忽略），紧跟IHDR
+// 数据：版本(1) 保留(3) 输入字节数(4，大端) 配置标记(8) 输入数据的BLAKE3哈希(32)
+constexpr char kManifestChunk[] = "qrMf";
+constexpr uint8_t kManifestVersion = 1;
+constexpr size_t kManifestBytes = 48;
+constexpr size_t kIhdrEnd = 8 + 12 + 13; // 签名 + IHDR数据块
+
+using SettingsTag = std::array<uint8_t, 8>;
+
+struct FrameManifest {
+    uint32_t inputBytes = 0;
+    SettingsTag settings{};
+    PayloadHash hash{};
+};
+
+// 影响单帧编码结果的配置（流式编码总是自适应尺寸，与尺寸档位无关）的哈希前8字节
+SettingsTag frameSettingsTag(const QRACConfig& profile) {
+    uint32_t ratioBits;
+    std::memcpy(&ratioBits, &profile.FEC_REDUNDANCY_RATIO, sizeof(ratioBits));
+    std::ostringstream text;
+    text << "L=" << profile.L << ";filler=" << static_cast<int>(profile.FILLER_MAX_VALUE) << ";fec=" << ratioBits
+        << ";min=" << profile.MIN_IMAGE_DIMENSION << ";symbols=" << profile.SYMBOLS_PER_PIXEL
+        << ";fecblock=" << profile.FEC_BLOCK_SIZE << ";rs=" << profile.USE_ADVANCED_FEC << ";check=" << profile.CHECK_BLOCK_SIZE;
+    std::string settings = text.str();
+    PayloadHash hash = blake3(reinterpret_cast<const uint8_t*>(settings.data()), settings.size());
+    SettingsTag tag;
+    std::copy_n(hash.begin(), tag.size(), tag.begin());
+    return tag;
+}
+
+// 在IHDR之后插入清单数据块
+void insertManifestChunk(ByteBuffer& png, const FrameManifest& manifest) {
+    std::array<uint8_t, 12 + kManifestBytes> chunk{};
+    uint8_t* data = chunk.data() + 8;
+    writeBigEndian32(chunk.data(), static_cast<uint32_t>(kManifestBytes));
+    std::memcpy(chunk.data() + 4, kManifestChunk, 4);
+    data[0] = kManifestVersion;
+    writeBigEndian32(data + 4, manifest.inputBytes);
+    std::copy(manifest.settings.begin(), manifest.settings.end(), data + 8);
+    std::copy(manifest.hash.begin(), manifest.hash.end(), data + 16);
+    writeBigEndian32(data + kManifestBytes, pngChunkCrc(kManifestChunk, { data, kManifestBytes }));
+    png.insert(png.begin() + kIhdrEnd, chunk.begin(), chunk.end());
+}
+
+// 清单数据块的数据和CRC，版本或CRC不符时返回false
+bool parseManifestChunk(const uint8_t* body, FrameManifest& manifest) {
+    if (body[0] != kManifestVersion || readBigEndian32(body + kManifestBytes) != pngChunkCrc(kManifestChunk, { body, kManifestBytes })) {
+        return false;
+    }
+    manifest.inputBytes = readBigEndian32(body + 4);
+    std::copy_n(body + 8, manifest.settings.size(), manifest.settings.begin());
+    std::copy_n(body + 16, manifest.hash.size(), manifest.hash.begin());
+    return true;
+}
+
+// 多帧PNG中的一帧及其清单
+struct ScannedFrame {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    bool hasManifest = false;
+    FrameManifest manifest;
+};
+
+// 依次扫描各帧：只读取数据块头和清单，跳过图像数据；遇到截断或非PNG的数据时停止
+std::vector<ScannedFrame> scanFrames(std::FILE* file) {
+    std::vector<ScannedFrame> frames;
+    uint64_t offset = 0;
+    while (true) {
+        std::array<uint8_t, 8> signature{};
+        if (readFully(file, signature.data(), signature.size()) != signature.size() || signature != kPngSignature) {
+            break;
+        }
+        ScannedFrame frame;
+        frame.offset = offset;
+        frame.size = signature.size();
+        bool ended = false;
+        while (true) {
+            uint8_t chunkHeader[8];
+            if (readFully(file, chunkHeader, sizeof(chunkHeader)) != sizeof(chunkHeader)) {
+                break;
+            }
+            uint32_t length = readBigEndian32(chunkHeader);
+            if (length > 0x7FFFFFFFu) {
+                break;
+            }
+            if (std::memcmp(chunkHeader + 4, kManifestChunk, 4) == 0 && length == kManifestBytes) {
+                std::array<uint8_t, kManifestBytes + 4> body;
+                if (readFully(file, body.data(), body.size()) != body.size()) {
+                    break;
+                }
+                frame.hasManifest = parseManifestChunk(body.data(), frame.manifest);
+            }
+            else if (!seekFile(file, static_cast<int64_t>(length) + 4, SEEK_CUR)) {
+                break;
+            }
+            frame.size += sizeof(chunkHeader) + length + 4;
+            if (std::memcmp(chunkHeader + 4, "IEND", 4) == 0) {
+                ended = true;
+                break;
+            }
+        }
+        if (!ended) {
+            break;
+        }
+        offset += frame.size;
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+// 旧图像中可以原样复制的一帧
+struct PreviousFrame {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t inputBytes = 0;
+};
+
+// 按输入数据的哈希索引旧图像中配置相同的帧；没有清单的帧（之前的版本、整体编码的图像）不使用
+std::map<PayloadHash, PreviousFrame> scanPreviousFrames(std::FILE* previous, const SettingsTag& settings) {
+    std::map<PayloadHash, PreviousFrame> frames;
+    for (const ScannedFrame& frame : scanFrames(previous)) {
+        if (frame.hasManifest && frame.manifest.settings == settings) {
+            frames.emplace(frame.manifest.hash, PreviousFrame{ frame.offset, frame.size, frame.manifest.inputBytes });
+        }
+    }
+    return frames;
+}
+
+// 读取一帧PNG的剩余部分（签名已读入frame），直到IEND数据块
+void readPngFrame(std::FILE* in, std::vector<uint8_t>& frame) {
+    while (true) {
+        uint8_t chunkHeader[8];
+        if (readFully(in, chunkHeader, sizeof(chunkHeader)) != sizeof(chunkHeader)) {
+            throw QRACException(ErrorType::ImageLoadError, "Truncated PNG frame in input stream");
+        }
+
+        uint32_t length = readBigEndian32(chunkHeader);
+        if (length > 0x7FFFFFFFu || frame.size() + length + 12 > kStreamMaxFrameBytes) {
+            throw QRACException(ErrorType::ImageLoadError, "PNG frame in input stream is too large");
+        }
+
+        size_t offset = frame.size();
+        frame.resize(offset + sizeof(chunkHeader) + length + 4); // 数据 + CRC
+        std::memcpy(frame.data() + offset, chunkHeader, sizeof(chunkHeader));
+        size_t body = length + 4;
+        if (readFully(in, frame.data() + offset + sizeof(chunkHeader), body) != body) {
+            throw QRACException(ErrorType::ImageLoadError, "Truncated PNG frame in input stream");
+        }
+
+        if (std::memcmp(chunkHeader + 4, "IEND", 4) == 0) {
+            return;
+        }
+    }
+}
+
+// 流水线：每个阶段一个线程，任一阶段出错时取消所有队列，join时重新抛出第一个异常
+// 取消标志和队列要在Pipeline之前构造，保证析构时先等待线程结束
+class Pipeline {
+public:
+    explicit Pipeline(std::atomic<bool>& cancelled) : m_cancelled(cancelled) {}
+
+    ~Pipeline() {
+        m_cancelled = true;
+        for (auto& t : m_threads) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    // body(StageTime& stage)：累计忙碌时间、输出字节数和计数器
+    template <typename Body>
+    void stage(const char* name, Body body) {
+        if (m_count == m_times.size()) {
+            throw std::logic_error("too many pipeline stages");
+        }
+        size_t index = m_count++;
+        m_threads.emplace_back([this, index, name, body]() mutable {
+            setTraceThreadName(std::string("stream ") + name);
+            StageTime stage;
+            stage.name = name;
+            try {
+                body(stage);
+            }
+            catch (...) {
+                fail(std::current_exception());
+            }
+            m_times[index] = stage;
+        });
+    }
+
+    // 等待所有阶段结束，返回各阶段的忙碌时间
+    std::vector<StageTime> join() {
+        for (auto& t : m_threads) {
+            t.join();
+        }
+        m_threads.clear();
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+        return std::vector<StageTime>(m_times.begin(), m_times.begin() + m_count);
+    }
+
+private:
+    void fail(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+        if (!m_error) {
+            m_error = error;
+        }
+        m_cancelled = true;
+    }
+
+    std::atomic<bool>& m_cancelled;
+    std::vector<std::thread> m_threads;
+    std::array<StageTime, 8> m_times{};
+    size_t m_count = 0;
+    std::mutex m_errorMutex;
+    std::exception_ptr m_error;
+};
+
+// 累计一段工作的耗时（启用--perf时同时累计本线程的计数器）
+class BusyTimer {
+public:
+    explicit BusyTimer(StageTime& stage) : m_stage(stage), m_perf(perfCountersEnabled()) {
+        if (m_perf) m_counters = readPerfCounters();
+        m_start = std::chrono::steady_clock::now();
+    }
+    ~BusyTimer() {
+        m_stage.busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        if (m_perf) m_stage.perf += readPerfCounters() - m_counters;
+    }
+
+private:
+    StageTime& m_stage;
+    bool m_perf;
+    PerfCounters m_counters;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// 在两个队列之间运行一个阶段：取出、处理、传给下一阶段，空指针表示流结束
+// work返回本阶段输出的字节数；每帧的处理记录为一个跟踪时间段
+template <typename Item, typename Work>
+void relay(const char* name, SpscQueue<std::unique_ptr<Item>>& input, SpscQueue<std::unique_ptr<Item>>& output,
+    StageTime& stage, Work work) {
+    std::unique_ptr<Item> item;
+    while (input.pop(item) && item) {
+        {
+            TraceSpan span(name, "stream", static_cast<long long>(item->index));
+            BusyTimer timer(stage);
+            stage.bytes += work(*item);
+        }
+        if (!output.push(std::move(item))) {
+            return;
+        }
+    }
+    output.push(nullptr);
+}
+
+struct EncodeFrame {
+    size_t index = 0;
+    std::vector<uint8_t> data; // 输入数据，FEC阶段后追加校验字节
+    size_t inputBytes = 0;
+    FrameManifest manifest;
+    bool reused = false;       // 增量编码：png为旧图像中内容相同的帧，跳过FEC、打包和压缩
+    Image image;
+    ByteBuffer png;
+};
+
+struct DecodeFrame {
+    size_t index = 0;
+    std::vector<uint8_t> encoded; // PNG/BMP文件内容
+    Image image;
+    std::vector<uint8_t> data;
+    std::vector<size_t> erasures; // Reed-Solomon：低置信度符号所在的字节
+    bool dataValid = true;
+    bool hasHash = false;         // 编码时记录的数据哈希（校验模式使用）
+    PayloadHash hash{};
+};
+
+} // namespace
+
+void setBinaryMode(std::FILE* file) {
+#ifdef _WIN32
+    _setmode(_fileno(file), _O_BINARY);
+#else
+    (void)file;
+#endif
+}
+
+void encodeStream(const CodecContext& ctx, std::FILE* in, std::FILE* out, StreamReport* report, size_t chunkBytes,
+    std::FILE* previous) {
+    encodeStream(ctx, [in](uint8_t* data, size_t size) { return readFully(in, data, size); }, out, report, chunkBytes, previous);
+}
+
+void encodeStream(const CodecContext& ctx, const StreamReader& read, std::FILE* out, StreamReport* report, size_t chunkBytes,
+    std::FILE* previous) {
+    StreamReport local;
+    if (chunkBytes == 0) {
+        chunkBytes = kStreamChunkBytes;
+    }
+    const SettingsTag settings = frameSettingsTag(ctx.profile());
+    std::map<PayloadHash, PreviousFrame> previousFrames;
+    if (previous) {
+        previousFrames = scanPreviousFrames(previous, settings);
+    }
+
+    using Queue = SpscQueue<std::unique_ptr<EncodeFrame>>;
+    std::atomic<bool> cancelled{ false };
+    Queue toFec(kStreamQueueDepth, cancelled);
+    Queue toPack(kStreamQueueDepth, cancelled);
+    Queue toDeflate(kStreamQueueDepth, cancelled);
+    Queue toWrite(kStreamQueueDepth, cancelled);
+    Pipeline pipeline(cancelled);
+
+    // 读取：按块切分输入，空输入也产生一帧
+    pipeline.stage("read", [&](StageTime& stage) {
+        for (size_t frames = 0;; frames++) {
+            auto frame = std::make_unique<EncodeFrame>();
+            frame->index = frames;
+            {
+                TraceSpan span("read", "stream", static_cast<long long>(frames));
+                BusyTimer timer(stage);
+                frame->data.resize(chunkBytes);
+                frame->data.resize(read(frame->data.data(), chunkBytes));
+                frame->inputBytes = frame->data.size();
+                frame->manifest = { static_cast<uint32_t>(frame->inputBytes), settings, blake3(frame->data.data(), frame->data.size()) };
+                stage.bytes += frame->inputBytes;
+
+                // 增量编码：旧图像中有内容和配置都相同的帧时直接读出（编码结果与重新编码相同）
+                auto match = previousFrames.find(frame->manifest.hash);
+                if (match != previousFrames.end() && match->second.inputBytes == frame->inputBytes &&
+                    seekFile(previous, static_cast<int64_t>(match->second.offset), SEEK_SET)) {
+                    frame->png.resize(match->second.size);
+                    frame->reused = readFully(previous, frame->png.data(), frame->png.size()) == frame->png.size();
+                    if (frame->reused) {
+                        std::vector<uint8_t>().swap(frame->data);
+                    }
+                    else {
+                        ByteBuffer().swap(frame->png);
+                    }
+                }
+            }
+            if (frame->inputBytes == 0 && frames > 0) {
+                break;
+            }
+            bool last = frame->inputBytes < chunkBytes;
+            if (!toFec.push(std::move(frame))) return;
+            if (last) break;
+        }
+        toFec.push(nullptr);
+    });
+
+    pipeline.stage("fec", [&](StageTime& stage) {
+        relay("fec", toFec, toPack, stage, [&](EncodeFrame& frame) {
+            if (frame.reused) return size_t(0);
+            addFEC(ctx, frame.data);
+            return frame.data.size();
+        });
+    });
+
+    // 符号打包：与encode()的自适应模式输出相同
+    pipeline.stage("pack", [&](StageTime& stage) {
+        relay("pack", toPack, toDeflate, stage, [&](EncodeFrame& frame) {
+            if (frame.reused) return size_t(0);
+            Image& image = frame.image;
+            encodedImageDimensions(ctx, frame.inputBytes, SizeMode::Adaptive, &image.width, &image.height);
+            image.channels = 3;
+            image.pixels = createQRACImage(ctx, dataToSymbols(ctx, frame.data), image.width, image.height);
+            std::vector<uint8_t>().swap(frame.data);
+            return image.pixels.size();
+        });
+    });
+
+    pipeline.stage("deflate", [&](StageTime& stage) {
+        relay("deflate", toDeflate, toWrite, stage, [&](EncodeFrame& frame) {
+            if (frame.reused) return size_t(0);
+            frame.png = encodePng(frame.image.view());
+            ByteBuffer().swap(frame.image.pixels);
+            insertManifestChunk(frame.png, frame.manifest);
+            return frame.png.size();
+        });
+    });
+
+    pipeline.stage("write", [&](StageTime& stage) {
+        std::unique_ptr<EncodeFrame> frame;
+        while (toWrite.pop(frame) && frame) {
+            TraceSpan span("write", "stream", static_cast<long long>(frame->index));
+            BusyTimer timer(stage);
+            writeFully(out, frame->png.data(), frame->png.size());
+            stage.bytes += frame->png.size();
+            local.lastFrameOffset = local.bytesOut;
+            local.lastFrameInputBytes = frame->inputBytes;
+            local.lastFrameHash = frame->manifest.hash;
+            local.frames++;
+            local.reusedFrames += frame->reused ? 1 : 0;
+            local.bytesIn += frame->inputBytes;
+            local.bytesOut += frame->png.size();
+        }
+    });
+
+    local.stages = pipeline.join();
+    if (std::fflush(out) != 0) {
+        throw QRACException(ErrorType::FileWriteError, "Failed to write output stream");
+    }
+    if (report) {
+        *report = std::move(local);
+    }
+}
+
+std::vector<StreamFrame> listStreamFrames(std::FILE* image) {
+    std::vector<StreamFrame> frames;
+    uint64_t inputOffset = 0;
+    for (const ScannedFrame& scanned : scanFrames(image)) {
+        if (!scanned.hasManifest) {
+            throw QRACException(ErrorType::ImageLoadError, "PNG frame without a frame manifest, cannot locate data for random access");
+        }
+        frames.push_back({ scanned.offset, scanned.size, inputOffset, scanned.manifest.inputBytes });
+        inputOffset += scanned.manifest.inputBytes;
+    }
+    if (frames.empty()) {
+        throw QRACException(ErrorType::ImageLoadError, "No complete PNG frame found");
+    }
+    return frames;
+}
+
+ByteBuffer decodeStreamFrame(const CodecContext& ctx, std::FILE* image, const StreamFrame& frame, DecodeReport* report) {
+    // 先检查帧大小再分配：frame.size来自文件，损坏的文件不能触发巨大的分配
+    if (frame.size > kStreamMaxFrameBytes) {
+        throw QRACException(ErrorType::ImageLoadError, "Cannot read PNG frame at offset " + std::to_string(frame.offset));
+    }
+    std::vector<uint8_t> encoded(static_cast<size_t>(frame.size));
+    if (!seekFile(image, static_cast<int64_t>(frame.offset), SEEK_SET) ||
+        readFully(image, encoded.data(), encoded.size()) != encoded.size()) {
+        throw QRACException(ErrorType::ImageLoadError, "Cannot read PNG frame at offset " + std::to_string(frame.offset));
+    }
+    Image decoded = loadImage(encoded);
+    std::vector<uint8_t>().swap(encoded);
+    ByteBuffer data = decode(decoded.view(), ctx, report);
+    if (data.size() != frame.inputBytes) {
+        throw QRACException(ErrorType::DataSizeError, "Frame at offset " + std::to_string(frame.offset) +
+            " decoded to " + std::to_string(data.size()) + " bytes, manifest records " + std::to_string(frame.inputBytes));
+    }
+    return data;
+}
+
+void decodeStream(const CodecContext& ctx, std::FILE* in, std::FILE* out, StreamReport* report) {
+    StreamReport local;
+
+    using Queue = SpscQueue<std::unique_ptr<DecodeFrame>>;
+    std::atomic<bool> cancelled{ false };
+    Queue toInflate(kStreamQueueDepth, cancelled);
+    Queue toUnpack(kStreamQueueDepth, cancelled);
+    Queue toFec(kStreamQueueDepth, cancelled);
+    Queue toWrite(kStreamQueueDepth, cancelled);
+    Pipeline pipeline(cancelled);
+
+    // 读取：按IEND切分PNG帧；其他格式整体作为一帧
+    pipeline.stage("read", [&](StageTime& stage) {
+        std::array<uint8_t, 8> signature{};
+        size_t got;
+        {
+            BusyTimer timer(stage);
+            got = readFully(in, signature.data(), signature.size());
+        }
+        if (got == 0) {
+            throw QRACException(ErrorType::ImageLoadError, "Input stream is empty");
+        }
+
+        if (got == signature.size() && signature == kPngSignature) {
+            for (size_t frames = 0;; frames++) {
+                auto frame = std::make_unique<DecodeFrame>();
+                frame->index = frames;
+                {
+                    TraceSpan span("read", "stream", static_cast<long long>(frames));
+                    BusyTimer timer(stage);
+                    frame->encoded.assign(signature.begin(), signature.end());
+                    readPngFrame(in, frame->encoded);
+                    stage.bytes += frame->encoded.size();
+                }
+                if (!toInflate.push(std::move(frame))) return;
+
+                {
+                    BusyTimer timer(stage);
+                    got = readFully(in, signature.data(), signature.size());
+                }
+                if (got == 0) {
+                    break;
+                }
+                if (got != signature.size() || signature != kPngSignature) {
+                    throw QRACException(ErrorType::ImageLoadError, "Unexpected data after PNG frame in input stream");
+                }
+            }
+        }
+        else {
+            auto frame = std::make_unique<DecodeFrame>();
+            {
+                TraceSpan span("read", "stream", 0);
+                BusyTimer timer(stage);
+                frame->encoded.assign(signature.begin(), signature.begin() + got);
+                std::array<uint8_t, 64 * 1024> buffer;
+                size_t n;
+                while ((n = readFully(in, buffer.data(), buffer.size())) > 0) {
+                    if (frame->encoded.size() + n > kStreamMaxFrameBytes) {
+                        throw QRACException(ErrorType::ImageLoadError, "Input image is too large");
+                    }
+                    frame->encoded.insert(frame->encoded.end(), buffer.begin(), buffer.begin() + n);
+                }
+                stage.bytes += frame->encoded.size();
+            }
+            if (!toInflate.push(std::move(frame))) return;
+        }
+        toInflate.push(nullptr);
+    });
+
+    pipeline.stage("inflate", [&](StageTime& stage) {
+        relay("inflate", toInflate, toUnpack, stage, [&](DecodeFrame& frame) {
+            frame.image = loadImage(frame.encoded);
+            local.bytesIn += frame.encoded.size(); // 只有本阶段写入
+            std::vector<uint8_t>().swap(frame.encoded);
+            return frame.image.pixels.size();
+        });
+    });
+
+    // 计数只由各自的阶段写入
+    pipeline.stage("unpack", [&](StageTime& stage) {
+        relay("unpack", toUnpack, toFec, stage, [&](DecodeFrame& frame) {
+            size_t deviating = 0;
+            bool softDecision = ctx.profile().USE_ADVANCED_FEC;
+            std::vector<uint8_t> confidence;
+            LevelCalibration calibration;
+            if (ctx.profile().CALIBRATE_LEVELS) {
+                calibration = calibrateLevels(ctx, frame.image.view());
+            }
+            std::vector<int> symbols = extractSymbols(ctx, frame.image.view(), &deviating, softDecision ? &confidence : nullptr,
+                &calibration);
+            local.deviatingValues += deviating;
+            local.calibratedFrames += calibration.applied ? 1 : 0;
+            local.fillerPixels += static_cast<size_t>(std::count(symbols.begin(), symbols.end(), -1)) / ctx.symbolsPerPixel();
+            frame.data = softDecision
+                ? symbolsToData(symbols, ctx.bitsPerSymbol(), confidence, ctx.erasureThreshold(), frame.erasures)
+                : symbolsToData(symbols, ctx.bitsPerSymbol());
+            ByteBuffer().swap(frame.image.pixels);
+            return frame.data.size();
+        });
+    });
+
+    pipeline.stage("fec", [&](StageTime& stage) {
+        relay("fec", toFec, toWrite, stage, [&](DecodeFrame& frame) {
+            FECReport fec;
+            frame.dataValid = verifyAndCorrectFEC(ctx, frame.data, &fec, frame.erasures);
+            std::vector<size_t>().swap(frame.erasures);
+            local.correctedBytes += fec.correctedBytes;
+            local.failedBlocks += fec.failedBlocks;
+            local.erasures += fec.erasures;
+            local.damagedBlocks += fec.damagedBlocks.size();
+            frame.hasHash = fec.hasPayloadHash;
+            frame.hash = fec.payloadHash;
+            return frame.data.size();
+        });
+    });
+
+    // 写出；校验模式（out为空）时代替写出，重新计算每帧数据的哈希并与编码时记录的比较
+    bool verifying = out == nullptr;
+    const char* lastStage = verifying ? "hash" : "write";
+    pipeline.stage(lastStage, [&](StageTime& stage) {
+        std::unique_ptr<DecodeFrame> frame;
+        while (toWrite.pop(frame) && frame) {
+            TraceSpan span(lastStage, "stream", static_cast<long long>(frame->index));
+            BusyTimer timer(stage);
+            if (verifying) {
+                if (!frame->hasHash) {
+                    local.unhashedFrames++;
+                }
+                else if (blake3(frame->data.data(), frame->data.size()) != frame->hash) {
+                    local.hashMismatches++;
+                }
+            }
+            else {
+                writeFully(out, frame->data.data(), frame->data.size());
+            }
+            stage.bytes += frame->data.size();
+            if (local.head.size() < kStreamHeadBytes) {
+                size_t take = std::min(kStreamHeadBytes - local.head.size(), frame->data.size());
+                local.head.insert(local.head.end(), frame->data.begin(), frame->data.begin() + take);
+            }
+            local.frames++;
+            local.bytesOut += frame->data.size();
+            if (!frame->dataValid) {
+                local.invalidFrames++;
+            }
+        }
+    });
+
+    local.stages = pipeline.join();
+    if (!verifying && std::fflush(out) != 0) {
+        throw QRACException(ErrorType::FileWriteError, "Failed to write output stream");
+    }
+    if (report) {
+        *report = std::move(local);
+    }
+}
+
+} // namespace qrac
@@ -0,0 +1,111 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 流式编解码（标准输入/输出、管道）
+ *
+ * 输入长度未知时按块编码：每kStreamChunkBytes字节输入生成一帧独立的QRAC PNG，
+ * 多帧直接首尾相接输出。解码时按PNG数据块结构（直到IEND）切分帧，
+ * 逐帧解码并立即写出，内存占用只与块大小有关，与总长度无关。
+ * 单帧的流就是普通的QRAC PNG文件，可以用其他模式解码。
+ *
+ * 每帧在IHDR之后带一个清单数据块（qrMf，辅助数据块，解码器忽略）：输入字节数、配置标记和输入数据的BLAKE3哈希。
+ * 增量编码时扫描旧图像的清单（跳过图像数据），新输入中内容和配置都相同的帧直接复制旧图像中的PNG字节，
+ * 只有变化的帧经过FEC、打包和压缩，编码时间与变化的数据量成正比，结果与完整编码相同。
+ *
+ * 编码和解码各由5个阶段组成，每个阶段一个线程，阶段之间用有界SPSC队列连接，
+ * 不同的帧在不同阶段上同时处理，总耗时取决于最慢的阶段而不是各阶段之和：
+ *   编码：读取 -> FEC -> 符号打包 -> 滤波/压缩(PNG) -> 写出
+ *   解码：读取帧 -> 解压/反滤波 -> 符号解包 -> FEC校验 -> 写出（校验模式为计算哈希）
+ ******************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "qrac.h"
+#include "qrac_perf.h"
+
+namespace qrac {
+
+// 每帧的输入字节数（4MB数据约对应2.8M像素）
+constexpr size_t kStreamChunkBytes = 4 * 1024 * 1024;
+
+// 单帧PNG的大小上限（防止损坏的输入导致无限制分配）
+constexpr size_t kStreamMaxFrameBytes = 1024ull * 1024 * 1024;
+
+// 每个阶段之间最多排队的帧数（决定内存上限）
+constexpr size_t kStreamQueueDepth = 2;
+
+// 同时存在的帧数上限：5个阶段各处理一帧，4个队列各排队kStreamQueueDepth帧
+constexpr size_t kStreamFramesInFlight = 5 + 4 * kStreamQueueDepth;
+
+// 解码时保留的输出开头字节数（用于识别文件类型）
+constexpr size_t kStreamHeadBytes = 4096;
+
+// 流水线阶段的忙碌时间（不含等待队列的时间）和输出的字节数
+struct StageTime {
+    const char* name = "";
+    double busySeconds = 0.0;
+    size_t bytes = 0;
+    PerfCounters perf; // 启用--perf时忙碌期间的硬件计数
+};
+
+struct StreamReport {
+    size_t bytesIn = 0;
+    size_t bytesOut = 0;
+    size_t frames = 0;
+    size_t reusedFrames = 0;   // 增量编码：从旧图像原样复制的帧
+    size_t lastFrameOffset = 0;     // 编码：最后一帧在本次输出中的位置（追加编码据此续写）
+    size_t lastFrameInputBytes = 0; // 编码：最后一帧的输入字节数
+    PayloadHash lastFrameHash{};    // 编码：最后一帧输入数据的BLAKE3哈希
+    size_t invalidFrames = 0; // FEC未能完全校正的帧
+    size_t correctedBytes = 0; // 解码：FEC纠正的字节数
+    size_t failedBlocks = 0;   // 解码：无法纠正的FEC块数
+    size_t fillerPixels = 0;   // 解码：填充像素数
+    size_t deviatingValues = 0; // 解码：提取时吸附到锚点的颜色值数
+    size_t erasures = 0;       // 解码：标记为擦除的字节数（Reed-Solomon）
+    size_t damagedBlocks = 0;  // 解码：FEC之前CRC32C不符的数据块数（分块校验）
+    size_t calibratedFrames = 0; // 解码：按校准后的电平解码的帧数
+    size_t hashMismatches = 0; // 校验：重新计算的哈希与编码时记录的不同的帧数
+    size_t unhashedFrames = 0; // 校验：没有可读的哈希的帧数（分块校验损坏，或--check-block off、之前的版本编码）
+    std::vector<StageTime> stages;
+    std::vector<uint8_t> head; // 解码：输出数据的前kStreamHeadBytes字节
+};
+
+// 将标准输入/输出切换为二进制模式（Windows下默认是文本模式）
+void setBinaryMode(std::FILE* file);
+
+// 编码：读取in直到EOF，每chunkBytes字节输出一帧PNG（自适应尺寸）
+// 空输入也输出一帧（解码为空数据）
+// previous非空时为增量编码：previous是旧版本的编码结果（可定位的文件，不能与out相同），内容相同的帧从中复制
+void encodeStream(const CodecContext& ctx, std::FILE* in, std::FILE* out,
+    StreamReport* report = nullptr, size_t chunkBytes = kStreamChunkBytes, std::FILE* previous = nullptr);
+
+// 编码的输入来源：读取最多size字节，只有在输入结束时才少于size；出错时抛出QRACException
+using StreamReader = std::function<size_t(uint8_t* data, size_t size)>;
+
+// 编码：从read读取输入（生成的数据，如归档），其他同上
+void encodeStream(const CodecContext& ctx, const StreamReader& read, std::FILE* out,
+    StreamReport* report = nullptr, size_t chunkBytes = kStreamChunkBytes, std::FILE* previous = nullptr);
+
+// 解码：依次读取PNG帧并写出数据；非PNG输入（BMP等）整体读入后按单帧解码
+// out为空时为校验模式：不写出数据，每帧解码后重新计算哈希，与编码时记录的比较（hashMismatches、unhashedFrames）
+void decodeStream(const CodecContext& ctx, std::FILE* in, std::FILE* out, StreamReport* report = nullptr);
+
+// 多帧PNG中一帧的位置（随机访问）
+struct StreamFrame {
+    uint64_t offset = 0;      // 在文件中的位置
+    uint64_t size = 0;        // PNG字节数
+    uint64_t inputOffset = 0; // 该帧数据在整个数据中的位置
+    uint64_t inputBytes = 0;  // 该帧的数据字节数
+};
+
+// 扫描多帧PNG（image须可定位），只读取数据块头和清单，跳过图像数据；有帧没有清单（之前的版本编码）时抛出异常
+std::vector<StreamFrame> listStreamFrames(std::FILE* image);
+
+// 读取并解码其中一帧，不需要解码之前的帧；FEC未能完全校正时report->dataValid为false
+ByteBuffer decodeStreamFrame(const CodecContext& ctx, std::FILE* image, const StreamFrame& frame,
+    DecodeReport* report = nullptr);
+
+} // namespace qrac
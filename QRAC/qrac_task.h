@@ -0,0 +1,230 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * C++20协程任务（批处理模式和服务模式使用）
+ *
+ * Task<T>：惰性协程，被co_await时才开始执行，完成后通过对称转移
+ *          直接恢复等待者，异常在co_await处重新抛出。
+ * 执行器是WorkStealingPool：协程在等待I/O时挂起，不占用线程，
+ * I/O完成后由回调把协程重新提交到线程池继续执行。
+ * 这样成千上万个进行中的作业/连接只需要少量线程。
+ ******************************************************************/
+#pragma once
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace qrac {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr error;
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            return handle.promise().continuation;
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T result) { value = std::move(result); }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+};
+
+} // namespace detail
+
+template <typename T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle) : m_handle(handle) {}
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (m_handle) m_handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+
+    T await_resume() {
+        promise_type& promise = m_handle.promise();
+        if (promise.error) {
+            std::rethrow_exception(promise.error);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*promise.value);
+        }
+    }
+
+private:
+    Handle m_handle;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+// 顶层协程：创建后挂起，由post()启动，完成后自动释放
+// 挂起中（从未完成）的顶层协程可以用handle.destroy()销毁，连带销毁它等待的Task
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() {
+            return { std::coroutine_handle<promise_type>::from_promise(*this) };
+        }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); } // 顶层任务必须自己处理异常
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// 运行task直到结束，然后调用done（可为空）
+inline DetachedTask detach(Task<void> task, std::function<void()> done = {}) {
+    co_await task;
+    if (done) {
+        done();
+    }
+}
+
+// 在执行器上恢复协程
+template <typename Executor>
+void post(Executor& executor, std::coroutine_handle<> handle) {
+    executor.submit([handle] { handle.resume(); });
+}
+
+// co_await resumeOn(pool)：切换到线程池中继续执行
+template <typename Executor>
+auto resumeOn(Executor& executor) {
+    struct Awaiter {
+        Executor& executor;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { post(executor, handle); }
+        void await_resume() const noexcept {}
+    };
+    return Awaiter{ executor };
+}
+
+// 把回调式异步操作包装为可co_await的对象：
+// start(done)发起操作，done()被调用后（可以在任意线程、也可以在start内部）协程在执行器上恢复
+template <typename Executor, typename Start>
+auto awaitCallback(Executor& executor, Start start) {
+    struct Awaiter {
+        Executor& executor;
+        Start start;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            // done可能在start返回前就恢复协程，之后不能再访问本对象
+            Executor* target = &executor;
+            start([target, handle] { post(*target, handle); });
+        }
+        void await_resume() const noexcept {}
+    };
+    return Awaiter{ executor, std::move(start) };
+}
+
+// 异步信号量：限制同时进行的作业数，等待时挂起协程而不是阻塞线程
+template <typename Executor>
+class AsyncSemaphore {
+public:
+    AsyncSemaphore(Executor& executor, size_t count) : m_executor(executor), m_count(count) {}
+
+    auto acquire() {
+        struct Awaiter {
+            AsyncSemaphore& semaphore;
+            bool await_ready() {
+                std::lock_guard<std::mutex> lock(semaphore.m_mutex);
+                if (semaphore.m_count > 0) {
+                    semaphore.m_count--;
+                    return true;
+                }
+                return false;
+            }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                std::lock_guard<std::mutex> lock(semaphore.m_mutex);
+                if (semaphore.m_count > 0) {
+                    semaphore.m_count--;
+                    return false; // 期间有人释放，不挂起
+                }
+                semaphore.m_waiters.push_back(handle);
+                return true;
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{ *this };
+    }
+
+    void release() {
+        std::coroutine_handle<> next;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_waiters.empty()) {
+                m_count++;
+                return;
+            }
+            next = m_waiters.front();
+            m_waiters.pop_front();
+        }
+        post(m_executor, next);
+    }
+
+private:
+    Executor& m_executor;
+    std::mutex m_mutex;
+    size_t m_count;
+    std::deque<std::coroutine_handle<>> m_waiters;
+};
+
+} // namespace qrac
@@ -0,0 +1,111 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 跟踪记录实现
+ *
+ * 每个线程第一次记录时在全局登记一个缓冲区（之后只由该线程追加），
+ * 缓冲区在线程结束后保留，写出时按线程输出thread_name元数据和X（完整）事件。
+ ******************************************************************/
+#include "qrac_trace.h"
+
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "qrac_stats.h"
+
+namespace qrac {
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    TraceClock::time_point begin;
+    TraceClock::time_point end;
+    long long index;
+    std::string detail;
+};
+
+struct ThreadTrace {
+    size_t tid = 0;
+    std::string name;
+    std::vector<TraceEvent> events;
+};
+
+std::mutex g_registryMutex;
+std::vector<std::unique_ptr<ThreadTrace>> g_threads;
+TraceClock::time_point g_epoch;
+thread_local ThreadTrace* t_trace = nullptr;
+
+ThreadTrace& threadTrace() {
+    if (!t_trace) {
+        auto trace = std::make_unique<ThreadTrace>();
+        trace->events.reserve(1024);
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        trace->tid = g_threads.size() + 1;
+        trace->name = "thread " + std::to_string(trace->tid);
+        t_trace = trace.get();
+        g_threads.push_back(std::move(trace));
+    }
+    return *t_trace;
+}
+
+// 相对于开始记录时刻的微秒数
+double microseconds(TraceClock::time_point time) {
+    return std::chrono::duration<double, std::micro>(time - g_epoch).count();
+}
+
+} // namespace
+
+void enableTracing() {
+    g_epoch = TraceClock::now();
+    trace_detail::enabled.store(true, std::memory_order_release);
+    setTraceThreadName("main");
+}
+
+void setTraceThreadName(const std::string& name) {
+    if (tracingEnabled()) {
+        threadTrace().name = name;
+    }
+}
+
+void traceSpan(const char* name, const char* category, TraceClock::time_point begin, TraceClock::time_point end,
+    long long index, const std::string& detail) {
+    threadTrace().events.push_back({ name, category, begin, end, index, detail });
+}
+
+size_t writeTrace(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    size_t count = 0;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << std::fixed << std::setprecision(3);
+    bool first = true;
+    for (const std::unique_ptr<ThreadTrace>& thread : g_threads) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->tid
+            << ",\"args\":{\"name\":" << jsonString(thread->name) << "}}";
+        first = false;
+        for (const TraceEvent& event : thread->events) {
+            out << ",\n{\"name\":" << jsonString(event.name) << ",\"cat\":" << jsonString(event.category)
+                << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->tid
+                << ",\"ts\":" << microseconds(event.begin)
+                << ",\"dur\":" << std::chrono::duration<double, std::micro>(event.end - event.begin).count();
+            if (event.index >= 0 || !event.detail.empty()) {
+                out << ",\"args\":{";
+                if (event.index >= 0) {
+                    out << "\"frame\":" << event.index;
+                }
+                if (!event.detail.empty()) {
+                    out << (event.index >= 0 ? "," : "") << "\"detail\":" << jsonString(event.detail);
+                }
+                out << "}";
+            }
+            out << "}";
+            count++;
+        }
+    }
+    out << "\n]}\n";
+    return count;
+}
+
+} // namespace qrac
@@ -0,0 +1,71 @@
+﻿/******************************************************************
+ * QRAC - Quantitative Random Access Codes
+ * 跟踪记录（--trace，Chrome/Perfetto trace-event格式）
+ *
+ * 启用后，作业的各阶段、流水线每一帧在每个阶段上的处理都记录为一个时间段
+ * （开始时间、持续时间、线程），结束时写成trace-event JSON，
+ * 可以在chrome://tracing或ui.perfetto.dev中查看各线程上的阶段如何重叠。
+ * 每个线程写自己的缓冲区，记录时不加锁；只有线程第一次记录时登记一次。
+ * 写出时所有记录线程必须已经结束或空闲（线程池已等待完成、流水线已join）。
+ * 未启用时TraceSpan只读取一个原子标志。
+ ******************************************************************/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+namespace qrac {
+
+using TraceClock = std::chrono::steady_clock;
+
+namespace trace_detail {
+inline std::atomic<bool> enabled{ false };
+}
+
+inline bool tracingEnabled() {
+    return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// 开始记录（时间戳从此刻起算），调用线程命名为main
+void enableTracing();
+
+// 当前线程在跟踪中显示的名称（未启用时忽略）
+void setTraceThreadName(const std::string& name);
+
+// 记录一个时间段；index为帧序号（-1表示无），detail为附加说明（如文件名）
+void traceSpan(const char* name, const char* category, TraceClock::time_point begin, TraceClock::time_point end,
+    long long index = -1, const std::string& detail = {});
+
+// 写出trace-event JSON（{"traceEvents":[...]}），返回记录数
+size_t writeTrace(std::ostream& out);
+
+// 作用域内的时间段
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const char* category, long long index = -1, std::string detail = {})
+        : m_name(name), m_category(category), m_index(index), m_active(tracingEnabled()) {
+        if (m_active) {
+            m_detail = std::move(detail);
+            m_begin = TraceClock::now();
+        }
+    }
+    ~TraceSpan() {
+        if (m_active) {
+            traceSpan(m_name, m_category, m_begin, TraceClock::now(), m_index, m_detail);
+        }
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* m_name;
+    const char* m_category;
+    long long m_index;
+    bool m_active;
+    std::string m_detail;
+    TraceClock::time_point m_begin;
+};
+
+} // namespace qrac